@@ -1,13 +1,21 @@
 #include "BaseDemo.h"
 #include <iostream>
 #include "VulkanHelper.h"
+#include "VulkanCpuProfiler.h"
 #include "glm/glm.hpp"
 #include <array>
 #include "VulkanGraphicPipeline.h"
+#include "VulkanGraphicsPipelineBuilder.h"
 #include "VulkanCompositeBuffer.h"
+#include "VulkanGBuffer.h"
+#include "VulkanPrepassStatistics.h"
+#include "VulkanGpuProfiler.h"
 #include "glm\gtx\transform.hpp"
 #include "Light.h"
+#include "LightCluster.h"
+#include "DrawSort.h"
 #include <chrono>
+#include <random>
 
 
 std::vector<cg::PointLight> point_lights = {
@@ -16,15 +24,40 @@ std::vector<cg::PointLight> point_lights = {
 	{glm::vec3(0.0f, 4.0f, 0.0f), glm::vec3(0.05f, 0.05f, 0.05f), glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(5.0f, 5.0f, 5.0f), 15.0f, 0.19f, 0.032f},
 	{glm::vec3(0.0f, 6.0f, 0.0f), glm::vec3(0.05f, 0.05f, 0.05f), glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(5.0f, 5.0f, 5.0f), 15.0f, 0.19f, 0.032f}
 };
+// the first boxes are drawn as the light sources above, any lights added afterwards have no box
+const uint32_t num_light_boxes = 4;
 
 struct PerObject {
 	alignas(16) glm::mat4 model_matrix;
 	alignas(16) glm::vec3 color;
 };
 
+// made on the simulation thread one frame ahead of rendering, see BaseDemo::Simulate
+struct BloomFramePacket : FramePacket {
+	glm::mat4 view;
+	std::vector<glm::mat4> box_transforms; // model matrix of each scene box, animated
+	std::vector<cg::PointLight> lights; // world space
+};
+
 struct PerCamera {
 	alignas(16) glm::mat4 view;
 	alignas(16) glm::mat4 proj;
+	alignas(16) glm::mat4 inv_proj; // deferred lighting reconstructs positions from depth
+	alignas(8) glm::vec2 extent;
+};
+
+// packed descriptors of the update templates, one member per binding in binding order
+struct FirstpassDescriptors {
+	VkDescriptorBufferInfo per_camera;
+	VkDescriptorBufferInfo per_object;
+	VkDescriptorBufferInfo lights;
+	VkDescriptorBufferInfo cluster_grid;
+	VkDescriptorBufferInfo light_indices;
+};
+
+struct DrawDescriptors {
+	VkDescriptorImageInfo bloom;
+	VkDescriptorImageInfo scene;
 };
 
 struct Vertex {
@@ -152,7 +185,56 @@ struct UBOData {
 class BloomDemo : public BaseDemo {
 private:
 	UBOData per_object_data;
-	UBOData per_light_data;
+	// the frame is updated by the job stages of RunFrameJobs, each stage reads what the one before wrote here
+	PerCamera frame_camera;
+	std::vector<cg::PointLight> frame_eye_lights;
+	std::vector<glm::vec3> frame_light_positions;
+	std::vector<float> frame_light_radii;
+	std::vector<uint32_t> frame_draw_order;
+	vk::JobCounter boxes_packed; // per object slots written, before they are copied to the uniform buffer
+	const static uint32_t light_job_batch_size = 128;
+	const static uint32_t box_job_batch_size = 256;
+
+	// lights are binned into a froxel grid on the cpu every frame, firstpass.frag only shades with the lights of its cluster
+	cg::LightClusterGrid light_grid;
+	const static bool stress_test_lights = false; // scatter small lights over the floor, up to max_lights in total
+	const static uint32_t max_lights = 1024;
+	const static uint32_t max_light_indices = 1 << 18;
+
+	// deferred shading writes albedo and normals first and lights every pixel once, forward shading lights every fragment that is drawn
+	const static bool deferred_shading = false;
+	const static vk::DeferredLightingMode deferred_lighting_mode = vk::DeferredLightingMode::SUBPASS;
+	vk::VulkanGBuffer gbuffer;
+	VkDescriptorSetLayout deferred_light_descriptor_set_layout;
+	VkPipelineLayout deferred_light_pipeline_layout;
+	vk::PipelinePermutations gbuffer_permutations; // axis: emissive, light sources write their own color
+	VkPipeline deferred_light_pipeline; // graphics pipeline of the lighting subpass or compute pipeline
+	std::vector<VkDescriptorSet> deferred_light_descriptor_sets;
+
+	// benchmark: stack copies of the boxes behind each other, drawn back to front so that every layer is overdrawn by the next one
+	// (unless sort_front_to_back is on). The "scene" scope of the gpu profile times the forward pass, or g-buffer + lighting
+	const static uint32_t overdraw_layers = 1;
+	std::vector<PerObject> scene_boxes;
+
+	// gpu time of every pass, percentiles are printed every gpu_report_interval frames and written to gpu_profile.json on exit.
+	// No pipeline statistics: they can't overlap with the pre-pass statistics query of the scene pass
+	vk::VulkanGpuProfiler gpu_profiler;
+	const static uint32_t gpu_report_interval = 500;
+	uint32_t gpu_profiled_frames = 0;
+
+	// depth pre-pass for the forward scene pass: a position only pipeline without fragment shader fills the depth buffer, then the
+	// color pipelines test EQUAL without writing depth, so every pixel is shaded once
+	const static bool depth_prepass = false;
+	const static bool sort_front_to_back = true; // light boxes and boxes are each written into their per object slots nearest first
+	VkPipeline depth_prepass_pipeline;
+	VkPipeline firstpass_light_equal_pipeline;
+	VkPipeline firstpass_equal_pipeline;
+	// fragment shader invocations of the forward scene pass with and without the pre-pass are printed every statistics_report_interval frames.
+	// The disabled variant is recorded in reference_offscreen_draw_cmd_buffers and submitted once every statistics_sample_interval frames
+	const static uint32_t statistics_report_interval = 500;
+	const static uint32_t statistics_sample_interval = 8;
+	vk::VulkanPrepassStatistics prepass_statistics; // only the forward scene pass has a pre-pass to compare with
+	std::vector<VkCommandBuffer> reference_offscreen_draw_cmd_buffers;
 
 	VkRenderPass firstpass_renderpass;
 	VkRenderPass blur_renderpass;
@@ -181,20 +263,22 @@ private:
 	VkDescriptorSetLayout firstpass_descriptor_set_layout;
 	VkDescriptorSetLayout blur_descriptor_set_layout;
 	VkDescriptorSetLayout draw_descriptor_set_layout;
+	vk::VulkanDescriptorUpdateTemplate firstpass_update_template;
+	vk::VulkanDescriptorUpdateTemplate draw_update_template;
 
 	VkPipeline firstpass_pipeline;
 	VkPipeline firstpass_light_pipeline;
 	VkPipeline light_pipeline;
 	VkPipeline light_firstpass_pipeline;
-	VkPipeline horizontal_pipeline;
-	VkPipeline vertical_pipeline;
+	vk::PipelinePermutations blur_permutations; // axis: horizontal, 0 blurs vertically 1 horizontally
 	VkPipeline draw_pipeline;
 
-	std::vector<vk::VulkanCompositeBuffer> light_uniform_buffers;
+	std::vector<vk::VulkanCompositeBuffer> light_storage_buffers;
+	std::vector<vk::VulkanCompositeBuffer> cluster_storage_buffers;
+	std::vector<vk::VulkanCompositeBuffer> light_index_storage_buffers;
 	std::vector<vk::VulkanCompositeBuffer> per_camera_uniform_buffers;
 	std::vector<vk::VulkanCompositeBuffer> per_obj_uniform_buffers;
 
-	VkDescriptorPool descriptor_pool;
 	std::vector<VkDescriptorSet> vertical_blur_descriptor_sets;
 	std::vector<VkDescriptorSet> horizontal_blur_descriptor_sets;
 	std::vector<VkDescriptorSet> firstpass_descriptor_sets;
@@ -224,16 +308,71 @@ public:
 		return true;
 	}
 
+	bool PipelineSimulation() override {
+		return true;
+	}
+
+	// scene_boxes and point_lights are only written while the resources are created, before the simulation starts
+	std::unique_ptr<FramePacket> Simulate(uint64_t frame_index, double time) override {
+		CPU_PROFILE_FUNCTION();
+		std::unique_ptr<BloomFramePacket> packet = std::make_unique<BloomFramePacket>();
+		packet->view = glm::lookAt(glm::vec3(0.0, 20.0f, 16.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		glm::mat4 rotating = glm::rotate(glm::mat4(1.0f), static_cast<float>(time) * glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		packet->box_transforms.resize(this->scene_boxes.size());
+		for (uint32_t i = 0; i < this->scene_boxes.size(); i++) {
+			packet->box_transforms[i] = this->scene_boxes[i].model_matrix * rotating;
+		}
+		packet->lights = point_lights;
+		return packet;
+	}
+
+	const BloomFramePacket& GetBloomFramePacket() {
+		return static_cast<const BloomFramePacket&>(*GetFramePacket());
+	}
+
 	void CreatePermanentResources() override {
+		if (stress_test_lights) {
+			AddStressTestLights();
+		}
+		this->light_grid = cg::LightClusterGrid(16, 9, 24, 1.0f, 100.0f, max_light_indices);
+		CreateSceneBoxes();
 		CreateUboDataArrays();
 		CreateVertexAndIndexBuffers();
 		CreateDescriptorSetLayouts();
 		CreateTextureSampler();
+		this->gpu_profiler.Create(this->physical_device, this->logical_device, this->queues[0].family_index, 8, 0, 1024);
+		RegisterShaderReloads();
+	}
+
+	void RegisterShaderReloads() {
+		RegisterShaderReload({ "shaders/firstpass_vert.spv", "shaders/firstpass_frag.spv", "shaders/light_vert.spv", "shaders/light_frag.spv",
+			"shaders/depth_prepass_vert.spv" }, [this]() { CleanupFirstpassPipeline(); }, [this]() { CreateFirstpassPipeline(); });
+		if (deferred_shading) {
+			RegisterShaderReload({ "shaders/firstpass_vert.spv", "shaders/gbuffer_frag.spv", "shaders/deferred_light_comp.spv", "shaders/deferred_light_vert.spv",
+				"shaders/deferred_light_frag.spv" }, [this]() { CleanupDeferredPipelines(); }, [this]() { CreateDeferredPipelines(); });
+		}
+		RegisterShaderReload({ "shaders/blur_vert.spv", "shaders/blur_frag.spv" }, [this]() { CleanupBlurPipelines(); }, [this]() { CreateBlurPipelines(); });
+		RegisterShaderReload({ "shaders/final_vert.spv", "shaders/final_frag.spv" }, [this]() { CleanupDrawPipeline(); }, [this]() { CreateDrawPipeline(); });
+	}
+
+	// the command buffers are recorded once with the pipelines, record them again with the rebuilt ones
+	void OnShadersReloaded() override {
+		vkFreeCommandBuffers(this->logical_device, this->command_pool, static_cast<uint32_t>(this->draw_cmd_buffers.size()), this->draw_cmd_buffers.data());
+		vkFreeCommandBuffers(this->logical_device, this->command_pool, static_cast<uint32_t>(this->offscreen_draw_cmd_buffers.size()), this->offscreen_draw_cmd_buffers.data());
+		if (this->prepass_statistics.IsEnabled()) {
+			vkFreeCommandBuffers(this->logical_device, this->command_pool, static_cast<uint32_t>(this->reference_offscreen_draw_cmd_buffers.size()),
+				this->reference_offscreen_draw_cmd_buffers.data());
+		}
+		CreateOffscreenDrawCmdBuffers();
+		CreateDrawCmdBuffers();
 	}
 
 	void CleanupPermanentResources() override {
+		this->gpu_profiler.WriteJson("gpu_profile.json");
+		this->gpu_profiler.Destroy();
 		vkDestroySampler(this->logical_device, this->sampler, nullptr);
-		CleanupDescriptorSetLayouts();
+		this->draw_update_template.Destroy();
+		this->firstpass_update_template.Destroy();
 		CleanupVertexAndIndexBuffers();
 		CleanupUboDataArrays();
 	};
@@ -244,8 +383,12 @@ public:
 		CreateFramebuffers();
 		CreatePipelines();
 		CreateUniformBuffers();
-		CreateDescriptorPool();
 		CreateDescriptorSets();
+		this->gpu_profiler.CreateQueryPools(this->vulkan_swap_chain.image_count);
+		if (!deferred_shading) {
+			this->prepass_statistics.Create(this->physical_device, this->logical_device, this->vulkan_swap_chain.image_count, "scene pass",
+				statistics_report_interval, statistics_sample_interval);
+		}
 		CreateOffscreenDrawCmdBuffers();
 		CreateDrawCmdBuffers();
 	}
@@ -253,7 +396,12 @@ public:
 	void CleanupNonPermanentResources() override {
 		vkFreeCommandBuffers(this->logical_device, this->command_pool, static_cast<uint32_t>(this->draw_cmd_buffers.size()), this->draw_cmd_buffers.data());
 		vkFreeCommandBuffers(this->logical_device, this->command_pool, static_cast<uint32_t>(this->offscreen_draw_cmd_buffers.size()), this->offscreen_draw_cmd_buffers.data());
-		vkDestroyDescriptorPool(this->logical_device, this->descriptor_pool, nullptr);
+		this->gpu_profiler.DestroyQueryPools();
+		if (this->prepass_statistics.IsEnabled()) {
+			vkFreeCommandBuffers(this->logical_device, this->command_pool, static_cast<uint32_t>(this->reference_offscreen_draw_cmd_buffers.size()),
+				this->reference_offscreen_draw_cmd_buffers.data());
+		}
+		this->prepass_statistics.Destroy();
 		CleanupUniformBuffers();
 		CleanupPipelines();
 		CleanupFramebuffers();
@@ -267,6 +415,7 @@ public:
 		req0.types.is_graphic = true;
 		req0.types.is_present = true;
 		req0.types.is_transfer = true;
+		req0.types.is_compute = deferred_shading && deferred_lighting_mode == vk::DeferredLightingMode::COMPUTE;
 		req0.num_queue = 1;
 		for (uint32_t i = 0; i < req0.num_queue; i++) {
 			req0.priorities.push_back(1.0f);
@@ -274,6 +423,12 @@ public:
 		return { req0 };
 	}
 
+	VkPhysicalDeviceFeatures GetDeviceFeatures() override {
+		VkPhysicalDeviceFeatures device_features = {};
+		vk::VulkanPrepassStatistics::EnableRequiredFeatures(this->physical_device, device_features);
+		return device_features;
+	}
+
 	void CreateAttachments() {
 		CreateFirstpassAndLightpassAttachments();
 		CreateBlurAttachment();
@@ -296,11 +451,15 @@ public:
 		color_attachment_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
 		color_attachment_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
 		color_attachment_create_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		if (deferred_shading && deferred_lighting_mode == vk::DeferredLightingMode::COMPUTE) {
+			color_attachment_create_info.usage |= VK_IMAGE_USAGE_STORAGE_BIT; // written by the lighting dispatch
+		}
 		this->firstpass_color_attachments.resize(this->vulkan_swap_chain.image_count);
 		for (uint32_t i = 0; i < this->firstpass_color_attachments.size(); i++) {
 			this->firstpass_color_attachments[i].Create(this->physical_device, this->logical_device,
 				color_attachment_create_info, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
 		}
+		color_attachment_create_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 		color_attachment_create_info.extent = { this->offscreen_framebuffer_width, this->offscreen_framebuffer_height, 1 };
 		this->light_color_attachments.resize(this->vulkan_swap_chain.image_count);
 		for (uint32_t i = 0; i < this->light_color_attachments.size(); i++) {
@@ -324,9 +483,17 @@ public:
 		depth_create_info.extent = { this->offscreen_framebuffer_width, this->offscreen_framebuffer_height, 1 };
 		this->light_depth_attachment.Create(this->physical_device, this->logical_device, depth_create_info,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_ASPECT_DEPTH_BIT);
+
+		if (deferred_shading) { // g-buffer and its render pass replace firstpass_depth_attachment and firstpass_renderpass for the full size pass
+			this->gbuffer.Create(this->physical_device, this->logical_device, this->vulkan_swap_chain.swap_extent, this->firstpass_color_attachments[0].format,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, deferred_lighting_mode);
+		}
 	}
 
 	void CleanupFirstpassAttachments() {
+		if (deferred_shading) {
+			this->gbuffer.Destroy();
+		}
 		this->light_depth_attachment.Destroy();
 		this->firstpass_depth_attachment.Destroy();
 		for (uint32_t i = 0; i < this->light_color_attachments.size(); i++) {
@@ -499,311 +666,227 @@ public:
 		std::vector<VkDescriptorSetLayoutBinding> firstpass_layout_bindings = {
 			vk::init::CreateDescriptorSetLayoutBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT),
 			vk::init::CreateDescriptorSetLayoutBinding(1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT),
-			vk::init::CreateDescriptorSetLayoutBinding(2, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, static_cast<uint32_t>(point_lights.size()), VK_SHADER_STAGE_FRAGMENT_BIT) //4 is number of lights
+			vk::init::CreateDescriptorSetLayoutBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT), // lights
+			vk::init::CreateDescriptorSetLayoutBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT), // cluster grid
+			vk::init::CreateDescriptorSetLayoutBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT) // light indices
 		};
 		
-		vk::init::CreateDescriptorSetLayout(this->logical_device, firstpass_layout_bindings, &this->firstpass_descriptor_set_layout);
+		this->firstpass_descriptor_set_layout = this->descriptor_layout_cache.CreateDescriptorSetLayout(firstpass_layout_bindings);
+		this->firstpass_update_template.Create(this->logical_device, this->firstpass_descriptor_set_layout, firstpass_layout_bindings);
+
+		if (deferred_shading) {
+			// same buffer bindings as the firstpass, g-buffer at 5, 6, 7 and the compute output at 8
+			bool compute = deferred_lighting_mode == vk::DeferredLightingMode::COMPUTE;
+			VkShaderStageFlags stage = compute ? VK_SHADER_STAGE_COMPUTE_BIT : VK_SHADER_STAGE_FRAGMENT_BIT;
+			VkDescriptorType gbuffer_type = compute ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+			std::vector<VkDescriptorSetLayoutBinding> deferred_light_layout_bindings = {
+				vk::init::CreateDescriptorSetLayoutBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, stage),
+				vk::init::CreateDescriptorSetLayoutBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, stage),
+				vk::init::CreateDescriptorSetLayoutBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, stage),
+				vk::init::CreateDescriptorSetLayoutBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, stage),
+				vk::init::CreateDescriptorSetLayoutBinding(5, gbuffer_type, 1, stage), // albedo
+				vk::init::CreateDescriptorSetLayoutBinding(6, gbuffer_type, 1, stage), // normal
+				vk::init::CreateDescriptorSetLayoutBinding(7, gbuffer_type, 1, stage) // depth
+			};
+			if (compute) {
+				deferred_light_layout_bindings.push_back(vk::init::CreateDescriptorSetLayoutBinding(8, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, stage));
+			}
+			this->deferred_light_descriptor_set_layout = this->descriptor_layout_cache.CreateDescriptorSetLayout(deferred_light_layout_bindings);
+		}
 
 		std::vector<VkDescriptorSetLayoutBinding> blur_layout_bindings = { 
 			vk::init::CreateDescriptorSetLayoutBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT) 
 		};
-		vk::init::CreateDescriptorSetLayout(this->logical_device, blur_layout_bindings, &this->blur_descriptor_set_layout);
+		this->blur_descriptor_set_layout = this->descriptor_layout_cache.CreateDescriptorSetLayout(blur_layout_bindings);
 
 		std::vector<VkDescriptorSetLayoutBinding> draw_layout_bindings = {
 			vk::init::CreateDescriptorSetLayoutBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT),
 			vk::init::CreateDescriptorSetLayoutBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT)
 		};
-		vk::init::CreateDescriptorSetLayout(this->logical_device, draw_layout_bindings, &this->draw_descriptor_set_layout);
-	}
-
-	void CleanupDescriptorSetLayouts() {
-		vkDestroyDescriptorSetLayout(this->logical_device, this->draw_descriptor_set_layout, nullptr);
-		vkDestroyDescriptorSetLayout(this->logical_device, this->blur_descriptor_set_layout, nullptr);
-		vkDestroyDescriptorSetLayout(this->logical_device, this->firstpass_descriptor_set_layout, nullptr);
+		this->draw_descriptor_set_layout = this->descriptor_layout_cache.CreateDescriptorSetLayout(draw_layout_bindings);
+		this->draw_update_template.Create(this->logical_device, this->draw_descriptor_set_layout, draw_layout_bindings);
 	}
 
 	void CreatePipelines() {
 		CreateFirstpassPipeline();
+		if (deferred_shading) {
+			CreateDeferredPipelines();
+		}
 		CreateBlurPipelines();
 		CreateDrawPipeline();
 	}
 
 	void CreateFirstpassPipeline() {
-		//firstpass shader
-		VkShaderModule firstpass_vert_shader_module = vk::CreateShaderModule(this->logical_device, "shaders/firstpass_vert.spv");
-		VkShaderModule firstpass_frag_shader_module = vk::CreateShaderModule(this->logical_device, "shaders/firstpass_frag.spv");
-		VkPipelineShaderStageCreateInfo firstpass_vert_shader_create_info = vk::CreateShaderStageCreateInfo(firstpass_vert_shader_module, VK_SHADER_STAGE_VERTEX_BIT);
-		VkPipelineShaderStageCreateInfo firstpass_frag_shader_create_info = vk::CreateShaderStageCreateInfo(firstpass_frag_shader_module, VK_SHADER_STAGE_FRAGMENT_BIT);
-
-		//light shader
-		VkShaderModule light_vert_shader_module = vk::CreateShaderModule(this->logical_device, "shaders/light_vert.spv");
-		VkShaderModule light_frag_shader_module = vk::CreateShaderModule(this->logical_device, "shaders/light_frag.spv");
-		VkPipelineShaderStageCreateInfo light_vert_shader_create_info = vk::CreateShaderStageCreateInfo(light_vert_shader_module, VK_SHADER_STAGE_VERTEX_BIT);
-		VkPipelineShaderStageCreateInfo light_frag_shader_create_info = vk::CreateShaderStageCreateInfo(light_frag_shader_module, VK_SHADER_STAGE_FRAGMENT_BIT);
+		std::vector<VkPushConstantRange> constant_ranges;
+		std::vector<VkDescriptorSetLayout> descriptor_set_layouts = { this->firstpass_descriptor_set_layout };
+		vk::CreatePipelineLayout(this->logical_device, descriptor_set_layouts, constant_ranges, &this->firstpass_pipeline_layout);
 
-		VkPipelineShaderStageCreateInfo shader_stages[] = { firstpass_vert_shader_create_info, firstpass_frag_shader_create_info };
+		VkShaderModule firstpass_vert_shader_module = this->shader_library.Get("shaders/firstpass_vert.spv");
+		VkShaderModule firstpass_frag_shader_module = this->shader_library.Get("shaders/firstpass_frag.spv");
+		VkShaderModule light_vert_shader_module = this->shader_library.Get("shaders/light_vert.spv");
+		VkShaderModule light_frag_shader_module = this->shader_library.Get("shaders/light_frag.spv");
+		//depth pre-pass shader, matches the gl_Position of both firstpass.vert and light.vert
+		VkShaderModule prepass_vert_shader_module = this->shader_library.Get("shaders/depth_prepass_vert.spv");
 
-		std::vector<VkVertexInputBindingDescription> input_binding_descs = Vertex::GetBindingDescriptions();
 		std::vector<VkVertexInputAttributeDescription> input_attrib_descs = Vertex::GetAttributeDescriptions();
-		VkPipelineVertexInputStateCreateInfo vertex_input_info = vk::CreateVertexInputStateCreateInfo(input_binding_descs, input_attrib_descs);
-		VkPipelineInputAssemblyStateCreateInfo assembly_state_info = vk::CreateInputAssemblyStateCreateInfo(false, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
-
-		VkViewport viewport = {};
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = (float)this->vulkan_swap_chain.swap_extent.width;
-		viewport.height = (float)this->vulkan_swap_chain.swap_extent.height;
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
-		std::vector<VkViewport> viewports = { viewport };
-
-		VkRect2D scissor = {};
-		scissor.offset = { 0, 0 };
-		scissor.extent = { this->vulkan_swap_chain.swap_extent.width, this->vulkan_swap_chain.swap_extent.height };
-		std::vector<VkRect2D> scissors = { scissor };
-		VkPipelineViewportStateCreateInfo viewport_state_info = vk::CreateViewportStateCreateInfo(viewports, scissors);
-
-		VkPipelineRasterizationStateCreateInfo rasterizer = vk::CreateRasterizationStateCreateInfo(false, false, VK_POLYGON_MODE_FILL, 1.0f,
-			VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE, false);
-
-		VkPipelineMultisampleStateCreateInfo multisample = vk::CreateMultisampleStateCreateInfo(false, VK_SAMPLE_COUNT_1_BIT);
-
-		std::vector<VkPipelineColorBlendAttachmentState> blend_attachment_states = { vk::CreateColorBlendAttachmentState(VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
-			VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT, false) };
-
-		VkPipelineDepthStencilStateCreateInfo depth_stencil = vk::CreateDepthStencilStateCreateInfo(true, true, VK_COMPARE_OP_LESS, false, false);
-
-		VkPipelineColorBlendStateCreateInfo color_blend_state = vk::CreateColorBlendStateCreateInfo(false, blend_attachment_states);
+		vk::GraphicsPipelineBuilder firstpass_builder;
+		firstpass_builder.SetShader(VK_SHADER_STAGE_VERTEX_BIT, firstpass_vert_shader_module);
+		firstpass_builder.SetShader(VK_SHADER_STAGE_FRAGMENT_BIT, firstpass_frag_shader_module);
+		firstpass_builder.SetVertexInput(Vertex::GetBindingDescriptions(), input_attrib_descs);
+		firstpass_builder.SetLayout(this->firstpass_pipeline_layout);
+		firstpass_builder.SetRenderPass(this->firstpass_renderpass);
+		firstpass_builder.state.viewport_extent = this->vulkan_swap_chain.swap_extent;
+		vk::GraphicsPipelineBuilder light_builder = firstpass_builder;
+		light_builder.SetShader(VK_SHADER_STAGE_VERTEX_BIT, light_vert_shader_module);
+		light_builder.SetShader(VK_SHADER_STAGE_FRAGMENT_BIT, light_frag_shader_module);
+		this->firstpass_pipeline = this->pipeline_registry.Get(firstpass_builder);
+		this->firstpass_light_pipeline = this->pipeline_registry.Get(light_builder);
+
+		//depth pre-pass pipeline: positions only, no fragment shader and no color writes
+		vk::GraphicsPipelineBuilder prepass_builder = firstpass_builder;
+		prepass_builder.SetShader(VK_SHADER_STAGE_VERTEX_BIT, prepass_vert_shader_module);
+		prepass_builder.RemoveShader(VK_SHADER_STAGE_FRAGMENT_BIT);
+		prepass_builder.SetVertexInput(Vertex::GetBindingDescriptions(), { input_attrib_descs[0] });
+		prepass_builder.state.color_write_mask = 0;
+		this->depth_prepass_pipeline = this->pipeline_registry.Get(prepass_builder);
+
+		//first pass pipelines drawn after the pre-pass, only the fragments that won the depth test are shaded
+		vk::GraphicsPipelineBuilder firstpass_equal_builder = firstpass_builder;
+		firstpass_equal_builder.state.depth_write = false;
+		firstpass_equal_builder.state.depth_compare_op = VK_COMPARE_OP_EQUAL;
+		vk::GraphicsPipelineBuilder light_equal_builder = firstpass_equal_builder;
+		light_equal_builder.SetShader(VK_SHADER_STAGE_VERTEX_BIT, light_vert_shader_module);
+		light_equal_builder.SetShader(VK_SHADER_STAGE_FRAGMENT_BIT, light_frag_shader_module);
+		this->firstpass_equal_pipeline = this->pipeline_registry.Get(firstpass_equal_builder);
+		this->firstpass_light_equal_pipeline = this->pipeline_registry.Get(light_equal_builder);
+
+		//light pass pipelines: same as the first pass ones with the offscreen viewport, so they are shared while the sizes match
+		VkExtent2D offscreen_extent = { this->offscreen_framebuffer_width, this->offscreen_framebuffer_height };
+		light_builder.state.viewport_extent = offscreen_extent;
+		firstpass_builder.state.viewport_extent = offscreen_extent;
+		this->light_pipeline = this->pipeline_registry.Get(light_builder);
+		this->light_firstpass_pipeline = this->pipeline_registry.Get(firstpass_builder);
+	}
 
-		std::vector<VkDynamicState> states = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
-		VkPipelineDynamicStateCreateInfo dynamic_state = vk::CreateDynamicStateCreateInfo(states);
+	void CreateDeferredPipelines() {
+		// g-buffer pipelines use the firstpass vertex shader and descriptor sets
+		VkShaderModule vert_shader_module = this->shader_library.Get("shaders/firstpass_vert.spv");
+		VkShaderModule gbuffer_frag_shader_module = this->shader_library.Get("shaders/gbuffer_frag.spv");
+
+		vk::GraphicsPipelineBuilder gbuffer_builder;
+		gbuffer_builder.SetShader(VK_SHADER_STAGE_VERTEX_BIT, vert_shader_module);
+		gbuffer_builder.SetShader(VK_SHADER_STAGE_FRAGMENT_BIT, gbuffer_frag_shader_module);
+		gbuffer_builder.SetVertexInput(Vertex::GetBindingDescriptions(), Vertex::GetAttributeDescriptions());
+		gbuffer_builder.SetLayout(this->firstpass_pipeline_layout);
+		gbuffer_builder.SetRenderPass(this->gbuffer.renderpass, vk::VulkanGBuffer::geometry_subpass);
+		gbuffer_builder.state.viewport_extent = this->vulkan_swap_chain.swap_extent;
+		gbuffer_builder.state.color_attachment_count = 2; // albedo, normal
+		this->gbuffer_permutations.Create(&this->pipeline_registry, &this->pipeline_usage_log, "bloom_gbuffer", gbuffer_builder,
+			{ { "emissive", VK_SHADER_STAGE_FRAGMENT_BIT, 0, { VK_FALSE, VK_TRUE } } });
 
 		std::vector<VkPushConstantRange> constant_ranges;
-		std::vector<VkDescriptorSetLayout> descriptor_set_layouts = { this->firstpass_descriptor_set_layout };
-		vk::CreatePipelineLayout(this->logical_device, descriptor_set_layouts, constant_ranges, &this->firstpass_pipeline_layout);
+		std::vector<VkDescriptorSetLayout> descriptor_set_layouts = { this->deferred_light_descriptor_set_layout };
+		vk::CreatePipelineLayout(this->logical_device, descriptor_set_layouts, constant_ranges, &this->deferred_light_pipeline_layout);
+
+		if (deferred_lighting_mode == vk::DeferredLightingMode::COMPUTE) {
+			VkShaderModule comp_shader_module = this->shader_library.Get("shaders/deferred_light_comp.spv");
+			VkComputePipelineCreateInfo compute_pipeline_info = {};
+			compute_pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+			compute_pipeline_info.stage = vk::CreateShaderStageCreateInfo(comp_shader_module, VK_SHADER_STAGE_COMPUTE_BIT);
+			compute_pipeline_info.layout = this->deferred_light_pipeline_layout;
+			compute_pipeline_info.basePipelineIndex = -1;
+			if (vkCreateComputePipelines(this->logical_device, VK_NULL_HANDLE, 1, &compute_pipeline_info, nullptr, &this->deferred_light_pipeline) != VK_SUCCESS) {
+				throw std::runtime_error("fail to create deferred lighting compute pipeline");
+			}
+			return;
+		}
 
-		VkGraphicsPipelineCreateInfo pipeline_info = {};
-		pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipeline_info.stageCount = 2;
-		pipeline_info.pStages = shader_stages;
-		pipeline_info.pVertexInputState = &vertex_input_info;
-		pipeline_info.pInputAssemblyState = &assembly_state_info;
-		pipeline_info.pViewportState = &viewport_state_info;
-		pipeline_info.pRasterizationState = &rasterizer;
-		pipeline_info.pMultisampleState = &multisample;
-		pipeline_info.pDepthStencilState = &depth_stencil; // optional
-		pipeline_info.pColorBlendState = &color_blend_state;
-		pipeline_info.pDynamicState = nullptr; // optional
-		pipeline_info.layout = this->firstpass_pipeline_layout;
-		pipeline_info.renderPass = this->firstpass_renderpass;
-		pipeline_info.subpass = 0;
-		pipeline_info.basePipelineHandle = nullptr; // optional
-		pipeline_info.basePipelineIndex = -1; // optional
-
-		// first pass pipeline
-		if (vkCreateGraphicsPipelines(this->logical_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &this->firstpass_pipeline) != VK_SUCCESS) {
-			throw std::runtime_error("fail to create firstpass pipeline");
-		}
-		//first pass light pipeline
-		shader_stages[0] = light_vert_shader_create_info;
-		shader_stages[1] = light_frag_shader_create_info;
-		if (vkCreateGraphicsPipelines(this->logical_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &this->firstpass_light_pipeline) != VK_SUCCESS) {
-			throw std::runtime_error("fail to create firstpass pipeline");
-		}
-
-		//Create light pipeline
-		viewports[0].width = (float)this->offscreen_framebuffer_width;
-		viewports[0].height = (float)this->offscreen_framebuffer_height;
-		scissors[0].extent.width = this->offscreen_framebuffer_width;
-		scissors[0].extent.height = this->offscreen_framebuffer_height;
-
-		if (vkCreateGraphicsPipelines(this->logical_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &this->light_pipeline) != VK_SUCCESS) {
-			throw std::runtime_error("fail to create light pipeline");
-		}
-		//ligth first pass pipeline
-		shader_stages[0] = firstpass_vert_shader_create_info;
-		shader_stages[1] = firstpass_frag_shader_create_info;
-		if (vkCreateGraphicsPipelines(this->logical_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &this->light_firstpass_pipeline) != VK_SUCCESS) {
-			throw std::runtime_error("fail to create light pipeline");
-		}
-
-		vkDestroyShaderModule(this->logical_device, light_frag_shader_module, nullptr);
-		vkDestroyShaderModule(this->logical_device, light_vert_shader_module, nullptr);
-
-		vkDestroyShaderModule(this->logical_device, firstpass_frag_shader_module, nullptr);
-		vkDestroyShaderModule(this->logical_device, firstpass_vert_shader_module, nullptr);
+		// lighting subpass: fullscreen triangle, no vertex input and no depth test
+		vk::GraphicsPipelineBuilder light_builder;
+		light_builder.SetShader(VK_SHADER_STAGE_VERTEX_BIT, this->shader_library.Get("shaders/deferred_light_vert.spv"));
+		light_builder.SetShader(VK_SHADER_STAGE_FRAGMENT_BIT, this->shader_library.Get("shaders/deferred_light_frag.spv"));
+		light_builder.SetLayout(this->deferred_light_pipeline_layout);
+		light_builder.SetRenderPass(this->gbuffer.renderpass, vk::VulkanGBuffer::lighting_subpass);
+		light_builder.state.viewport_extent = this->vulkan_swap_chain.swap_extent;
+		light_builder.state.cull_mode = VK_CULL_MODE_NONE;
+		light_builder.state.depth_test = false;
+		light_builder.state.depth_write = false;
+		this->deferred_light_pipeline = this->pipeline_registry.Get(light_builder);
 	}
 
 	void CreateBlurPipelines() {
-		VkShaderModule vert_shader_module = vk::CreateShaderModule(logical_device, "shaders/blur_vert.spv");
-		VkShaderModule frag_shader_module = vk::CreateShaderModule(logical_device, "shaders/blur_frag.spv");
-
-		VkPipelineShaderStageCreateInfo vert_shader_create_info = vk::CreateShaderStageCreateInfo(vert_shader_module, VK_SHADER_STAGE_VERTEX_BIT);
-		VkPipelineShaderStageCreateInfo frag_shader_create_info = vk::CreateShaderStageCreateInfo(frag_shader_module, VK_SHADER_STAGE_FRAGMENT_BIT);
-
-		VkPipelineShaderStageCreateInfo shader_stages[] = { vert_shader_create_info, frag_shader_create_info };
-
-		std::vector<VkVertexInputBindingDescription> input_binding_descs = QuadVertex::GetBindingDescriptions();
-		std::vector<VkVertexInputAttributeDescription> input_attrib_descs = QuadVertex::GetAttributeDescriptions();
-		VkPipelineVertexInputStateCreateInfo vertex_input_info = vk::CreateVertexInputStateCreateInfo(input_binding_descs, input_attrib_descs);
-		VkPipelineInputAssemblyStateCreateInfo assembly_state_info = vk::CreateInputAssemblyStateCreateInfo(false, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
-
-		std::vector<VkViewport> viewports = { {} };
-		viewports[0].x = 0.0f;
-		viewports[0].y = 0.0f;
-		viewports[0].width = (float)this->offscreen_framebuffer_width;
-		viewports[0].height = (float)this->offscreen_framebuffer_height;
-		viewports[0].minDepth = 0.0f;
-		viewports[0].maxDepth = 1.0f;
-
-		std::vector<VkRect2D> scissors = { {} };
-		scissors[0].offset = { 0, 0 };
-		scissors[0].extent = { this->offscreen_framebuffer_width, this->offscreen_framebuffer_height };
-		VkPipelineViewportStateCreateInfo viewport_state_info = vk::CreateViewportStateCreateInfo(viewports, scissors);
-
-		VkPipelineRasterizationStateCreateInfo rasterizer = vk::CreateRasterizationStateCreateInfo(false, false, VK_POLYGON_MODE_FILL, 1.0f,
-			VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE, false);
-
-		VkPipelineMultisampleStateCreateInfo multisample = vk::CreateMultisampleStateCreateInfo(false, VK_SAMPLE_COUNT_1_BIT);
-
-		VkPipelineColorBlendAttachmentState blend_attachment_state = vk::CreateColorBlendAttachmentState(VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
-			VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT, false);
-
-		std::vector<VkPipelineColorBlendAttachmentState> blend_attachment_states = { blend_attachment_state };
-
-		VkPipelineDepthStencilStateCreateInfo depth_stencil = vk::CreateDepthStencilStateCreateInfo(false, false, VK_COMPARE_OP_LESS, false, false);// no depth test necessary
-
-		VkPipelineColorBlendStateCreateInfo color_blend_state = vk::CreateColorBlendStateCreateInfo(false, blend_attachment_states);
-
-		std::vector<VkDynamicState> states = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
-		VkPipelineDynamicStateCreateInfo dynamic_state = vk::CreateDynamicStateCreateInfo(states);
-
 		std::vector<VkPushConstantRange> constant_ranges;
 		std::vector<VkDescriptorSetLayout> descriptor_set_layouts = { this->blur_descriptor_set_layout };
 		vk::CreatePipelineLayout(this->logical_device, descriptor_set_layouts, constant_ranges, &this->blur_pipeline_layout);
 
-		VkGraphicsPipelineCreateInfo pipeline_info = {};
-		pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipeline_info.stageCount = 2;
-		pipeline_info.pStages = shader_stages;
-		pipeline_info.pVertexInputState = &vertex_input_info;
-		pipeline_info.pInputAssemblyState = &assembly_state_info;
-		pipeline_info.pViewportState = &viewport_state_info;
-		pipeline_info.pRasterizationState = &rasterizer;
-		pipeline_info.pMultisampleState = &multisample;
-		pipeline_info.pDepthStencilState = &depth_stencil; // optional
-		pipeline_info.pColorBlendState = &color_blend_state;
-		pipeline_info.pDynamicState = nullptr; // optional
-		pipeline_info.layout = this->blur_pipeline_layout;
-		pipeline_info.subpass = 0;
-		pipeline_info.basePipelineHandle = nullptr; // optional
-		pipeline_info.basePipelineIndex = -1; // optional
-		pipeline_info.renderPass = this->blur_renderpass;
-
-		uint32_t blur_dir = 0; // 0 is vertical 1 is horizontal. We are creating vertical pipeline here
-
-		std::vector<VkSpecializationMapEntry> specialization_map_entries = { vk::init::CreateSpecializationMapEntry(0, 0, sizeof(uint32_t)) };
-		VkSpecializationInfo specialization_info = vk::init::CreateSpecializationInfo(specialization_map_entries, sizeof(blur_dir), &blur_dir);
-		
-		shader_stages[1].pSpecializationInfo = &specialization_info;
-
-		if (vkCreateGraphicsPipelines(this->logical_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &this->vertical_pipeline) != VK_SUCCESS) {
-			throw std::runtime_error("fail to create vertical graphic pipeline");
-		}
-
-		blur_dir = 1;
-		if (vkCreateGraphicsPipelines(this->logical_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &this->horizontal_pipeline) != VK_SUCCESS) {
-			throw std::runtime_error("fail to create horizontal graphic pipeline");
-		}
-
-		vkDestroyShaderModule(this->logical_device, frag_shader_module, nullptr);
-		vkDestroyShaderModule(this->logical_device, vert_shader_module, nullptr);
+		vk::GraphicsPipelineBuilder builder;
+		builder.SetShader(VK_SHADER_STAGE_VERTEX_BIT, this->shader_library.Get("shaders/blur_vert.spv"));
+		builder.SetShader(VK_SHADER_STAGE_FRAGMENT_BIT, this->shader_library.Get("shaders/blur_frag.spv"));
+		builder.SetVertexInput(QuadVertex::GetBindingDescriptions(), QuadVertex::GetAttributeDescriptions());
+		builder.SetLayout(this->blur_pipeline_layout);
+		builder.SetRenderPass(this->blur_renderpass);
+		builder.state.viewport_extent = { this->offscreen_framebuffer_width, this->offscreen_framebuffer_height };
+		builder.state.depth_test = false; // no depth test necessary
+		builder.state.depth_write = false;
+		this->blur_permutations.Create(&this->pipeline_registry, &this->pipeline_usage_log, "bloom_blur", builder,
+			{ { "horizontal", VK_SHADER_STAGE_FRAGMENT_BIT, 0, { 0, 1 } } });
 	}
 
 	void CreateDrawPipeline() {
-		VkShaderModule vert_shader_module = vk::CreateShaderModule(logical_device, "shaders/final_vert.spv");
-		VkShaderModule frag_shader_module = vk::CreateShaderModule(logical_device, "shaders/final_frag.spv");
-
-		VkPipelineShaderStageCreateInfo vert_shader_create_info = vk::CreateShaderStageCreateInfo(vert_shader_module, VK_SHADER_STAGE_VERTEX_BIT);
-		VkPipelineShaderStageCreateInfo frag_shader_create_info = vk::CreateShaderStageCreateInfo(frag_shader_module, VK_SHADER_STAGE_FRAGMENT_BIT);
-
-		VkPipelineShaderStageCreateInfo shader_stages[] = { vert_shader_create_info, frag_shader_create_info };
-
-		std::vector<VkVertexInputBindingDescription> input_binding_descs = QuadVertex::GetBindingDescriptions();
-		std::vector<VkVertexInputAttributeDescription> input_attrib_descs = QuadVertex::GetAttributeDescriptions();
-		VkPipelineVertexInputStateCreateInfo vertex_input_info = vk::CreateVertexInputStateCreateInfo(input_binding_descs, input_attrib_descs);
-		VkPipelineInputAssemblyStateCreateInfo assembly_state_info = vk::CreateInputAssemblyStateCreateInfo(false, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
-
-		VkViewport viewport = {};
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = (float)this->vulkan_swap_chain.swap_extent.width;
-		viewport.height = (float)this->vulkan_swap_chain.swap_extent.height;
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
-		std::vector<VkViewport> viewports = { viewport };
-
-		VkRect2D scissor = {};
-		scissor.offset = { 0, 0 };
-		scissor.extent = { this->vulkan_swap_chain.swap_extent.width, this->vulkan_swap_chain.swap_extent.height };
-		std::vector<VkRect2D> scissors = { scissor };
-		VkPipelineViewportStateCreateInfo viewport_state_info = vk::CreateViewportStateCreateInfo(viewports, scissors);
-
-		VkPipelineRasterizationStateCreateInfo rasterizer = vk::CreateRasterizationStateCreateInfo(false, false, VK_POLYGON_MODE_FILL, 1.0f,
-			VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE, false);
-
-		VkPipelineMultisampleStateCreateInfo multisample = vk::CreateMultisampleStateCreateInfo(false, VK_SAMPLE_COUNT_1_BIT);
-
-		VkPipelineColorBlendAttachmentState blend_attachment_state = vk::CreateColorBlendAttachmentState(VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
-			VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT, false);
-
-		std::vector<VkPipelineColorBlendAttachmentState> blend_attachment_states = { blend_attachment_state };
-
-		VkPipelineDepthStencilStateCreateInfo depth_stencil = vk::CreateDepthStencilStateCreateInfo(false, false, VK_COMPARE_OP_LESS, false, false);// no depth test necessary
-
-		VkPipelineColorBlendStateCreateInfo color_blend_state = vk::CreateColorBlendStateCreateInfo(false, blend_attachment_states);
-
 		std::vector<VkPushConstantRange> constant_ranges;
 		std::vector<VkDescriptorSetLayout> descriptor_set_layouts = { this->draw_descriptor_set_layout };
 		vk::CreatePipelineLayout(this->logical_device, descriptor_set_layouts, constant_ranges, &this->draw_pipeline_layout);
 
-		VkGraphicsPipelineCreateInfo pipeline_info = {};
-		pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipeline_info.stageCount = 2;
-		pipeline_info.pStages = shader_stages;
-		pipeline_info.pVertexInputState = &vertex_input_info;
-		pipeline_info.pInputAssemblyState = &assembly_state_info;
-		pipeline_info.pViewportState = &viewport_state_info;
-		pipeline_info.pRasterizationState = &rasterizer;
-		pipeline_info.pMultisampleState = &multisample;
-		pipeline_info.pDepthStencilState = &depth_stencil; // optional
-		pipeline_info.pColorBlendState = &color_blend_state;
-		pipeline_info.pDynamicState = nullptr; // optional
-		pipeline_info.layout = this->draw_pipeline_layout; // uses same pipeline layout as blur
-		pipeline_info.subpass = 0;
-		pipeline_info.basePipelineHandle = nullptr; // optional
-		pipeline_info.basePipelineIndex = -1; // optional
-
-		pipeline_info.renderPass = this->renderpass;
+		vk::GraphicsPipelineBuilder builder;
+		builder.SetShader(VK_SHADER_STAGE_VERTEX_BIT, this->shader_library.Get("shaders/final_vert.spv"));
+		builder.SetShader(VK_SHADER_STAGE_FRAGMENT_BIT, this->shader_library.Get("shaders/final_frag.spv"));
+		builder.SetVertexInput(QuadVertex::GetBindingDescriptions(), QuadVertex::GetAttributeDescriptions());
+		builder.SetLayout(this->draw_pipeline_layout);
+		builder.SetRenderPass(this->renderpass);
+		builder.state.viewport_extent = this->vulkan_swap_chain.swap_extent;
+		builder.state.depth_test = false; // no depth test necessary
+		builder.state.depth_write = false;
+		this->draw_pipeline = this->pipeline_registry.Get(builder);
+	}
 
-		if (vkCreateGraphicsPipelines(this->logical_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &this->draw_pipeline) != VK_SUCCESS) {
-			throw std::runtime_error("fail to create draw graphic pipeline");
+	void CleanupPipelines() {
+		if (deferred_shading) {
+			CleanupDeferredPipelines();
 		}
+		CleanupDrawPipeline();
+		CleanupBlurPipelines();
+		CleanupFirstpassPipeline();
+	}
 
-		vkDestroyShaderModule(this->logical_device, frag_shader_module, nullptr);
-		vkDestroyShaderModule(this->logical_device, vert_shader_module, nullptr);
+	void CleanupDeferredPipelines() {
+		if (deferred_lighting_mode == vk::DeferredLightingMode::COMPUTE) {
+			vkDestroyPipeline(this->logical_device, this->deferred_light_pipeline, nullptr);
+		}
+		else {
+			this->pipeline_registry.Release(this->deferred_light_pipeline);
+		}
+		vkDestroyPipelineLayout(this->logical_device, this->deferred_light_pipeline_layout, nullptr);
+		this->gbuffer_permutations.Destroy();
 	}
 
-	void CleanupPipelines() {
-		vkDestroyPipeline(this->logical_device, this->draw_pipeline, nullptr);
+	void CleanupDrawPipeline() {
+		this->pipeline_registry.Release(this->draw_pipeline);
 		vkDestroyPipelineLayout(this->logical_device, this->draw_pipeline_layout, nullptr);
-		vkDestroyPipeline(this->logical_device, this->horizontal_pipeline, nullptr);
-		vkDestroyPipeline(this->logical_device, this->vertical_pipeline, nullptr);
+	}
+
+	void CleanupBlurPipelines() {
+		this->blur_permutations.Destroy();
 		vkDestroyPipelineLayout(this->logical_device, this->blur_pipeline_layout, nullptr);
-		vkDestroyPipeline(this->logical_device, this->light_firstpass_pipeline, nullptr);
-		vkDestroyPipeline(this->logical_device, this->light_pipeline, nullptr);
-		vkDestroyPipeline(this->logical_device, this->firstpass_light_pipeline, nullptr);
-		vkDestroyPipeline(this->logical_device, this->firstpass_pipeline, nullptr);
+	}
+
+	void CleanupFirstpassPipeline() {
+		this->pipeline_registry.Release(this->light_firstpass_pipeline);
+		this->pipeline_registry.Release(this->light_pipeline);
+		this->pipeline_registry.Release(this->firstpass_equal_pipeline);
+		this->pipeline_registry.Release(this->firstpass_light_equal_pipeline);
+		this->pipeline_registry.Release(this->depth_prepass_pipeline);
+		this->pipeline_registry.Release(this->firstpass_light_pipeline);
+		this->pipeline_registry.Release(this->firstpass_pipeline);
 		vkDestroyPipelineLayout(this->logical_device, this->firstpass_pipeline_layout, nullptr);
 	}
 
@@ -837,6 +920,12 @@ public:
 		attachments[1] = this->firstpass_depth_attachment.image_view;
 		for (uint32_t i = 0; i < this->firstpass_framebuffers.size(); i++) {
 			attachments[0] = this->firstpass_color_attachments[i].image_view;
+			if (deferred_shading) {
+				std::vector<VkImageView> gbuffer_attachments = this->gbuffer.GetFramebufferAttachments(this->firstpass_color_attachments[i].image_view);
+				vk::init::CreateFrameBuffer(this->logical_device, this->gbuffer.renderpass, gbuffer_attachments,
+					this->vulkan_swap_chain.swap_extent.width, this->vulkan_swap_chain.swap_extent.height, &this->firstpass_framebuffers[i]);
+				continue;
+			}
 			vk::init::CreateFrameBuffer(this->logical_device, this->firstpass_renderpass, attachments,
 				this->vulkan_swap_chain.swap_extent.width, this->vulkan_swap_chain.swap_extent.height, &this->firstpass_framebuffers[i]);
 		}
@@ -903,26 +992,15 @@ public:
 		this->quad_index_buffer.CreateBuffer(this->logical_device, this->physical_device, quad_index_buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
 			VK_SHARING_MODE_EXCLUSIVE, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-		// create fences
-		VkFence transfer_finished_fences[4];
-		vk::init::CreateFence(this->logical_device, 0, &transfer_finished_fences[0]); // create fence in unsignaled state
-		vk::init::CreateFence(this->logical_device, 0, &transfer_finished_fences[1]); // create fence in unsignaled state
-		vk::init::CreateFence(this->logical_device, 0, &transfer_finished_fences[2]); // create fence in unsignaled state
-		vk::init::CreateFence(this->logical_device, 0, &transfer_finished_fences[3]); // create fence in unsignaled state
 		//transfer
-		this->cube_vertex_buffer.TransferFromAnotherBuffer(cube_staging_vertex_buffer, this->command_pool, 0, 0, cube_vertex_buffer_size, this->queues[0], transfer_finished_fences[0]);
-		this->quad_vertex_buffer.TransferFromAnotherBuffer(quad_staging_vertex_buffer, this->command_pool, 0, 0, quad_vertex_buffer_size, this->queues[0], transfer_finished_fences[1]);
-		this->cube_index_buffer.TransferFromAnotherBuffer(cube_staging_index_buffer, this->command_pool, 0, 0, cube_index_buffer_size, this->queues[0], transfer_finished_fences[2]);
-		this->quad_index_buffer.TransferFromAnotherBuffer(quad_staging_index_buffer, this->command_pool, 0, 0, quad_index_buffer_size, this->queues[0], transfer_finished_fences[3]);
-		// wait for transfer to finish
-		vkWaitForFences(this->logical_device, 4, transfer_finished_fences, VK_TRUE, UINT64_MAX);
-
-		//cleanup fences and staging buffers
-		vkDestroyFence(this->logical_device, transfer_finished_fences[0], nullptr);
-		vkDestroyFence(this->logical_device, transfer_finished_fences[1], nullptr);
-		vkDestroyFence(this->logical_device, transfer_finished_fences[2], nullptr);
-		vkDestroyFence(this->logical_device, transfer_finished_fences[3], nullptr);
-
+		this->cube_vertex_buffer.TransferFromAnotherBuffer(cube_staging_vertex_buffer, this->command_pool, 0, 0, cube_vertex_buffer_size, this->queues[0]);
+		this->quad_vertex_buffer.TransferFromAnotherBuffer(quad_staging_vertex_buffer, this->command_pool, 0, 0, quad_vertex_buffer_size, this->queues[0]);
+		this->cube_index_buffer.TransferFromAnotherBuffer(cube_staging_index_buffer, this->command_pool, 0, 0, cube_index_buffer_size, this->queues[0]);
+		uint64_t transfers_finished = this->quad_index_buffer.TransferFromAnotherBuffer(quad_staging_index_buffer, this->command_pool, 0, 0, quad_index_buffer_size, this->queues[0]);
+		// wait for transfer to finish, the last value of the queue also covers the transfers submitted before it
+		this->queues[0].timeline.WaitUntil(transfers_finished);
+
+		//cleanup staging buffers
 		quad_staging_index_buffer.DestroyBuffer();
 		cube_staging_index_buffer.DestroyBuffer();
 
@@ -939,11 +1017,16 @@ public:
 
 	void CreateUniformBuffers() {
 		
-		VkDeviceSize light_uniform_buffer_size = this->per_light_data.total_size;
-		this->light_uniform_buffers.resize(this->vulkan_swap_chain.image_count);
-		for (uint32_t i = 0; i < this->light_uniform_buffers.size(); i++) {
-			this->light_uniform_buffers[i].CreateBuffer(this->logical_device, this->physical_device, light_uniform_buffer_size,
-				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_SHARING_MODE_EXCLUSIVE, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		this->light_storage_buffers.resize(this->vulkan_swap_chain.image_count);
+		this->cluster_storage_buffers.resize(this->vulkan_swap_chain.image_count);
+		this->light_index_storage_buffers.resize(this->vulkan_swap_chain.image_count);
+		for (uint32_t i = 0; i < this->vulkan_swap_chain.image_count; i++) {
+			this->light_storage_buffers[i].CreateBuffer(this->logical_device, this->physical_device, GetLightBufferSize(),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_SHARING_MODE_EXCLUSIVE, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			this->cluster_storage_buffers[i].CreateBuffer(this->logical_device, this->physical_device, GetClusterBufferSize(),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_SHARING_MODE_EXCLUSIVE, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			this->light_index_storage_buffers[i].CreateBuffer(this->logical_device, this->physical_device, GetLightIndexBufferSize(),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_SHARING_MODE_EXCLUSIVE, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 		}
 		VkDeviceSize mvp_uniform_buffer_size = sizeof(PerCamera);
 		this->per_camera_uniform_buffers.resize(this->vulkan_swap_chain.image_count);
@@ -968,91 +1051,88 @@ public:
 		for (uint32_t i = 0; i < this->per_camera_uniform_buffers.size(); i++) {
 			this->per_camera_uniform_buffers[i].DestroyBuffer();
 		}
-		for (uint32_t i = 0; i < this->light_uniform_buffers.size(); i++) {
-			this->light_uniform_buffers[i].DestroyBuffer();
+		for (uint32_t i = 0; i < this->light_storage_buffers.size(); i++) {
+			this->light_index_storage_buffers[i].DestroyBuffer();
+			this->cluster_storage_buffers[i].DestroyBuffer();
+			this->light_storage_buffers[i].DestroyBuffer();
 		}
 	}
 
-	void CreateDescriptorPool() {
-		// 5 uniform buffer descriptor (light * 4 and per camera) 
-		// 4 combined image sampler (for vertical blur, horizontal blur and 2 for screen render)  
-		// 1 uniform_buffer_dynamic (for per object)
-		std::vector<VkDescriptorPoolSize> poolsizes = {
-			{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER , this->vulkan_swap_chain.image_count * 5},
-			{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, this->vulkan_swap_chain.image_count * 4},
-			{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, this->vulkan_swap_chain.image_count}
-		};
-		vk::init::CreateDescriptorPool(this->logical_device, poolsizes, this->vulkan_swap_chain.image_count * 10, &this->descriptor_pool);
-	}
-
 	void CreateDescriptorSets() {
 		CreateFirstpassDescriptorSets();
+		if (deferred_shading) {
+			CreateDeferredLightDescriptorSets();
+		}
 		CreateBlurDescriptorSets();
 		CreateDrawDescriptorSets();
 	}
 
 	void CreateFirstpassDescriptorSets() {
 		this->firstpass_descriptor_sets.resize(this->vulkan_swap_chain.image_count);
-		std::vector<VkDescriptorSetLayout> layouts(this->vulkan_swap_chain.image_count, this->firstpass_descriptor_set_layout);
-		vk::init::AllocateDescriptorSets(this->logical_device, this->descriptor_pool, layouts, this->firstpass_descriptor_sets);
 		for (uint32_t i = 0; i < this->firstpass_descriptor_sets.size(); i++) {
+			FirstpassDescriptors descriptors = {};
+			descriptors.per_camera = vk::init::CreateDescriptorBufferInfo(this->per_camera_uniform_buffers[i].buffer, 0, sizeof(PerCamera));
+			descriptors.per_object = vk::init::CreateDescriptorBufferInfo(this->per_obj_uniform_buffers[i].buffer, 0, sizeof(PerObject)); //https://www.khronos.org/registry/vulkan/specs/1.2-extensions/man/html/VkDescriptorBufferInfo.html
+			descriptors.lights = vk::init::CreateDescriptorBufferInfo(this->light_storage_buffers[i].buffer, 0, GetLightBufferSize());
+			descriptors.cluster_grid = vk::init::CreateDescriptorBufferInfo(this->cluster_storage_buffers[i].buffer, 0, GetClusterBufferSize());
+			descriptors.light_indices = vk::init::CreateDescriptorBufferInfo(this->light_index_storage_buffers[i].buffer, 0, GetLightIndexBufferSize());
+			this->firstpass_descriptor_sets[i] = this->descriptor_set_cache.Get(this->firstpass_update_template, descriptors);
+		}
+	}
 
+	void CreateDeferredLightDescriptorSets() {
+		this->deferred_light_descriptor_sets.resize(this->vulkan_swap_chain.image_count);
+		std::vector<VkDescriptorImageInfo> gbuffer_infos = this->gbuffer.GetLightingImageInfos(this->sampler);
+		for (uint32_t i = 0; i < this->deferred_light_descriptor_sets.size(); i++) {
 			std::vector<VkWriteDescriptorSet> descriptor_writes;
 
-			VkDescriptorBufferInfo binding0_info = vk::init::CreateDescriptorBufferInfo(this->per_camera_uniform_buffers[i].buffer, 0, sizeof(PerCamera));
-			descriptor_writes.push_back(vk::init::CreateWriteDescriptorSet(this->firstpass_descriptor_sets[i], 0, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, &binding0_info, nullptr));
-
-			VkDescriptorBufferInfo binding1_info = vk::init::CreateDescriptorBufferInfo(this->per_obj_uniform_buffers[i].buffer, 0, sizeof(PerObject)); //https://www.khronos.org/registry/vulkan/specs/1.2-extensions/man/html/VkDescriptorBufferInfo.html
-			descriptor_writes.push_back(vk::init::CreateWriteDescriptorSet(this->firstpass_descriptor_sets[i], 1, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, &binding1_info, nullptr));
+			VkDescriptorBufferInfo camera_info = vk::init::CreateDescriptorBufferInfo(this->per_camera_uniform_buffers[i].buffer, 0, sizeof(PerCamera));
+			descriptor_writes.push_back(vk::init::CreateWriteDescriptorSet(VK_NULL_HANDLE, 0, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, &camera_info, nullptr));
 
-			std::vector<VkDescriptorBufferInfo> arr(point_lights.size());
-			for (uint32_t j = 0; j < point_lights.size(); j++) {
-				arr[j] = vk::init::CreateDescriptorBufferInfo(this->light_uniform_buffers[i].buffer, static_cast<uint64_t>(this->per_light_data.stride) * j, sizeof(cg::PointLight));
-				descriptor_writes.push_back(vk::init::CreateWriteDescriptorSet(this->firstpass_descriptor_sets[i], 2, j, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, &arr[j], nullptr));
+			std::array<VkDescriptorBufferInfo, 3> buffer_infos = {
+				vk::init::CreateDescriptorBufferInfo(this->light_storage_buffers[i].buffer, 0, GetLightBufferSize()),
+				vk::init::CreateDescriptorBufferInfo(this->cluster_storage_buffers[i].buffer, 0, GetClusterBufferSize()),
+				vk::init::CreateDescriptorBufferInfo(this->light_index_storage_buffers[i].buffer, 0, GetLightIndexBufferSize())
+			};
+			for (uint32_t j = 0; j < buffer_infos.size(); j++) {
+				descriptor_writes.push_back(vk::init::CreateWriteDescriptorSet(VK_NULL_HANDLE, 2 + j, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &buffer_infos[j], nullptr));
 			}
-			vkUpdateDescriptorSets(this->logical_device, static_cast<uint32_t>(descriptor_writes.size()), descriptor_writes.data(), 0, nullptr);
-			
+			for (uint32_t j = 0; j < gbuffer_infos.size(); j++) {
+				descriptor_writes.push_back(vk::init::CreateWriteDescriptorSet(VK_NULL_HANDLE, 5 + j, 0, this->gbuffer.GetLightingDescriptorType(), 1, nullptr, &gbuffer_infos[j]));
+			}
+			VkDescriptorImageInfo output_info = vk::init::CreateDescriptorImageInfo(VK_NULL_HANDLE, this->firstpass_color_attachments[i].image_view, VK_IMAGE_LAYOUT_GENERAL);
+			if (deferred_lighting_mode == vk::DeferredLightingMode::COMPUTE) {
+				descriptor_writes.push_back(vk::init::CreateWriteDescriptorSet(VK_NULL_HANDLE, 8, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, nullptr, &output_info));
+			}
+			this->deferred_light_descriptor_sets[i] = this->descriptor_set_cache.Get(this->deferred_light_descriptor_set_layout, descriptor_writes);
 		}
 	}
 
 	void CreateBlurDescriptorSets() {
 		this->vertical_blur_descriptor_sets.resize(this->vulkan_swap_chain.image_count);
-		std::vector<VkDescriptorSetLayout> layouts(this->vulkan_swap_chain.image_count, this->blur_descriptor_set_layout);
-		vk::init::AllocateDescriptorSets(this->logical_device, this->descriptor_pool, layouts, this->vertical_blur_descriptor_sets);
 		for (uint32_t i = 0; i < vertical_blur_descriptor_sets.size(); i++) {
 			VkDescriptorImageInfo image_info = vk::init::CreateDescriptorImageInfo(sampler, this->light_color_attachments[i].image_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-			VkWriteDescriptorSet descriptor_write = vk::init::CreateWriteDescriptorSet(this->vertical_blur_descriptor_sets[i], 0, 0,
-				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, nullptr, &image_info);
-			vkUpdateDescriptorSets(this->logical_device, 1, &descriptor_write, 0, nullptr);
+			std::vector<VkWriteDescriptorSet> descriptor_writes = { vk::init::CreateWriteDescriptorSet(VK_NULL_HANDLE, 0, 0,
+				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, nullptr, &image_info) };
+			this->vertical_blur_descriptor_sets[i] = this->descriptor_set_cache.Get(this->blur_descriptor_set_layout, descriptor_writes);
 		}
 
 		this->horizontal_blur_descriptor_sets.resize(this->vulkan_swap_chain.image_count);
-		vk::init::AllocateDescriptorSets(this->logical_device, this->descriptor_pool, layouts, this->horizontal_blur_descriptor_sets);
 		for (uint32_t i = 0; i < horizontal_blur_descriptor_sets.size(); i++) {
 			VkDescriptorImageInfo image_info = vk::init::CreateDescriptorImageInfo(sampler, this->vertical_blur_attachments[i].image_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-			VkWriteDescriptorSet descriptor_write = vk::init::CreateWriteDescriptorSet(this->horizontal_blur_descriptor_sets[i], 0, 0,
-				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, nullptr, &image_info);
-			vkUpdateDescriptorSets(this->logical_device, 1, &descriptor_write, 0, nullptr);
+			std::vector<VkWriteDescriptorSet> descriptor_writes = { vk::init::CreateWriteDescriptorSet(VK_NULL_HANDLE, 0, 0,
+				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, nullptr, &image_info) };
+			this->horizontal_blur_descriptor_sets[i] = this->descriptor_set_cache.Get(this->blur_descriptor_set_layout, descriptor_writes);
 		}
 	}
 
 	void CreateDrawDescriptorSets() {
 		this->draw_descriptor_sets.resize(this->vulkan_swap_chain.image_count);
-		std::vector<VkDescriptorSetLayout> layouts(this->vulkan_swap_chain.image_count, this->draw_descriptor_set_layout); 
-		vk::init::AllocateDescriptorSets(this->logical_device, this->descriptor_pool, layouts, this->draw_descriptor_sets);
-
-		std::array<VkWriteDescriptorSet, 2> descriptor_writes = {};
 		for (uint32_t i = 0; i < draw_descriptor_sets.size(); i++) {
-			VkDescriptorImageInfo image_info0 = vk::init::CreateDescriptorImageInfo(sampler, this->horizontal_blur_attachments[i].image_view, 
-				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-			descriptor_writes[0] = vk::init::CreateWriteDescriptorSet(this->draw_descriptor_sets[i], 0, 0,
-				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, nullptr, &image_info0);
-
-			VkDescriptorImageInfo image_info1 = vk::init::CreateDescriptorImageInfo(sampler, this->firstpass_color_attachments[i].image_view,
-				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-			descriptor_writes[1] = vk::init::CreateWriteDescriptorSet(this->draw_descriptor_sets[i], 1, 0,
-				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, nullptr, &image_info1);
-			vkUpdateDescriptorSets(this->logical_device, static_cast<uint32_t>(descriptor_writes.size()), descriptor_writes.data(), 0, nullptr);
+			DrawDescriptors descriptors = {};
+			descriptors.bloom = vk::init::CreateDescriptorImageInfo(sampler, this->horizontal_blur_attachments[i].image_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			descriptors.scene = vk::init::CreateDescriptorImageInfo(sampler, this->firstpass_color_attachments[i].image_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			this->draw_descriptor_sets[i] = this->descriptor_set_cache.Get(this->draw_update_template, descriptors);
 		}
 	}
 
@@ -1060,6 +1140,22 @@ public:
 		this->offscreen_draw_cmd_buffers.resize(this->vulkan_swap_chain.image_count);
 		vk::init::CreateCmdBuffer(this->logical_device, this->command_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY,
 			this->vulkan_swap_chain.image_count, this->offscreen_draw_cmd_buffers.data());
+		for (uint32_t i = 0; i < this->offscreen_draw_cmd_buffers.size(); i++) {
+			RecordOffscreenDrawCmdBuffer(this->offscreen_draw_cmd_buffers[i], i, depth_prepass);
+		}
+		if (!this->prepass_statistics.IsEnabled()) {
+			return;
+		}
+		this->reference_offscreen_draw_cmd_buffers.resize(this->vulkan_swap_chain.image_count);
+		vk::init::CreateCmdBuffer(this->logical_device, this->command_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			this->vulkan_swap_chain.image_count, this->reference_offscreen_draw_cmd_buffers.data());
+		for (uint32_t i = 0; i < this->reference_offscreen_draw_cmd_buffers.size(); i++) {
+			RecordOffscreenDrawCmdBuffer(this->reference_offscreen_draw_cmd_buffers[i], i, !depth_prepass);
+		}
+	}
+
+	// use_depth_prepass only changes the forward scene pass
+	void RecordOffscreenDrawCmdBuffer(VkCommandBuffer cmd_buffer, uint32_t image_index, bool use_depth_prepass) {
 		VkDeviceSize vertex_offsets[] = { 0 };
 
 		std::vector<VkClearValue> clear_values = { {}, {} };
@@ -1069,89 +1165,125 @@ public:
 		std::vector<VkClearValue> blur_clear_values = { {} };
 		blur_clear_values[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
 
-		for (uint32_t i = 0; i < this->offscreen_draw_cmd_buffers.size(); i++) {
-			vk::util::BeginCmdBuffer(this->offscreen_draw_cmd_buffers[i], VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT, nullptr);
-			
-			// firstpass render pass
-			vk::util::BeginRenderpass(this->offscreen_draw_cmd_buffers[i], this->firstpass_renderpass, this->firstpass_framebuffers[i], { 0,0 },
-				{ this->vulkan_swap_chain.swap_extent.width, this->vulkan_swap_chain.swap_extent.height }, clear_values, VK_SUBPASS_CONTENTS_INLINE);
-
-			vkCmdBindVertexBuffers(this->offscreen_draw_cmd_buffers[i], 0, 1, &this->cube_vertex_buffer.buffer, vertex_offsets);
-			vkCmdBindIndexBuffer(this->offscreen_draw_cmd_buffers[i], this->cube_index_buffer.buffer, 0, VK_INDEX_TYPE_UINT16);
-
-			vkCmdBindPipeline(this->offscreen_draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, this->firstpass_light_pipeline);
-			for (uint32_t j = 0; j < point_lights.size(); j++) { //draw light
-				uint32_t dynamic_alignment = j * this->per_object_data.stride;
-				vkCmdBindDescriptorSets(this->offscreen_draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-					this->firstpass_pipeline_layout, 0, 1, &this->firstpass_descriptor_sets[i], 1, &dynamic_alignment);
-				vkCmdDrawIndexed(this->offscreen_draw_cmd_buffers[i], static_cast<uint32_t>(cube_indices.size()), 1, 0, 0, 0);
-			}
-
-			vkCmdBindPipeline(this->offscreen_draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, this->firstpass_pipeline);
-			for (uint32_t j = point_lights.size(); j < boxes_data.size(); j++) { //draw boxes
-				uint32_t dynamic_alignment = j * this->per_object_data.stride;
-				vkCmdBindDescriptorSets(this->offscreen_draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-					this->firstpass_pipeline_layout, 0, 1, &this->firstpass_descriptor_sets[i], 1, &dynamic_alignment);
-				vkCmdDrawIndexed(this->offscreen_draw_cmd_buffers[i], static_cast<uint32_t>(cube_indices.size()), 1, 0, 0, 0);
-			}
-
-			vkCmdEndRenderPass(this->offscreen_draw_cmd_buffers[i]);
+		vk::util::BeginCmdBuffer(cmd_buffer, VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT, nullptr);
 
-			//light renderpass
+		this->gpu_profiler.CmdBeginFrame(cmd_buffer, image_index);
 
-			vk::util::BeginRenderpass(this->offscreen_draw_cmd_buffers[i], this->firstpass_renderpass, this->light_framebuffers[i], { 0,0 },
-				{ this->offscreen_framebuffer_width, this->offscreen_framebuffer_height }, clear_values, VK_SUBPASS_CONTENTS_INLINE);
-
-			vkCmdBindVertexBuffers(this->offscreen_draw_cmd_buffers[i], 0, 1, &this->cube_vertex_buffer.buffer, vertex_offsets);
-			vkCmdBindIndexBuffer(this->offscreen_draw_cmd_buffers[i], this->cube_index_buffer.buffer, 0, VK_INDEX_TYPE_UINT16);
-
-			vkCmdBindPipeline(this->offscreen_draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, this->light_pipeline);
-			for (uint32_t j = 0; j < point_lights.size(); j++) { //draw light
-				uint32_t dynamic_alignment = j * this->per_object_data.stride;
-				vkCmdBindDescriptorSets(this->offscreen_draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-					this->firstpass_pipeline_layout, 0, 1, &this->firstpass_descriptor_sets[i], 1, &dynamic_alignment);
-				vkCmdDrawIndexed(this->offscreen_draw_cmd_buffers[i], static_cast<uint32_t>(cube_indices.size()), 1, 0, 0, 0);
+		// firstpass render pass
+		this->gpu_profiler.CmdBeginScope(cmd_buffer, image_index, "scene");
+		if (deferred_shading) {
+			RecordDeferredScenePass(cmd_buffer, image_index);
+		}
+		else {
+			this->prepass_statistics.CmdBegin(cmd_buffer, image_index, use_depth_prepass);
+			vk::util::BeginRenderpass(cmd_buffer, this->firstpass_renderpass, this->firstpass_framebuffers[image_index], { 0,0 },
+				{ this->vulkan_swap_chain.swap_extent.width, this->vulkan_swap_chain.swap_extent.height }, clear_values, VK_SUBPASS_CONTENTS_INLINE);
+			if (use_depth_prepass) {
+				RecordSceneDraws(cmd_buffer, image_index, this->depth_prepass_pipeline, this->depth_prepass_pipeline);
+				RecordSceneDraws(cmd_buffer, image_index, this->firstpass_light_equal_pipeline, this->firstpass_equal_pipeline);
 			}
-
-			vkCmdBindPipeline(this->offscreen_draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, this->light_firstpass_pipeline);
-			for (uint32_t j = point_lights.size(); j < boxes_data.size(); j++) { //draw boxes
-				uint32_t dynamic_alignment = j * this->per_object_data.stride;
-				vkCmdBindDescriptorSets(this->offscreen_draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-					this->firstpass_pipeline_layout, 0, 1, &this->firstpass_descriptor_sets[i], 1, &dynamic_alignment);
-				vkCmdDrawIndexed(this->offscreen_draw_cmd_buffers[i], static_cast<uint32_t>(cube_indices.size()), 1, 0, 0, 0);
+			else {
+				RecordSceneDraws(cmd_buffer, image_index, this->firstpass_light_pipeline, this->firstpass_pipeline);
 			}
+			vkCmdEndRenderPass(cmd_buffer);
+			this->prepass_statistics.CmdEnd(cmd_buffer, image_index, use_depth_prepass);
+		}
+		this->gpu_profiler.CmdEndScope(cmd_buffer, image_index);
+
+		//light renderpass
+		this->gpu_profiler.CmdBeginScope(cmd_buffer, image_index, "light");
+		vk::util::BeginRenderpass(cmd_buffer, this->firstpass_renderpass, this->light_framebuffers[image_index], { 0,0 },
+			{ this->offscreen_framebuffer_width, this->offscreen_framebuffer_height }, clear_values, VK_SUBPASS_CONTENTS_INLINE);
+
+		RecordSceneDraws(cmd_buffer, image_index, this->light_pipeline, this->light_firstpass_pipeline);
+
+		vkCmdEndRenderPass(cmd_buffer);
+		this->gpu_profiler.CmdEndScope(cmd_buffer, image_index);
+
+		//vertical blur render pass
+		this->gpu_profiler.CmdBeginScope(cmd_buffer, image_index, "vertical blur");
+		vk::util::BeginRenderpass(cmd_buffer, this->blur_renderpass, this->vertical_blur_framebuffers[image_index], { 0,0 },
+			{ this->offscreen_framebuffer_width, this->offscreen_framebuffer_height }, blur_clear_values, VK_SUBPASS_CONTENTS_INLINE);
+
+		vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->blur_permutations.Get({ 0 }));
+		vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+			this->blur_pipeline_layout, 0, 1, &this->vertical_blur_descriptor_sets[image_index], 0, nullptr);
+		vkCmdBindVertexBuffers(cmd_buffer, 0, 1, &this->quad_vertex_buffer.buffer, vertex_offsets);
+		vkCmdBindIndexBuffer(cmd_buffer, this->quad_index_buffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+		vkCmdDrawIndexed(cmd_buffer, static_cast<uint32_t>(quad_indices.size()), 1, 0, 0, 0);
+
+		vkCmdEndRenderPass(cmd_buffer);
+		this->gpu_profiler.CmdEndScope(cmd_buffer, image_index);
+
+		// horizontal blur render pass
+		this->gpu_profiler.CmdBeginScope(cmd_buffer, image_index, "horizontal blur");
+		vk::util::BeginRenderpass(cmd_buffer, this->blur_renderpass, this->horizontal_blur_framebuffers[image_index], { 0,0 },
+			{ this->offscreen_framebuffer_width, this->offscreen_framebuffer_height }, blur_clear_values, VK_SUBPASS_CONTENTS_INLINE);
+
+		vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->blur_permutations.Get({ 1 }));
+		vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+			this->blur_pipeline_layout, 0, 1, &this->horizontal_blur_descriptor_sets[image_index], 0, nullptr);
+		vkCmdBindVertexBuffers(cmd_buffer, 0, 1, &this->quad_vertex_buffer.buffer, vertex_offsets);
+		vkCmdBindIndexBuffer(cmd_buffer, this->quad_index_buffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+		vkCmdDrawIndexed(cmd_buffer, static_cast<uint32_t>(quad_indices.size()), 1, 0, 0, 0);
+
+		vkCmdEndRenderPass(cmd_buffer);
+		this->gpu_profiler.CmdEndScope(cmd_buffer, image_index);
+		if (vkEndCommandBuffer(cmd_buffer) != VK_SUCCESS) {
+			throw std::runtime_error("fail to end command buffer recording");
+		}
+	}
 
-			vkCmdEndRenderPass(this->offscreen_draw_cmd_buffers[i]);
-
-			//vertical blur render pass
-			vk::util::BeginRenderpass(this->offscreen_draw_cmd_buffers[i], this->blur_renderpass, this->vertical_blur_framebuffers[i], { 0,0 },
-				{ this->offscreen_framebuffer_width, this->offscreen_framebuffer_height }, blur_clear_values, VK_SUBPASS_CONTENTS_INLINE);
-
-			vkCmdBindPipeline(this->offscreen_draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, this->vertical_pipeline);
-			vkCmdBindDescriptorSets(this->offscreen_draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-				this->blur_pipeline_layout, 0, 1, &this->vertical_blur_descriptor_sets[i], 0, nullptr);
-			vkCmdBindVertexBuffers(this->offscreen_draw_cmd_buffers[i], 0, 1, &this->quad_vertex_buffer.buffer, vertex_offsets);
-			vkCmdBindIndexBuffer(this->offscreen_draw_cmd_buffers[i], this->quad_index_buffer.buffer, 0, VK_INDEX_TYPE_UINT16);
-			vkCmdDrawIndexed(this->offscreen_draw_cmd_buffers[i], static_cast<uint32_t>(quad_indices.size()), 1, 0, 0, 0);
-
-			vkCmdEndRenderPass(this->offscreen_draw_cmd_buffers[i]);
-
-			// horizontal blur render pass
-			vk::util::BeginRenderpass(this->offscreen_draw_cmd_buffers[i], this->blur_renderpass, this->horizontal_blur_framebuffers[i], { 0,0 },
-				{ this->offscreen_framebuffer_width, this->offscreen_framebuffer_height }, blur_clear_values, VK_SUBPASS_CONTENTS_INLINE);
+	// light boxes first, then the other boxes. The vertex/index buffers are bound here
+	void RecordSceneDraws(VkCommandBuffer cmd_buffer, uint32_t image_index, VkPipeline light_box_pipeline, VkPipeline box_pipeline) {
+		VkDeviceSize vertex_offsets[] = { 0 };
+		vkCmdBindVertexBuffers(cmd_buffer, 0, 1, &this->cube_vertex_buffer.buffer, vertex_offsets);
+		vkCmdBindIndexBuffer(cmd_buffer, this->cube_index_buffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+
+		vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, light_box_pipeline);
+		for (uint32_t j = 0; j < num_light_boxes; j++) { //draw light
+			uint32_t dynamic_alignment = j * this->per_object_data.stride;
+			vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+				this->firstpass_pipeline_layout, 0, 1, &this->firstpass_descriptor_sets[image_index], 1, &dynamic_alignment);
+			vkCmdDrawIndexed(cmd_buffer, static_cast<uint32_t>(cube_indices.size()), 1, 0, 0, 0);
+		}
 
-			vkCmdBindPipeline(this->offscreen_draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, this->horizontal_pipeline);
-			vkCmdBindDescriptorSets(this->offscreen_draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-				this->blur_pipeline_layout, 0, 1, &this->horizontal_blur_descriptor_sets[i], 0, nullptr);
-			vkCmdBindVertexBuffers(this->offscreen_draw_cmd_buffers[i], 0, 1, &this->quad_vertex_buffer.buffer, vertex_offsets);
-			vkCmdBindIndexBuffer(this->offscreen_draw_cmd_buffers[i], this->quad_index_buffer.buffer, 0, VK_INDEX_TYPE_UINT16);
-			vkCmdDrawIndexed(this->offscreen_draw_cmd_buffers[i], static_cast<uint32_t>(quad_indices.size()), 1, 0, 0, 0);
+		vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, box_pipeline);
+		for (uint32_t j = num_light_boxes; j < this->scene_boxes.size(); j++) { //draw boxes
+			uint32_t dynamic_alignment = j * this->per_object_data.stride;
+			vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+				this->firstpass_pipeline_layout, 0, 1, &this->firstpass_descriptor_sets[image_index], 1, &dynamic_alignment);
+			vkCmdDrawIndexed(cmd_buffer, static_cast<uint32_t>(cube_indices.size()), 1, 0, 0, 0);
+		}
+	}
 
-			vkCmdEndRenderPass(this->offscreen_draw_cmd_buffers[i]);
-			if (vkEndCommandBuffer(this->offscreen_draw_cmd_buffers[i]) != VK_SUCCESS) {
-				throw std::runtime_error("fail to end command buffer recording");
-			}
+	// g-buffer, then lighting as the second subpass or as a compute dispatch. Leaves firstpass_color_attachments[image_index] in SHADER_READ_ONLY_OPTIMAL
+	void RecordDeferredScenePass(VkCommandBuffer cmd_buffer, uint32_t image_index) {
+		std::vector<VkClearValue> clear_values = this->gbuffer.GetClearValues();
+		vk::util::BeginRenderpass(cmd_buffer, this->gbuffer.renderpass, this->firstpass_framebuffers[image_index], { 0,0 },
+			this->gbuffer.extent, clear_values, VK_SUBPASS_CONTENTS_INLINE);
+		RecordSceneDraws(cmd_buffer, image_index, this->gbuffer_permutations.Get({ VK_TRUE }), this->gbuffer_permutations.Get({ VK_FALSE }));
+
+		if (deferred_lighting_mode == vk::DeferredLightingMode::SUBPASS) {
+			vkCmdNextSubpass(cmd_buffer, VK_SUBPASS_CONTENTS_INLINE);
+			vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->deferred_light_pipeline);
+			vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+				this->deferred_light_pipeline_layout, 0, 1, &this->deferred_light_descriptor_sets[image_index], 0, nullptr);
+			vkCmdDraw(cmd_buffer, 3, 1, 0, 0); // fullscreen triangle
+			vkCmdEndRenderPass(cmd_buffer);
+			return;
 		}
+		vkCmdEndRenderPass(cmd_buffer);
+
+		VkImage output = this->firstpass_color_attachments[image_index].image;
+		vk::util::TransitionImageLayout(cmd_buffer, output, VK_IMAGE_ASPECT_COLOR_BIT, 1, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+		vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->deferred_light_pipeline);
+		vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+			this->deferred_light_pipeline_layout, 0, 1, &this->deferred_light_descriptor_sets[image_index], 0, nullptr);
+		vkCmdDispatch(cmd_buffer, (this->gbuffer.extent.width + 7) / 8, (this->gbuffer.extent.height + 7) / 8, 1); // 8x8 local size
+		vk::util::TransitionImageLayout(cmd_buffer, output, VK_IMAGE_ASPECT_COLOR_BIT, 1, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
 	}
 
 	void CreateDrawCmdBuffers() {
@@ -1166,6 +1298,7 @@ public:
 		for (uint32_t i = 0; i < this->draw_cmd_buffers.size(); i++) {
 			vk::util::BeginCmdBuffer(this->draw_cmd_buffers[i], VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT, nullptr);
 
+			this->gpu_profiler.CmdBeginScope(this->draw_cmd_buffers[i], i, "final"); // recorded after the offscreen cmd buffers of the image
 			vk::util::BeginRenderpass(this->draw_cmd_buffers[i], this->renderpass,
 				this->swapchain_framebuffers[i], { 0,0 }, this->vulkan_swap_chain.swap_extent, clear_values, VK_SUBPASS_CONTENTS_INLINE);
 
@@ -1177,6 +1310,7 @@ public:
 			vkCmdDrawIndexed(this->draw_cmd_buffers[i], static_cast<uint32_t>(quad_indices.size()), 1, 0, 0, 0);
 
 			vkCmdEndRenderPass(this->draw_cmd_buffers[i]);
+			this->gpu_profiler.CmdEndScope(this->draw_cmd_buffers[i], i);
 
 			if (vkEndCommandBuffer(this->draw_cmd_buffers[i]) != VK_SUCCESS) {
 				throw std::runtime_error("fail to end command buffer recording");
@@ -1186,11 +1320,10 @@ public:
 
 	void Draw() override {
 		// wait for a previous iteration of the current frame to complete
-		vkWaitForFences(this->logical_device, 1, &this->cmdbuffers_inflight[this->current_frame], VK_TRUE, UINT64_MAX);
+		WaitForFrameSlot();
 
 		uint32_t image_index;
-		VkResult result = vkAcquireNextImageKHR(this->logical_device, this->vulkan_swap_chain.swap_chain, UINT64_MAX,
-			this->image_available_semaphores[this->current_frame], VK_NULL_HANDLE, &image_index);
+		VkResult result = AcquireNextImage(&image_index);
 		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
 			RecreateSwapChain();
 			return;
@@ -1198,28 +1331,39 @@ public:
 		else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
 			throw std::runtime_error("fail to acquire swap chain image");
 		}
-		UpdateUniformBufferData(image_index);
-
-		// Check if a previous frame is using this image (i.e. there is its fence to wait on)
-		if (this->images_inflight[image_index] != VK_NULL_HANDLE) {
-			vkWaitForFences(this->logical_device, 1, &this->images_inflight[image_index], VK_TRUE, UINT64_MAX);
+		RunFrameJobs(image_index);
+
+		// Check if a previous frame is using this image (i.e. there is its timeline value to wait on)
+		if (this->images_inflight[image_index] != 0) {
+			WaitUntil(this->queues[0].timeline, this->images_inflight[image_index]);
+			// the previous submission using this image is done, reference frames aren't profiled
+			if (!this->prepass_statistics.IsEnabled() || this->prepass_statistics.WasSubmitted(image_index, depth_prepass)) {
+				ReadGpuProfile(image_index);
+			}
+			this->prepass_statistics.ReadResults(image_index);
 		}
-		this->images_inflight[image_index] = this->cmdbuffers_inflight[this->current_frame]; // set the image as being used by the current frame
-		vkResetFences(this->logical_device, 1, &this->cmdbuffers_inflight[current_frame]); // reset fence back to unsignal states so that later frames will have to wait
-
-		// submit offscreen cmd buffers
-		std::vector<VkSemaphore> offscreen_wait_semaphores;
-		std::vector<VkPipelineStageFlags> offscreen_wait_stages;
+		// submit offscreen cmd buffers, the reference variant once every statistics_sample_interval frames
+		VkCommandBuffer offscreen_cmd_buffer = this->offscreen_draw_cmd_buffers[image_index];
+		bool sample_reference = this->prepass_statistics.IsReferenceFrame(this->fps_count);
+		if (sample_reference) {
+			offscreen_cmd_buffer = this->reference_offscreen_draw_cmd_buffers[image_index];
+		}
+		this->prepass_statistics.SetSubmitted(image_index, sample_reference ? !depth_prepass : depth_prepass);
+		std::vector<vk::SemaphoreWait> offscreen_waits;
+		std::vector<VkCommandBuffer> offscreen_cmd_buffers = { offscreen_cmd_buffer };
 		std::vector<VkSemaphore> offscreen_signal_semaphores;
-		this->queues[0].SubmitSingleCmdBuffer(offscreen_wait_semaphores, offscreen_wait_stages,
-			this->offscreen_draw_cmd_buffers[image_index], offscreen_signal_semaphores, VK_NULL_HANDLE);
+		uint64_t offscreen_value = this->queues[0].Submit(offscreen_waits, offscreen_cmd_buffers, offscreen_signal_semaphores);
 
-		//submit draw cmd buffers
-		std::vector<VkSemaphore> wait_semaphores = { this->image_available_semaphores[this->current_frame] };
-		std::vector<VkPipelineStageFlags> wait_stages = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+		//submit draw cmd buffers, the final pass samples the blurred images the offscreen submission rendered
+		std::vector<vk::SemaphoreWait> waits = {
+			{ this->image_available_semaphores[this->current_frame], 0, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT },
+			this->queues[0].timeline.WaitFor(offscreen_value, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT)
+		};
+		std::vector<VkCommandBuffer> cmd_buffers = { this->draw_cmd_buffers[image_index] };
 		std::vector<VkSemaphore> signal_semaphores = { this->render_finished_semaphores[this->current_frame] };
-		this->queues[0].SubmitSingleCmdBuffer(wait_semaphores, wait_stages, this->draw_cmd_buffers[image_index],
-			signal_semaphores, this->cmdbuffers_inflight[this->current_frame]);
+		uint64_t frame_value = this->queues[0].Submit(waits, cmd_buffers, signal_semaphores);
+		this->frames_inflight[this->current_frame] = frame_value;
+		this->images_inflight[image_index] = frame_value; // set the image as being used by the current frame
 		result = this->queues[0].PresentImage(signal_semaphores, this->vulkan_swap_chain.swap_chain, image_index);
 		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || this->framebuffer_resized) {
 			this->framebuffer_resized = false;
@@ -1231,37 +1375,80 @@ public:
 		this->current_frame = (this->current_frame + 1) % MAX_FRAMES_INFLIGHT;
 	}
 
-	void UpdateUniformBufferData(uint32_t current_image) {
-		static auto start_time = std::chrono::high_resolution_clock::now();
-		auto current_time = std::chrono::high_resolution_clock::now();
-		float elapsed = std::chrono::duration<float, std::chrono::seconds::period>(current_time - start_time).count();
-		PerCamera mvp;
-		mvp.view = glm::lookAt(glm::vec3(0.0, 20.0f, 16.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	// the projection follows the swapchain, which only the main thread knows
+	void UpdateSceneJobs(vk::JobCounter& counter) override {
+		CPU_PROFILE_FUNCTION();
+		const BloomFramePacket* packet = &GetBloomFramePacket();
+		PerCamera& mvp = this->frame_camera;
+		mvp.view = packet->view;
 		mvp.proj = glm::perspective(glm::radians(45.0f), this->vulkan_swap_chain.swap_extent.width / (float)this->vulkan_swap_chain.swap_extent.height, 0.1f, 1000.0f);
 		mvp.proj[1][1] *= -1;
+		mvp.inv_proj = glm::inverse(mvp.proj);
+		mvp.extent = glm::vec2(this->vulkan_swap_chain.swap_extent.width, this->vulkan_swap_chain.swap_extent.height);
+
+		this->frame_eye_lights.resize(packet->lights.size());
+		this->frame_light_positions.resize(packet->lights.size());
+		this->frame_light_radii.resize(packet->lights.size());
+		this->job_system.ParallelFor(static_cast<uint32_t>(packet->lights.size()), light_job_batch_size, [this, packet](uint32_t begin, uint32_t end) {
+			CPU_PROFILE_ZONE("UpdateLights");
+			for (uint32_t i = begin; i < end; i++) {
+				//update light data here, only uses in firstpass.frag to shade
+				this->frame_eye_lights[i] = packet->lights[i];
+				this->frame_eye_lights[i].position = glm::vec3(this->frame_camera.view * glm::vec4(packet->lights[i].position, 1.0f)); // need light position in eyeCoord 
+				this->frame_light_positions[i] = this->frame_eye_lights[i].position;
+				this->frame_light_radii[i] = cg::GetPointLightRadius(packet->lights[i], 1.0f / 256.0f);
+			}
+		}, &counter);
+	}
 
-		glm::mat4 rotating = glm::rotate(glm::mat4(1.0f), elapsed * glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	// light binning and the draw order don't touch the same data
+	void CullJobs(vk::JobCounter& counter) override {
+		this->job_system.Run([this]() {
+			CPU_PROFILE_ZONE("BuildLightGrid");
+			this->light_grid.Build(this->frame_light_positions, this->frame_light_radii, this->frame_camera.proj);
+		}, &counter);
+		this->job_system.Run([this]() {
+			CPU_PROFILE_ZONE("GetDrawOrder");
+			// uses to draw both light sources and cubes
+			this->frame_draw_order = GetDrawOrder(this->frame_camera.view);
+		}, &counter);
+	}
 
-		unsigned char* light_ptr = this->per_light_data.data;
-		for (uint32_t i = 0; i < point_lights.size(); i++) {
-			//update light data here, only uses in firstpass.frag to shade
-			cg::PointLight light = point_lights[i];
-			light.position = glm::vec3(mvp.view * glm::vec4(point_lights[i].position, 1.0f)); // need light position in eyeCoord 
-			*(reinterpret_cast<cg::PointLight*>(light_ptr)) = light;
-			light_ptr += this->per_light_data.stride;
-		}
-		cg::PointLight* test_ptr = reinterpret_cast<cg::PointLight*>(this->per_light_data.data);
-		// uses to draw both light sources and cubes
-		unsigned char* obj_ptr = this->per_object_data.data;
-		for (uint32_t i = 0; i < boxes_data.size(); i++) {
-			PerObject per_obj = boxes_data[i];
-			per_obj.model_matrix = per_obj.model_matrix * rotating;
-			*reinterpret_cast<PerObject*>(obj_ptr) = per_obj;
-			obj_ptr += this->per_object_data.stride;
+	// a job per buffer: two jobs must not map the same memory at once
+	void PackUniformJobs(uint32_t image_index, vk::JobCounter& counter) override {
+		const BloomFramePacket* packet = &GetBloomFramePacket();
+		this->job_system.ParallelFor(static_cast<uint32_t>(this->scene_boxes.size()), box_job_batch_size, [this, packet](uint32_t begin, uint32_t end) {
+			CPU_PROFILE_ZONE("PackBoxes");
+			unsigned char* obj_ptr = this->per_object_data.data + static_cast<size_t>(begin) * this->per_object_data.stride;
+			for (uint32_t i = begin; i < end; i++) {
+				PerObject per_obj = this->scene_boxes[this->frame_draw_order[i]];
+				per_obj.model_matrix = packet->box_transforms[this->frame_draw_order[i]];
+				*reinterpret_cast<PerObject*>(obj_ptr) = per_obj;
+				obj_ptr += this->per_object_data.stride;
+			}
+		}, &this->boxes_packed);
+		this->job_system.Run([this, image_index]() {
+			this->per_obj_uniform_buffers[image_index].CopyFromHostData(this->per_object_data.data, this->per_object_data.total_size, 0);
+		}, &counter, &this->boxes_packed);
+		this->job_system.Run([this, image_index]() {
+			this->light_storage_buffers[image_index].CopyFromHostData(this->frame_eye_lights.data(),
+				static_cast<uint32_t>(sizeof(cg::PointLight) * this->frame_eye_lights.size()), 0);
+		}, &counter);
+		this->job_system.Run([this, image_index]() {
+			cg::ClusterGridHeader grid_header = this->light_grid.GetHeader(static_cast<uint32_t>(this->frame_eye_lights.size()));
+			this->cluster_storage_buffers[image_index].CopyFromHostData(&grid_header, sizeof(cg::ClusterGridHeader), 0);
+			this->cluster_storage_buffers[image_index].CopyFromHostData(this->light_grid.cluster_ranges.data(),
+				static_cast<uint32_t>(sizeof(glm::uvec2) * this->light_grid.cluster_ranges.size()), sizeof(cg::ClusterGridHeader));
+		}, &counter);
+		if (!this->light_grid.light_indices.empty()) {
+			this->job_system.Run([this, image_index]() {
+				this->light_index_storage_buffers[image_index].CopyFromHostData(this->light_grid.light_indices.data(),
+					static_cast<uint32_t>(sizeof(uint32_t) * this->light_grid.light_indices.size()), 0);
+			}, &counter);
 		}
-		this->light_uniform_buffers[current_image].CopyFromHostData(this->per_light_data.data, this->per_light_data.total_size, 0);
-		this->per_camera_uniform_buffers[current_image].CopyFromHostData(&mvp, sizeof(PerCamera), 0);
-		this->per_obj_uniform_buffers[current_image].CopyFromHostData(this->per_object_data.data, this->per_object_data.total_size, 0);
+		this->job_system.Run([this, image_index]() {
+			this->per_camera_uniform_buffers[image_index].CopyFromHostData(&this->frame_camera, sizeof(PerCamera), 0);
+		}, &counter);
 	}
 
 	void CreateTextureSampler() {
@@ -1283,22 +1470,98 @@ public:
 		}
 	}
 
+	VkDeviceSize GetLightBufferSize() {
+		return sizeof(cg::PointLight) * point_lights.size();
+	}
+
+	VkDeviceSize GetClusterBufferSize() {
+		return sizeof(cg::ClusterGridHeader) + sizeof(glm::uvec2) * this->light_grid.GetClusterCount();
+	}
+
+	VkDeviceSize GetLightIndexBufferSize() {
+		return sizeof(uint32_t) * max_light_indices;
+	}
+
+	// small dim lights over the floor, radius of influence is about 3 units so each touches only a few clusters
+	void AddStressTestLights() {
+		std::mt19937 generator(1234);
+		std::uniform_real_distribution<float> position_dist(-40.0f, 40.0f);
+		std::uniform_real_distribution<float> height_dist(-1.0f, 2.0f);
+		std::uniform_real_distribution<float> color_dist(0.1f, 0.3f);
+		while (point_lights.size() < max_lights) {
+			glm::vec3 color = glm::vec3(color_dist(generator), color_dist(generator), color_dist(generator));
+			point_lights.push_back({ glm::vec3(position_dist(generator), height_dist(generator), position_dist(generator)), color * 0.1f, color, color,
+				1.0f, 1.0f, 8.0f });
+		}
+	}
+
+	// boxes_data plus the overdraw benchmark layers, pushed away from the camera. Farther layers come first so they are drawn first
+	void CreateSceneBoxes() {
+		this->scene_boxes.assign(boxes_data.begin(), boxes_data.begin() + num_light_boxes);
+		glm::vec3 away_from_camera = glm::normalize(glm::vec3(0.0f, -20.0f, -16.0f));
+		for (uint32_t layer = overdraw_layers; layer > 0; layer--) {
+			glm::mat4 offset = glm::translate(away_from_camera * 1.5f * static_cast<float>(layer - 1));
+			for (uint32_t j = num_light_boxes; j < boxes_data.size(); j++) {
+				this->scene_boxes.push_back({ offset * boxes_data[j].model_matrix, boxes_data[j].color });
+			}
+		}
+	}
+
+	void ReadGpuProfile(uint32_t image_index) {
+		this->gpu_profiler.ReadResults(image_index);
+		this->gpu_profiled_frames++;
+		if (this->gpu_profiled_frames < gpu_report_interval || !this->gpu_profiler.IsSupported()) {
+			return;
+		}
+		const char* path = !deferred_shading ? "forward" : (deferred_lighting_mode == vk::DeferredLightingMode::SUBPASS ? "deferred subpass" : "deferred compute");
+		std::cout << path << " shading, " << overdraw_layers << " overdraw layers, " << point_lights.size() << " lights:" << std::endl;
+		for (vk::GpuScopeStatistics& scope : this->gpu_profiler.GetStatistics()) {
+			std::cout << "  " << scope.name << ": p50 " << scope.p50_ms << " ms, p95 " << scope.p95_ms << " ms, p99 " << scope.p99_ms << " ms" << std::endl;
+		}
+		this->gpu_profiled_frames = 0;
+	}
+
+	// light boxes and boxes are drawn with different pipelines, so each group is sorted on its own.
+	// Command buffers draw the per object slots in order, sorting only changes which box goes into which slot
+	std::vector<uint32_t> GetDrawOrder(glm::mat4 view) {
+		std::vector<uint32_t> draw_order(this->scene_boxes.size());
+		for (uint32_t i = 0; i < draw_order.size(); i++) {
+			draw_order[i] = i;
+		}
+		if (!sort_front_to_back) {
+			return draw_order;
+		}
+		std::vector<glm::vec3> light_box_positions;
+		std::vector<glm::vec3> box_positions;
+		for (uint32_t i = 0; i < this->scene_boxes.size(); i++) {
+			glm::vec3 position = glm::vec3(this->scene_boxes[i].model_matrix[3]); // the rotation is applied in model space
+			if (i < num_light_boxes) {
+				light_box_positions.push_back(position);
+			}
+			else {
+				box_positions.push_back(position);
+			}
+		}
+		std::vector<uint32_t> light_box_order = cg::SortFrontToBack(view, light_box_positions);
+		std::vector<uint32_t> box_order = cg::SortFrontToBack(view, box_positions);
+		for (uint32_t i = 0; i < light_box_order.size(); i++) {
+			draw_order[i] = light_box_order[i];
+		}
+		for (uint32_t i = 0; i < box_order.size(); i++) {
+			draw_order[num_light_boxes + i] = num_light_boxes + box_order[i];
+		}
+		return draw_order;
+	}
+
 	void CreateUboDataArrays() {
 		uint32_t min_ubuffer_alignment = vk::GetMinUniformBufferAlignment(this->physical_device);
 		this->per_object_data.stride = vk::util::CalculateObjectSize(sizeof(PerObject), min_ubuffer_alignment);
-		this->per_object_data.total_size = this->per_object_data.stride * boxes_data.size();
+		this->per_object_data.total_size = this->per_object_data.stride * static_cast<uint32_t>(this->scene_boxes.size());
 		this->per_object_data.data = reinterpret_cast<unsigned char*>(operator new(this->per_object_data.total_size));
 
-		this->per_light_data.stride = vk::util::CalculateObjectSize(sizeof(cg::PointLight), min_ubuffer_alignment);
-		this->per_light_data.total_size = this->per_light_data.stride * point_lights.size();
-		this->per_light_data.data = reinterpret_cast<unsigned char*>(operator new(this->per_light_data.total_size));
 	}
 
 	void CleanupUboDataArrays() {
-		delete[] this->per_light_data.data;
-		this->per_light_data.total_size = 0;
-		this->per_light_data.stride = 0;
-
 		delete[] this->per_object_data.data;
 		this->per_object_data.total_size = 0;
 		this->per_object_data.stride = 0;
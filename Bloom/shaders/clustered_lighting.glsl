@@ -0,0 +1,48 @@
+// clustered point lights, shared by forward (firstpass.frag) and deferred (deferred_light.frag/.comp) shading.
+// Lights are binned on the cpu into tiles_x * tiles_y screen tiles times depth slices, each cluster holds an (offset, count) range into lightIndices
+struct PointLight {
+	vec3 positionEyeCoord;
+	vec3 ambient;
+	vec3 diffuse;
+	vec3 specular;
+	float constant;
+	float linear;
+	float quadratic;
+};
+
+layout(std430, binding = 2) readonly buffer Lights {
+	PointLight lights[];
+};
+
+layout(std430, binding = 3) readonly buffer Clusters {
+	uvec4 gridSize; // tiles x, tiles y, depth slices, number of lights
+	vec4 depthParams; // near, far, slices / log(far / near)
+	uvec2 clusterRanges[];
+};
+
+layout(std430, binding = 4) readonly buffer LightIndices {
+	uint lightIndices[];
+};
+
+uint getClusterIndex(vec2 ndc, float depth) {
+	uvec2 tile = uvec2(clamp(floor((ndc * 0.5 + 0.5) * vec2(gridSize.xy)), vec2(0.0), vec2(gridSize.xy) - 1.0));
+	float slice = clamp(floor(log(depth / depthParams.x) * depthParams.z), 0.0, float(gridSize.z) - 1.0);
+	return tile.x + gridSize.x * (tile.y + gridSize.y * uint(slice));
+}
+
+// positionEyeCoord and normalEyeCoord are in eye space, ndc is the fragment's position on screen
+vec3 shadePointLights(vec3 albedo, vec3 positionEyeCoord, vec3 normalEyeCoord, vec2 ndc) {
+	vec3 result = vec3(0.0, 0.0, 0.0);
+	uvec2 range = clusterRanges[getClusterIndex(ndc, -positionEyeCoord.z)];
+	for (uint i = 0; i < range.y; i++) {
+		PointLight light = lights[lightIndices[range.x + i]];
+		float dist = length(light.positionEyeCoord - positionEyeCoord);
+		float attenuation = 1.0 / (light.constant + light.linear * dist + light.quadratic * dist * dist);
+		vec3 ambient = light.ambient * albedo * attenuation;
+		vec3 l = normalize(light.positionEyeCoord - positionEyeCoord);
+		vec3 diffuse = light.diffuse * albedo * max(0.0, dot(l, normalEyeCoord)) * attenuation;
+		result += ambient;
+		result += diffuse;
+	}
+	return result;
+}
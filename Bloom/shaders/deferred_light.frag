@@ -0,0 +1,37 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "clustered_lighting.glsl"
+#include "gbuffer_packing.glsl"
+
+layout(binding = 0) uniform PerCamera {
+	mat4 view;
+	mat4 proj;
+	mat4 invProj;
+	vec2 extent;
+} perCamera;
+
+// the g-buffer texel of this pixel, read from tile memory
+layout(input_attachment_index = 0, binding = 5) uniform subpassInput albedoInput;
+layout(input_attachment_index = 1, binding = 6) uniform subpassInput normalInput;
+layout(input_attachment_index = 2, binding = 7) uniform subpassInput depthInput;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+	float depth = subpassLoad(depthInput).r;
+	if (depth == 1.0) { // background
+		outColor = vec4(0.0, 0.0, 0.0, 1.0);
+		return;
+	}
+	vec4 albedo = subpassLoad(albedoInput);
+	if (albedo.a > 0.0) {
+		outColor = vec4(albedo.rgb * albedo.a * MAX_EMISSIVE, 1.0);
+		return;
+	}
+	vec2 ndc = gl_FragCoord.xy / perCamera.extent * 2.0 - 1.0;
+	vec3 position = reconstructPosition(ndc, depth, perCamera.invProj);
+	vec3 normal = decodeOctahedral(subpassLoad(normalInput).xy);
+	outColor = vec4(shadePointLights(albedo.rgb, position, normal, ndc), 1.0);
+}
@@ -0,0 +1,23 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(binding = 0) uniform PerCamera {
+    mat4 view;
+    mat4 proj;
+} perCamera;
+
+layout (binding = 1) uniform PerObject 
+{
+	mat4 modelMatrix; 
+	vec3 color;
+} perObject;
+
+layout(location = 0) in vec3 inPosition;
+
+// same expression as firstpass.vert so that the color pass passes the EQUAL depth test
+invariant gl_Position;
+
+void main() {
+	mat4 modelView = perCamera.view * perObject.modelMatrix;
+    gl_Position = perCamera.proj * modelView * vec4(inPosition, 1.0);
+}
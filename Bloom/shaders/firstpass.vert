@@ -18,7 +18,9 @@ layout(location = 1) in vec3 inNormal;
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec4 positionEyeCoord;
 layout(location = 2) out vec3 normalEyeCoord;
+layout(location = 3) out vec4 positionClip; // to find the fragment's cluster independently of the framebuffer size
 
+invariant gl_Position; // must match depth_prepass.vert
 
 void main() {
 	fragColor = perObject.color;
@@ -27,5 +29,6 @@ void main() {
 	mat3 normalMatrix = mat3(transpose(inverse(perObject.modelMatrix)));
 	normalEyeCoord =  normalize(mat3(perCamera.view) * normalMatrix * inNormal);
     gl_Position = perCamera.proj * modelView * vec4(inPosition, 1.0);
+	positionClip = gl_Position;
 }
 
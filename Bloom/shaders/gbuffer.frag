@@ -0,0 +1,18 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "gbuffer_packing.glsl"
+
+layout (constant_id = 0) const bool EMISSIVE = false; // light sources are not lit, they glow with their own color
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 2) in vec3 normalEyeCoord;
+
+layout(location = 0) out vec4 outAlbedo;
+layout(location = 1) out vec2 outNormal;
+
+void main() {
+	outAlbedo = packAlbedo(fragColor, EMISSIVE);
+	outNormal = encodeOctahedral(normalize(normalEyeCoord));
+}
@@ -0,0 +1,35 @@
+// g-buffer layout: albedo (rgba8) and octahedral encoded eye space normal (rg16), position is reconstructed from depth.
+// Emissive surfaces store their color normalized in albedo.rgb and their intensity / MAX_EMISSIVE in albedo.a, lit surfaces have albedo.a = 0
+const float MAX_EMISSIVE = 8.0;
+
+vec2 signNotZero(vec2 v) {
+	return vec2((v.x >= 0.0) ? 1.0 : -1.0, (v.y >= 0.0) ? 1.0 : -1.0);
+}
+
+// unit vector to [-1, 1]^2: project onto the octahedron |x| + |y| + |z| = 1 and fold the lower half over the diagonals
+vec2 encodeOctahedral(vec3 n) {
+	vec2 p = n.xy / (abs(n.x) + abs(n.y) + abs(n.z));
+	return (n.z <= 0.0) ? ((1.0 - abs(p.yx)) * signNotZero(p)) : p;
+}
+
+vec3 decodeOctahedral(vec2 e) {
+	vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0) {
+		n.xy = (1.0 - abs(n.yx)) * signNotZero(n.xy);
+	}
+	return normalize(n);
+}
+
+vec4 packAlbedo(vec3 color, bool emissive) {
+	if (!emissive) {
+		return vec4(color, 0.0);
+	}
+	float intensity = max(max(color.r, color.g), max(color.b, 1e-4));
+	return vec4(color / intensity, min(intensity / MAX_EMISSIVE, 1.0));
+}
+
+// view space position from the pixel's ndc xy and its depth buffer value
+vec3 reconstructPosition(vec2 ndc, float depth, mat4 invProj) {
+	vec4 position = invProj * vec4(ndc, depth, 1.0);
+	return position.xyz / position.w;
+}
@@ -17,7 +17,10 @@ layout(location = 1) in vec3 inNormal;
 
 layout(location = 0) out vec3 fragColor;
 
+invariant gl_Position; // must match depth_prepass.vert
+
 void main() {
 	fragColor = perObject.color;
-    gl_Position = perCamera.proj * perCamera.view * perObject.modelMatrix * vec4(inPosition, 1.0);
+	mat4 modelView = perCamera.view * perObject.modelMatrix;
+    gl_Position = perCamera.proj * modelView * vec4(inPosition, 1.0);
 }
\ No newline at end of file
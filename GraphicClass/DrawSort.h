@@ -0,0 +1,32 @@
+#pragma once
+#include "glm/glm.hpp"
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+namespace cg {
+
+	// unsigned key with the same order as the float: positive floats get the sign bit set, negative floats get every bit flipped
+	inline uint32_t FloatSortKey(float value) {
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(float));
+		return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+	}
+
+	// draw order of the objects at world_positions, nearest to the camera first. The key is the view space depth of the object's origin,
+	// ties keep their original order
+	inline std::vector<uint32_t> SortFrontToBack(glm::mat4 view, const std::vector<glm::vec3>& world_positions) {
+		std::vector<uint64_t> keys(world_positions.size());
+		for (uint32_t i = 0; i < world_positions.size(); i++) {
+			float depth = -(view * glm::vec4(world_positions[i], 1.0f)).z; // camera looks down -z
+			keys[i] = (static_cast<uint64_t>(FloatSortKey(depth)) << 32) | i;
+		}
+		std::sort(keys.begin(), keys.end());
+		std::vector<uint32_t> order(keys.size());
+		for (uint32_t i = 0; i < keys.size(); i++) {
+			order[i] = static_cast<uint32_t>(keys[i]);
+		}
+		return order;
+	}
+}
@@ -0,0 +1,175 @@
+#pragma once
+#include "glm/glm.hpp"
+#include "Light.h"
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+namespace cg {
+
+	// distance at which the light's contribution drops under threshold, used as the radius of the light's sphere of influence
+	inline float GetPointLightRadius(const PointLight& light, float threshold) {
+		glm::vec3 color = light.diffuse + light.ambient;
+		float max_intensity = std::max(std::max(color.r, color.g), color.b);
+		// solve constant + linear * d + quadratic * d^2 = max_intensity / threshold
+		float c = light.constant - max_intensity / threshold;
+		if (c >= 0.0f) { // never bright enough
+			return 0.0f;
+		}
+		if (light.quadratic > 0.0f) {
+			return (-light.linear + std::sqrt(light.linear * light.linear - 4.0f * light.quadratic * c)) / (2.0f * light.quadratic);
+		}
+		if (light.linear > 0.0f) {
+			return -c / light.linear;
+		}
+		return INFINITY;
+	}
+
+	// matches the header of the cluster storage buffer in the shaders, followed by one uvec2 (offset, count) per cluster
+	struct ClusterGridHeader {
+		alignas(16) glm::uvec4 grid_size; // tiles x, tiles y, depth slices, number of lights
+		alignas(16) glm::vec4 depth_params; // near, far, slices / log(far / near), unused
+	};
+
+	// froxel grid over the view frustum: tiles_x * tiles_y screen tiles, each split into depth slices spaced exponentially between near and far.
+	// Lights are binned on the CPU by testing their sphere of influence against every froxel's view space bounding box
+	class LightClusterGrid {
+	public:
+		LightClusterGrid() = default;
+
+		LightClusterGrid(uint32_t tiles_x, uint32_t tiles_y, uint32_t slices, float near_plane, float far_plane, uint32_t max_light_indices) :
+			tiles_x(tiles_x), tiles_y(tiles_y), slices(slices), near_plane(near_plane), far_plane(far_plane), max_light_indices(max_light_indices) {
+			this->slice_scale = slices / std::log(far_plane / near_plane);
+			this->cluster_ranges.resize(GetClusterCount());
+			this->light_indices.reserve(max_light_indices);
+		}
+
+		uint32_t GetClusterCount() {
+			return this->tiles_x * this->tiles_y * this->slices;
+		}
+
+		ClusterGridHeader GetHeader(uint32_t light_count) {
+			ClusterGridHeader header = {};
+			header.grid_size = glm::uvec4(this->tiles_x, this->tiles_y, this->slices, light_count);
+			header.depth_params = glm::vec4(this->near_plane, this->far_plane, this->slice_scale, 0.0f);
+			return header;
+		}
+
+		// positions are the light centers in eye coordinates, proj is the camera projection (any y flip is taken into account).
+		// Fills cluster_ranges and light_indices, a cluster's lights are light_indices[range.x, range.x + range.y)
+		void Build(const std::vector<glm::vec3>& positions, const std::vector<float>& radii, glm::mat4 proj) {
+			float scale_x = proj[0][0];
+			float scale_y = proj[1][1];
+			this->cluster_lights.clear();
+			this->cluster_of_light.clear();
+			for (uint32_t i = 0; i < positions.size(); i++) {
+				BinLight(i, positions[i], radii[i], scale_x, scale_y);
+			}
+
+			// counting sort by cluster, lights stay in index order inside a cluster
+			std::fill(this->cluster_ranges.begin(), this->cluster_ranges.end(), glm::uvec2(0, 0));
+			uint32_t pair_count = std::min(static_cast<uint32_t>(this->cluster_of_light.size()), this->max_light_indices); // drop what doesn't fit
+			for (uint32_t i = 0; i < pair_count; i++) {
+				this->cluster_ranges[this->cluster_of_light[i]].y++;
+			}
+			uint32_t offset = 0;
+			for (glm::uvec2& range : this->cluster_ranges) {
+				range.x = offset;
+				offset += range.y;
+				range.y = 0;
+			}
+			this->light_indices.resize(pair_count);
+			for (uint32_t i = 0; i < pair_count; i++) {
+				glm::uvec2& range = this->cluster_ranges[this->cluster_of_light[i]];
+				this->light_indices[range.x + range.y] = this->cluster_lights[i];
+				range.y++;
+			}
+		}
+
+	private:
+		float SliceNear(uint32_t slice) {
+			return this->near_plane * std::pow(this->far_plane / this->near_plane, slice / static_cast<float>(this->slices));
+		}
+
+		uint32_t SliceOf(float depth) {
+			float slice = std::floor(std::log(depth / this->near_plane) * this->slice_scale);
+			return static_cast<uint32_t>(std::min(std::max(slice, 0.0f), static_cast<float>(this->slices - 1)));
+		}
+
+		uint32_t TileOf(float ndc, uint32_t tiles) {
+			float tile = std::floor((ndc * 0.5f + 0.5f) * tiles);
+			return static_cast<uint32_t>(std::min(std::max(tile, 0.0f), static_cast<float>(tiles - 1)));
+		}
+
+		// ndc range covered by the view space interval [a, b] (along x or y) for view depths in [d_min, d_max]
+		static glm::vec2 ProjectInterval(float a, float b, float d_min, float d_max, float scale) {
+			float c0 = scale * a / d_min, c1 = scale * a / d_max, c2 = scale * b / d_min, c3 = scale * b / d_max;
+			return glm::vec2(std::min(std::min(c0, c1), std::min(c2, c3)), std::max(std::max(c0, c1), std::max(c2, c3)));
+		}
+
+		// view space range covered by the ndc interval [n0, n1] for view depths in [d_min, d_max], the inverse of ProjectInterval
+		static glm::vec2 UnprojectInterval(float n0, float n1, float d_min, float d_max, float scale) {
+			float c0 = n0 * d_min / scale, c1 = n0 * d_max / scale, c2 = n1 * d_min / scale, c3 = n1 * d_max / scale;
+			return glm::vec2(std::min(std::min(c0, c1), std::min(c2, c3)), std::max(std::max(c0, c1), std::max(c2, c3)));
+		}
+
+		void BinLight(uint32_t light_index, glm::vec3 position, float radius, float scale_x, float scale_y) {
+			float depth = -position.z; // camera looks down -z
+			if (depth + radius < this->near_plane || depth - radius > this->far_plane) {
+				return;
+			}
+			uint32_t first_slice = SliceOf(std::max(depth - radius, this->near_plane));
+			uint32_t last_slice = SliceOf(std::min(depth + radius, this->far_plane));
+			for (uint32_t slice = first_slice; slice <= last_slice; slice++) {
+				float slice_near = SliceNear(slice);
+				float slice_far = SliceNear(slice + 1);
+				float d_min = std::max(slice_near, depth - radius);
+				float d_max = std::min(slice_far, depth + radius);
+
+				// conservative screen rect of the sphere inside this slice
+				glm::vec2 ndc_x = ProjectInterval(position.x - radius, position.x + radius, d_min, d_max, scale_x);
+				glm::vec2 ndc_y = ProjectInterval(position.y - radius, position.y + radius, d_min, d_max, scale_y);
+				if (ndc_x.y < -1.0f || ndc_x.x > 1.0f || ndc_y.y < -1.0f || ndc_y.x > 1.0f) {
+					continue;
+				}
+				uint32_t first_x = TileOf(ndc_x.x, this->tiles_x), last_x = TileOf(ndc_x.y, this->tiles_x);
+				uint32_t first_y = TileOf(ndc_y.x, this->tiles_y), last_y = TileOf(ndc_y.y, this->tiles_y);
+
+				for (uint32_t y = first_y; y <= last_y; y++) {
+					float tile_y0 = y * 2.0f / this->tiles_y - 1.0f;
+					glm::vec2 bounds_y = UnprojectInterval(tile_y0, tile_y0 + 2.0f / this->tiles_y, slice_near, slice_far, scale_y);
+					for (uint32_t x = first_x; x <= last_x; x++) {
+						float tile_x0 = x * 2.0f / this->tiles_x - 1.0f;
+						glm::vec2 bounds_x = UnprojectInterval(tile_x0, tile_x0 + 2.0f / this->tiles_x, slice_near, slice_far, scale_x);
+						// sphere against the froxel's bounding box
+						glm::vec3 box_min = glm::vec3(bounds_x.x, bounds_y.x, -slice_far);
+						glm::vec3 box_max = glm::vec3(bounds_x.y, bounds_y.y, -slice_near);
+						glm::vec3 closest = glm::clamp(position, box_min, box_max);
+						glm::vec3 diff = closest - position;
+						if (glm::dot(diff, diff) > radius * radius) {
+							continue;
+						}
+						this->cluster_of_light.push_back(x + this->tiles_x * (y + this->tiles_y * slice));
+						this->cluster_lights.push_back(light_index);
+					}
+				}
+			}
+		}
+
+	public:
+		std::vector<glm::uvec2> cluster_ranges; // offset, count into light_indices
+		std::vector<uint32_t> light_indices;
+		uint32_t tiles_x = 0;
+		uint32_t tiles_y = 0;
+		uint32_t slices = 0;
+		float near_plane = 0.0f;
+		float far_plane = 0.0f;
+		uint32_t max_light_indices = 0;
+	private:
+		float slice_scale = 0.0f;
+		// (cluster, light) pairs found while binning, before sorting by cluster
+		std::vector<uint32_t> cluster_of_light;
+		std::vector<uint32_t> cluster_lights;
+	};
+}
@@ -0,0 +1,176 @@
+#pragma once
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <algorithm>
+
+namespace cg {
+
+	// a square region of the atlas, in texels
+	struct AtlasTile {
+		uint32_t x = 0;
+		uint32_t y = 0;
+		uint32_t size = 0; // 0 means the tile is not allocated
+	};
+
+	// per shadow casting light bookkeeping. Point lights use 6 tiles, one per cube face, spot/directional lights use 1
+	struct ShadowAtlasEntry {
+		std::array<AtlasTile, 6> tiles;
+		uint32_t face_count = 0;
+		uint32_t tile_size = 0;
+		bool dirty = true; // tiles need to be re-rendered
+	};
+
+	// partitions a square depth texture with a quadtree. Every node is either free, split into 4 children or used by one tile.
+	// The tree is stored implicitly: children of node i are 4i+1 .. 4i+4, so no node is ever allocated after construction
+	class ShadowAtlas {
+	public:
+		ShadowAtlas() = default;
+
+		// atlas_size and min_tile_size must be powers of two
+		ShadowAtlas(uint32_t atlas_size, uint32_t min_tile_size) : atlas_size(atlas_size), min_tile_size(min_tile_size) {
+			uint32_t levels = 1;
+			for (uint32_t size = atlas_size; size > min_tile_size; size /= 2) {
+				levels++;
+			}
+			this->max_level = levels - 1;
+			uint32_t node_count = 0;
+			for (uint32_t i = 0, nodes_in_level = 1; i < levels; i++, nodes_in_level *= 4) {
+				node_count += nodes_in_level;
+			}
+			this->nodes.assign(node_count, NodeState::FREE);
+		}
+
+		// size is rounded up to a power of two and clamped to [min_tile_size, atlas_size]. Returns false when the atlas is full
+		bool Allocate(uint32_t size, AtlasTile& tile) {
+			size = RoundTileSize(size);
+			uint32_t target_level = 0;
+			for (uint32_t s = this->atlas_size; s > size; s /= 2) {
+				target_level++;
+			}
+			return Allocate(0, 0, 0, 0, target_level, tile);
+		}
+
+		void Free(AtlasTile& tile) {
+			if (tile.size == 0) {
+				return;
+			}
+			// walk down to the node covering the tile
+			uint32_t node = 0;
+			uint32_t x = 0, y = 0;
+			for (uint32_t size = this->atlas_size; size > tile.size; size /= 2) {
+				uint32_t half = size / 2;
+				uint32_t child = ((tile.x >= x + half) ? 1 : 0) + ((tile.y >= y + half) ? 2 : 0);
+				x += (child & 1) * half;
+				y += (child >> 1) * half;
+				node = 4 * node + 1 + child;
+			}
+			this->nodes[node] = NodeState::FREE;
+			// merge back up while all siblings are free
+			while (node != 0) {
+				uint32_t parent = (node - 1) / 4;
+				for (uint32_t i = 1; i <= 4; i++) {
+					if (this->nodes[4 * parent + i] != NodeState::FREE) {
+						tile = {};
+						return;
+					}
+				}
+				this->nodes[parent] = NodeState::FREE;
+				node = parent;
+			}
+			tile = {};
+		}
+
+		void Clear() {
+			std::fill(this->nodes.begin(), this->nodes.end(), NodeState::FREE);
+		}
+
+		uint32_t RoundTileSize(uint32_t size) {
+			uint32_t rounded = this->min_tile_size;
+			while (rounded < size && rounded < this->atlas_size) {
+				rounded *= 2;
+			}
+			return rounded;
+		}
+
+		// importance is the fraction of the screen the light affects, in [0, 1]. A light covering the whole screen gets max_tile_size
+		uint32_t GetTileSize(float importance, uint32_t max_tile_size) {
+			importance = std::min(std::max(importance, 0.0f), 1.0f);
+			uint32_t size = this->min_tile_size;
+			while (size * 2 <= max_tile_size && size * 2 <= importance * max_tile_size) {
+				size *= 2;
+			}
+			return size;
+		}
+
+		// tile rect in normalized atlas coordinates: xy offset, zw extent
+		glm::vec4 GetTileRect(const AtlasTile& tile) {
+			float inv_size = 1.0f / this->atlas_size;
+			return glm::vec4(tile.x * inv_size, tile.y * inv_size, tile.size * inv_size, tile.size * inv_size);
+		}
+
+	private:
+		enum class NodeState : uint8_t { FREE, SPLIT, USED };
+
+		bool Allocate(uint32_t node, uint32_t level, uint32_t x, uint32_t y, uint32_t target_level, AtlasTile& tile) {
+			NodeState state = this->nodes[node];
+			if (state == NodeState::USED) {
+				return false;
+			}
+			uint32_t size = this->atlas_size >> level;
+			if (level == target_level) {
+				if (state != NodeState::FREE) { // part of it is used by smaller tiles
+					return false;
+				}
+				this->nodes[node] = NodeState::USED;
+				tile = { x, y, size };
+				return true;
+			}
+			if (level == this->max_level) {
+				return false;
+			}
+			// prefer filling nodes that are already split, so large free nodes stay available for large tiles
+			uint32_t half = size / 2;
+			if (state == NodeState::SPLIT) {
+				for (uint32_t pass = 0; pass < 2; pass++) { // split children first, then free ones
+					for (uint32_t i = 0; i < 4; i++) {
+						uint32_t child = 4 * node + 1 + i;
+						if ((pass == 0) != (this->nodes[child] == NodeState::SPLIT)) {
+							continue;
+						}
+						if (Allocate(child, level + 1, x + (i & 1) * half, y + (i >> 1) * half, target_level, tile)) {
+							return true;
+						}
+					}
+				}
+				return false;
+			}
+			this->nodes[node] = NodeState::SPLIT; // children of a free node are all free
+			return Allocate(4 * node + 1, level + 1, x, y, target_level, tile);
+		}
+
+	public:
+		uint32_t atlas_size = 0;
+		uint32_t min_tile_size = 0;
+	private:
+		uint32_t max_level = 0;
+		std::vector<NodeState> nodes;
+	};
+
+	// view matrix of one cube face (+X, -X, +Y, -Y, +Z, -Z), to be used with a 90 degree perspective projection
+	inline glm::mat4 GetCubeFaceViewMatrix(glm::vec3 position, uint32_t face) {
+		static const glm::vec3 directions[6] = {
+			glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+			glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+			glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)
+		};
+		static const glm::vec3 ups[6] = {
+			glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+			glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f),
+			glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)
+		};
+		return glm::lookAt(position, position + directions[face], ups[face]);
+	}
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include <vector>
+#include <array>
+#include <cmath>
+#include <algorithm>
+
+namespace cg {
+
+	struct ShadowCascade {
+		glm::mat4 light_space_matrix;
+		float split_depth; // view space distance of the far end of this cascade
+	};
+
+	// practical split scheme: blend between logarithmic and uniform splits of [near_plane, far_plane]
+	// lambda = 1 is fully logarithmic (best texel distribution), lambda = 0 is fully uniform
+	// returns cascade_count view space distances, the last one is always far_plane
+	inline std::vector<float> CalculateCascadeSplits(uint32_t cascade_count, float near_plane, float far_plane, float lambda) {
+		std::vector<float> splits(cascade_count);
+		float ratio = far_plane / near_plane;
+		float range = far_plane - near_plane;
+		for (uint32_t i = 0; i < cascade_count; i++) {
+			float p = (i + 1) / static_cast<float>(cascade_count);
+			float log_split = near_plane * std::pow(ratio, p);
+			float uniform_split = near_plane + range * p;
+			splits[i] = lambda * log_split + (1.0f - lambda) * uniform_split;
+		}
+		return splits;
+	}
+
+	// fit one orthographic light projection around each cascade's slice of the camera frustum.
+	// view and proj are the camera matrices, proj built with camera_near and camera_far.
+	// The slice is wrapped in a bounding sphere so the projection size does not change when the camera rotates, and the projection
+	// is snapped to whole shadow map texels so shadows of static objects don't shimmer when the camera moves.
+	// caster_margin pulls the light back so that casters outside of the slice (but between it and the light) still land in the map
+	inline std::vector<ShadowCascade> FitCascades(glm::mat4 view, glm::mat4 proj, float camera_near, float camera_far, std::vector<float>& splits,
+		glm::vec3 light_dir, uint32_t shadow_map_resolution, float caster_margin) {
+		// frustum corners in world space, depth is zero to one
+		glm::mat4 inv_view_proj = glm::inverse(proj * view);
+		std::array<glm::vec3, 8> frustum_corners;
+		uint32_t idx = 0;
+		for (float z : {0.0f, 1.0f}) {
+			for (float y : {-1.0f, 1.0f}) {
+				for (float x : {-1.0f, 1.0f}) {
+					glm::vec4 corner = inv_view_proj * glm::vec4(x, y, z, 1.0f);
+					frustum_corners[idx++] = glm::vec3(corner) / corner.w;
+				}
+			}
+		}
+
+		light_dir = glm::normalize(light_dir);
+		glm::vec3 up = (std::abs(light_dir.y) > 0.99f) ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+
+		std::vector<ShadowCascade> cascades(splits.size());
+		float last_split = camera_near;
+		for (uint32_t i = 0; i < splits.size(); i++) {
+			// corners of this slice, positions along each frustum edge are linear in view depth
+			float t_near = (last_split - camera_near) / (camera_far - camera_near);
+			float t_far = (splits[i] - camera_near) / (camera_far - camera_near);
+			std::array<glm::vec3, 8> slice_corners;
+			for (uint32_t j = 0; j < 4; j++) {
+				glm::vec3 edge = frustum_corners[j + 4] - frustum_corners[j];
+				slice_corners[j] = frustum_corners[j] + edge * t_near;
+				slice_corners[j + 4] = frustum_corners[j] + edge * t_far;
+			}
+
+			glm::vec3 center = glm::vec3(0.0f);
+			for (glm::vec3& corner : slice_corners) {
+				center += corner;
+			}
+			center /= 8.0f;
+			float radius = 0.0f;
+			for (glm::vec3& corner : slice_corners) {
+				radius = std::max(radius, glm::length(corner - center));
+			}
+			radius = std::ceil(radius * 16.0f) / 16.0f; // quantize so that small numerical changes don't resize the cascade
+
+			glm::mat4 light_view = glm::lookAt(center - light_dir * (radius + caster_margin), center, up);
+			glm::mat4 light_proj = glm::ortho(-radius, radius, -radius, radius, 0.0f, 2.0f * radius + caster_margin);
+
+			// snap the projection so that the world origin always falls on a texel corner
+			glm::vec4 shadow_origin = light_proj * light_view * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+			shadow_origin *= shadow_map_resolution / 2.0f;
+			glm::vec4 rounded_origin = glm::round(shadow_origin);
+			glm::vec4 rounded_offset = (rounded_origin - shadow_origin) * (2.0f / shadow_map_resolution);
+			light_proj[3][0] += rounded_offset.x;
+			light_proj[3][1] += rounded_offset.y;
+
+			cascades[i].light_space_matrix = light_proj * light_view;
+			cascades[i].split_depth = splits[i];
+			last_split = splits[i];
+		}
+		return cascades;
+	}
+}
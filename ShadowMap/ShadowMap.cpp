@@ -1,12 +1,18 @@
 #include "BaseDemo.h"
 #include "glm/glm.hpp"
 #include "VulkanHelper.h"
+#include "VulkanCpuProfiler.h"
 #include "VulkanCompositeBuffer.h"
 #include "VulkanGraphicPipeline.h"
+#include "VulkanBindlessTable.h"
 #include "glm\gtx\transform.hpp"
 #include "Light.h"
+#include "ShadowCascade.h"
+#include "ShadowAtlas.h"
 #include <array>
 #include <chrono>
+#include <algorithm>
+#include <cstring>
 
 struct PerObject {
 	alignas(16) glm::mat4 model_matrix;
@@ -18,8 +24,55 @@ struct PerCamera {
 	alignas(16) glm::mat4 proj;
 };
 
+// packed descriptors of draw_update_template, one member per binding in binding order
+struct DrawDescriptors {
+	VkDescriptorBufferInfo per_camera;
+	VkDescriptorBufferInfo per_object;
+	VkDescriptorBufferInfo per_light;
+	VkDescriptorBufferInfo light;
+	VkDescriptorBufferInfo atlas_lights;
+};
+
+// handles of bindless_table read by the draw fragment shaders, pushed as constants
+struct BindlessIndices {
+	uint32_t shadow_map;
+	uint32_t shadow_atlas;
+	uint32_t shadow_sampler;
+};
+
+const uint32_t num_cascades = 4;
+
 struct PerLight {
-	alignas(16) glm::mat4  light_space_matrix;
+	alignas(16) glm::mat4 light_space_matrices[num_cascades];
+	alignas(16) glm::vec4 cascade_splits; // view space far distance of each cascade
+};
+
+const uint32_t max_atlas_lights = 24; // keeps AtlasLights under the 16KB guaranteed uniform buffer range
+
+struct AtlasLight {
+	alignas(16) glm::vec4 position_world; // w is the radius of influence
+	alignas(16) glm::vec4 position_eye; // w is 1 when the light has shadow tiles in the atlas
+	alignas(16) glm::vec4 color;
+	alignas(16) glm::mat4 face_matrices[6]; // projectionMat * view mat of each cube face
+	alignas(16) glm::vec4 tile_rects[6]; // xy offset, zw extent in normalized atlas coordinates
+};
+
+struct AtlasLights {
+	alignas(16) glm::uvec4 count; // x is the number of lights
+	AtlasLight lights[max_atlas_lights];
+};
+
+// kernels of shaders/shadow_filter.glsl, selected through specialization constants
+enum ShadowFilter : uint32_t {
+	SHADOW_FILTER_HARDWARE_PCF = 0, // 1 tap, 2x2 bilinear PCF done by the comparison sampler
+	SHADOW_FILTER_OPTIMIZED_PCF = 1, // 9 taps covering a 5x5 tent
+	SHADOW_FILTER_POISSON = 2, // poisson_taps taps rotated per pixel
+};
+
+struct ShadowFilterConstants {
+	uint32_t filter;
+	uint32_t poisson_taps;
+	float filter_radius; // in texels, poisson only
 };
 
 struct UBOData {
@@ -123,6 +176,21 @@ const std::vector<PerObject> objects_data = { // 6 matrices
 
 const uint32_t num_cubes = 6;
 
+// point lights that cast shadows through the shadow atlas: position, color
+const std::vector<std::pair<glm::vec3, glm::vec3>> atlas_point_lights = {
+	{glm::vec3(3.0f, 2.0f, 2.0f), glm::vec3(0.6f, 0.2f, 0.2f)},
+	{glm::vec3(-3.0f, 2.0f, -2.0f), glm::vec3(0.2f, 0.6f, 0.2f)},
+	{glm::vec3(-3.0f, 2.0f, 3.0f), glm::vec3(0.2f, 0.2f, 0.6f)},
+	{glm::vec3(4.0f, 1.0f, -4.0f), glm::vec3(0.6f, 0.6f, 0.2f)},
+	{glm::vec3(0.0f, 3.0f, -7.0f), glm::vec3(0.2f, 0.6f, 0.6f)},
+	{glm::vec3(-8.0f, 1.0f, 2.0f), glm::vec3(0.6f, 0.2f, 0.6f)},
+	{glm::vec3(8.0f, 1.0f, 4.0f), glm::vec3(0.4f, 0.4f, 0.4f)},
+	{glm::vec3(2.0f, -2.0f, 10.0f), glm::vec3(0.6f, 0.4f, 0.2f)},
+};
+
+// static objects are rendered once into the shadow cache, the rest are rendered into the shadow map every frame
+const std::vector<bool> is_static_object = { true, true, true, true, true, false, true }; // the cyan cube moves
+
 class ShadowMapDemo : public BaseDemo {
 private:
 	UBOData per_object_data;
@@ -132,10 +200,17 @@ private:
 	vk::VulkanCompositeBuffer wall_index_buffer;
 	VkDescriptorSetLayout depth_descriptor_set_layout;
 	VkDescriptorSetLayout draw_descriptor_set_layout;
+	vk::VulkanDescriptorUpdateTemplate draw_update_template;
 	VkSampler sampler;
+	VkSampler shadow_sampler; // comparison sampler for the shadow map and the atlas
+	// the shadow map and the atlas are sampled through the bindless table instead of fixed bindings of the draw set
+	vk::VulkanBindlessTable bindless_table;
+	std::vector<uint32_t> shadow_map_handles;
+	uint32_t atlas_handle;
+	uint32_t shadow_sampler_handle;
 	std::vector<vk::VulkanCompositeImage> depth_attachments;
 	VkRenderPass depth_renderpass;
-	std::vector<VkFramebuffer> depth_framebuffers;
+	std::vector<std::vector<VkFramebuffer>> depth_framebuffers; // one framebuffer per cascade layer
 	VkPipelineLayout depth_pipeline_layout;
 	VkPipelineLayout draw_pipeline_layout;
 	VkPipeline depth_pipeline;
@@ -144,13 +219,57 @@ private:
 	std::vector<vk::VulkanCompositeBuffer> per_object_uniform_buffers;
 	std::vector<vk::VulkanCompositeBuffer> per_light_uniform_buffers;
 	std::vector<vk::VulkanCompositeBuffer> per_camera_uniform_buffers;
-	VkDescriptorPool descriptor_pool;
 	std::vector<VkDescriptorSet> depth_descriptor_sets;
 	std::vector<VkDescriptorSet> draw_descriptor_sets;
 	std::vector<VkCommandBuffer> offscreen_draw_cmd_buffers;
 
-	const static int offscreen_framebuffer_width = 2048;
-	const static int offscreen_framebuffer_height = 2048;
+	// shadow cache: depth of the static objects, copied into depth_attachments[i] each frame before the dynamic objects are drawn on top
+	vk::VulkanCompositeImage static_depth_attachment;
+	VkRenderPass static_depth_renderpass;
+	std::vector<VkFramebuffer> static_depth_framebuffers; // one framebuffer per cascade layer
+	vk::VulkanCompositeBuffer static_per_light_uniform_buffer;
+	vk::VulkanCompositeBuffer static_per_object_uniform_buffer;
+	VkDescriptorSet static_depth_descriptor_set;
+	VkCommandBuffer static_shadow_cmd_buffer;
+	PerLight cached_per_light = {}; // light matrices the shadow cache was rendered with
+	bool static_shadow_dirty = true;
+	uint64_t static_shadow_value = 0; // value of queues[0].timeline signaled by the last rebuild of the shadow cache
+	bool has_dynamic_casters;
+	VkImageAspectFlags depth_barrier_aspect;
+
+	// shadow atlas: each point light gets 6 tiles of one depth image shared by all lights, all dirty tiles are rendered in one renderpass
+	cg::ShadowAtlas shadow_atlas;
+	std::vector<cg::ShadowAtlasEntry> atlas_entries;
+	AtlasLights atlas_lights;
+	vk::VulkanCompositeImage atlas_attachment;
+	VkRenderPass atlas_renderpass;
+	VkFramebuffer atlas_framebuffer;
+	VkPipelineLayout atlas_pipeline_layout;
+	VkPipeline atlas_pipeline;
+	std::vector<VkCommandBuffer> atlas_cmd_buffers; // one per frame in flight, re-recorded whenever some tiles are dirty
+	std::vector<vk::VulkanCompositeBuffer> atlas_light_uniform_buffers;
+	bool atlas_initialized; // the atlas image still has to be moved out of the undefined layout
+
+	// 4 cascades of 1024 * 1024 take the same memory as the single 2048 * 2048 map they replace
+	const static int offscreen_framebuffer_width = 1024;
+	const static int offscreen_framebuffer_height = 1024;
+
+	const static bool show_shadow_map = false; // draw the first cascade of the shadow map on screen instead of the scene
+	// wider kernels hide the texels of a lower resolution shadow map, trading shadow map memory bandwidth for filter taps
+	const static uint32_t shadow_filter = SHADOW_FILTER_OPTIMIZED_PCF;
+	const static uint32_t poisson_taps = 16; // at most 16
+	constexpr static float filter_radius = 1.5f;
+	constexpr static float camera_near = 0.1f;
+	constexpr static float camera_far = 1000.0f;
+	constexpr static float shadow_distance = 50.0f; // cascades cover the view frustum from camera_near up to here
+	constexpr static float cascade_split_lambda = 0.95f;
+	constexpr static float shadow_caster_margin = 50.0f;
+	constexpr static float camera_fov = 45.0f;
+
+	const static uint32_t atlas_size = 4096;
+	const static uint32_t max_atlas_tile_size = 512;
+	const static uint32_t min_atlas_tile_size = 64;
+	constexpr static float atlas_light_radius = 12.0f;
 public:
 
 	const char* GetWindowTitle() override {
@@ -180,14 +299,23 @@ public:
 		return false;
 	}
 
+	bool IsDeviceSuitable(VkPhysicalDevice physical_device) override {
+		return vk::VulkanBindlessTable::IsSupported(physical_device);
+	}
+
+	VkPhysicalDeviceVulkan12Features GetVulkan12Features() override {
+		VkPhysicalDeviceVulkan12Features features = BaseDemo::GetVulkan12Features();
+		vk::VulkanBindlessTable::EnableRequiredFeatures(features);
+		return features;
+	}
+
 
 	void Draw() override {
 		// wait for a previous iteration of the current frame to complete
-		vkWaitForFences(this->logical_device, 1, &this->cmdbuffers_inflight[this->current_frame], VK_TRUE, UINT64_MAX);
+		WaitForFrameSlot();
 
 		uint32_t image_index;
-		VkResult result = vkAcquireNextImageKHR(this->logical_device, this->vulkan_swap_chain.swap_chain, UINT64_MAX,
-			this->image_available_semaphores[this->current_frame], VK_NULL_HANDLE, &image_index);
+		VkResult result = AcquireNextImage(&image_index);
 		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
 			RecreateSwapChain();
 			return;
@@ -197,26 +325,31 @@ public:
 		}
 		UpdateUniformBufferData(image_index);
 
-		// Check if a previous frame is using this image (i.e. there is its fence to wait on)
-		if (this->images_inflight[image_index] != VK_NULL_HANDLE) {
-			vkWaitForFences(this->logical_device, 1, &this->images_inflight[image_index], VK_TRUE, UINT64_MAX);
+		// Check if a previous frame is using this image (i.e. there is its timeline value to wait on)
+		if (this->images_inflight[image_index] != 0) {
+			WaitUntil(this->queues[0].timeline, this->images_inflight[image_index]);
 		}
-		this->images_inflight[image_index] = this->cmdbuffers_inflight[this->current_frame]; // set the image as being used by the current frame
-		vkResetFences(this->logical_device, 1, &this->cmdbuffers_inflight[current_frame]); // reset fence back to unsignal states so that later frames will have to wait
 
 		// submit offscreen cmd buffers
-		std::vector<VkSemaphore> offscreen_wait_semaphores;
-		std::vector<VkPipelineStageFlags> offscreen_wait_stages;
+		if (this->static_shadow_dirty) {
+			SubmitStaticShadowCmdBuffer();
+		}
+		SubmitAtlasCmdBuffer(image_index);
+		std::vector<vk::SemaphoreWait> offscreen_waits;
+		std::vector<VkCommandBuffer> offscreen_cmd_buffers = { this->offscreen_draw_cmd_buffers[image_index] };
 		std::vector<VkSemaphore> offscreen_signal_semaphores;
-		this->queues[0].SubmitSingleCmdBuffer(offscreen_wait_semaphores, offscreen_wait_stages,
-			this->offscreen_draw_cmd_buffers[image_index], offscreen_signal_semaphores, VK_NULL_HANDLE);
+		uint64_t offscreen_value = this->queues[0].Submit(offscreen_waits, offscreen_cmd_buffers, offscreen_signal_semaphores);
 
-		//submit draw cmd buffers
-		std::vector<VkSemaphore> wait_semaphores = { this->image_available_semaphores[this->current_frame] };
-		std::vector<VkPipelineStageFlags> wait_stages = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+		//submit draw cmd buffers, the shadow maps of every offscreen submission above are sampled in the fragment shader
+		std::vector<vk::SemaphoreWait> waits = {
+			{ this->image_available_semaphores[this->current_frame], 0, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT },
+			this->queues[0].timeline.WaitFor(offscreen_value, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT)
+		};
+		std::vector<VkCommandBuffer> cmd_buffers = { this->draw_cmd_buffers[image_index] };
 		std::vector<VkSemaphore> signal_semaphores = { this->render_finished_semaphores[this->current_frame] };
-		this->queues[0].SubmitSingleCmdBuffer(wait_semaphores, wait_stages, this->draw_cmd_buffers[image_index],
-			signal_semaphores, this->cmdbuffers_inflight[this->current_frame]);
+		uint64_t frame_value = this->queues[0].Submit(waits, cmd_buffers, signal_semaphores);
+		this->frames_inflight[this->current_frame] = frame_value;
+		this->images_inflight[image_index] = frame_value; // set the image as being used by the current frame
 		result = this->queues[0].PresentImage(signal_semaphores, this->vulkan_swap_chain.swap_chain, image_index);
 		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || this->framebuffer_resized) {
 			this->framebuffer_resized = false;
@@ -229,42 +362,84 @@ public:
 	}
 
 	void CreatePermanentResources() override {
+		this->shadow_atlas = cg::ShadowAtlas(atlas_size, min_atlas_tile_size);
+		this->atlas_entries.resize(atlas_point_lights.size());
 		CreateUboDataArrays();
 		CreateVertexAndIndexBuffers();
 		CreateDescriptorSetLayouts();
 		CreateTextureSampler();
+		CreateShadowSampler();
+		this->bindless_table.Create(this->physical_device, this->logical_device);
+		// the debug view reads raw depth values, the scene compares against them
+		this->shadow_sampler_handle = this->bindless_table.AddSampler(show_shadow_map ? this->sampler : this->shadow_sampler);
+		RegisterShaderReloads();
+	}
+
+	void RegisterShaderReloads() {
+		RegisterShaderReload({ "shaders/depth_vert.spv", "shaders/atlas_depth_vert.spv", "shaders/depth_frag.spv" },
+			[this]() { CleanupDepthPipelines(); }, [this]() { CreateDepthPipelines(); });
+		RegisterShaderReload({ "shaders/shadow_map_vert.spv", "shaders/shadow_map_frag.spv", "shaders/debug_vert.spv", "shaders/debug_frag.spv" },
+			[this]() { CleanupDrawPipeline(); }, [this]() { CreateDrawPipeline(); });
+	}
+
+	// the command buffers are recorded once with the pipelines, record them again with the rebuilt ones. The atlas is recorded every frame
+	void OnShadersReloaded() override {
+		vkFreeCommandBuffers(this->logical_device, this->command_pool, static_cast<uint32_t>(this->draw_cmd_buffers.size()), this->draw_cmd_buffers.data());
+		vkFreeCommandBuffers(this->logical_device, this->command_pool, static_cast<uint32_t>(this->offscreen_draw_cmd_buffers.size()), this->offscreen_draw_cmd_buffers.data());
+		vkFreeCommandBuffers(this->logical_device, this->command_pool, 1, &this->static_shadow_cmd_buffer);
+		CreateStaticShadowCmdBuffer();
+		CreateOffscreenDrawCmdBuffers();
+		CreateDrawCmdBuffers();
+		// depth shaders may have changed, the cached and atlas shadows are rendered again
+		this->static_shadow_dirty = true;
+		for (cg::ShadowAtlasEntry& entry : this->atlas_entries) {
+			entry.dirty = true;
+		}
 	}
 
 	void CleanupPermanentResources() override {
+		this->bindless_table.Destroy();
+		vkDestroySampler(this->logical_device, this->shadow_sampler, nullptr);
 		vkDestroySampler(this->logical_device, this->sampler, nullptr);
-		CleanupDescriptorSetLayouts();
+		this->draw_update_template.Destroy();
 		CleanupVertexAndIndexBuffers();
 		CleanupUboDataArrays();
 	}
 
 	void CreateNonPermanentResources() override {
 		CreateAttachments();
-		CreateDepthRenderpass();
+		CreateDepthRenderpasses();
 		CreateFramebuffers();
 		CreatePipelines();
 		CreateUniformBuffers();
-		CreateDescriptorPool();
 		CreateDescriptorSets();
+		CreateStaticShadowCmdBuffer();
 		CreateOffscreenDrawCmdBuffers();
 		CreateDrawCmdBuffers();
+		this->atlas_cmd_buffers.resize(MAX_FRAMES_INFLIGHT);
+		vk::init::CreateCmdBuffer(this->logical_device, this->command_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, MAX_FRAMES_INFLIGHT, this->atlas_cmd_buffers.data());
+		this->static_shadow_dirty = true; // the cache image was just recreated
+		// the atlas image was just recreated, every tile has to be rendered again
+		this->atlas_initialized = false;
+		for (cg::ShadowAtlasEntry& entry : this->atlas_entries) {
+			entry.dirty = true;
+		}
 	}
 
 	void CleanupNonPermanentResources() override {
 		vkFreeCommandBuffers(this->logical_device, this->command_pool, static_cast<uint32_t>(this->draw_cmd_buffers.size()), this->draw_cmd_buffers.data());
 		vkFreeCommandBuffers(this->logical_device, this->command_pool, static_cast<uint32_t>(this->offscreen_draw_cmd_buffers.size()), this->offscreen_draw_cmd_buffers.data());
-		vkDestroyDescriptorPool(this->logical_device, this->descriptor_pool, nullptr);
+		vkFreeCommandBuffers(this->logical_device, this->command_pool, 1, &this->static_shadow_cmd_buffer);
+		vkFreeCommandBuffers(this->logical_device, this->command_pool, static_cast<uint32_t>(this->atlas_cmd_buffers.size()), this->atlas_cmd_buffers.data());
 		CleanupUniformBuffers();
 		CleanupPipelines();
 		CleanupFramebuffers();
 		CleanupRenderpass();
+		for (uint32_t handle : this->shadow_map_handles) {
+			this->bindless_table.Free(vk::BindlessResourceType::SAMPLED_IMAGE, handle);
+		}
+		this->bindless_table.Free(vk::BindlessResourceType::SAMPLED_IMAGE, this->atlas_handle);
 		CleanupAttachments();
-		
-		
 	}
 
 	void CreateVertexAndIndexBuffers() {
@@ -302,25 +477,14 @@ public:
 		this->wall_index_buffer.CreateBuffer(this->logical_device, this->physical_device, wall_index_buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
 			VK_SHARING_MODE_EXCLUSIVE, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-		// create fences
-		VkFence transfer_finished_fences[4];
-		vk::init::CreateFence(this->logical_device, 0, &transfer_finished_fences[0]); // create fence in unsignaled state
-		vk::init::CreateFence(this->logical_device, 0, &transfer_finished_fences[1]); // create fence in unsignaled state
-		vk::init::CreateFence(this->logical_device, 0, &transfer_finished_fences[2]); // create fence in unsignaled state
-		vk::init::CreateFence(this->logical_device, 0, &transfer_finished_fences[3]); // create fence in unsignaled state
-
-		this->cube_vertex_buffer.TransferFromAnotherBuffer(cube_staging_vertex_buffer, this->command_pool, 0, 0, cube_vertex_buffer_size, this->queues[0], transfer_finished_fences[0]);
-		this->cube_index_buffer.TransferFromAnotherBuffer(cube_staging_index_buffer, this->command_pool, 0, 0, cube_index_buffer_size, this->queues[0], transfer_finished_fences[1]);
-		this->wall_vertex_buffer.TransferFromAnotherBuffer(wall_staging_vertex_buffer, this->command_pool, 0, 0, wall_vertex_buffer_size, this->queues[0], transfer_finished_fences[2]);
-		this->wall_index_buffer.TransferFromAnotherBuffer(wall_staging_index_buffer, this->command_pool, 0, 0, wall_index_buffer_size, this->queues[0], transfer_finished_fences[3]);
+		this->cube_vertex_buffer.TransferFromAnotherBuffer(cube_staging_vertex_buffer, this->command_pool, 0, 0, cube_vertex_buffer_size, this->queues[0]);
+		this->cube_index_buffer.TransferFromAnotherBuffer(cube_staging_index_buffer, this->command_pool, 0, 0, cube_index_buffer_size, this->queues[0]);
+		this->wall_vertex_buffer.TransferFromAnotherBuffer(wall_staging_vertex_buffer, this->command_pool, 0, 0, wall_vertex_buffer_size, this->queues[0]);
+		uint64_t transfers_finished = this->wall_index_buffer.TransferFromAnotherBuffer(wall_staging_index_buffer, this->command_pool, 0, 0, wall_index_buffer_size, this->queues[0]);
+		// the last value of the queue also covers the transfers submitted before it
+		this->queues[0].timeline.WaitUntil(transfers_finished);
 
-		vkWaitForFences(this->logical_device, 4, transfer_finished_fences, VK_TRUE, UINT64_MAX);
-
-		//cleanup fences and staging buffers
-		vkDestroyFence(this->logical_device, transfer_finished_fences[0], nullptr);
-		vkDestroyFence(this->logical_device, transfer_finished_fences[1], nullptr);
-		vkDestroyFence(this->logical_device, transfer_finished_fences[2], nullptr);
-		vkDestroyFence(this->logical_device, transfer_finished_fences[3], nullptr);
+		//cleanup staging buffers
 
 		wall_staging_index_buffer.DestroyBuffer();
 		wall_staging_vertex_buffer.DestroyBuffer();
@@ -340,21 +504,17 @@ public:
 			vk::init::CreateDescriptorSetLayoutBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT),
 			vk::init::CreateDescriptorSetLayoutBinding(1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT),
 		};
-		vk::init::CreateDescriptorSetLayout(this->logical_device, depth_layout_bindings, &this->depth_descriptor_set_layout);
+		this->depth_descriptor_set_layout = this->descriptor_layout_cache.CreateDescriptorSetLayout(depth_layout_bindings);
 
 		std::vector<VkDescriptorSetLayoutBinding> draw_layout_bindings = {
 			vk::init::CreateDescriptorSetLayoutBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT),
 			vk::init::CreateDescriptorSetLayoutBinding(1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT),
-			vk::init::CreateDescriptorSetLayoutBinding(2, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT),
+			vk::init::CreateDescriptorSetLayoutBinding(2, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT),
 			vk::init::CreateDescriptorSetLayoutBinding(3, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT),
-			vk::init::CreateDescriptorSetLayoutBinding(4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT)
+			vk::init::CreateDescriptorSetLayoutBinding(5, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT)
 		};
-		vk::init::CreateDescriptorSetLayout(this->logical_device, draw_layout_bindings, &this->draw_descriptor_set_layout);
-	}
-
-	void CleanupDescriptorSetLayouts() {
-		vkDestroyDescriptorSetLayout(this->logical_device, this->draw_descriptor_set_layout, nullptr);
-		vkDestroyDescriptorSetLayout(this->logical_device, this->depth_descriptor_set_layout, nullptr);
+		this->draw_descriptor_set_layout = this->descriptor_layout_cache.CreateDescriptorSetLayout(draw_layout_bindings);
+		this->draw_update_template.Create(this->logical_device, this->draw_descriptor_set_layout, draw_layout_bindings);
 	}
 
 	void CreateTextureSampler() {
@@ -376,6 +536,27 @@ public:
 		}
 	}
 
+	void CreateShadowSampler() {
+		VkSamplerCreateInfo create_info = {};
+		create_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		create_info.magFilter = VK_FILTER_LINEAR; // linear filtering on a comparison sampler gives 2x2 PCF for free
+		create_info.minFilter = VK_FILTER_LINEAR;
+		create_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		create_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER; // outside of the map is lit
+		create_info.addressModeV = create_info.addressModeU;
+		create_info.addressModeW = create_info.addressModeU;
+		create_info.mipLodBias = 0.0f;
+		create_info.maxAnisotropy = 1.0f;
+		create_info.compareEnable = VK_TRUE;
+		create_info.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL; // returns 1 when the reference depth is not behind the stored depth
+		create_info.minLod = 0.0f;
+		create_info.maxLod = 0.0f;
+		create_info.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+		if (vkCreateSampler(this->logical_device, &create_info, nullptr, &this->shadow_sampler) != VK_SUCCESS) {
+			throw std::runtime_error("fail to create shadow sampler");
+		}
+	}
+
 	void CreateAttachments() {
 		VkImageCreateInfo depth_create_info = {};
 		depth_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -383,32 +564,62 @@ public:
 		depth_create_info.format = vk::GetSupportedDepthFormat(this->physical_device);
 		depth_create_info.extent = { this->offscreen_framebuffer_width, this->offscreen_framebuffer_height, 1 };
 		depth_create_info.mipLevels = 1;
-		depth_create_info.arrayLayers = 1;
+		depth_create_info.arrayLayers = num_cascades; // all cascades live in one layered image
 		depth_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
 		depth_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
-		depth_create_info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		depth_create_info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 		this->depth_attachments.resize(this->vulkan_swap_chain.image_count);
 		for (uint32_t i = 0; i < this->depth_attachments.size(); i++) {
 			this->depth_attachments[i].Create(this->physical_device, this->logical_device, depth_create_info, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_ASPECT_DEPTH_BIT);
+			this->depth_attachments[i].CreateLayerImageViews(VK_IMAGE_ASPECT_DEPTH_BIT);
 		}
+
+		depth_create_info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		this->static_depth_attachment.CreateImage(this->physical_device, this->logical_device, depth_create_info, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		this->static_depth_attachment.CreateLayerImageViews(VK_IMAGE_ASPECT_DEPTH_BIT);
+
+		VkImageCreateInfo atlas_create_info = depth_create_info;
+		atlas_create_info.extent = { atlas_size, atlas_size, 1 };
+		atlas_create_info.arrayLayers = 1;
+		atlas_create_info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		this->atlas_attachment.Create(this->physical_device, this->logical_device, atlas_create_info, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_ASPECT_DEPTH_BIT);
+
+		// layout transitions of a combined depth stencil image must include the stencil aspect
+		VkFormat format = depth_create_info.format;
+		bool has_stencil = format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D16_UNORM_S8_UINT;
+		this->depth_barrier_aspect = has_stencil ? (VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT) : VK_IMAGE_ASPECT_DEPTH_BIT;
 	}
 
 	void CleanupAttachments() {
+		this->atlas_attachment.Destroy();
+		this->static_depth_attachment.Destroy();
 		for (uint32_t i = 0; i < this->depth_attachments.size(); i++) {
 			this->depth_attachments[i].Destroy();
 		}
 	}
 
-	void CreateDepthRenderpass() {
+	void CreateDepthRenderpasses() {
+		// the shadow cache is cleared and rendered from scratch, then only ever copied from
+		CreateDepthRenderpass(VK_ATTACHMENT_LOAD_OP_CLEAR, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, &this->static_depth_renderpass);
+		// the per frame shadow map starts from a copy of the cache and ends up being sampled by the draw pass
+		CreateDepthRenderpass(VK_ATTACHMENT_LOAD_OP_LOAD, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, &this->depth_renderpass);
+		// the atlas keeps the tiles that are not re-rendered, dirty tiles are cleared one by one inside the renderpass
+		CreateDepthRenderpass(VK_ATTACHMENT_LOAD_OP_LOAD, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, &this->atlas_renderpass);
+	}
+
+	void CreateDepthRenderpass(VkAttachmentLoadOp load_op, VkImageLayout initial_layout, VkImageLayout final_layout, VkRenderPass* renderpass) {
 		VkAttachmentDescription depth_attachment_desc = {};
 		depth_attachment_desc.format = this->depth_attachments[0].format;
 		depth_attachment_desc.samples = VK_SAMPLE_COUNT_1_BIT;
-		depth_attachment_desc.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		depth_attachment_desc.loadOp = load_op;
 		depth_attachment_desc.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 		depth_attachment_desc.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		depth_attachment_desc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		depth_attachment_desc.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		depth_attachment_desc.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		depth_attachment_desc.initialLayout = initial_layout;
+		depth_attachment_desc.finalLayout = final_layout;
+		bool copy_in = initial_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		bool load = load_op == VK_ATTACHMENT_LOAD_OP_LOAD;
+		bool copy_out = final_layout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
 
 		VkAttachmentReference depth_ref = { 0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
 
@@ -419,21 +630,23 @@ public:
 		subpass_desc.pDepthStencilAttachment = &depth_ref;
 
 		std::vector<VkSubpassDependency> dependencies = { {}, {} };
+		// previous readers are either the draw pass (fragment shader) or the per frame copies out of the cache (transfer)
+		// when loading, the copy into the attachment has to be visible before depth testing
 		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
 		dependencies[0].dstSubpass = 0;
-		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-		dependencies[0].srcAccessMask = 0;
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+		dependencies[0].srcAccessMask = copy_in ? VK_ACCESS_TRANSFER_WRITE_BIT : 0;
 		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-		dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | (load ? VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT : 0);
 
-		//make sure that subsequent fragment shader stage of after-commands wont start until we have finished writing to the depth attachment
+		//make sure that subsequent fragment shader stage (or copy) of after-commands wont start until we have finished writing to the depth attachment
 		// flush to make sure that the depth_attachment_output's write is visible to the fragment_shader's read. 
 		dependencies[1].srcSubpass = 0;
 		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
 		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
 		dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-		dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		dependencies[1].dstStageMask = copy_out ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		dependencies[1].dstAccessMask = copy_out ? VK_ACCESS_TRANSFER_READ_BIT : VK_ACCESS_SHADER_READ_BIT;
 
 		VkRenderPassCreateInfo create_info = {};
 		create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -444,12 +657,14 @@ public:
 		create_info.dependencyCount = static_cast<uint32_t>(dependencies.size());
 		create_info.pDependencies = dependencies.data();
 
-		if (vkCreateRenderPass(this->logical_device, &create_info, nullptr, &depth_renderpass) != VK_SUCCESS) {
+		if (vkCreateRenderPass(this->logical_device, &create_info, nullptr, renderpass) != VK_SUCCESS) {
 			throw std::runtime_error("fail to create offscreen renderpass");
 		}
 	}
 
 	void CleanupRenderpass() {
+		vkDestroyRenderPass(this->logical_device, this->atlas_renderpass, nullptr);
+		vkDestroyRenderPass(this->logical_device, this->static_depth_renderpass, nullptr);
 		vkDestroyRenderPass(this->logical_device, this->depth_renderpass, nullptr);
 	}
 
@@ -457,26 +672,51 @@ public:
 		std::vector<VkImageView> attachments(1);
 		this->depth_framebuffers.resize(this->vulkan_swap_chain.image_count);
 		for (uint32_t i = 0; i < depth_framebuffers.size(); i++) {
-			attachments[0] = this->depth_attachments[i].image_view;
-			vk::init::CreateFrameBuffer(this->logical_device, this->depth_renderpass, attachments,
-				this->offscreen_framebuffer_width, this->offscreen_framebuffer_height, &this->depth_framebuffers[i]);
+			this->depth_framebuffers[i].resize(num_cascades);
+			for (uint32_t j = 0; j < num_cascades; j++) {
+				attachments[0] = this->depth_attachments[i].layer_views[j];
+				vk::init::CreateFrameBuffer(this->logical_device, this->depth_renderpass, attachments,
+					this->offscreen_framebuffer_width, this->offscreen_framebuffer_height, &this->depth_framebuffers[i][j]);
+			}
 		}
+		this->static_depth_framebuffers.resize(num_cascades);
+		for (uint32_t j = 0; j < num_cascades; j++) {
+			attachments[0] = this->static_depth_attachment.layer_views[j];
+			vk::init::CreateFrameBuffer(this->logical_device, this->static_depth_renderpass, attachments,
+				this->offscreen_framebuffer_width, this->offscreen_framebuffer_height, &this->static_depth_framebuffers[j]);
+		}
+		attachments[0] = this->atlas_attachment.image_view;
+		vk::init::CreateFrameBuffer(this->logical_device, this->atlas_renderpass, attachments, atlas_size, atlas_size, &this->atlas_framebuffer);
 	}
 
 	void CleanupFramebuffers() {
 		for (uint32_t i = 0; i < depth_framebuffers.size(); i++) {
-			vkDestroyFramebuffer(this->logical_device, this->depth_framebuffers[i], nullptr);
+			for (VkFramebuffer framebuffer : this->depth_framebuffers[i]) {
+				vkDestroyFramebuffer(this->logical_device, framebuffer, nullptr);
+			}
 		}
+		for (VkFramebuffer framebuffer : this->static_depth_framebuffers) {
+			vkDestroyFramebuffer(this->logical_device, framebuffer, nullptr);
+		}
+		vkDestroyFramebuffer(this->logical_device, this->atlas_framebuffer, nullptr);
 	}
 
 	void CreatePipelines() {
-		CreateDepthPipeline();
+		CreateDepthPipelines();
 		CreateDrawPipeline();
 	}
 
-	void CreateDepthPipeline() {
-		VkShaderModule vert_shader_module = vk::CreateShaderModule(logical_device, "shaders/depth_vert.spv");
-		VkShaderModule frag_shader_module = vk::CreateShaderModule(logical_device, "shaders/depth_frag.spv");
+	void CreateDepthPipelines() {
+		// cascades: fixed viewport covering one layer, cascade index as push constant
+		CreateDepthPipeline("shaders/depth_vert.spv", this->depth_renderpass, sizeof(uint32_t), false, &this->depth_pipeline_layout, &this->depth_pipeline);
+		// atlas: viewport set per tile, light space matrix of the tile as push constant
+		CreateDepthPipeline("shaders/atlas_depth_vert.spv", this->atlas_renderpass, sizeof(glm::mat4), true, &this->atlas_pipeline_layout, &this->atlas_pipeline);
+	}
+
+	void CreateDepthPipeline(const char* vert_shader_path, VkRenderPass renderpass, uint32_t push_constant_size, bool dynamic_viewport,
+		VkPipelineLayout* pipeline_layout, VkPipeline* pipeline) {
+		VkShaderModule vert_shader_module = this->shader_library.Get(vert_shader_path);
+		VkShaderModule frag_shader_module = this->shader_library.Get("shaders/depth_frag.spv");
 
 		VkPipelineShaderStageCreateInfo vert_shader_create_info = vk::CreateShaderStageCreateInfo(vert_shader_module, VK_SHADER_STAGE_VERTEX_BIT);
 		VkPipelineShaderStageCreateInfo frag_shader_create_info = vk::CreateShaderStageCreateInfo(frag_shader_module, VK_SHADER_STAGE_FRAGMENT_BIT);
@@ -517,9 +757,15 @@ public:
 
 		VkPipelineColorBlendStateCreateInfo color_blend_state = vk::CreateColorBlendStateCreateInfo(false, blend_attachment_states);
 
-		std::vector<VkPushConstantRange> constant_ranges;
+		std::vector<VkPushConstantRange> constant_ranges = { {VK_SHADER_STAGE_VERTEX_BIT, 0, push_constant_size} };
 		std::vector<VkDescriptorSetLayout> descriptor_set_layouts = { this->depth_descriptor_set_layout };
-		vk::CreatePipelineLayout(this->logical_device, descriptor_set_layouts, constant_ranges, &this->depth_pipeline_layout);
+		vk::CreatePipelineLayout(this->logical_device, descriptor_set_layouts, constant_ranges, pipeline_layout);
+
+		std::vector<VkDynamicState> dynamic_states = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+		VkPipelineDynamicStateCreateInfo dynamic_state_info = {};
+		dynamic_state_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		dynamic_state_info.dynamicStateCount = static_cast<uint32_t>(dynamic_states.size());
+		dynamic_state_info.pDynamicStates = dynamic_states.data();
 
 		VkGraphicsPipelineCreateInfo pipeline_info = {};
 		pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
@@ -532,31 +778,55 @@ public:
 		pipeline_info.pMultisampleState = &multisample;
 		pipeline_info.pDepthStencilState = &depth_stencil; // optional
 		pipeline_info.pColorBlendState = &color_blend_state;
-		pipeline_info.pDynamicState = nullptr; // optional
-		pipeline_info.layout = this->depth_pipeline_layout; 
+		pipeline_info.pDynamicState = dynamic_viewport ? &dynamic_state_info : nullptr;
+		pipeline_info.layout = *pipeline_layout;
 		pipeline_info.subpass = 0;
 		pipeline_info.basePipelineHandle = nullptr; // optional
 		pipeline_info.basePipelineIndex = -1; // optional
 
-		pipeline_info.renderPass = this->depth_renderpass;
+		pipeline_info.renderPass = renderpass;
 
-		if (vkCreateGraphicsPipelines(this->logical_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &this->depth_pipeline) != VK_SUCCESS) {
-			throw std::runtime_error("fail to create draw graphic pipeline");
+		if (vkCreateGraphicsPipelines(this->logical_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, pipeline) != VK_SUCCESS) {
+			throw std::runtime_error("fail to create depth graphic pipeline");
 		}
+	}
 
-		vkDestroyShaderModule(this->logical_device, frag_shader_module, nullptr);
-		vkDestroyShaderModule(this->logical_device, vert_shader_module, nullptr);
+	// the archive also holds shadow_map.frag with each pcf filter frozen in (shaders/shaders.json), so spirv-opt removed the other kernels.
+	// The hot reload only compiles the generic module, which is used while the reload is on
+	const char* GetShadowMapFragPath() {
+		const char* variant_path = nullptr;
+		if (shadow_filter == SHADOW_FILTER_HARDWARE_PCF) {
+			variant_path = "shaders/shadow_map_frag_hardware_pcf.spv";
+		}
+		else if (shadow_filter == SHADOW_FILTER_OPTIMIZED_PCF) {
+			variant_path = "shaders/shadow_map_frag_optimized_pcf.spv";
+		}
+		if (SHADER_HOT_RELOAD_ENABLED || variant_path == nullptr || !this->shader_library.IsArchived(variant_path)) {
+			return "shaders/shadow_map_frag.spv";
+		}
+		return variant_path;
 	}
 
 	void CreateDrawPipeline() {
-		VkShaderModule vert_shader_module = vk::CreateShaderModule(logical_device, "shaders/debug_vert.spv");
-		VkShaderModule frag_shader_module = vk::CreateShaderModule(logical_device, "shaders/debug_frag.spv");
+		VkShaderModule vert_shader_module = this->shader_library.Get(show_shadow_map ? "shaders/debug_vert.spv" : "shaders/shadow_map_vert.spv");
+		VkShaderModule frag_shader_module = this->shader_library.Get(show_shadow_map ? "shaders/debug_frag.spv" : GetShadowMapFragPath());
 
 		VkPipelineShaderStageCreateInfo vert_shader_create_info = vk::CreateShaderStageCreateInfo(vert_shader_module, VK_SHADER_STAGE_VERTEX_BIT);
 		VkPipelineShaderStageCreateInfo frag_shader_create_info = vk::CreateShaderStageCreateInfo(frag_shader_module, VK_SHADER_STAGE_FRAGMENT_BIT);
 
 		VkPipelineShaderStageCreateInfo shader_stages[] = { vert_shader_create_info, frag_shader_create_info };
 
+		ShadowFilterConstants filter_constants = { shadow_filter, poisson_taps, filter_radius };
+		std::vector<VkSpecializationMapEntry> specialization_map_entries = {
+			vk::init::CreateSpecializationMapEntry(0, offsetof(ShadowFilterConstants, filter), sizeof(uint32_t)),
+			vk::init::CreateSpecializationMapEntry(1, offsetof(ShadowFilterConstants, poisson_taps), sizeof(uint32_t)),
+			vk::init::CreateSpecializationMapEntry(2, offsetof(ShadowFilterConstants, filter_radius), sizeof(float))
+		};
+		VkSpecializationInfo specialization_info = vk::init::CreateSpecializationInfo(specialization_map_entries, sizeof(ShadowFilterConstants), &filter_constants);
+		if (!show_shadow_map) {
+			shader_stages[1].pSpecializationInfo = &specialization_info;
+		}
+
 		std::vector<VkVertexInputBindingDescription> input_binding_descs = Vertex::GetBindingDescriptions();
 		std::vector<VkVertexInputAttributeDescription> input_attrib_descs = Vertex::GetAttributeDescriptions();
 		VkPipelineVertexInputStateCreateInfo vertex_input_info = vk::CreateVertexInputStateCreateInfo(input_binding_descs, input_attrib_descs);
@@ -591,8 +861,8 @@ public:
 
 		VkPipelineColorBlendStateCreateInfo color_blend_state = vk::CreateColorBlendStateCreateInfo(false, blend_attachment_states);
 
-		std::vector<VkPushConstantRange> constant_ranges;
-		std::vector<VkDescriptorSetLayout> descriptor_set_layouts = { this->draw_descriptor_set_layout };
+		std::vector<VkPushConstantRange> constant_ranges = { {VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(BindlessIndices)} };
+		std::vector<VkDescriptorSetLayout> descriptor_set_layouts = { this->draw_descriptor_set_layout, this->bindless_table.layout };
 		vk::CreatePipelineLayout(this->logical_device, descriptor_set_layouts, constant_ranges, &this->draw_pipeline_layout);
 
 		VkGraphicsPipelineCreateInfo pipeline_info = {};
@@ -617,14 +887,21 @@ public:
 		if (vkCreateGraphicsPipelines(this->logical_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &this->draw_pipeline) != VK_SUCCESS) {
 			throw std::runtime_error("fail to create draw graphic pipeline");
 		}
-
-		vkDestroyShaderModule(this->logical_device, frag_shader_module, nullptr);
-		vkDestroyShaderModule(this->logical_device, vert_shader_module, nullptr);
 	}
 
 	void CleanupPipelines() {
+		CleanupDrawPipeline();
+		CleanupDepthPipelines();
+	}
+
+	void CleanupDrawPipeline() {
 		vkDestroyPipeline(this->logical_device, this->draw_pipeline, nullptr);
 		vkDestroyPipelineLayout(this->logical_device, this->draw_pipeline_layout, nullptr);
+	}
+
+	void CleanupDepthPipelines() {
+		vkDestroyPipeline(this->logical_device, this->atlas_pipeline, nullptr);
+		vkDestroyPipelineLayout(this->logical_device, this->atlas_pipeline_layout, nullptr);
 		vkDestroyPipeline(this->logical_device, this->depth_pipeline, nullptr);
 		vkDestroyPipelineLayout(this->logical_device, this->depth_pipeline_layout, nullptr);
 	}
@@ -648,6 +925,16 @@ public:
 			this->per_camera_uniform_buffers[i].CreateBuffer(this->logical_device, this->physical_device, per_camera_size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_SHARING_MODE_EXCLUSIVE,
 				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 		}
+		this->static_per_light_uniform_buffer.CreateBuffer(this->logical_device, this->physical_device, per_light_size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_SHARING_MODE_EXCLUSIVE,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		this->static_per_object_uniform_buffer.CreateBuffer(this->logical_device, this->physical_device, per_object_size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_SHARING_MODE_EXCLUSIVE,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		VkDeviceSize atlas_lights_size = sizeof(AtlasLights);
+		this->atlas_light_uniform_buffers.resize(this->vulkan_swap_chain.image_count);
+		for (uint32_t i = 0; i < this->atlas_light_uniform_buffers.size(); i++) {
+			this->atlas_light_uniform_buffers[i].CreateBuffer(this->logical_device, this->physical_device, atlas_lights_size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_SHARING_MODE_EXCLUSIVE,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		}
 		VkDeviceSize light_size = sizeof(cg::PointLight);
 		this->light_uniform_buffers.resize(this->vulkan_swap_chain.image_count);
 		for (uint32_t i = 0; i < this->light_uniform_buffers.size(); i++) {
@@ -657,6 +944,11 @@ public:
 	}
 
 	void CleanupUniformBuffers() {
+		for (uint32_t i = 0; i < this->atlas_light_uniform_buffers.size(); i++) {
+			this->atlas_light_uniform_buffers[i].DestroyBuffer();
+		}
+		this->static_per_object_uniform_buffer.DestroyBuffer();
+		this->static_per_light_uniform_buffer.DestroyBuffer();
 		for (uint32_t i = 0; i < this->light_uniform_buffers.size(); i++) {
 			this->light_uniform_buffers[i].DestroyBuffer();
 		}
@@ -684,15 +976,6 @@ public:
 		this->per_object_data.total_size = 0;
 	}
 
-	void CreateDescriptorPool() {
-		std::vector<VkDescriptorPoolSize> poolsizes = {
-			{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER , this->vulkan_swap_chain.image_count * 4}, // for per light, per camera, point light
-			{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, this->vulkan_swap_chain.image_count }, // for shadow map
-			{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, this->vulkan_swap_chain.image_count * 2} //for per object
-		};
-		vk::init::CreateDescriptorPool(this->logical_device, poolsizes, this->vulkan_swap_chain.image_count * 7, &this->descriptor_pool);
-	}
-
 	void CreateDescriptorSets() {
 		CreateDepthDescriptorSets();
 		CreateDrawDescriptorSets();
@@ -700,75 +983,202 @@ public:
 
 	void CreateDepthDescriptorSets() {
 		this->depth_descriptor_sets.resize(this->vulkan_swap_chain.image_count);
-		std::vector<VkDescriptorSetLayout> layouts(this->vulkan_swap_chain.image_count, this->depth_descriptor_set_layout);
-		vk::init::AllocateDescriptorSets(this->logical_device, this->descriptor_pool, layouts, depth_descriptor_sets);
 		std::vector<VkWriteDescriptorSet> descriptor_writes(2);
 		for (uint32_t i = 0; i < depth_descriptor_sets.size(); i++) {
 			VkDescriptorBufferInfo binding0_info = vk::init::CreateDescriptorBufferInfo(this->per_light_uniform_buffers[i].buffer, 0, sizeof(PerLight));
-			descriptor_writes[0] = vk::init::CreateWriteDescriptorSet(this->depth_descriptor_sets[i], 0, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, &binding0_info, nullptr);
+			descriptor_writes[0] = vk::init::CreateWriteDescriptorSet(VK_NULL_HANDLE, 0, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, &binding0_info, nullptr);
 			VkDescriptorBufferInfo binding1_info = vk::init::CreateDescriptorBufferInfo(this->per_object_uniform_buffers[i].buffer, 0, sizeof(PerObject)); //https://www.khronos.org/registry/vulkan/specs/1.2-extensions/man/html/VkDescriptorBufferInfo.html
-			descriptor_writes[1] = vk::init::CreateWriteDescriptorSet(this->depth_descriptor_sets[i], 1, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, &binding1_info, nullptr);
-			vkUpdateDescriptorSets(this->logical_device, static_cast<uint32_t>(descriptor_writes.size()), descriptor_writes.data(), 0, nullptr);
+			descriptor_writes[1] = vk::init::CreateWriteDescriptorSet(VK_NULL_HANDLE, 1, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, &binding1_info, nullptr);
+			this->depth_descriptor_sets[i] = this->descriptor_set_cache.Get(this->depth_descriptor_set_layout, descriptor_writes);
 		}
+
+		VkDescriptorBufferInfo binding0_info = vk::init::CreateDescriptorBufferInfo(this->static_per_light_uniform_buffer.buffer, 0, sizeof(PerLight));
+		descriptor_writes[0] = vk::init::CreateWriteDescriptorSet(VK_NULL_HANDLE, 0, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, &binding0_info, nullptr);
+		VkDescriptorBufferInfo binding1_info = vk::init::CreateDescriptorBufferInfo(this->static_per_object_uniform_buffer.buffer, 0, sizeof(PerObject));
+		descriptor_writes[1] = vk::init::CreateWriteDescriptorSet(VK_NULL_HANDLE, 1, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, &binding1_info, nullptr);
+		this->static_depth_descriptor_set = this->descriptor_set_cache.Get(this->depth_descriptor_set_layout, descriptor_writes);
 	}
 
 	void CreateDrawDescriptorSets() {
 		this->draw_descriptor_sets.resize(this->vulkan_swap_chain.image_count);
-		std::vector<VkDescriptorSetLayout> layouts(this->vulkan_swap_chain.image_count, this->draw_descriptor_set_layout);
-		vk::init::AllocateDescriptorSets(this->logical_device, this->descriptor_pool, layouts, this->draw_descriptor_sets);
-		std::vector<VkWriteDescriptorSet> descriptor_writes(5);
+		this->shadow_map_handles.resize(this->vulkan_swap_chain.image_count);
 		for (uint32_t i = 0; i < draw_descriptor_sets.size(); i++) {
-			VkDescriptorBufferInfo binding0_info = vk::init::CreateDescriptorBufferInfo(this->per_camera_uniform_buffers[i].buffer, 0, sizeof(PerCamera));
-			descriptor_writes[0] = vk::init::CreateWriteDescriptorSet(this->draw_descriptor_sets[i], 0, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, &binding0_info, nullptr);
-			VkDescriptorBufferInfo binding1_info = vk::init::CreateDescriptorBufferInfo(this->per_object_uniform_buffers[i].buffer, 0, sizeof(PerObject));
-			descriptor_writes[1] = vk::init::CreateWriteDescriptorSet(this->draw_descriptor_sets[i], 1, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, &binding1_info, nullptr);
-			VkDescriptorBufferInfo binding2_info = vk::init::CreateDescriptorBufferInfo(this->per_light_uniform_buffers[i].buffer, 0, sizeof(PerLight));
-			descriptor_writes[2] = vk::init::CreateWriteDescriptorSet(this->draw_descriptor_sets[i], 2, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, &binding2_info, nullptr);
-			VkDescriptorBufferInfo binding3_info = vk::init::CreateDescriptorBufferInfo(this->light_uniform_buffers[i].buffer, 0, sizeof(cg::PointLight));
-			descriptor_writes[3] = vk::init::CreateWriteDescriptorSet(this->draw_descriptor_sets[i], 3, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, &binding3_info, nullptr);
-			VkDescriptorImageInfo binding4_info = vk::init::CreateDescriptorImageInfo(this->sampler, this->depth_attachments[i].image_view, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
-			descriptor_writes[4] = vk::init::CreateWriteDescriptorSet(this->draw_descriptor_sets[i], 4, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, nullptr, &binding4_info);
-			vkUpdateDescriptorSets(this->logical_device, static_cast<uint32_t>(descriptor_writes.size()), descriptor_writes.data(), 0, nullptr);
+			DrawDescriptors descriptors = {};
+			descriptors.per_camera = vk::init::CreateDescriptorBufferInfo(this->per_camera_uniform_buffers[i].buffer, 0, sizeof(PerCamera));
+			descriptors.per_object = vk::init::CreateDescriptorBufferInfo(this->per_object_uniform_buffers[i].buffer, 0, sizeof(PerObject));
+			descriptors.per_light = vk::init::CreateDescriptorBufferInfo(this->per_light_uniform_buffers[i].buffer, 0, sizeof(PerLight));
+			descriptors.light = vk::init::CreateDescriptorBufferInfo(this->light_uniform_buffers[i].buffer, 0, sizeof(cg::PointLight));
+			descriptors.atlas_lights = vk::init::CreateDescriptorBufferInfo(this->atlas_light_uniform_buffers[i].buffer, 0, sizeof(AtlasLights));
+			this->draw_descriptor_sets[i] = this->descriptor_set_cache.Get(this->draw_update_template, descriptors);
+			this->shadow_map_handles[i] = this->bindless_table.AddSampledImage(this->depth_attachments[i].image_view, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+		}
+		this->atlas_handle = this->bindless_table.AddSampledImage(this->atlas_attachment.image_view, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+	}
+
+	// draws the static or the dynamic objects into every cascade, each cascade rendering into its own layer of the shadow map
+	void RecordDepthDraws(VkCommandBuffer cmd_buffer, VkRenderPass renderpass, std::vector<VkFramebuffer>& framebuffers,
+		VkDescriptorSet descriptor_set, bool static_objects) {
+		std::vector<VkClearValue> clear_values = { {} };
+		clear_values[0].depthStencil = { 1.0f, 0 };
+
+		for (uint32_t cascade = 0; cascade < num_cascades; cascade++) {
+			vk::util::BeginRenderpass(cmd_buffer, renderpass, framebuffers[cascade], { 0,0 },
+				{ this->offscreen_framebuffer_width, this->offscreen_framebuffer_height }, clear_values, VK_SUBPASS_CONTENTS_INLINE);
+
+			vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->depth_pipeline);
+			vkCmdPushConstants(cmd_buffer, this->depth_pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(uint32_t), &cascade);
+			RecordObjectDraws(cmd_buffer, this->depth_pipeline_layout, descriptor_set, static_objects, !static_objects);
+
+			vkCmdEndRenderPass(cmd_buffer);
 		}
 	}
 
+	void RecordObjectDraws(VkCommandBuffer cmd_buffer, VkPipelineLayout pipeline_layout, VkDescriptorSet descriptor_set, bool draw_static, bool draw_dynamic) {
+		VkDeviceSize vertex_offsets[] = { 0 };
+
+		vkCmdBindVertexBuffers(cmd_buffer, 0, 1, &this->cube_vertex_buffer.buffer, vertex_offsets);
+		vkCmdBindIndexBuffer(cmd_buffer, this->cube_index_buffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+		for (uint32_t j = 0; j < num_cubes; j++) { //draw boxes
+			if (is_static_object[j] ? !draw_static : !draw_dynamic) {
+				continue;
+			}
+			uint32_t dynamic_alignment = j * this->per_object_data.stride;
+			vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, &descriptor_set, 1, &dynamic_alignment);
+			vkCmdDrawIndexed(cmd_buffer, static_cast<uint32_t>(cube_indices.size()), 1, 0, 0, 0);
+		}
+
+		vkCmdBindVertexBuffers(cmd_buffer, 0, 1, &this->wall_vertex_buffer.buffer, vertex_offsets);
+		vkCmdBindIndexBuffer(cmd_buffer, this->wall_index_buffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+		for (uint32_t j = num_cubes; j < objects_data.size(); j++) {
+			if (is_static_object[j] ? !draw_static : !draw_dynamic) {
+				continue;
+			}
+			uint32_t dynamic_alignment = j * this->per_object_data.stride;
+			vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, &descriptor_set, 1, &dynamic_alignment);
+			vkCmdDrawIndexed(cmd_buffer, static_cast<uint32_t>(wall_indices.size()), 1, 0, 0, 0);
+		}
+	}
+
+	// renders the dirty tiles of the atlas. Clean tiles are kept from previous frames, so nothing is submitted when no tile is dirty
+	void SubmitAtlasCmdBuffer(uint32_t current_image) {
+		bool any_dirty = !this->atlas_initialized;
+		for (cg::ShadowAtlasEntry& entry : this->atlas_entries) {
+			any_dirty = any_dirty || (entry.dirty && entry.face_count > 0);
+		}
+		if (!any_dirty) {
+			return;
+		}
+
+		// the timeline value of current_frame was waited on in Draw, so the previous recording of this cmd buffer has finished
+		VkCommandBuffer cmd_buffer = this->atlas_cmd_buffers[this->current_frame];
+		vk::util::BeginCmdBuffer(cmd_buffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, nullptr);
+		if (!this->atlas_initialized) {
+			vk::util::TransitionImageLayout(cmd_buffer, this->atlas_attachment.image, this->depth_barrier_aspect, 1,
+				VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT);
+			this->atlas_initialized = true;
+		}
+
+		std::vector<VkClearValue> clear_values = { {} };
+		vk::util::BeginRenderpass(cmd_buffer, this->atlas_renderpass, this->atlas_framebuffer, { 0,0 }, { atlas_size, atlas_size }, clear_values, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->atlas_pipeline);
+
+		VkClearAttachment clear_attachment = {};
+		clear_attachment.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+		clear_attachment.clearValue.depthStencil = { 1.0f, 0 };
+		for (uint32_t i = 0; i < this->atlas_entries.size(); i++) {
+			cg::ShadowAtlasEntry& entry = this->atlas_entries[i];
+			if (!entry.dirty) {
+				continue;
+			}
+			for (uint32_t face = 0; face < entry.face_count; face++) {
+				cg::AtlasTile& tile = entry.tiles[face];
+				VkViewport viewport = { (float)tile.x, (float)tile.y, (float)tile.size, (float)tile.size, 0.0f, 1.0f };
+				VkRect2D scissor = { { (int32_t)tile.x, (int32_t)tile.y }, { tile.size, tile.size } };
+				vkCmdSetViewport(cmd_buffer, 0, 1, &viewport);
+				vkCmdSetScissor(cmd_buffer, 0, 1, &scissor);
+
+				VkClearRect clear_rect = { scissor, 0, 1 };
+				vkCmdClearAttachments(cmd_buffer, 1, &clear_attachment, 1, &clear_rect);
+
+				vkCmdPushConstants(cmd_buffer, this->atlas_pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4),
+					&this->atlas_lights.lights[i].face_matrices[face]);
+				RecordObjectDraws(cmd_buffer, this->atlas_pipeline_layout, this->depth_descriptor_sets[current_image], true, true);
+			}
+			entry.dirty = false;
+		}
+		vkCmdEndRenderPass(cmd_buffer);
+		if (vkEndCommandBuffer(cmd_buffer) != VK_SUCCESS) {
+			throw std::runtime_error("fail to end command buffer recording");
+		}
+
+		std::vector<vk::SemaphoreWait> waits;
+		std::vector<VkCommandBuffer> cmd_buffers = { cmd_buffer };
+		std::vector<VkSemaphore> signal_semaphores;
+		this->queues[0].Submit(waits, cmd_buffers, signal_semaphores);
+	}
+
+	void CreateStaticShadowCmdBuffer() {
+		vk::init::CreateCmdBuffer(this->logical_device, this->command_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1, &this->static_shadow_cmd_buffer);
+		vk::util::BeginCmdBuffer(this->static_shadow_cmd_buffer, 0, nullptr);
+		RecordDepthDraws(this->static_shadow_cmd_buffer, this->static_depth_renderpass, this->static_depth_framebuffers, this->static_depth_descriptor_set, true);
+		if (vkEndCommandBuffer(this->static_shadow_cmd_buffer) != VK_SUCCESS) {
+			throw std::runtime_error("fail to end command buffer recording");
+		}
+	}
+
+	// re-renders the shadow cache with the light matrices of the current frame. Only happens when the light or a static object changes
+	void SubmitStaticShadowCmdBuffer() {
+		// the previous rebuild may still be reading the static uniform buffers
+		this->queues[0].timeline.WaitUntil(this->static_shadow_value);
+
+		this->static_per_light_uniform_buffer.CopyFromHostData(&this->cached_per_light, sizeof(PerLight), 0);
+		// staged apart from per_object_data, which holds the animated objects of the frame
+		std::vector<unsigned char> static_object_data(this->per_object_data.total_size);
+		for (uint32_t i = 0; i < objects_data.size(); i++) {
+			*reinterpret_cast<PerObject*>(static_object_data.data() + i * this->per_object_data.stride) = objects_data[i];
+		}
+		this->static_per_object_uniform_buffer.CopyFromHostData(static_object_data.data(), this->per_object_data.total_size, 0);
+
+		std::vector<vk::SemaphoreWait> waits;
+		std::vector<VkCommandBuffer> cmd_buffers = { this->static_shadow_cmd_buffer };
+		std::vector<VkSemaphore> signal_semaphores;
+		this->static_shadow_value = this->queues[0].Submit(waits, cmd_buffers, signal_semaphores);
+		this->static_shadow_dirty = false;
+	}
+
 	void CreateOffscreenDrawCmdBuffers() {
 		this->offscreen_draw_cmd_buffers.resize(this->vulkan_swap_chain.image_count);
 		vk::init::CreateCmdBuffer(this->logical_device, this->command_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY,
 			this->vulkan_swap_chain.image_count, this->offscreen_draw_cmd_buffers.data());
-		VkDeviceSize vertex_offsets[] = { 0 };
 
-		std::vector<VkClearValue> clear_values = { {} };
-		clear_values[0].depthStencil = { 1.0f, 0 };
+		this->has_dynamic_casters = std::find(is_static_object.begin(), is_static_object.end(), false) != is_static_object.end();
+
+		VkImageCopy copy_region = {};
+		copy_region.srcSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 0, num_cascades };
+		copy_region.srcOffset = { 0, 0, 0 };
+		copy_region.dstSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 0, num_cascades };
+		copy_region.dstOffset = { 0, 0, 0 };
+		copy_region.extent = { this->offscreen_framebuffer_width, this->offscreen_framebuffer_height, 1 };
 
 		for (uint32_t i = 0; i < this->offscreen_draw_cmd_buffers.size(); i++) {
 			vk::util::BeginCmdBuffer(this->offscreen_draw_cmd_buffers[i], VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT, nullptr);
 
-			// depth renderpass
-			vk::util::BeginRenderpass(this->offscreen_draw_cmd_buffers[i], this->depth_renderpass, this->depth_framebuffers[i], { 0,0 },
-				{ this->offscreen_framebuffer_width, this->offscreen_framebuffer_height }, clear_values, VK_SUBPASS_CONTENTS_INLINE);
+			// start from the cached static depth, old content is discarded because the copy overwrites all of it
+			vk::util::TransitionImageLayout(this->offscreen_draw_cmd_buffers[i], this->depth_attachments[i].image, this->depth_barrier_aspect, num_cascades,
+				VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+			vkCmdCopyImage(this->offscreen_draw_cmd_buffers[i], this->static_depth_attachment.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				this->depth_attachments[i].image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
 
-			vkCmdBindPipeline(this->offscreen_draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, this->depth_pipeline);
-			vkCmdBindVertexBuffers(this->offscreen_draw_cmd_buffers[i], 0, 1, &this->cube_vertex_buffer.buffer, vertex_offsets);
-			vkCmdBindIndexBuffer(this->offscreen_draw_cmd_buffers[i], this->cube_index_buffer.buffer, 0, VK_INDEX_TYPE_UINT16);
-
-			for (uint32_t j = 0; j < num_cubes; j++) { //draw boxes
-				uint32_t dynamic_alignment = j * this->per_object_data.stride;
-				vkCmdBindDescriptorSets(this->offscreen_draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-					this->depth_pipeline_layout, 0, 1, &this->depth_descriptor_sets[i], 1, &dynamic_alignment);
-				vkCmdDrawIndexed(this->offscreen_draw_cmd_buffers[i], static_cast<uint32_t>(cube_indices.size()), 1, 0, 0, 0);
+			if (this->has_dynamic_casters) {
+				RecordDepthDraws(this->offscreen_draw_cmd_buffers[i], this->depth_renderpass, this->depth_framebuffers[i], this->depth_descriptor_sets[i], false);
 			}
-
-			vkCmdBindVertexBuffers(this->offscreen_draw_cmd_buffers[i], 0, 1, &this->wall_vertex_buffer.buffer, vertex_offsets);
-			vkCmdBindIndexBuffer(this->offscreen_draw_cmd_buffers[i], this->wall_index_buffer.buffer, 0, VK_INDEX_TYPE_UINT16);
-			for (uint32_t j = num_cubes; j < objects_data.size(); j++) {
-				uint32_t dynamic_alignment = j * this->per_object_data.stride;
-				vkCmdBindDescriptorSets(this->offscreen_draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-					this->depth_pipeline_layout, 0, 1, &this->depth_descriptor_sets[i], 1, &dynamic_alignment);
-				vkCmdDrawIndexed(this->offscreen_draw_cmd_buffers[i], static_cast<uint32_t>(wall_indices.size()), 1, 0, 0, 0);
+			else { // static scene, the copy is the whole shadow pass
+				vk::util::TransitionImageLayout(this->offscreen_draw_cmd_buffers[i], this->depth_attachments[i].image, this->depth_barrier_aspect, num_cascades,
+					VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+					VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
 			}
-
-			vkCmdEndRenderPass(this->offscreen_draw_cmd_buffers[i]);
 			if (vkEndCommandBuffer(this->offscreen_draw_cmd_buffers[i]) != VK_SUCCESS) {
 				throw std::runtime_error("fail to end command buffer recording");
 			}
@@ -791,35 +1201,38 @@ public:
 				this->swapchain_framebuffers[i], { 0,0 }, this->vulkan_swap_chain.swap_extent, clear_values, VK_SUBPASS_CONTENTS_INLINE);
 
 			vkCmdBindPipeline(this->draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, this->draw_pipeline);
-
-			//vkCmdBindVertexBuffers(this->draw_cmd_buffers[i], 0, 1, &this->cube_vertex_buffer.buffer, vertex_offsets);
-			//vkCmdBindIndexBuffer(this->draw_cmd_buffers[i], this->cube_index_buffer.buffer, 0, VK_INDEX_TYPE_UINT16);
-
-			//for (uint32_t j = 0; j < num_cubes; j++) { //draw boxes
-			//	uint32_t dynamic_alignment = j * this->per_object_data.stride;
-			//	vkCmdBindDescriptorSets(this->draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-			//		this->draw_pipeline_layout, 0, 1, &this->draw_descriptor_sets[i], 1, &dynamic_alignment);
-			//	vkCmdDrawIndexed(this->draw_cmd_buffers[i], static_cast<uint32_t>(cube_indices.size()), 1, 0, 0, 0);
-			//}
-
-			//vkCmdBindVertexBuffers(this->draw_cmd_buffers[i], 0, 1, &this->wall_vertex_buffer.buffer, vertex_offsets);
-			//vkCmdBindIndexBuffer(this->draw_cmd_buffers[i], this->wall_index_buffer.buffer, 0, VK_INDEX_TYPE_UINT16);
-
-			//for (uint32_t j = num_cubes; j < objects_data.size(); j++) {
-			//	uint32_t dynamic_alignment = j * this->per_object_data.stride;
-			//	vkCmdBindDescriptorSets(this->draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-			//		this->draw_pipeline_layout, 0, 1, &this->draw_descriptor_sets[i], 1, &dynamic_alignment);
-			//	vkCmdDrawIndexed(this->draw_cmd_buffers[i], static_cast<uint32_t>(wall_indices.size()), 1, 0, 0, 0);
-			//}
-			
-			//test code
-			vkCmdBindVertexBuffers(this->draw_cmd_buffers[i], 0, 1, &this->cube_vertex_buffer.buffer, vertex_offsets);
-			vkCmdBindIndexBuffer(this->draw_cmd_buffers[i], this->cube_index_buffer.buffer, 0, VK_INDEX_TYPE_UINT16);
-			uint32_t dynamic_alignment = 0;
-			vkCmdBindDescriptorSets(this->draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
+			this->bindless_table.Bind(this->draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, this->draw_pipeline_layout, 1);
+			BindlessIndices indices = { this->shadow_map_handles[i], this->atlas_handle, this->shadow_sampler_handle };
+			vkCmdPushConstants(this->draw_cmd_buffers[i], this->draw_pipeline_layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(BindlessIndices), &indices);
+
+			if (show_shadow_map) {
+				// full screen quad generated in debug.vert
+				uint32_t dynamic_alignment = 0;
+				vkCmdBindDescriptorSets(this->draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
 					this->draw_pipeline_layout, 0, 1, &this->draw_descriptor_sets[i], 1, &dynamic_alignment);
-			vkCmdDraw(this->draw_cmd_buffers[i], 6, 1, 0, 0);
-			//test code
+				vkCmdDraw(this->draw_cmd_buffers[i], 6, 1, 0, 0);
+			}
+			else {
+				vkCmdBindVertexBuffers(this->draw_cmd_buffers[i], 0, 1, &this->cube_vertex_buffer.buffer, vertex_offsets);
+				vkCmdBindIndexBuffer(this->draw_cmd_buffers[i], this->cube_index_buffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+
+				for (uint32_t j = 0; j < num_cubes; j++) { //draw boxes
+					uint32_t dynamic_alignment = j * this->per_object_data.stride;
+					vkCmdBindDescriptorSets(this->draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
+						this->draw_pipeline_layout, 0, 1, &this->draw_descriptor_sets[i], 1, &dynamic_alignment);
+					vkCmdDrawIndexed(this->draw_cmd_buffers[i], static_cast<uint32_t>(cube_indices.size()), 1, 0, 0, 0);
+				}
+
+				vkCmdBindVertexBuffers(this->draw_cmd_buffers[i], 0, 1, &this->wall_vertex_buffer.buffer, vertex_offsets);
+				vkCmdBindIndexBuffer(this->draw_cmd_buffers[i], this->wall_index_buffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+
+				for (uint32_t j = num_cubes; j < objects_data.size(); j++) {
+					uint32_t dynamic_alignment = j * this->per_object_data.stride;
+					vkCmdBindDescriptorSets(this->draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
+						this->draw_pipeline_layout, 0, 1, &this->draw_descriptor_sets[i], 1, &dynamic_alignment);
+					vkCmdDrawIndexed(this->draw_cmd_buffers[i], static_cast<uint32_t>(wall_indices.size()), 1, 0, 0, 0);
+				}
+			}
 
 			vkCmdEndRenderPass(this->draw_cmd_buffers[i]);
 
@@ -830,40 +1243,133 @@ public:
 	}
 
 	void UpdateUniformBufferData(uint32_t current_image) {
+		CPU_PROFILE_FUNCTION();
 		static auto start_time = std::chrono::high_resolution_clock::now();
 		auto current_time = std::chrono::high_resolution_clock::now();
 		float elapsed = std::chrono::duration<float, std::chrono::seconds::period>(current_time - start_time).count();
 		PerCamera mvp;
 		mvp.view = glm::lookAt(glm::vec3(0.0, 4.0f, 16.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		mvp.proj = glm::perspective(glm::radians(45.0f), this->vulkan_swap_chain.swap_extent.width / (float)this->vulkan_swap_chain.swap_extent.height, 0.1f, 1000.0f);
+		mvp.proj = glm::perspective(glm::radians(camera_fov), this->vulkan_swap_chain.swap_extent.width / (float)this->vulkan_swap_chain.swap_extent.height, camera_near, camera_far);
 		mvp.proj[1][1] *= -1;
 		this->per_camera_uniform_buffers[current_image].CopyFromHostData(&mvp, sizeof(PerCamera), 0);
 
+		glm::vec3 light_position = glm::vec3(0.0f, 20.0f, 0.0f);
+		glm::vec3 light_target = glm::vec3(0.0f, 0.0f, 0.0f);
 		cg::PointLight light;
 		light.constant = 1.0f;
 		light.linear = 0.0f;
 		light.quadratic = 0.0f;
-		light.position = glm::vec3(0.0f, 20.0f, 0.0f);
+		light.position = glm::vec3(mvp.view * glm::vec4(light_position, 1.0f)); // shadow_map.frag needs light position in eyeCoord
 		light.diffuse = glm::vec3(5.0f, 5.0f, 5.0f);
 		light.ambient = glm::vec3(0.2f, 0.2f, 0.2f);
 		this->light_uniform_buffers[current_image].CopyFromHostData(&light, sizeof(cg::PointLight), 0);
 
-		glm::mat4 light_projection = glm::ortho(-100.0f, 100.0f, -100.0f, 100.0f, 0.1f, 1000.0f);
-		PerLight per_light;
-		glm::mat4 light_view = glm::lookAt(light.position, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-		per_light.light_space_matrix = light_projection * light_view;
+		// the light is far away compared to the scene, so it is treated as a directional light for shadowing
+		std::vector<float> splits = cg::CalculateCascadeSplits(num_cascades, camera_near, shadow_distance, cascade_split_lambda);
+		std::vector<cg::ShadowCascade> cascades = cg::FitCascades(mvp.view, mvp.proj, camera_near, camera_far, splits,
+			light_target - light_position, this->offscreen_framebuffer_width, shadow_caster_margin);
+		PerLight per_light = {};
+		for (uint32_t i = 0; i < num_cascades; i++) {
+			per_light.light_space_matrices[i] = cascades[i].light_space_matrix;
+			per_light.cascade_splits[i] = cascades[i].split_depth;
+		}
 		this->per_light_uniform_buffers[current_image].CopyFromHostData(&per_light, sizeof(PerLight), 0);
+		// static objects never move, so the cache only goes stale when the light matrices change
+		if (std::memcmp(&per_light, &this->cached_per_light, sizeof(PerLight)) != 0) {
+			this->cached_per_light = per_light;
+			this->static_shadow_dirty = true;
+		}
 
 		// used to draw cubes
 		unsigned char* obj_ptr = this->per_object_data.data;
+		std::vector<glm::vec3> dynamic_positions;
 		for (uint32_t i = 0; i < objects_data.size(); i++) {
 			PerObject per_obj = objects_data[i];
-			per_obj.model_matrix = per_obj.model_matrix;
+			if (!is_static_object[i]) {
+				per_obj.model_matrix = glm::translate(glm::vec3(0.0f, 2.0f * std::sin(elapsed), 0.0f)) * per_obj.model_matrix;
+				dynamic_positions.push_back(glm::vec3(per_obj.model_matrix[3]));
+			}
 			*reinterpret_cast<PerObject*>(obj_ptr) = per_obj;
 			obj_ptr += this->per_object_data.stride;
 		}
 		this->per_object_uniform_buffers[current_image].CopyFromHostData(this->per_object_data.data, this->per_object_data.total_size, 0);
-		
+
+		UpdateShadowAtlas(mvp.view, dynamic_positions);
+		this->atlas_light_uniform_buffers[current_image].CopyFromHostData(&this->atlas_lights, sizeof(AtlasLights), 0);
+	}
+
+	// gives every point light tiles sized by how much of the screen it can light, and marks the tiles that have to be re-rendered
+	void UpdateShadowAtlas(glm::mat4 view, std::vector<glm::vec3>& dynamic_positions) {
+		uint32_t light_count = std::min(static_cast<uint32_t>(atlas_point_lights.size()), max_atlas_lights);
+		float tan_half_fov = std::tan(glm::radians(camera_fov) / 2.0f);
+
+		std::vector<float> importances(light_count);
+		std::vector<uint32_t> order(light_count);
+		for (uint32_t i = 0; i < light_count; i++) {
+			glm::vec3 position_eye = glm::vec3(view * glm::vec4(atlas_point_lights[i].first, 1.0f));
+			float dist = glm::length(position_eye);
+			bool behind_camera = position_eye.z > atlas_light_radius;
+			importances[i] = (dist < atlas_light_radius) ? 1.0f : (behind_camera ? 0.0f : atlas_light_radius / (dist * tan_half_fov));
+			order[i] = i;
+		}
+
+		// tiles whose size changes are released first so the most important lights get their tiles before the atlas fills up
+		for (uint32_t i = 0; i < light_count; i++) {
+			cg::ShadowAtlasEntry& entry = this->atlas_entries[i];
+			uint32_t tile_size = this->shadow_atlas.GetTileSize(importances[i], max_atlas_tile_size);
+			if (tile_size != entry.tile_size) {
+				for (uint32_t face = 0; face < entry.face_count; face++) {
+					this->shadow_atlas.Free(entry.tiles[face]);
+				}
+				entry.face_count = 0;
+				entry.tile_size = tile_size;
+			}
+		}
+		std::sort(order.begin(), order.end(), [&importances](uint32_t a, uint32_t b) { return importances[a] > importances[b]; });
+		for (uint32_t i : order) {
+			cg::ShadowAtlasEntry& entry = this->atlas_entries[i];
+			if (entry.face_count > 0) {
+				continue;
+			}
+			// when the atlas is full, fall back to smaller tiles
+			for (uint32_t size = entry.tile_size; size >= min_atlas_tile_size && entry.face_count == 0; size /= 2) {
+				uint32_t face = 0;
+				for (; face < 6; face++) {
+					if (!this->shadow_atlas.Allocate(size, entry.tiles[face])) {
+						break;
+					}
+				}
+				if (face < 6) {
+					for (uint32_t j = 0; j < face; j++) {
+						this->shadow_atlas.Free(entry.tiles[j]);
+					}
+					continue;
+				}
+				entry.face_count = 6;
+				entry.dirty = true;
+			}
+		}
+
+		glm::mat4 face_projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, atlas_light_radius);
+		this->atlas_lights.count = glm::uvec4(light_count, 0, 0, 0);
+		for (uint32_t i = 0; i < light_count; i++) {
+			cg::ShadowAtlasEntry& entry = this->atlas_entries[i];
+			glm::vec3 position = atlas_point_lights[i].first;
+			AtlasLight& light = this->atlas_lights.lights[i];
+			light.position_world = glm::vec4(position, atlas_light_radius);
+			light.position_eye = glm::vec4(glm::vec3(view * glm::vec4(position, 1.0f)), entry.face_count > 0 ? 1.0f : 0.0f);
+			light.color = glm::vec4(atlas_point_lights[i].second, 1.0f);
+			for (uint32_t face = 0; face < entry.face_count; face++) {
+				light.face_matrices[face] = face_projection * cg::GetCubeFaceViewMatrix(position, face);
+				light.tile_rects[face] = this->shadow_atlas.GetTileRect(entry.tiles[face]);
+			}
+			// a moving caster inside the light's range changes its shadow
+			for (glm::vec3& dynamic_position : dynamic_positions) {
+				if (glm::length(dynamic_position - position) < atlas_light_radius + 2.0f) { // 2 covers the cube's half diagonal
+					entry.dirty = true;
+				}
+			}
+		}
 	}
 
 }; 
@@ -0,0 +1,18 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout (binding = 1) uniform PerObject 
+{
+	mat4 modelMatrix; 
+} perObject;
+
+layout(push_constant) uniform PushConstants {
+	mat4 lightSpaceMatrix; // projectionMat * view mat of the cube face rendered into the current atlas tile
+} pushConstants;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+
+void main() {
+    gl_Position = pushConstants.lightSpaceMatrix * perObject.modelMatrix * vec4(inPosition, 1.0);
+}
\ No newline at end of file
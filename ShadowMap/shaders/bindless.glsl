@@ -0,0 +1,13 @@
+// the bindless table (vk::VulkanBindlessTable) bound at set 1, the including shader needs GL_EXT_nonuniform_qualifier.
+// Its sampled image array is declared once per image type the shaders read, a handle must only be used with the type of its image.
+// Images and samplers are combined where they are sampled, e.g. sampler2DArrayShadow(bindlessTextures2DArray[i], bindlessSamplers[j])
+layout(set = 1, binding = 0) uniform texture2D bindlessTextures2D[];
+layout(set = 1, binding = 0) uniform texture2DArray bindlessTextures2DArray[];
+layout(set = 1, binding = 1) uniform sampler bindlessSamplers[];
+
+// handles of the resources the draw reads, see BindlessIndices in ShadowMap.cpp
+layout(push_constant) uniform BindlessIndices {
+	uint shadowMap;
+	uint shadowAtlas;
+	uint shadowSampler;
+} bindlessIndices;
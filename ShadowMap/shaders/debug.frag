@@ -1,5 +1,7 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
 //change this directional light to pointlight later
 
 layout(binding=3) uniform PointLight {
@@ -12,7 +14,9 @@ layout(binding=3) uniform PointLight {
 	float quadratic;
 } light;
 
-layout (binding = 4) uniform sampler2D depthMap;
+#include "bindless.glsl"
+
+#define depthMap sampler2DArray(bindlessTextures2DArray[bindlessIndices.shadowMap], bindlessSamplers[bindlessIndices.shadowSampler])
 
 layout(location = 0) in vec2 fragTexCoord;
 
@@ -20,7 +24,7 @@ layout(location = 0) out vec4 outColor;
 
 
 void main() {
-	float depthVal = texture(depthMap, fragTexCoord).r;
+	float depthVal = texture(depthMap, vec3(fragTexCoord, 0.0)).r; // first cascade
 	outColor = vec4(vec3(depthVal), 1.0);
 }
 
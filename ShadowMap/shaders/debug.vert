@@ -12,8 +12,11 @@ layout (binding = 1) uniform PerObject
 	vec3 color;
 } perObject;
 
+#define NUM_CASCADES 4
+
 layout(binding = 2) uniform PerLight {
-    mat4 lightSpaceMatrix; // projectionMat * view mat with light at origin
+    mat4 lightSpaceMatrices[NUM_CASCADES]; // projectionMat * view mat with light at origin, one per cascade
+    vec4 cascadeSplits; // view space far distance of each cascade
 } perLight;
 
 layout(location = 0) in vec3 inPosition;
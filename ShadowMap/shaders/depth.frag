@@ -2,5 +2,5 @@
 #extension GL_ARB_separate_shader_objects : enable
 
 void main() {
-	gl_FragDepth = 0.0;
+	// depth only, the rasterized depth is written automatically
 }
\ No newline at end of file
@@ -2,8 +2,11 @@
 #extension GL_ARB_separate_shader_objects : enable
 
 
+#define NUM_CASCADES 4
+
 layout(binding = 0) uniform PerLight {
-    mat4 lightSpaceMatrix; // projectionMat * view mat with light at origin
+    mat4 lightSpaceMatrices[NUM_CASCADES]; // projectionMat * view mat with light at origin, one per cascade
+    vec4 cascadeSplits;
 } perLight;
 
 layout (binding = 1) uniform PerObject 
@@ -14,6 +17,10 @@ layout (binding = 1) uniform PerObject
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inNormal;
 
+layout(push_constant) uniform PushConstants {
+	uint cascadeIndex;
+} pushConstants;
+
 void main() {
-    gl_Position = perLight.lightSpaceMatrix * perObject.modelMatrix * vec4(inPosition, 1.0);
+    gl_Position = perLight.lightSpaceMatrices[pushConstants.cascadeIndex] * perObject.modelMatrix * vec4(inPosition, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,57 @@
+// shadow map filtering kernels, shared by every shader sampling a shadow map through a comparison sampler.
+// Each tap is one hardware comparison, which already does 2x2 PCF with bilinear weights.
+// The kernel is picked at pipeline creation through specialization constants:
+//   0: hardware 2x2 PCF only, 1 tap
+//   1: optimized PCF, 9 bilinear taps weighted to cover a 5x5 texel tent filter (Castano, "Shadow Mapping Summary")
+//   2: Poisson disk, POISSON_TAPS taps rotated per pixel, FILTER_RADIUS texels wide
+layout (constant_id = 0) const int SHADOW_FILTER = 1;
+layout (constant_id = 1) const int POISSON_TAPS = 16;
+layout (constant_id = 2) const float FILTER_RADIUS = 1.5;
+
+const vec2 poissonDisk[16] = vec2[](
+	vec2(-0.94201624, -0.39906216), vec2(0.94558609, -0.76890725),
+	vec2(-0.094184101, -0.92938870), vec2(0.34495938, 0.29387760),
+	vec2(-0.91588581, 0.45771432), vec2(-0.81544232, -0.87912464),
+	vec2(-0.38277543, 0.27676845), vec2(0.97484398, 0.75648379),
+	vec2(0.44323325, -0.97511554), vec2(0.53742981, -0.47373420),
+	vec2(-0.26496911, -0.41893023), vec2(0.79197514, 0.19090188),
+	vec2(-0.24188840, 0.99706507), vec2(-0.81409955, 0.91437590),
+	vec2(0.19984126, 0.78641367), vec2(0.14383161, -0.14100790)
+);
+
+int shadowFilterTapCount() {
+	if (SHADOW_FILTER == 0) {
+		return 1;
+	}
+	if (SHADOW_FILTER == 1) {
+		return 9;
+	}
+	return min(POISSON_TAPS, 16);
+}
+
+// returns the texture coordinate of tap i in xy and its weight in z. uv is the unfiltered coordinate, mapSize the shadow map size in texels
+vec3 shadowFilterTap(int i, vec2 uv, vec2 mapSize) {
+	vec2 texelSize = 1.0 / mapSize;
+	if (SHADOW_FILTER == 0) {
+		return vec3(uv, 1.0);
+	}
+	if (SHADOW_FILTER == 1) {
+		vec2 texel = uv * mapSize;
+		vec2 base = floor(texel + 0.5);
+		vec2 st = texel + 0.5 - base;
+		base = (base - 0.5) * texelSize;
+		// tap positions and weights along one axis, the 2D kernel is their outer product
+		vec3 weights = vec3(4.0 - 3.0 * st.x, 7.0, 1.0 + 3.0 * st.x);
+		vec3 offsetsU = vec3((3.0 - 2.0 * st.x) / weights.x - 2.0, (3.0 + st.x) / weights.y, st.x / weights.z + 2.0);
+		vec3 weightsV = vec3(4.0 - 3.0 * st.y, 7.0, 1.0 + 3.0 * st.y);
+		vec3 offsetsV = vec3((3.0 - 2.0 * st.y) / weightsV.x - 2.0, (3.0 + st.y) / weightsV.y, st.y / weightsV.z + 2.0);
+		int x = i % 3;
+		int y = i / 3;
+		return vec3(base + vec2(offsetsU[x], offsetsV[y]) * texelSize, weights[x] * weightsV[y]);
+	}
+	// rotate the disk per pixel so banding turns into noise
+	float noise = fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+	float angle = noise * 6.28318531;
+	mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+	return vec3(uv + rotation * poissonDisk[i] * FILTER_RADIUS * texelSize, 1.0);
+}
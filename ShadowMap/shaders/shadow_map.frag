@@ -1,5 +1,7 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
 //change this directional light to pointlight later
 
 layout(binding=3) uniform PointLight {
@@ -12,30 +14,133 @@ layout(binding=3) uniform PointLight {
 	float quadratic;
 } light;
 
-layout (binding = 4) uniform sampler2D depthMap;
+#define NUM_CASCADES 4
+
+layout(binding = 2) uniform PerLight {
+    mat4 lightSpaceMatrices[NUM_CASCADES]; // projectionMat * view mat with light at origin, one per cascade
+    vec4 cascadeSplits; // view space far distance of each cascade
+} perLight;
+
+#include "bindless.glsl"
+
+// comparison sampler, returns how lit the fragment is
+#define depthMap sampler2DArrayShadow(bindlessTextures2DArray[bindlessIndices.shadowMap], bindlessSamplers[bindlessIndices.shadowSampler])
+
+#define MAX_ATLAS_LIGHTS 24
+
+struct AtlasLight {
+	vec4 positionWorld; // w is the radius of influence
+	vec4 positionEyeCoord; // w is 1 when the light has shadow tiles in the atlas
+	vec4 color;
+	mat4 faceMatrices[6]; // projectionMat * view mat of each cube face
+	vec4 tileRects[6]; // xy offset, zw extent in normalized atlas coordinates
+};
+
+layout(binding = 5) uniform AtlasLights {
+	uvec4 count;
+	AtlasLight lights[MAX_ATLAS_LIGHTS];
+} atlasLights;
+
+#define shadowAtlas sampler2DShadow(bindlessTextures2D[bindlessIndices.shadowAtlas], bindlessSamplers[bindlessIndices.shadowSampler])
+
+#include "shadow_filter.glsl"
 
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec4 positionEyeCoord;
 layout(location = 2) in vec3 normalEyeCoord;
-layout(location = 3) in vec4  positionProjLightCoord;
+layout(location = 3) in vec4 positionWorldCoord;
 
 layout(location = 0) out vec4 outColor;
 
-float isInShadow(vec4 fragPos) {
+uint selectCascade(float viewDepth) {
+	for (uint i = 0; i < NUM_CASCADES - 1; i++) {
+		if (viewDepth < perLight.cascadeSplits[i]) {
+			return i;
+		}
+	}
+	return NUM_CASCADES - 1;
+}
+
+float isInShadow(vec4 worldPos, float viewDepth) {
+	if (viewDepth > perLight.cascadeSplits[NUM_CASCADES - 1]) {
+		return 0.0; // beyond shadow distance
+	}
+	uint cascade = selectCascade(viewDepth);
+	vec4 fragPos = perLight.lightSpaceMatrices[cascade] * worldPos;
 	//perspective division
 	vec3 projCoord = vec3(fragPos) / fragPos.w;
-	projCoord = projCoord * 0.5 + vec3(0.5, 0.5, 0.5); // x, y need to be in range (0, 1) bc they are textureCoord and z need to be in range (0, 1) because that is the range of depth value stored
-	float closestDepth = texture(depthMap, vec2(projCoord)).r;
-	return (projCoord.z > closestDepth)? 1.0: 0.0;
+	// x, y need to be in range (0, 1) bc they are textureCoord, z is already in range (0, 1) with GLM_FORCE_DEPTH_ZERO_TO_ONE
+	vec2 texCoord = projCoord.xy * 0.5 + vec2(0.5, 0.5);
+	const float bias = 0.002;
+	vec2 mapSize = vec2(textureSize(depthMap, 0).xy);
+	float lit = 0.0;
+	float totalWeight = 0.0;
+	for (int i = 0; i < shadowFilterTapCount(); i++) {
+		vec3 tap = shadowFilterTap(i, texCoord, mapSize);
+		lit += tap.z * texture(depthMap, vec4(tap.xy, float(cascade), projCoord.z - bias));
+		totalWeight += tap.z;
+	}
+	return 1.0 - lit / totalWeight;
+}
+
+uint selectCubeFace(vec3 dir) {
+	vec3 absDir = abs(dir);
+	if (absDir.x >= absDir.y && absDir.x >= absDir.z) {
+		return dir.x > 0.0 ? 0 : 1;
+	}
+	if (absDir.y >= absDir.z) {
+		return dir.y > 0.0 ? 2 : 3;
+	}
+	return dir.z > 0.0 ? 4 : 5;
+}
+
+float isInAtlasShadow(uint lightIndex, vec4 worldPos) {
+	if (atlasLights.lights[lightIndex].positionEyeCoord.w == 0.0) {
+		return 0.0; // the atlas had no room for this light
+	}
+	uint face = selectCubeFace(worldPos.xyz - atlasLights.lights[lightIndex].positionWorld.xyz);
+	vec4 fragPos = atlasLights.lights[lightIndex].faceMatrices[face] * worldPos;
+	vec3 projCoord = vec3(fragPos) / fragPos.w;
+	vec4 rect = atlasLights.lights[lightIndex].tileRects[face];
+	vec2 mapSize = vec2(textureSize(shadowAtlas, 0));
+	vec2 texCoord = rect.xy + (projCoord.xy * 0.5 + vec2(0.5, 0.5)) * rect.zw;
+	// keep every tap half a texel inside the tile so filtering doesn't pick up the neighbouring tile
+	vec2 halfTexel = 0.5 / mapSize;
+	const float bias = 0.0005;
+	float lit = 0.0;
+	float totalWeight = 0.0;
+	for (int i = 0; i < shadowFilterTapCount(); i++) {
+		vec3 tap = shadowFilterTap(i, texCoord, mapSize);
+		vec2 tapCoord = clamp(tap.xy, rect.xy + halfTexel, rect.xy + rect.zw - halfTexel);
+		lit += tap.z * texture(shadowAtlas, vec3(tapCoord, projCoord.z - bias));
+		totalWeight += tap.z;
+	}
+	return 1.0 - lit / totalWeight;
+}
+
+vec3 atlasLighting(vec4 worldPos) {
+	vec3 result = vec3(0.0);
+	for (uint i = 0; i < atlasLights.count.x; i++) {
+		vec4 toLight = vec4(atlasLights.lights[i].positionEyeCoord.xyz, 1.0) - positionEyeCoord;
+		float dist = length(toLight);
+		float radius = atlasLights.lights[i].positionWorld.w;
+		if (dist > radius) {
+			continue;
+		}
+		float attenuation = (1.0 - dist / radius) * (1.0 - dist / radius);
+		float diffuse = max(0.0, dot(vec3(toLight) / dist, normalEyeCoord));
+		result += atlasLights.lights[i].color.rgb * fragColor * diffuse * attenuation * (1.0 - isInAtlasShadow(i, worldPos));
+	}
+	return result;
 }
 
 void main() {
-	float shadow = isInShadow(positionProjLightCoord);
+	float shadow = isInShadow(positionWorldCoord, -positionEyeCoord.z);
 	float dist = length(vec4(light.positionEyeCoord, 1.0) - positionEyeCoord);
 	float attenuation = 1.0 / (light.constant + light.linear * dist + light.quadratic * dist * dist);
 	vec3 ambient = light.ambient * fragColor * attenuation;
 	vec4 l = normalize(vec4(light.positionEyeCoord, 1.0) - positionEyeCoord);
 	vec3 diffuse = light.diffuse * fragColor * max(0.0, dot(vec3(l), normalEyeCoord)) * attenuation;
-	outColor = vec4(ambient + diffuse * (1.0 - shadow), 1.0);
+	outColor = vec4(ambient + diffuse * (1.0 - shadow) + atlasLighting(positionWorldCoord), 1.0);
 }
 
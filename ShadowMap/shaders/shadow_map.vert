@@ -12,8 +12,11 @@ layout (binding = 1) uniform PerObject
 	vec3 color;
 } perObject;
 
+#define NUM_CASCADES 4
+
 layout(binding = 2) uniform PerLight {
-    mat4 lightSpaceMatrix; // projectionMat * view mat with light at origin
+    mat4 lightSpaceMatrices[NUM_CASCADES]; // projectionMat * view mat with light at origin, one per cascade
+    vec4 cascadeSplits; // view space far distance of each cascade
 } perLight;
 
 layout(location = 0) in vec3 inPosition;
@@ -22,7 +25,7 @@ layout(location = 1) in vec3 inNormal;
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec4 positionEyeCoord;
 layout(location = 2) out vec3 normalEyeCoord;
-layout(location = 3) out vec4 positionProjLightCoord;
+layout(location = 3) out vec4 positionWorldCoord;
 
 
 void main() {
@@ -31,7 +34,7 @@ void main() {
 	positionEyeCoord = perCamera.view * worldPos;
 	mat3 normalMatrix = mat3(transpose(inverse(perObject.modelMatrix)));
 	normalEyeCoord =  normalize(mat3(perCamera.view) * normalMatrix * inNormal);
-	positionProjLightCoord = perLight.lightSpaceMatrix * worldPos;
+	positionWorldCoord = worldPos; // light space position depends on the cascade, which is picked per fragment
     gl_Position = perCamera.proj * positionEyeCoord;
 }
 
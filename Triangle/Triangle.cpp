@@ -2,23 +2,27 @@
 #include <iostream>
 #include "VulkanGraphicPipeline.h"
 #include "VulkanHelper.h"
+#include "VulkanCpuProfiler.h"
 #include "glm/glm.hpp"
 #include "VulkanCompositeBuffer.h"
 #include "glm/gtc/matrix_transform.hpp"
 #include <chrono>
 #include <array>
+#include <limits>
+#include <algorithm>
 #include "VulkanPhysicalDevice.h"
 #include "Light.h"
+#include "VulkanPerDrawData.h"
+#include "VulkanShaderReflection.h"
+#include "VulkanRenderQueue.h"
+#include "VulkanPrepassStatistics.h"
+#include "VulkanThreadCommandPools.h"
+#include <random>
 #include "glm\gtx\transform.hpp"
 
 
 
-struct UBOData {
-	unsigned char* data = nullptr;
-	uint32_t total_size;
-	uint32_t stride;
-};
-
+// pushed before each box draw, see VulkanPerDrawData
 struct PerObject {
 	alignas(16) glm::mat4 model_matrix;
 	alignas(16) glm::vec3 color;
@@ -29,6 +33,12 @@ struct PerCamera {
 	alignas(16) glm::mat4 proj;
 };
 
+// packed descriptors of descriptor_update_template, one member per binding the shaders declare in binding order
+struct DrawDescriptors {
+	VkDescriptorBufferInfo per_camera;
+	VkDescriptorBufferInfo light;
+};
+
 struct Vertex {
 	alignas(16) glm::vec3 pos;
 	alignas(16) glm::vec3 normal;
@@ -113,18 +123,65 @@ const std::vector<PerObject> boxes_data = { // 10 matrices
 class TriangleDemo : public BaseDemo {
 
 private:
-	UBOData per_object_data;
+	vk::VulkanPerDrawData per_draw_data;
+	std::vector<float> box_depths; // view space depth of each box, the render queue draws the nearest first
+	// modules of the shader library, the descriptor set and pipeline layouts are built from what the shaders declare
+	VkShaderModule vert_shader_module;
+	VkShaderModule frag_shader_module;
+	VkShaderModule prepass_vert_shader_module;
+	vk::PipelineLayoutReflection pipeline_reflection;
 	VkDescriptorSetLayout descriptor_set_layout;
+	vk::VulkanDescriptorUpdateTemplate descriptor_update_template;
 	VkPipelineLayout pipeline_layout;
 	VkPipeline graphic_pipeline;
 	vk::VulkanCompositeBuffer vertex_buffer;
 	vk::VulkanCompositeBuffer index_buffer;
 	std::vector<vk::VulkanCompositeBuffer> light_uniform_buffers;
 	std::vector<vk::VulkanCompositeBuffer> per_camera_uniform_buffers;
-	std::vector<vk::VulkanCompositeBuffer> per_obj_uniform_buffers;
-	VkDescriptorPool descriptor_pool;
 	std::vector<VkDescriptorSet> descriptor_sets;
 
+	// depth pre-pass: a position only pipeline without fragment shader fills the depth buffer, then the color pass tests EQUAL without
+	// writing depth, so every pixel is shaded once
+	const static bool depth_prepass = true;
+	const static bool sort_front_to_back = true; // boxes are drawn nearest first
+	VkPipeline depth_prepass_pipeline;
+	VkPipeline depth_equal_pipeline;
+	// draws of the frame sorted by pipeline, descriptor set, mesh and depth, recorded without redundant binds. Pipeline ids follow the
+	// pass order: pre-pass, then depth equal, then the single pass pipeline
+	vk::RenderQueue render_queue;
+	uint32_t depth_prepass_pipeline_id;
+	uint32_t depth_equal_pipeline_id;
+	uint32_t graphic_pipeline_id;
+	uint32_t box_mesh_id;
+	std::vector<uint32_t> descriptor_set_ids; // per image
+	// fragment shader invocations of the frame with and without the pre-pass are printed every statistics_report_interval frames.
+	// The disabled variant is recorded in reference_cmd_buffers and submitted once every statistics_sample_interval frames to measure it
+	const static uint32_t statistics_report_interval = 500;
+	const static uint32_t statistics_sample_interval = 8;
+	// the query is active over the secondary command buffers of the frame, which needs inheritedQueries: without it nothing is measured
+	vk::VulkanPrepassStatistics prepass_statistics;
+	std::vector<VkCommandBuffer> reference_cmd_buffers;
+	bool inherited_queries_supported = false;
+	// RecordJobs splits the sorted draws of the frame into a range per job system thread and records each range into a secondary command
+	// buffer from the thread's pool, the primary command buffer only executes them. Ranges have at least record_job_min_draws draws, so a
+	// frame with few draws stays a single job
+	const static uint32_t record_job_min_draws = 256;
+	vk::VulkanThreadCommandPools thread_command_pools; // per frame slot and job system thread
+	bool frame_use_depth_prepass = depth_prepass; // the variant the jobs of the frame record
+	std::vector<VkCommandBuffer> frame_secondary_cmd_buffers; // one per range in draw order, written by the recording jobs
+	// the startup benchmarks below only run when turned on, they take a while and print to the console
+	const static bool run_benchmarks = false;
+	// the per draw recording cost of the ways to hand per object data to a draw is printed at startup, 0 draws skips it
+	const static uint32_t benchmark_draw_count = 10000;
+	const static uint32_t benchmark_repetitions = 5;
+	// sorting and recording cost of the render queue, printed once the first swapchain exists, 0 draws skips it
+	const static uint32_t render_queue_benchmark_draw_count = 100000;
+	bool render_queue_benchmarked = false;
+	// CPU time of recording draws into secondary command buffers with one job system thread and with all of them, printed once the first
+	// swapchain exists, 0 draws skips it
+	const static uint32_t parallel_recording_benchmark_draw_count = 100000;
+	bool parallel_recording_benchmarked = false;
+
 public:
 	const char* GetWindowTitle() override {
 		return "Triangle Demo";
@@ -143,10 +200,10 @@ public:
 	}
 
 	void Draw() override {
-		vkWaitForFences(this->logical_device, 1, &this->cmdbuffers_inflight[this->current_frame], VK_TRUE, UINT64_MAX);
+		WaitForFrameSlot();
+		this->thread_command_pools.Reset(this->current_frame);
 		uint32_t image_index;
-		VkResult result = vkAcquireNextImageKHR(this->logical_device, this->vulkan_swap_chain.swap_chain, UINT64_MAX, 
-			this->image_available_semaphores[this->current_frame], VK_NULL_HANDLE, &image_index);
+		VkResult result = AcquireNextImage(&image_index);
 		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
 			RecreateSwapChain();
 			return;
@@ -155,18 +212,27 @@ public:
 			throw std::runtime_error("fail to acquire swap chain image");
 		}
 		UpdateUniformBufferData(image_index);
-		if (this->images_inflight[image_index] != VK_NULL_HANDLE) {
-			vkWaitForFences(this->logical_device, 1, &this->images_inflight[image_index], VK_TRUE, UINT64_MAX);
+		if (this->images_inflight[image_index] != 0) {
+			WaitUntil(this->queues[0].timeline, this->images_inflight[image_index]);
+			this->prepass_statistics.ReadResults(image_index); // the previous submission using this image is done
 		}
-		this->images_inflight[image_index] = this->cmdbuffers_inflight[this->current_frame];
-		std::vector<VkSemaphore> wait_semaphores = { this->image_available_semaphores[this->current_frame]};
-		std::vector<VkPipelineStageFlags> wait_stages = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+		std::vector<vk::SemaphoreWait> waits = { { this->image_available_semaphores[this->current_frame], 0, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT } };
 		std::vector<VkSemaphore> signal_semaphores = { this->render_finished_semaphores[this->current_frame] };
 
-		vkResetFences(this->logical_device, 1, &this->cmdbuffers_inflight[current_frame]);
+		// the enabled variant, except for one frame every statistics_sample_interval where the other one is measured
+		bool use_depth_prepass = this->prepass_statistics.IsReferenceFrame(this->fps_count) ? !depth_prepass : depth_prepass;
+		VkCommandBuffer cmd_buffer = use_depth_prepass == depth_prepass ? this->draw_cmd_buffers[image_index] : this->reference_cmd_buffers[image_index];
+		this->prepass_statistics.SetSubmitted(image_index, use_depth_prepass);
+		// the per object data is pushed, so the command buffers are recorded with this frame's draw order
+		this->frame_use_depth_prepass = use_depth_prepass;
+		RunFrameJobs(image_index);
+		RecordDrawCmdBuffer(cmd_buffer, image_index, use_depth_prepass);
+		this->per_draw_data.Flush(image_index);
 		// queue[0] is present and graphic queue
-		this->queues[0].SubmitSingleCmdBuffer(wait_semaphores, wait_stages, this->draw_cmd_buffers[image_index], 
-			signal_semaphores, this->cmdbuffers_inflight[this->current_frame]);
+		std::vector<VkCommandBuffer> cmd_buffers = { cmd_buffer };
+		uint64_t frame_value = this->queues[0].Submit(waits, cmd_buffers, signal_semaphores);
+		this->frames_inflight[this->current_frame] = frame_value;
+		this->images_inflight[image_index] = frame_value;
 		result = this->queues[0].PresentImage(signal_semaphores, this->vulkan_swap_chain.swap_chain, image_index);
 		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || this->framebuffer_resized) {
 			this->framebuffer_resized = false;
@@ -179,71 +245,161 @@ public:
 	}
 
 	void CreatePermanentResources() override {
-		CreateUboDataArrays();
+		this->box_depths.resize(boxes_data.size());
 		CreateVertexAndIndexBuffers();
+		CreateShaderModules();
 		CreateDescriptorSetLayout();
+		this->thread_command_pools.Create(this->logical_device, this->queues[0].family_index, MAX_FRAMES_INFLIGHT, this->job_system.GetThreadCount());
+		BenchmarkDrawRecording();
 	}
 
 	void CleanupPermanentResources() override {
-		vkDestroyDescriptorSetLayout(this->logical_device, this->descriptor_set_layout, nullptr);
+		this->thread_command_pools.Destroy();
+		this->descriptor_update_template.Destroy();
 		this->index_buffer.DestroyBuffer();
 		this->vertex_buffer.DestroyBuffer();
-		CleanupUboDataArrays();
 	};
 
 	void CreateNonPermanentResources() override {
+		// 80 bytes, within the 128 bytes of push constants every device has
+		this->per_draw_data.Create(this->physical_device, this->logical_device, sizeof(PerObject), static_cast<uint32_t>(boxes_data.size()),
+			this->vulkan_swap_chain.image_count, VK_SHADER_STAGE_VERTEX_BIT, vk::PerDrawDataPath::PUSH_CONSTANTS);
 		CreatePipelines();
 		CreateUniformBuffers();
-		CreateDescriptorPool();
 		CreateDescriptorSets();
+		CreateRenderQueue();
+		if (this->inherited_queries_supported) {
+			this->prepass_statistics.Create(this->physical_device, this->logical_device, this->vulkan_swap_chain.image_count, "box pass",
+				statistics_report_interval, statistics_sample_interval);
+		}
 		CreateDrawCmdBuffers();
+		BenchmarkRenderQueue();
+		BenchmarkParallelRecording();
 	}
 
 	void CleanupNonPermanentResources() override {
 		vkFreeCommandBuffers(this->logical_device, this->command_pool, static_cast<uint32_t>(this->draw_cmd_buffers.size()), this->draw_cmd_buffers.data());
-		vkDestroyDescriptorPool(this->logical_device, this->descriptor_pool, nullptr);
+		if (this->prepass_statistics.IsEnabled()) {
+			vkFreeCommandBuffers(this->logical_device, this->command_pool, static_cast<uint32_t>(this->reference_cmd_buffers.size()), this->reference_cmd_buffers.data());
+		}
+		this->prepass_statistics.Destroy();
+		this->render_queue.Reset();
 		CleanupUniformBuffers();
 		CleanupPipelines();
+		this->per_draw_data.Destroy();
 	}
 
+	// recorded in Draw, once the previous submission of the image is done
 	void CreateDrawCmdBuffers() {
+		this->draw_cmd_buffers.resize(this->vulkan_swap_chain.image_count);
+		vk::init::CreateCmdBuffer(this->logical_device, this->command_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, this->vulkan_swap_chain.image_count, this->draw_cmd_buffers.data());
+		if (!this->prepass_statistics.IsEnabled()) {
+			return;
+		}
+		this->reference_cmd_buffers.resize(this->vulkan_swap_chain.image_count);
+		vk::init::CreateCmdBuffer(this->logical_device, this->command_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, this->vulkan_swap_chain.image_count, this->reference_cmd_buffers.data());
+	}
+
+	// executes the secondary command buffers RecordJobs recorded for the frame
+	void RecordDrawCmdBuffer(VkCommandBuffer cmd_buffer, uint32_t image_index, bool use_depth_prepass) {
+		CPU_PROFILE_FUNCTION();
 		std::vector<VkClearValue> clear_values = { {}, {} };
 		clear_values[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
 		clear_values[1].depthStencil = { 1.0f, 0 };
-		VkDeviceSize vertex_offsets[] = { 0 };
 
-		this->draw_cmd_buffers.resize(this->vulkan_swap_chain.image_count);
-		vk::init::CreateCmdBuffer(this->logical_device, this->command_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, this->vulkan_swap_chain.image_count, this->draw_cmd_buffers.data());
-		for (uint32_t i = 0; i < this->draw_cmd_buffers.size(); i++) {
-			vk::util::BeginCmdBuffer(this->draw_cmd_buffers[i], VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT, nullptr);
-
-			vk::util::BeginRenderpass(this->draw_cmd_buffers[i], this->renderpass, 
-				this->swapchain_framebuffers[i], { 0,0 }, this->vulkan_swap_chain.swap_extent, clear_values, VK_SUBPASS_CONTENTS_INLINE);
-
-			vkCmdBindPipeline(this->draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, this->graphic_pipeline);
-			vkCmdBindVertexBuffers(this->draw_cmd_buffers[i], 0, 1, &this->vertex_buffer.buffer, vertex_offsets);
-			vkCmdBindIndexBuffer(this->draw_cmd_buffers[i], this->index_buffer.buffer, 0, VK_INDEX_TYPE_UINT16);
-			for (uint32_t j = 0; j < boxes_data.size(); j++) { //draw boxes
-				uint32_t dynamic_alignment = j * this->per_object_data.stride;
-				vkCmdBindDescriptorSets(this->draw_cmd_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-					this->pipeline_layout, 0, 1, &this->descriptor_sets[i], 1, &dynamic_alignment);
-				vkCmdDrawIndexed(this->draw_cmd_buffers[i], static_cast<uint32_t>(cube_indices.size()), 1, 0, 0, 0);
-			}
-			
-			vkCmdEndRenderPass(this->draw_cmd_buffers[i]);
+		vk::util::BeginCmdBuffer(cmd_buffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, nullptr);
+		this->prepass_statistics.CmdBegin(cmd_buffer, image_index, use_depth_prepass);
 
-			if (vkEndCommandBuffer(this->draw_cmd_buffers[i]) != VK_SUCCESS) {
-				throw std::runtime_error("fail to end command buffer recording");
-			}
+		vk::util::BeginRenderpass(cmd_buffer, this->renderpass, this->swapchain_framebuffers[image_index], { 0,0 }, this->vulkan_swap_chain.swap_extent,
+			clear_values, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		if (!this->frame_secondary_cmd_buffers.empty()) {
+			vkCmdExecuteCommands(cmd_buffer, static_cast<uint32_t>(this->frame_secondary_cmd_buffers.size()), this->frame_secondary_cmd_buffers.data());
+		}
+
+		vkCmdEndRenderPass(cmd_buffer);
+		this->prepass_statistics.CmdEnd(cmd_buffer, image_index, use_depth_prepass);
+
+		if (vkEndCommandBuffer(cmd_buffer) != VK_SUCCESS) {
+			throw std::runtime_error("fail to end command buffer recording");
 		}
 	}
 
-	void CreatePipelines() {
-		VkShaderModule vert_shader_module = vk::CreateShaderModule(this->logical_device, "shaders/firstpass_vert.spv");
-		VkShaderModule frag_shader_module = vk::CreateShaderModule(this->logical_device, "shaders/firstpass_frag.spv");
+	// sorts the draws of the frame on the calling thread, then records a range of them per job. The per object data is pushed, so
+	// per_draw_data.Record only records commands and can be called from several threads
+	void RecordJobs(uint32_t image_index, vk::JobCounter& counter) override {
+		this->render_queue.Clear();
+		if (this->frame_use_depth_prepass) {
+			PushBoxDraws(image_index, this->depth_prepass_pipeline_id);
+			PushBoxDraws(image_index, this->depth_equal_pipeline_id);
+		}
+		else {
+			PushBoxDraws(image_index, this->graphic_pipeline_id);
+		}
+		this->render_queue.Sort();
+		RecordSecondaryCmdBuffers(this->render_queue, this->current_frame, image_index, this->job_system.GetThreadCount(), record_job_min_draws, counter);
+	}
+
+	// splits the queue's draws into at most range_count ranges of at least min_draws draws, and records each range into a secondary command
+	// buffer of the frame slot from a job. frame_secondary_cmd_buffers gets the buffers in draw order once counter is done
+	void RecordSecondaryCmdBuffers(vk::RenderQueue& queue, uint32_t frame, uint32_t image_index, uint32_t range_count, uint32_t min_draws,
+		vk::JobCounter& counter) {
+		uint32_t draw_count = queue.GetDrawCount();
+		range_count = std::max(1u, std::min(range_count, draw_count / std::max(1u, min_draws)));
+		uint32_t range_size = (draw_count + range_count - 1) / range_count;
+		this->frame_secondary_cmd_buffers.assign(draw_count == 0 ? 0 : (draw_count + range_size - 1) / range_size, VK_NULL_HANDLE);
+		for (uint32_t range = 0; range < this->frame_secondary_cmd_buffers.size(); range++) {
+			uint32_t first_draw = range * range_size;
+			uint32_t range_draw_count = std::min(range_size, draw_count - first_draw);
+			this->job_system.Run([this, &queue, frame, image_index, range, first_draw, range_draw_count]() {
+				CPU_PROFILE_ZONE("RecordDrawRange");
+				VkCommandBuffer cmd_buffer = this->thread_command_pools.AllocateSecondary(frame);
+				VkCommandBufferInheritanceInfo inheritance_info = {};
+				inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+				inheritance_info.renderPass = this->renderpass;
+				inheritance_info.subpass = 0;
+				inheritance_info.framebuffer = this->swapchain_framebuffers[image_index];
+				// the primary command buffer's statistics query counts the draws of the secondary ones
+				inheritance_info.pipelineStatistics = this->prepass_statistics.IsEnabled() ? VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT : 0;
+				vk::util::BeginCmdBuffer(cmd_buffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+					&inheritance_info);
+				// the draws of the benchmark repeat the boxes
+				queue.RecordRange(cmd_buffer, first_draw, range_draw_count, [this](VkCommandBuffer cmd_buffer, VkPipelineLayout pipeline_layout, uint32_t box) {
+					this->per_draw_data.Record(cmd_buffer, pipeline_layout, box, boxes_data[box % boxes_data.size()]);
+				}, nullptr);
+				if (vkEndCommandBuffer(cmd_buffer) != VK_SUCCESS) {
+					throw std::runtime_error("fail to end command buffer recording");
+				}
+				this->frame_secondary_cmd_buffers[range] = cmd_buffer;
+			}, &counter);
+		}
+	}
+
+	void PushBoxDraws(uint32_t image_index, uint32_t pipeline_id) {
+		for (uint32_t j = 0; j < boxes_data.size(); j++) {
+			this->render_queue.Push(pipeline_id, this->descriptor_set_ids[image_index], this->box_mesh_id, this->box_depths[j], j);
+		}
+	}
+
+	// every pipeline shares the layout, so the set stays bound across pipeline binds
+	void CreateRenderQueue() {
+		this->depth_prepass_pipeline_id = this->render_queue.AddPipeline(this->depth_prepass_pipeline, this->pipeline_layout);
+		this->depth_equal_pipeline_id = this->render_queue.AddPipeline(this->depth_equal_pipeline, this->pipeline_layout);
+		this->graphic_pipeline_id = this->render_queue.AddPipeline(this->graphic_pipeline, this->pipeline_layout);
+		this->descriptor_set_ids.resize(this->descriptor_sets.size());
+		for (uint32_t i = 0; i < this->descriptor_sets.size(); i++) {
+			this->descriptor_set_ids[i] = this->render_queue.AddDescriptorSet(this->descriptor_sets[i]);
+		}
+		vk::RenderMesh box_mesh = {};
+		box_mesh.vertex_buffer = this->vertex_buffer.buffer;
+		box_mesh.index_buffer = this->index_buffer.buffer;
+		box_mesh.index_type = VK_INDEX_TYPE_UINT16;
+		box_mesh.index_count = static_cast<uint32_t>(cube_indices.size());
+		this->box_mesh_id = this->render_queue.AddMesh(box_mesh);
+	}
 
-		VkPipelineShaderStageCreateInfo vert_shader_create_info = vk::CreateShaderStageCreateInfo(vert_shader_module, VK_SHADER_STAGE_VERTEX_BIT);
-		VkPipelineShaderStageCreateInfo frag_shader_create_info = vk::CreateShaderStageCreateInfo(frag_shader_module, VK_SHADER_STAGE_FRAGMENT_BIT);
+	void CreatePipelines() {
+		VkPipelineShaderStageCreateInfo vert_shader_create_info = vk::CreateShaderStageCreateInfo(this->vert_shader_module, VK_SHADER_STAGE_VERTEX_BIT);
+		VkPipelineShaderStageCreateInfo frag_shader_create_info = vk::CreateShaderStageCreateInfo(this->frag_shader_module, VK_SHADER_STAGE_FRAGMENT_BIT);
 		
 		VkPipelineShaderStageCreateInfo shader_stages[] = { vert_shader_create_info, frag_shader_create_info };
 
@@ -284,9 +440,10 @@ public:
 		std::vector<VkDynamicState> states = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
 		VkPipelineDynamicStateCreateInfo dynamic_state = vk::CreateDynamicStateCreateInfo(states);
 
-		std::vector<VkPushConstantRange> constant_ranges;
-		std::vector<VkDescriptorSetLayout> descriptor_set_layouts = {this->descriptor_set_layout};
-		vk::CreatePipelineLayout(this->logical_device , descriptor_set_layouts, constant_ranges, &this->pipeline_layout);
+		// set 0 comes back from the layout cache as descriptor_set_layout
+		this->pipeline_reflection.CheckPushConstantRange(this->per_draw_data.GetPushConstantRange());
+		std::vector<VkDescriptorSetLayout> descriptor_set_layouts;
+		this->pipeline_reflection.CreatePipelineLayout(this->logical_device, this->descriptor_layout_cache, descriptor_set_layouts, &this->pipeline_layout);
 
 		VkGraphicsPipelineCreateInfo pipeline_info = {};
 		pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
@@ -310,11 +467,32 @@ public:
 			throw std::runtime_error("fail to create graphics pipeline");
 		}
 
-		vkDestroyShaderModule(this->logical_device, frag_shader_module, nullptr);
-		vkDestroyShaderModule(this->logical_device, vert_shader_module, nullptr);
+		// depth pre-pass pipeline: positions only, no fragment shader and no color writes
+		shader_stages[0] = vk::CreateShaderStageCreateInfo(this->prepass_vert_shader_module, VK_SHADER_STAGE_VERTEX_BIT);
+		std::vector<VkVertexInputAttributeDescription> position_attrib_descs = { input_attrib_descs[0] };
+		VkPipelineVertexInputStateCreateInfo position_input_info = vk::CreateVertexInputStateCreateInfo(input_binding_descs, position_attrib_descs);
+		blend_attachment_states[0].colorWriteMask = 0;
+		pipeline_info.stageCount = 1;
+		pipeline_info.pVertexInputState = &position_input_info;
+		if (vkCreateGraphicsPipelines(this->logical_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &this->depth_prepass_pipeline) != VK_SUCCESS) {
+			throw std::runtime_error("fail to create depth prepass pipeline");
+		}
+
+		// color pass after the pre-pass: only the fragments that won the depth test are shaded
+		shader_stages[0] = vert_shader_create_info;
+		blend_attachment_states[0].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+		depth_stencil.depthWriteEnable = VK_FALSE;
+		depth_stencil.depthCompareOp = VK_COMPARE_OP_EQUAL;
+		pipeline_info.stageCount = 2;
+		pipeline_info.pVertexInputState = &vertex_input_info;
+		if (vkCreateGraphicsPipelines(this->logical_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &this->depth_equal_pipeline) != VK_SUCCESS) {
+			throw std::runtime_error("fail to create depth equal pipeline");
+		}
 	}
 
 	void CleanupPipelines() {
+		vkDestroyPipeline(this->logical_device, this->depth_equal_pipeline, nullptr);
+		vkDestroyPipeline(this->logical_device, this->depth_prepass_pipeline, nullptr);
 		vkDestroyPipeline(this->logical_device, this->graphic_pipeline, nullptr);
 		vkDestroyPipelineLayout(this->logical_device, this->pipeline_layout, nullptr);
 	}
@@ -331,6 +509,16 @@ public:
 		return { req0 };
 	}
 
+	VkPhysicalDeviceFeatures GetDeviceFeatures() override {
+		VkPhysicalDeviceFeatures device_features = {};
+		vk::VulkanPrepassStatistics::EnableRequiredFeatures(this->physical_device, device_features);
+		VkPhysicalDeviceFeatures supported_features;
+		vkGetPhysicalDeviceFeatures(this->physical_device, &supported_features);
+		this->inherited_queries_supported = supported_features.inheritedQueries == VK_TRUE;
+		device_features.inheritedQueries = supported_features.inheritedQueries;
+		return device_features;
+	}
+
 	void CreateVertexAndIndexBuffers() {
 		VkDeviceSize buffer_size = sizeof(Vertex) * cube.size();
 		VkDeviceSize index_buffer_size = sizeof(cube_indices[0]) * cube_indices.size();
@@ -353,33 +541,39 @@ public:
 		this->index_buffer.CreateBuffer(this->logical_device, this->physical_device, index_buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
 			VK_SHARING_MODE_EXCLUSIVE, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 		
-		// create fences
-		VkFence transfer_finished_fences[2];
-		vk::init::CreateFence(this->logical_device, 0, &transfer_finished_fences[0]); // create fence in unsignaled state
-		vk::init::CreateFence(this->logical_device, 0, &transfer_finished_fences[1]); // create fence in unsignaled state
 		//transfer
-		this->vertex_buffer.TransferFromAnotherBuffer(staging_buffer, this->command_pool, 0, 0, buffer_size, this->queues[0], transfer_finished_fences[0]);
-		this->index_buffer.TransferFromAnotherBuffer(staging_index_buffer, this->command_pool, 0, 0, index_buffer_size, this->queues[0], transfer_finished_fences[1]);
-		// wait for transfer to finish
-		vkWaitForFences(this->logical_device, 2, transfer_finished_fences, VK_TRUE, UINT64_MAX);
+		this->vertex_buffer.TransferFromAnotherBuffer(staging_buffer, this->command_pool, 0, 0, buffer_size, this->queues[0]);
+		uint64_t transfers_finished = this->index_buffer.TransferFromAnotherBuffer(staging_index_buffer, this->command_pool, 0, 0, index_buffer_size, this->queues[0]);
+		// wait for transfer to finish, the last value of the queue also covers the transfers submitted before it
+		this->queues[0].timeline.WaitUntil(transfers_finished);
 		
-		//cleanup fences and staging buffers
-		vkDestroyFence(this->logical_device, transfer_finished_fences[0], nullptr);
-		vkDestroyFence(this->logical_device, transfer_finished_fences[1], nullptr);
-
+		//cleanup staging buffers
 		staging_buffer.DestroyBuffer();
 		staging_index_buffer.DestroyBuffer();
 	}
 
 
-	void CreateDescriptorSetLayout(){
-		std::vector<VkDescriptorSetLayoutBinding> layout_bindings = {
-			vk::init::CreateDescriptorSetLayoutBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT),
-			vk::init::CreateDescriptorSetLayoutBinding(1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT),
-			vk::init::CreateDescriptorSetLayoutBinding(2, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT) //4 is number of lights
-		};
+	// the vertex inputs of the shaders are checked against Vertex, and the stages against each other, so a shader out of sync fails here
+	void CreateShaderModules() {
+		vk::ShaderReflection vert_reflection;
+		vk::ShaderReflection frag_reflection;
+		vk::ShaderReflection prepass_vert_reflection;
+		this->vert_shader_module = this->shader_library.Get("shaders/firstpass_vert.spv", vert_reflection);
+		this->frag_shader_module = this->shader_library.Get("shaders/firstpass_frag.spv", frag_reflection);
+		this->prepass_vert_shader_module = this->shader_library.Get("shaders/depth_prepass_vert.spv", prepass_vert_reflection);
+		std::vector<VkVertexInputAttributeDescription> input_attrib_descs = Vertex::GetAttributeDescriptions();
+		std::vector<VkVertexInputAttributeDescription> position_attrib_descs = { input_attrib_descs[0] };
+		vert_reflection.CheckVertexInputs(input_attrib_descs);
+		prepass_vert_reflection.CheckVertexInputs(position_attrib_descs);
+		this->pipeline_reflection.AddStage(vert_reflection);
+		this->pipeline_reflection.AddStage(frag_reflection);
+		this->pipeline_reflection.AddStage(prepass_vert_reflection);
+	}
 
-		vk::init::CreateDescriptorSetLayout(this->logical_device, layout_bindings, &this->descriptor_set_layout);
+	void CreateDescriptorSetLayout(){
+		std::vector<VkDescriptorSetLayoutBinding> layout_bindings = this->pipeline_reflection.GetSetBindings(0);
+		this->descriptor_set_layout = this->descriptor_layout_cache.CreateDescriptorSetLayout(layout_bindings);
+		this->descriptor_update_template.Create(this->logical_device, this->descriptor_set_layout, layout_bindings);
 	}
 
 	void CreateUniformBuffers() {
@@ -395,19 +589,9 @@ public:
 			this->per_camera_uniform_buffers[i].CreateBuffer(this->logical_device, this->physical_device, camera_uniform_buffer_size,
 				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_SHARING_MODE_EXCLUSIVE, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 		}
-		VkDeviceSize model_uniform_buffer_size = this->per_object_data.total_size;
-		this->per_obj_uniform_buffers.resize(this->vulkan_swap_chain.image_count);
-		for (uint32_t i = 0; i < this->per_obj_uniform_buffers.size(); i++) {
-			this->per_obj_uniform_buffers[i].CreateBuffer(this->logical_device, this->physical_device, model_uniform_buffer_size,
-				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_SHARING_MODE_EXCLUSIVE, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-			// in real world, dont do host coherent, but do a manual flush of the updated buffer memory part for better performance. ie:  vkFlushMappedMemoryRanges.
-		}
 	}
 
 	void CleanupUniformBuffers() {
-		for (uint32_t i = 0; i < this->per_obj_uniform_buffers.size(); i++) {
-			per_obj_uniform_buffers[i].DestroyBuffer();
-		}
 		for (uint32_t i = 0; i < this->per_camera_uniform_buffers.size(); i++) {
 			per_camera_uniform_buffers[i].DestroyBuffer();
 		}
@@ -417,6 +601,7 @@ public:
 	}
 
 	void UpdateUniformBufferData(uint32_t current_image) {
+		CPU_PROFILE_FUNCTION();
 		static auto start_time = std::chrono::high_resolution_clock::now();
 		auto current_time = std::chrono::high_resolution_clock::now();
 		float elapsed = std::chrono::duration<float, std::chrono::seconds::period>(current_time - start_time).count();
@@ -436,60 +621,258 @@ public:
 		light.linear = 0.09f;
 		light.quadratic = 0.032f;
 	
-		// uses to draw both light sources and cubes
-		unsigned char* obj_ptr = this->per_object_data.data;
+		// without sorting every box has the same depth, and the queue keeps them in array order
 		for (uint32_t i = 0; i < boxes_data.size(); i++) {
-			PerObject per_obj = boxes_data[i];
-			per_obj.model_matrix = per_obj.model_matrix;
-			*reinterpret_cast<PerObject*>(obj_ptr) = per_obj;
-			obj_ptr += this->per_object_data.stride;
+			this->box_depths[i] = sort_front_to_back ? -(mvp.view * boxes_data[i].model_matrix[3]).z : 0.0f; // camera looks down -z
 		}
 		this->light_uniform_buffers[current_image].CopyFromHostData(&light, sizeof(cg::PointLight), 0);
 		this->per_camera_uniform_buffers[current_image].CopyFromHostData(&mvp, sizeof(PerCamera), 0);
-		this->per_obj_uniform_buffers[current_image].CopyFromHostData(this->per_object_data.data, this->per_object_data.total_size, 0);;
-	}
-
-	void CreateDescriptorPool() {
-		std::vector<VkDescriptorPoolSize> poolsizes = {
-			{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, this->vulkan_swap_chain.image_count * 2},
-			{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, this->vulkan_swap_chain.image_count}
-		};
-		vk::init::CreateDescriptorPool(this->logical_device, poolsizes, this->vulkan_swap_chain.image_count * 3, &this->descriptor_pool);
 	}
 
 	void CreateDescriptorSets() {
 		this->descriptor_sets.resize(this->vulkan_swap_chain.image_count);
-		std::vector<VkDescriptorSetLayout> layouts(this->vulkan_swap_chain.image_count, this->descriptor_set_layout);
-		vk::init::AllocateDescriptorSets(this->logical_device, this->descriptor_pool, layouts, this->descriptor_sets);
-
 		for (uint32_t i = 0; i < this->descriptor_sets.size(); i++) {
+			DrawDescriptors descriptors = {};
+			descriptors.per_camera = vk::init::CreateDescriptorBufferInfo(this->per_camera_uniform_buffers[i].buffer, 0, sizeof(PerCamera));
+			descriptors.light = vk::init::CreateDescriptorBufferInfo(this->light_uniform_buffers[i].buffer, 0, sizeof(cg::PointLight));
+			this->descriptor_sets[i] = this->descriptor_set_cache.Get(this->descriptor_update_template, descriptors);
+		}
+	}
 
-			std::vector<VkWriteDescriptorSet> descriptor_writes;
-
-			VkDescriptorBufferInfo binding0_info = vk::init::CreateDescriptorBufferInfo(this->per_camera_uniform_buffers[i].buffer, 0, sizeof(PerCamera));
-			descriptor_writes.push_back(vk::init::CreateWriteDescriptorSet(this->descriptor_sets[i], 0, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, &binding0_info, nullptr));
+	// records benchmark_draw_count draws' worth of per object data into a command buffer that is never submitted, once per way of handing
+	// it to a draw, and prints the best time per draw out of benchmark_repetitions. Only the per draw commands are recorded: no pipeline
+	// is bound and nothing is drawn, the draw call itself costs the same on every path
+	void BenchmarkDrawRecording() {
+		if (!run_benchmarks || benchmark_draw_count == 0) {
+			return;
+		}
+		// the path the boxes used before: a dynamic uniform buffer written once per frame, rebound with the offset of each draw
+		const uint32_t dynamic_slot_count = 64;
+		uint32_t dynamic_stride = vk::util::CalculateObjectSize(sizeof(PerObject), vk::GetMinUniformBufferAlignment(this->physical_device));
+		std::vector<unsigned char> dynamic_data(dynamic_stride * dynamic_slot_count);
+		vk::VulkanCompositeBuffer dynamic_buffer;
+		dynamic_buffer.CreateBuffer(this->logical_device, this->physical_device, dynamic_data.size(), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+			VK_SHARING_MODE_EXCLUSIVE, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		std::vector<VkDescriptorSetLayoutBinding> bindings = {
+			vk::init::CreateDescriptorSetLayoutBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT)
+		};
+		// neither the layout nor the set are cached, both are released at the end with the allocator they come from
+		VkDescriptorSetLayout dynamic_layout;
+		vk::init::CreateDescriptorSetLayout(this->logical_device, bindings, &dynamic_layout);
+		vk::VulkanDescriptorAllocator benchmark_allocator;
+		benchmark_allocator.Create(this->logical_device, 1);
+		benchmark_allocator.AddLayout(dynamic_layout, bindings);
+		VkDescriptorSet dynamic_set = benchmark_allocator.Allocate(dynamic_layout);
+		VkDescriptorBufferInfo buffer_info = vk::init::CreateDescriptorBufferInfo(dynamic_buffer.buffer, 0, sizeof(PerObject));
+		VkWriteDescriptorSet write = vk::init::CreateWriteDescriptorSet(dynamic_set, 0, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, &buffer_info, nullptr);
+		vkUpdateDescriptorSets(this->logical_device, 1, &write, 0, nullptr);
+
+		vk::VulkanPerDrawData pushed_payloads;
+		pushed_payloads.Create(this->physical_device, this->logical_device, sizeof(PerObject), benchmark_draw_count, 1, VK_SHADER_STAGE_VERTEX_BIT,
+			vk::PerDrawDataPath::PUSH_CONSTANTS);
+		vk::VulkanPerDrawData indexed_payloads;
+		indexed_payloads.Create(this->physical_device, this->logical_device, sizeof(PerObject), benchmark_draw_count, 1, VK_SHADER_STAGE_VERTEX_BIT,
+			vk::PerDrawDataPath::STORAGE_BUFFER);
+		// the pushed range covers the index of the storage buffer path too
+		std::vector<VkDescriptorSetLayout> set_layouts = { dynamic_layout };
+		std::vector<VkPushConstantRange> constant_ranges = { pushed_payloads.GetPushConstantRange() };
+		VkPipelineLayout benchmark_pipeline_layout;
+		vk::CreatePipelineLayout(this->logical_device, set_layouts, constant_ranges, &benchmark_pipeline_layout);
+
+		VkCommandBuffer cmd_buffer;
+		vk::init::CreateCmdBuffer(this->logical_device, this->command_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1, &cmd_buffer);
+		const char* path_names[3] = { "dynamic uniform buffer offset", "push constant payload", "push constant index into a storage buffer" };
+		for (uint32_t path = 0; path < 3; path++) {
+			double best_seconds = std::numeric_limits<double>::max();
+			for (uint32_t r = 0; r < benchmark_repetitions; r++) {
+				auto start_time = std::chrono::high_resolution_clock::now();
+				vk::util::BeginCmdBuffer(cmd_buffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, nullptr);
+				for (uint32_t j = 0; j < benchmark_draw_count; j++) {
+					const PerObject& payload = boxes_data[j % boxes_data.size()];
+					if (path == 0) {
+						uint32_t slot_offset = (j % dynamic_slot_count) * dynamic_stride;
+						*reinterpret_cast<PerObject*>(dynamic_data.data() + slot_offset) = payload;
+						vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, benchmark_pipeline_layout, 0, 1, &dynamic_set, 1, &slot_offset);
+					}
+					else if (path == 1) {
+						pushed_payloads.Record(cmd_buffer, benchmark_pipeline_layout, j, payload);
+					}
+					else {
+						indexed_payloads.Record(cmd_buffer, benchmark_pipeline_layout, j, payload);
+					}
+				}
+				if (vkEndCommandBuffer(cmd_buffer) != VK_SUCCESS) {
+					throw std::runtime_error("fail to end command buffer recording");
+				}
+				// the uploads are part of the cost of the buffer paths
+				if (path == 0) {
+					dynamic_buffer.CopyFromHostData(dynamic_data.data(), static_cast<uint32_t>(dynamic_data.size()), 0);
+				}
+				indexed_payloads.Flush(0);
+				auto end_time = std::chrono::high_resolution_clock::now();
+				best_seconds = std::min(best_seconds, std::chrono::duration<double, std::chrono::seconds::period>(end_time - start_time).count());
+			}
+			std::cout << "per draw recording cost, " << path_names[path] << ": " << best_seconds * 1e9 / benchmark_draw_count << " ns" << std::endl;
+		}
 
-			VkDescriptorBufferInfo binding1_info = vk::init::CreateDescriptorBufferInfo(this->per_obj_uniform_buffers[i].buffer, 0, sizeof(PerObject)); //https://www.khronos.org/registry/vulkan/specs/1.2-extensions/man/html/VkDescriptorBufferInfo.html
-			descriptor_writes.push_back(vk::init::CreateWriteDescriptorSet(this->descriptor_sets[i], 1, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, &binding1_info, nullptr));
+		vkFreeCommandBuffers(this->logical_device, this->command_pool, 1, &cmd_buffer);
+		vkDestroyPipelineLayout(this->logical_device, benchmark_pipeline_layout, nullptr);
+		indexed_payloads.Destroy();
+		pushed_payloads.Destroy();
+		benchmark_allocator.Destroy();
+		vkDestroyDescriptorSetLayout(this->logical_device, dynamic_layout, nullptr);
+		dynamic_buffer.DestroyBuffer();
+	}
 
-			VkDescriptorBufferInfo binding2_info = vk::init::CreateDescriptorBufferInfo(this->light_uniform_buffers[i].buffer, 0, sizeof(cg::PointLight)); //https://www.khronos.org/registry/vulkan/specs/1.2-extensions/man/html/VkDescriptorBufferInfo.html
-			descriptor_writes.push_back(vk::init::CreateWriteDescriptorSet(this->descriptor_sets[i], 2, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, &binding2_info, nullptr));
-			vkUpdateDescriptorSets(this->logical_device, static_cast<uint32_t>(descriptor_writes.size()), descriptor_writes.data(), 0, nullptr);
+	// pushes render_queue_benchmark_draw_count draws with random pipelines, descriptor sets, meshes and depths into a queue of their own,
+	// and records them into a command buffer that is never submitted, in push order and sorted. Prints the best times out of
+	// benchmark_repetitions with the binds each order needs. The meshes are the faces of the box at different vertex buffer offsets,
+	// so changing mesh rebinds the vertex buffer. Each draw pushes the per object data of a box, as the pipeline layout declares
+	void BenchmarkRenderQueue() {
+		if (!run_benchmarks || render_queue_benchmark_draw_count == 0 || this->render_queue_benchmarked) {
+			return;
+		}
+		this->render_queue_benchmarked = true;
+		vk::RenderQueue queue;
+		uint32_t pipeline_ids[3] = {
+			queue.AddPipeline(this->depth_prepass_pipeline, this->pipeline_layout),
+			queue.AddPipeline(this->depth_equal_pipeline, this->pipeline_layout),
+			queue.AddPipeline(this->graphic_pipeline, this->pipeline_layout)
+		};
+		for (VkDescriptorSet descriptor_set : this->descriptor_sets) {
+			queue.AddDescriptorSet(descriptor_set);
+		}
+		const uint32_t face_count = 6;
+		for (uint32_t face = 0; face < face_count; face++) {
+			vk::RenderMesh face_mesh = {};
+			face_mesh.vertex_buffer = this->vertex_buffer.buffer;
+			face_mesh.vertex_buffer_offset = face * 4 * sizeof(Vertex);
+			face_mesh.index_buffer = this->index_buffer.buffer;
+			face_mesh.index_type = VK_INDEX_TYPE_UINT16;
+			face_mesh.first_index = face * 6;
+			face_mesh.index_count = 6;
+			face_mesh.vertex_offset = -static_cast<int32_t>(face * 4); // indices count from the start of the buffer
+			queue.AddMesh(face_mesh);
+		}
+		struct RandomDraw {
+			uint32_t pipeline;
+			uint32_t descriptor_set;
+			uint32_t mesh;
+			float depth;
+		};
+		std::mt19937 random_engine(7);
+		std::uniform_real_distribution<float> depth_distribution(0.1f, 1000.0f);
+		std::vector<RandomDraw> random_draws(render_queue_benchmark_draw_count);
+		for (RandomDraw& draw : random_draws) {
+			draw.pipeline = pipeline_ids[random_engine() % 3];
+			draw.descriptor_set = static_cast<uint32_t>(random_engine() % this->descriptor_sets.size());
+			draw.mesh = random_engine() % face_count;
+			draw.depth = depth_distribution(random_engine);
+		}
 
+		VkCommandBuffer cmd_buffer;
+		vk::init::CreateCmdBuffer(this->logical_device, this->command_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1, &cmd_buffer);
+		std::vector<VkClearValue> clear_values = { {}, {} };
+		double best_push_seconds = std::numeric_limits<double>::max();
+		double best_sort_seconds = std::numeric_limits<double>::max();
+		double best_std_sort_seconds = std::numeric_limits<double>::max();
+		double best_record_seconds[2] = { std::numeric_limits<double>::max(), std::numeric_limits<double>::max() };
+		vk::RenderQueueStatistics statistics[2];
+		std::vector<uint64_t> keys(random_draws.size());
+		for (uint32_t r = 0; r < benchmark_repetitions; r++) {
+			for (uint32_t sorted = 0; sorted < 2; sorted++) {
+				auto start_time = std::chrono::high_resolution_clock::now();
+				queue.Clear();
+				for (uint32_t j = 0; j < random_draws.size(); j++) {
+					queue.Push(random_draws[j].pipeline, random_draws[j].descriptor_set, random_draws[j].mesh, random_draws[j].depth, j);
+				}
+				auto pushed_time = std::chrono::high_resolution_clock::now();
+				if (sorted == 1) {
+					queue.Sort();
+				}
+				auto sorted_time = std::chrono::high_resolution_clock::now();
+				vk::util::BeginCmdBuffer(cmd_buffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, nullptr);
+				vk::util::BeginRenderpass(cmd_buffer, this->renderpass, this->swapchain_framebuffers[0], { 0,0 }, this->vulkan_swap_chain.swap_extent,
+					clear_values, VK_SUBPASS_CONTENTS_INLINE);
+				queue.Record(cmd_buffer, [this](VkCommandBuffer cmd_buffer, VkPipelineLayout pipeline_layout, uint32_t draw) {
+					uint32_t box = draw % static_cast<uint32_t>(boxes_data.size());
+					this->per_draw_data.Record(cmd_buffer, pipeline_layout, box, boxes_data[box]);
+				});
+				vkCmdEndRenderPass(cmd_buffer);
+				if (vkEndCommandBuffer(cmd_buffer) != VK_SUCCESS) {
+					throw std::runtime_error("fail to end command buffer recording");
+				}
+				auto end_time = std::chrono::high_resolution_clock::now();
+				best_push_seconds = std::min(best_push_seconds, std::chrono::duration<double, std::chrono::seconds::period>(pushed_time - start_time).count());
+				if (sorted == 1) {
+					best_sort_seconds = std::min(best_sort_seconds, std::chrono::duration<double, std::chrono::seconds::period>(sorted_time - pushed_time).count());
+				}
+				best_record_seconds[sorted] = std::min(best_record_seconds[sorted], std::chrono::duration<double, std::chrono::seconds::period>(end_time - sorted_time).count());
+				statistics[sorted] = queue.GetStatistics();
+			}
+			// comparison sort of the same keys
+			for (uint32_t j = 0; j < random_draws.size(); j++) {
+				keys[j] = vk::RenderQueue::MakeKey(random_draws[j].pipeline, random_draws[j].descriptor_set, random_draws[j].mesh, random_draws[j].depth);
+			}
+			auto start_time = std::chrono::high_resolution_clock::now();
+			std::stable_sort(keys.begin(), keys.end());
+			auto end_time = std::chrono::high_resolution_clock::now();
+			best_std_sort_seconds = std::min(best_std_sort_seconds, std::chrono::duration<double, std::chrono::seconds::period>(end_time - start_time).count());
+		}
+		vkFreeCommandBuffers(this->logical_device, this->command_pool, 1, &cmd_buffer);
+
+		std::cout << "render queue, " << render_queue_benchmark_draw_count << " draws: push " << best_push_seconds * 1e3 << " ms, radix sort "
+			<< best_sort_seconds * 1e3 << " ms (std::stable_sort " << best_std_sort_seconds * 1e3 << " ms)" << std::endl;
+		const char* order_names[2] = { "push order", "sorted" };
+		for (uint32_t sorted = 0; sorted < 2; sorted++) {
+			const vk::RenderQueueStatistics& stats = statistics[sorted];
+			std::cout << "render queue recording, " << order_names[sorted] << ": " << best_record_seconds[sorted] * 1e3 << " ms, binds (skipped): pipeline "
+				<< stats.pipeline_binds << " (" << stats.skipped_pipeline_binds << "), descriptor set " << stats.descriptor_set_binds << " ("
+				<< stats.skipped_descriptor_set_binds << "), vertex buffer " << stats.vertex_buffer_binds << " (" << stats.skipped_vertex_buffer_binds
+				<< "), index buffer " << stats.index_buffer_binds << " (" << stats.skipped_index_buffer_binds << ")" << std::endl;
 		}
 	}
 
-	void CreateUboDataArrays() {
-		uint32_t min_ubuffer_alignment = vk::GetMinUniformBufferAlignment(this->physical_device);
-		this->per_object_data.stride = vk::util::CalculateObjectSize(sizeof(PerObject), min_ubuffer_alignment);
-		this->per_object_data.total_size = this->per_object_data.stride * boxes_data.size();
-		this->per_object_data.data = reinterpret_cast<unsigned char*>(operator new(this->per_object_data.total_size));
-	}
+	// records parallel_recording_benchmark_draw_count sorted box draws into secondary command buffers that are never submitted, from one
+	// job system thread then from all of them, the way RecordJobs does. Prints the best times out of benchmark_repetitions. Runs before
+	// the first frame, so the pools of frame slot 0 are free
+	void BenchmarkParallelRecording() {
+		if (!run_benchmarks || parallel_recording_benchmark_draw_count == 0 || this->parallel_recording_benchmarked) {
+			return;
+		}
+		this->parallel_recording_benchmarked = true;
+		vk::RenderQueue queue;
+		uint32_t pipeline_id = queue.AddPipeline(this->graphic_pipeline, this->pipeline_layout);
+		uint32_t descriptor_set_id = queue.AddDescriptorSet(this->descriptor_sets[0]);
+		vk::RenderMesh box_mesh = {};
+		box_mesh.vertex_buffer = this->vertex_buffer.buffer;
+		box_mesh.index_buffer = this->index_buffer.buffer;
+		box_mesh.index_type = VK_INDEX_TYPE_UINT16;
+		box_mesh.index_count = static_cast<uint32_t>(cube_indices.size());
+		uint32_t mesh_id = queue.AddMesh(box_mesh);
+		for (uint32_t j = 0; j < parallel_recording_benchmark_draw_count; j++) {
+			queue.Push(pipeline_id, descriptor_set_id, mesh_id, this->box_depths[j % boxes_data.size()], j);
+		}
+		queue.Sort();
+
+		uint32_t thread_counts[2] = { 1, this->job_system.GetThreadCount() };
+		double best_seconds[2] = { std::numeric_limits<double>::max(), std::numeric_limits<double>::max() };
+		for (uint32_t r = 0; r < benchmark_repetitions; r++) {
+			for (uint32_t i = 0; i < 2; i++) {
+				this->thread_command_pools.Reset(0);
+				auto start_time = std::chrono::high_resolution_clock::now();
+				vk::JobCounter recorded;
+				RecordSecondaryCmdBuffers(queue, 0, 0, thread_counts[i], record_job_min_draws, recorded);
+				this->job_system.Wait(recorded);
+				auto end_time = std::chrono::high_resolution_clock::now();
+				best_seconds[i] = std::min(best_seconds[i], std::chrono::duration<double, std::chrono::seconds::period>(end_time - start_time).count());
+			}
+		}
+		this->thread_command_pools.Reset(0);
+		this->frame_secondary_cmd_buffers.clear();
 
-	void CleanupUboDataArrays() {
-		delete[] this->per_object_data.data;
-		this->per_object_data.total_size = 0;
-		this->per_object_data.stride = 0;
+		std::cout << "parallel recording, " << parallel_recording_benchmark_draw_count << " draws: 1 thread " << best_seconds[0] * 1e3 << " ms, "
+			<< thread_counts[1] << " threads " << best_seconds[1] * 1e3 << " ms (x" << best_seconds[0] / best_seconds[1] << ")" << std::endl;
 	}
 };
 
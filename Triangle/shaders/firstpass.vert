@@ -6,7 +6,8 @@ layout(binding = 0) uniform PerCamera {
     mat4 proj;
 } perCamera;
 
-layout (binding = 1) uniform PerObject 
+// pushed before each draw
+layout(push_constant) uniform PerObject 
 {
 	mat4 modelMatrix; 
 	vec3 color;
@@ -19,6 +20,7 @@ layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec4 positionEyeCoord;
 layout(location = 2) out vec3 normalEyeCoord;
 
+invariant gl_Position; // must match depth_prepass.vert
 
 void main() {
 	fragColor = perObject.color;
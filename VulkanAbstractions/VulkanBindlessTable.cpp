@@ -0,0 +1,189 @@
+#include "VulkanBindlessTable.h"
+#include <stdexcept>
+#include <algorithm>
+#include "VulkanHelper.h"
+
+namespace vk {
+
+	void BindlessHandleAllocator::Create(uint32_t capacity) {
+		this->capacity = capacity;
+		this->next_unused = 0;
+		this->free_handles.clear();
+	}
+
+	uint32_t BindlessHandleAllocator::Allocate() {
+		if (!this->free_handles.empty()) {
+			uint32_t handle = this->free_handles.back();
+			this->free_handles.pop_back();
+			return handle;
+		}
+		if (this->next_unused == this->capacity) {
+			throw std::runtime_error("bindless table is full");
+		}
+		return this->next_unused++;
+	}
+
+	void BindlessHandleAllocator::Free(uint32_t handle) {
+		if (handle >= this->next_unused) {
+			throw std::runtime_error("bindless handle was never allocated");
+		}
+		this->free_handles.push_back(handle);
+	}
+
+	uint32_t BindlessHandleAllocator::GetLiveCount() {
+		return this->next_unused - static_cast<uint32_t>(this->free_handles.size());
+	}
+
+	void VulkanBindlessTable::Create(VkPhysicalDevice physical_device, VkDevice logical_device, BindlessTableCapacities capacities) {
+		if (this->logical_device != VK_NULL_HANDLE) {
+			throw std::runtime_error("bindless table is already created");
+		}
+		if (!IsSupported(physical_device)) {
+			throw std::runtime_error("bindless descriptors are not supported");
+		}
+		this->logical_device = logical_device;
+
+		// update after bind arrays have their own, much larger, limits
+		VkPhysicalDeviceVulkan12Properties vulkan12_properties = {};
+		vulkan12_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+		VkPhysicalDeviceProperties2 properties = {};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties.pNext = &vulkan12_properties;
+		vkGetPhysicalDeviceProperties2(physical_device, &properties);
+		uint32_t counts[3] = {
+			std::min({ capacities.sampled_images, vulkan12_properties.maxDescriptorSetUpdateAfterBindSampledImages,
+				vulkan12_properties.maxPerStageDescriptorUpdateAfterBindSampledImages }),
+			std::min({ capacities.samplers, vulkan12_properties.maxDescriptorSetUpdateAfterBindSamplers,
+				vulkan12_properties.maxPerStageDescriptorUpdateAfterBindSamplers }),
+			std::min({ capacities.storage_buffers, vulkan12_properties.maxDescriptorSetUpdateAfterBindStorageBuffers,
+				vulkan12_properties.maxPerStageDescriptorUpdateAfterBindStorageBuffers })
+		};
+		VkDescriptorType types[3] = { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, VK_DESCRIPTOR_TYPE_SAMPLER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER };
+
+		std::vector<VkDescriptorSetLayoutBinding> bindings;
+		std::vector<VkDescriptorBindingFlags> binding_flags;
+		std::vector<VkDescriptorPoolSize> poolsizes;
+		for (uint32_t i = 0; i < 3; i++) {
+			this->handles[i].Create(counts[i]);
+			bindings.push_back(vk::init::CreateDescriptorSetLayoutBinding(i, types[i], counts[i], VK_SHADER_STAGE_ALL));
+			// unused entries may hold no descriptor, and entries no pending command buffer uses may be rewritten while the set is bound
+			binding_flags.push_back(VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT
+				| VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT);
+			poolsizes.push_back({ types[i], counts[i] });
+		}
+
+		VkDescriptorSetLayoutBindingFlagsCreateInfo flags_info = {};
+		flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+		flags_info.bindingCount = static_cast<uint32_t>(binding_flags.size());
+		flags_info.pBindingFlags = binding_flags.data();
+		VkDescriptorSetLayoutCreateInfo layout_info = {};
+		layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layout_info.pNext = &flags_info;
+		layout_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+		layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+		layout_info.pBindings = bindings.data();
+		if (vkCreateDescriptorSetLayout(logical_device, &layout_info, nullptr, &this->layout) != VK_SUCCESS) {
+			throw std::runtime_error("fail to create bindless descriptor set layout");
+		}
+
+		VkDescriptorPoolCreateInfo pool_info = {};
+		pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+		pool_info.poolSizeCount = static_cast<uint32_t>(poolsizes.size());
+		pool_info.pPoolSizes = poolsizes.data();
+		pool_info.maxSets = 1;
+		if (vkCreateDescriptorPool(logical_device, &pool_info, nullptr, &this->pool) != VK_SUCCESS) {
+			throw std::runtime_error("fail to create bindless descriptor pool");
+		}
+
+		std::vector<VkDescriptorSetLayout> layouts = { this->layout };
+		std::vector<VkDescriptorSet> sets(1);
+		vk::init::AllocateDescriptorSets(logical_device, this->pool, layouts, sets);
+		this->set = sets[0];
+	}
+
+	void VulkanBindlessTable::Destroy() {
+		if (this->logical_device == VK_NULL_HANDLE) {
+			return;
+		}
+		vkDestroyDescriptorPool(this->logical_device, this->pool, nullptr);
+		vkDestroyDescriptorSetLayout(this->logical_device, this->layout, nullptr);
+		this->pool = VK_NULL_HANDLE;
+		this->layout = VK_NULL_HANDLE;
+		this->set = VK_NULL_HANDLE;
+		this->logical_device = VK_NULL_HANDLE;
+	}
+
+	uint32_t VulkanBindlessTable::AddSampledImage(VkImageView image_view, VkImageLayout image_layout) {
+		uint32_t handle = this->handles[static_cast<uint32_t>(BindlessResourceType::SAMPLED_IMAGE)].Allocate();
+		VkDescriptorImageInfo image_info = vk::init::CreateDescriptorImageInfo(VK_NULL_HANDLE, image_view, image_layout);
+		Write(BindlessResourceType::SAMPLED_IMAGE, handle, &image_info, nullptr);
+		return handle;
+	}
+
+	uint32_t VulkanBindlessTable::AddSampler(VkSampler sampler) {
+		uint32_t handle = this->handles[static_cast<uint32_t>(BindlessResourceType::SAMPLER)].Allocate();
+		VkDescriptorImageInfo image_info = vk::init::CreateDescriptorImageInfo(sampler, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_UNDEFINED);
+		Write(BindlessResourceType::SAMPLER, handle, &image_info, nullptr);
+		return handle;
+	}
+
+	uint32_t VulkanBindlessTable::AddStorageBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+		uint32_t handle = this->handles[static_cast<uint32_t>(BindlessResourceType::STORAGE_BUFFER)].Allocate();
+		VkDescriptorBufferInfo buffer_info = vk::init::CreateDescriptorBufferInfo(buffer, offset, range);
+		Write(BindlessResourceType::STORAGE_BUFFER, handle, nullptr, &buffer_info);
+		return handle;
+	}
+
+	void VulkanBindlessTable::Free(BindlessResourceType type, uint32_t handle) {
+		// the stale descriptor stays in the array, partially bound arrays only require that shaders don't read it
+		this->handles[static_cast<uint32_t>(type)].Free(handle);
+	}
+
+	void VulkanBindlessTable::Bind(VkCommandBuffer cmd_buffer, VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout, uint32_t set_index) {
+		vkCmdBindDescriptorSets(cmd_buffer, bind_point, pipeline_layout, set_index, 1, &this->set, 0, nullptr);
+	}
+
+	bool VulkanBindlessTable::IsSupported(VkPhysicalDevice physical_device) {
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physical_device, &properties);
+		if (properties.apiVersion < VK_API_VERSION_1_2) {
+			return false;
+		}
+		VkPhysicalDeviceVulkan12Features vulkan12_features = {};
+		vulkan12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		VkPhysicalDeviceFeatures2 features = {};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = &vulkan12_features;
+		vkGetPhysicalDeviceFeatures2(physical_device, &features);
+		return vulkan12_features.descriptorIndexing && vulkan12_features.runtimeDescriptorArray && vulkan12_features.descriptorBindingPartiallyBound
+			&& vulkan12_features.descriptorBindingSampledImageUpdateAfterBind && vulkan12_features.descriptorBindingStorageBufferUpdateAfterBind
+			&& vulkan12_features.descriptorBindingUpdateUnusedWhilePending && vulkan12_features.shaderSampledImageArrayNonUniformIndexing
+			&& vulkan12_features.shaderStorageBufferArrayNonUniformIndexing;
+	}
+
+	void VulkanBindlessTable::EnableRequiredFeatures(VkPhysicalDeviceVulkan12Features& features) {
+		features.descriptorIndexing = VK_TRUE;
+		features.runtimeDescriptorArray = VK_TRUE;
+		features.descriptorBindingPartiallyBound = VK_TRUE;
+		features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+		features.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+		features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+		features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+		features.shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
+	}
+
+	void VulkanBindlessTable::Write(BindlessResourceType type, uint32_t handle, const VkDescriptorImageInfo* image_info, const VkDescriptorBufferInfo* buffer_info) {
+		VkDescriptorType types[3] = { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, VK_DESCRIPTOR_TYPE_SAMPLER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER };
+		VkWriteDescriptorSet write = {};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = this->set;
+		write.dstBinding = static_cast<uint32_t>(type);
+		write.dstArrayElement = handle;
+		write.descriptorType = types[static_cast<uint32_t>(type)];
+		write.descriptorCount = 1;
+		write.pImageInfo = image_info;
+		write.pBufferInfo = buffer_info;
+		vkUpdateDescriptorSets(this->logical_device, 1, &write, 0, nullptr);
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "vulkan/vulkan.h"
+#include <vector>
+
+namespace vk {
+
+	// the binding of each array in the table's set
+	enum class BindlessResourceType {
+		SAMPLED_IMAGE = 0,
+		SAMPLER = 1,
+		STORAGE_BUFFER = 2
+	};
+
+	struct BindlessTableCapacities {
+		uint32_t sampled_images = 4096;
+		uint32_t samplers = 64;
+		uint32_t storage_buffers = 1024;
+	};
+
+	// hands out indices of a fixed size array, freed indices are reused first
+	class BindlessHandleAllocator {
+	public:
+		void Create(uint32_t capacity);
+		uint32_t Allocate();
+		void Free(uint32_t handle);
+		uint32_t GetLiveCount();
+	public:
+		uint32_t capacity = 0;
+	private:
+		uint32_t next_unused = 0; // every index from here on was never handed out
+		std::vector<uint32_t> free_handles;
+	};
+
+	// one descriptor set holding a large array of each of sampled images, samplers and storage buffers, built on the descriptor
+	// indexing of Vulkan 1.2. The arrays are partially bound and update after bind: resources are added or freed at any time while
+	// the set stays bound, and shaders pick them by the returned handle (an index into the array), usually passed in push constants.
+	// So a draw switching textures or buffers only pushes new indices instead of binding another descriptor set.
+	// A freed handle can be reused by the next Add, so it must only be freed once the gpu is done with every submission using it
+	class VulkanBindlessTable {
+	public:
+		void Create(VkPhysicalDevice physical_device, VkDevice logical_device, BindlessTableCapacities capacities = {});
+		void Destroy();
+		uint32_t AddSampledImage(VkImageView image_view, VkImageLayout image_layout);
+		uint32_t AddSampler(VkSampler sampler);
+		uint32_t AddStorageBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+		void Free(BindlessResourceType type, uint32_t handle);
+		// the table is bound at set_index of any pipeline layout including the layout
+		void Bind(VkCommandBuffer cmd_buffer, VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout, uint32_t set_index);
+		// check it when picking the device, creating a device with the features EnableRequiredFeatures turns on fails without them
+		static bool IsSupported(VkPhysicalDevice physical_device);
+		// turns on the descriptor indexing features the table relies on
+		static void EnableRequiredFeatures(VkPhysicalDeviceVulkan12Features& features);
+	public:
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		VkDescriptorSet set = VK_NULL_HANDLE;
+	private:
+		void Write(BindlessResourceType type, uint32_t handle, const VkDescriptorImageInfo* image_info, const VkDescriptorBufferInfo* buffer_info);
+	private:
+		VkDevice logical_device = VK_NULL_HANDLE;
+		VkDescriptorPool pool = VK_NULL_HANDLE;
+		BindlessHandleAllocator handles[3]; // indexed by BindlessResourceType
+	};
+}
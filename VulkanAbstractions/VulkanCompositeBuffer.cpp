@@ -1,6 +1,7 @@
 #include "VulkanCompositeBuffer.h"
 #include <stdexcept>
 #include "VulkanHelper.h"
+#include "VulkanCpuProfiler.h"
 
 namespace vk {
 
@@ -38,6 +39,7 @@ namespace vk {
 	}
 
 	void VulkanCompositeBuffer::CopyFromHostData(void* data, uint32_t data_size, uint32_t offset) {
+		CPU_PROFILE_FUNCTION();
 		if (this->buffer == VK_NULL_HANDLE) {
 			throw std::runtime_error("this buffer is not yet created or is already destroyed");
 		}
@@ -50,8 +52,9 @@ namespace vk {
 		vkUnmapMemory(this->logical_device, this->buffer_memory);
 	}
 
-	void VulkanCompositeBuffer::TransferFromAnotherBuffer(VulkanCompositeBuffer& src_buffers, VkCommandPool pool, uint32_t src_offset, uint32_t dst_offset, uint32_t size, 
-		VulkanQueue& queue, VkFence wait_fence) {
+	uint64_t VulkanCompositeBuffer::TransferFromAnotherBuffer(VulkanCompositeBuffer& src_buffers, VkCommandPool pool, uint32_t src_offset, uint32_t dst_offset, uint32_t size, 
+		VulkanQueue& queue) {
+		CPU_PROFILE_FUNCTION();
 		if (this->buffer == VK_NULL_HANDLE || src_buffers.buffer == VK_NULL_HANDLE) {
 			throw std::runtime_error("either buffer is not yet created or is already destroyed");
 		}
@@ -78,8 +81,9 @@ namespace vk {
 		if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
 			throw std::runtime_error("fail to end command buffer recording");
 		}
-		std::vector<VkSemaphore> semaphores;
-		std::vector<VkPipelineStageFlags> flags;
-		queue.SubmitSingleCmdBuffer(semaphores, flags, command_buffer, semaphores, wait_fence);
+		std::vector<SemaphoreWait> waits;
+		std::vector<VkCommandBuffer> command_buffers = { command_buffer };
+		std::vector<VkSemaphore> signal_semaphores;
+		return queue.Submit(waits, command_buffers, signal_semaphores);
 	}
 }
\ No newline at end of file
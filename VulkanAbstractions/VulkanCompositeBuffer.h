@@ -12,8 +12,9 @@ namespace vk {
 		void CreateBuffer(VkDevice logical_device, VkPhysicalDevice physical_device, VkDeviceSize size, VkBufferUsageFlags usage, VkSharingMode sharing_mode, VkMemoryPropertyFlags mem_properties);
 		void DestroyBuffer();
 		void CopyFromHostData(void * data, uint32_t data_size, uint32_t offset);
-		void TransferFromAnotherBuffer(VulkanCompositeBuffer & src_buffers, VkCommandPool pool, uint32_t src_offset, uint32_t dst_offset, uint32_t size, 
-			VulkanQueue & queue, VkFence wait_fence);
+		// returns the value of queue's timeline the copy signals
+		uint64_t TransferFromAnotherBuffer(VulkanCompositeBuffer & src_buffers, VkCommandPool pool, uint32_t src_offset, uint32_t dst_offset, uint32_t size, 
+			VulkanQueue & queue);
 	public:
 		VkMemoryPropertyFlags mem_properties;
 		VkBufferUsageFlags usage;
@@ -11,6 +11,11 @@ namespace vk {
 		{VK_IMAGE_TYPE_3D, VK_IMAGE_VIEW_TYPE_3D},
 	};
 
+	std::unordered_map<VkImageType, VkImageViewType> VulkanCompositeImage::image_to_array_view_map {
+		{VK_IMAGE_TYPE_1D, VK_IMAGE_VIEW_TYPE_1D_ARRAY},
+		{VK_IMAGE_TYPE_2D, VK_IMAGE_VIEW_TYPE_2D_ARRAY},
+	};
+
 	// properties: https://www.khronos.org/registry/vulkan/specs/1.2-extensions/man/html/VkMemoryPropertyFlagBits.html
 	void VulkanCompositeImage::CreateImage(VkPhysicalDevice physical_device, VkDevice logical_device, VkImageCreateInfo create_info, VkMemoryPropertyFlags mem_properties) {
 		if (this->image != VK_NULL_HANDLE) {
@@ -19,6 +24,7 @@ namespace vk {
 		this->image_type = create_info.imageType;
 		this->format = create_info.format;
 		this->image_extent = create_info.extent;
+		this->array_layers = create_info.arrayLayers;
 		this->usage_flag = create_info.usage;
 		this->logical_device = logical_device;
 		//create
@@ -45,24 +51,49 @@ namespace vk {
 		}
 		VkImageViewCreateInfo create_info = {};
 		create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-		create_info.viewType = image_to_view_map[this->image_type];
+		create_info.viewType = (this->array_layers > 1) ? image_to_array_view_map[this->image_type] : image_to_view_map[this->image_type];
 		create_info.image = this->image;
 		create_info.format = this->format;
 		create_info.subresourceRange.baseMipLevel = 0;
 		create_info.subresourceRange.levelCount = 1;
 		create_info.subresourceRange.baseArrayLayer = 0;
-		create_info.subresourceRange.layerCount = 1;
+		create_info.subresourceRange.layerCount = this->array_layers;
 		create_info.subresourceRange.aspectMask = aspect_flag;
 		if (vkCreateImageView(logical_device, &create_info, nullptr, &this->image_view) != VK_SUCCESS) {
 			throw std::runtime_error("fail to create image view");
 		}
 	}
 
+	void VulkanCompositeImage::CreateLayerImageViews(VkImageAspectFlags aspect_flag) {
+		if (this->image == VK_NULL_HANDLE) {
+			throw std::runtime_error("Needs to create VkImage before creating image view");
+		}
+		if (!this->layer_views.empty()) {
+			throw std::runtime_error("Layer image views are already created");
+		}
+		VkImageViewCreateInfo create_info = {};
+		create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		create_info.viewType = image_to_view_map[this->image_type];
+		create_info.image = this->image;
+		create_info.format = this->format;
+		create_info.subresourceRange.baseMipLevel = 0;
+		create_info.subresourceRange.levelCount = 1;
+		create_info.subresourceRange.layerCount = 1;
+		create_info.subresourceRange.aspectMask = aspect_flag;
+		this->layer_views.resize(this->array_layers);
+		for (uint32_t i = 0; i < this->array_layers; i++) {
+			create_info.subresourceRange.baseArrayLayer = i;
+			if (vkCreateImageView(logical_device, &create_info, nullptr, &this->layer_views[i]) != VK_SUCCESS) {
+				throw std::runtime_error("fail to create layer image view");
+			}
+		}
+	}
+
 	void VulkanCompositeImage::DestroyImage() {
 		if (this->image == VK_NULL_HANDLE) {
 			throw std::runtime_error("Image is not yet created");
 		}
-		if (this->image_view != VK_NULL_HANDLE) {
+		if (this->image_view != VK_NULL_HANDLE || !this->layer_views.empty()) {
 			throw std::runtime_error("Needs to destroy image view first before destroying image");
 		}
 		vkFreeMemory(this->logical_device, this->device_memory, nullptr);
@@ -72,11 +103,17 @@ namespace vk {
 	}
 
 	void VulkanCompositeImage::DestroyImageView() {
-		if (this->image_view == VK_NULL_HANDLE) {
+		if (this->image_view == VK_NULL_HANDLE && this->layer_views.empty()) {
 			throw std::runtime_error("Image view is not yet created");
 		}
-		vkDestroyImageView(this->logical_device, this->image_view, nullptr);
-		this->image_view = VK_NULL_HANDLE;
+		if (this->image_view != VK_NULL_HANDLE) { // an image can have only per layer views
+			vkDestroyImageView(this->logical_device, this->image_view, nullptr);
+			this->image_view = VK_NULL_HANDLE;
+		}
+		for (VkImageView layer_view : this->layer_views) {
+			vkDestroyImageView(this->logical_device, layer_view, nullptr);
+		}
+		this->layer_views.clear();
 	}
 
 	void VulkanCompositeImage::Create(VkPhysicalDevice physical_device, VkDevice logical_device, VkImageCreateInfo create_info, VkMemoryPropertyFlags properties, VkImageAspectFlags aspect_flag) {
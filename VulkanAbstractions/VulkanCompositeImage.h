@@ -1,13 +1,15 @@
 #pragma once
 #include "vulkan/vulkan.h"
 #include <unordered_map>
+#include <vector>
 
 namespace vk {
 
 	class VulkanCompositeImage {
 	public:
 		void CreateImage(VkPhysicalDevice physical_device, VkDevice logical_device, VkImageCreateInfo create_info, VkMemoryPropertyFlags mem_properties);
-		void CreateImageView(VkImageAspectFlags aspect_flag);
+		void CreateImageView(VkImageAspectFlags aspect_flag); // a 2D image with several layers gets a 2D array view
+		void CreateLayerImageViews(VkImageAspectFlags aspect_flag); // one 2D view per array layer, i.e. for rendering into a single layer
 		void DestroyImage();
 		void DestroyImageView();
 		void Create(VkPhysicalDevice physical_device, VkDevice logical_device, VkImageCreateInfo create_info, VkMemoryPropertyFlags mem_properties, VkImageAspectFlags aspect_flag); // will create both image and image view
@@ -15,16 +17,19 @@ namespace vk {
 	public:
 		VkFormat format;
 		VkImageView image_view = VK_NULL_HANDLE;
+		std::vector<VkImageView> layer_views;
+		VkImage image = VK_NULL_HANDLE; // exposed for copies and layout transitions
 	private:
-		VkImage image = VK_NULL_HANDLE;
 		VkDeviceMemory device_memory = VK_NULL_HANDLE;
 		
 		VkImageType image_type;
 		
 		VkExtent3D image_extent;
+		uint32_t array_layers;
 		VkImageUsageFlags usage_flag;
 		VkDevice logical_device;
 		static std::unordered_map<VkImageType, VkImageViewType> image_to_view_map;
+		static std::unordered_map<VkImageType, VkImageViewType> image_to_array_view_map;
 	};
 
 }
\ No newline at end of file
@@ -0,0 +1,123 @@
+#include "VulkanCpuProfiler.h"
+#include <stdexcept>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+namespace vk {
+
+	std::atomic<bool> VulkanCpuProfiler::enabled{ true };
+
+	namespace {
+		// rings are only added, and live until the process exits so zones of finished threads can still be exported
+		std::mutex rings_mutex;
+		std::vector<std::unique_ptr<CpuZoneRing>> rings;
+
+		// reference points for converting ticks to nanoseconds
+		const uint64_t start_ticks = VulkanCpuProfiler::Now();
+		const auto start_time = std::chrono::steady_clock::now();
+
+		struct ThreadEvents {
+			uint32_t thread_id;
+			std::string thread_name;
+			std::vector<CpuZoneEvent> events;
+		};
+	}
+
+	CpuZoneRing* VulkanCpuProfiler::RegisterThread() {
+		std::lock_guard<std::mutex> lock(rings_mutex);
+		rings.push_back(std::make_unique<CpuZoneRing>());
+		CpuZoneRing* ring = rings.back().get();
+		ring->thread_id = static_cast<uint32_t>(rings.size());
+		ring->thread_name = "thread " + std::to_string(ring->thread_id);
+		return ring;
+	}
+
+	void VulkanCpuProfiler::SetThreadName(const char* name) {
+		CpuZoneRing& ring = GetThreadRing();
+		std::lock_guard<std::mutex> lock(rings_mutex);
+		ring.thread_name = name;
+	}
+
+	std::string VulkanCpuProfiler::ToChromeTrace() {
+		std::vector<ThreadEvents> threads;
+		{
+			std::lock_guard<std::mutex> lock(rings_mutex);
+			for (std::unique_ptr<CpuZoneRing>& ring : rings) {
+				ThreadEvents thread = { ring->thread_id, ring->thread_name, {} };
+				uint64_t head = ring->head.load(std::memory_order_acquire);
+				uint64_t first = head > CpuZoneRing::capacity ? head - CpuZoneRing::capacity : 0;
+				for (uint64_t i = first; i < head; i++) {
+					CpuZoneSlot& slot = ring->slots[i & (CpuZoneRing::capacity - 1)];
+					// the slot must still hold the i-th zone, complete, before and after its fields are read
+					uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+					if (sequence != 2 * i + 2) {
+						continue;
+					}
+					CpuZoneEvent event = { slot.name.load(std::memory_order_relaxed), slot.begin_ticks.load(std::memory_order_relaxed),
+						slot.end_ticks.load(std::memory_order_relaxed) };
+					std::atomic_thread_fence(std::memory_order_acquire);
+					if (slot.sequence.load(std::memory_order_relaxed) == sequence) {
+						thread.events.push_back(event);
+					}
+				}
+				threads.push_back(thread);
+			}
+		}
+
+		uint64_t base_ticks = UINT64_MAX;
+		for (ThreadEvents& thread : threads) {
+			for (CpuZoneEvent& event : thread.events) {
+				base_ticks = std::min(base_ticks, event.begin_ticks);
+			}
+		}
+		double microseconds_per_tick = GetNanosecondsPerTick() / 1000.0;
+
+		std::ostringstream json;
+		json << std::fixed << std::setprecision(3);
+		json << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+		bool first_event = true;
+		for (ThreadEvents& thread : threads) {
+			json << (first_event ? "\n" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": " << thread.thread_id
+				<< ", \"args\": {\"name\": \"" << thread.thread_name << "\"}}";
+			first_event = false;
+			for (CpuZoneEvent& event : thread.events) {
+				json << ",\n{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << thread.thread_id
+					<< ", \"ts\": " << (event.begin_ticks - base_ticks) * microseconds_per_tick
+					<< ", \"dur\": " << (event.end_ticks - event.begin_ticks) * microseconds_per_tick << "}";
+			}
+		}
+		json << "\n]}\n";
+		return json.str();
+	}
+
+	void VulkanCpuProfiler::WriteChromeTrace(const char* path) {
+		std::ofstream file(path);
+		if (!file.is_open()) {
+			throw std::runtime_error("fail to open cpu trace file");
+		}
+		file << ToChromeTrace();
+	}
+
+	double VulkanCpuProfiler::MeasureZoneOverhead(uint32_t iterations) {
+		uint64_t begin_ticks = Now();
+		for (uint32_t i = 0; i < iterations; i++) {
+			CPU_PROFILE_ZONE("zone overhead");
+		}
+		return (Now() - begin_ticks) * GetNanosecondsPerTick() / iterations;
+	}
+
+	double VulkanCpuProfiler::GetNanosecondsPerTick() {
+#ifdef VK_CPU_PROFILER_TSC
+		uint64_t ticks = Now() - start_ticks;
+		double nanoseconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start_time).count();
+		return ticks == 0 ? 1.0 : nanoseconds / ticks;
+#else
+		return 1.0;
+#endif
+	}
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define VK_CPU_PROFILER_TSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define VK_CPU_PROFILER_TSC 1
+#endif
+
+// build with VK_CPU_PROFILER_ENABLED=0 to compile every zone out
+#ifndef VK_CPU_PROFILER_ENABLED
+#define VK_CPU_PROFILER_ENABLED 1
+#endif
+
+#define VK_CPU_PROFILER_CONCAT_INNER(a, b) a##b
+#define VK_CPU_PROFILER_CONCAT(a, b) VK_CPU_PROFILER_CONCAT_INNER(a, b)
+
+#if VK_CPU_PROFILER_ENABLED
+// times the rest of the enclosing block. Only the pointer of name is stored, so it must be a string literal
+#define CPU_PROFILE_ZONE(name) vk::CpuProfileZone VK_CPU_PROFILER_CONCAT(cpu_profile_zone_, __LINE__)(name)
+#define CPU_PROFILE_FUNCTION() CPU_PROFILE_ZONE(__FUNCTION__)
+#else
+#define CPU_PROFILE_ZONE(name)
+#define CPU_PROFILE_FUNCTION()
+#endif
+
+namespace vk {
+
+	struct CpuZoneEvent {
+		const char* name;
+		uint64_t begin_ticks;
+		uint64_t end_ticks;
+	};
+
+	// one ring slot, guarded by a seqlock so the exporter can read it while the owner overwrites it. sequence is 2 * n + 1 while the n-th
+	// zone of the ring is being written into the slot and 2 * n + 2 once it is complete
+	struct CpuZoneSlot {
+		std::atomic<uint64_t> sequence{ 0 };
+		std::atomic<const char*> name{ nullptr };
+		std::atomic<uint64_t> begin_ticks{ 0 };
+		std::atomic<uint64_t> end_ticks{ 0 };
+	};
+
+	// zones of one thread, in the order they ended. Only the owning thread writes: it fills the slot under its sequence, then publishes it by
+	// bumping head with release order, so nothing is locked while recording. Once the ring is full the oldest zones are overwritten
+	struct CpuZoneRing {
+		const static uint32_t capacity = 1 << 16; // power of 2
+		CpuZoneSlot slots[capacity];
+		std::atomic<uint64_t> head{ 0 };
+		uint32_t thread_id = 0;
+		std::string thread_name;
+	};
+
+	// scoped zone profiler for the cpu side of the frame, exported in the Chrome trace event format (chrome://tracing or ui.perfetto.dev).
+	// A zone costs two clock reads and one store into the thread's ring. On x86 the clock is the time stamp counter, which is a lot cheaper
+	// than steady_clock, and ticks are converted to time when exporting
+	class VulkanCpuProfiler {
+	public:
+		static uint64_t Now() {
+#ifdef VK_CPU_PROFILER_TSC
+			return __rdtsc();
+#else
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+		}
+
+		static bool IsEnabled() {
+			return enabled.load(std::memory_order_relaxed);
+		}
+
+		static void SetEnabled(bool is_enabled) {
+			enabled.store(is_enabled, std::memory_order_relaxed);
+		}
+
+		// the calling thread's ring, registered on first use
+		static CpuZoneRing& GetThreadRing() {
+			thread_local CpuZoneRing* ring = RegisterThread();
+			return *ring;
+		}
+
+		static void Record(const char* name, uint64_t begin_ticks, uint64_t end_ticks) {
+			CpuZoneRing& ring = GetThreadRing();
+			uint64_t head = ring.head.load(std::memory_order_relaxed);
+			CpuZoneSlot& slot = ring.slots[head & (CpuZoneRing::capacity - 1)];
+			slot.sequence.store(2 * head + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release); // the odd sequence is visible before any field changes
+			slot.name.store(name, std::memory_order_relaxed);
+			slot.begin_ticks.store(begin_ticks, std::memory_order_relaxed);
+			slot.end_ticks.store(end_ticks, std::memory_order_relaxed);
+			slot.sequence.store(2 * head + 2, std::memory_order_release);
+			ring.head.store(head + 1, std::memory_order_release);
+		}
+
+		static void SetThreadName(const char* name);
+		// can be called while other threads keep recording, a zone whose slot is overwritten while it is read is left out
+		static std::string ToChromeTrace();
+		static void WriteChromeTrace(const char* path);
+		// average cost of an empty zone in nanoseconds
+		static double MeasureZoneOverhead(uint32_t iterations);
+		// nanoseconds per tick of Now(), measured against steady_clock since the program started
+		static double GetNanosecondsPerTick();
+	private:
+		static CpuZoneRing* RegisterThread();
+	private:
+		static std::atomic<bool> enabled;
+	};
+
+	class CpuProfileZone {
+	public:
+		explicit CpuProfileZone(const char* name) : name(name), begin_ticks(VulkanCpuProfiler::IsEnabled() ? VulkanCpuProfiler::Now() : 0) {
+		}
+
+		~CpuProfileZone() {
+			if (this->begin_ticks != 0) {
+				VulkanCpuProfiler::Record(this->name, this->begin_ticks, VulkanCpuProfiler::Now());
+			}
+		}
+
+		CpuProfileZone(const CpuProfileZone&) = delete;
+		CpuProfileZone& operator=(const CpuProfileZone&) = delete;
+	private:
+		const char* name;
+		uint64_t begin_ticks; // 0 if the profiler was disabled when the zone began
+	};
+}
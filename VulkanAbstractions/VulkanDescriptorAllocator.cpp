@@ -0,0 +1,158 @@
+#include "VulkanDescriptorAllocator.h"
+#include <stdexcept>
+#include <algorithm>
+#include "VulkanHelper.h"
+#include "VulkanCpuProfiler.h"
+
+namespace vk {
+
+	namespace {
+		const uint32_t max_pool_sets = 4096;
+	}
+
+	void VulkanDescriptorAllocator::Create(VkDevice logical_device, uint32_t initial_sets, std::vector<DescriptorPoolRatio> ratios) {
+		if (this->logical_device != VK_NULL_HANDLE) {
+			throw std::runtime_error("descriptor allocator is already created");
+		}
+		this->logical_device = logical_device;
+		this->next_pool_sets = std::max(initial_sets, 1u);
+		this->ratios = ratios;
+	}
+
+	void VulkanDescriptorAllocator::Destroy() {
+		if (this->logical_device == VK_NULL_HANDLE) {
+			return;
+		}
+		for (VkDescriptorPool pool : this->used_pools) {
+			vkDestroyDescriptorPool(this->logical_device, pool, nullptr);
+		}
+		for (VkDescriptorPool pool : this->free_pools) {
+			vkDestroyDescriptorPool(this->logical_device, pool, nullptr);
+		}
+		this->used_pools.clear();
+		this->free_pools.clear();
+		this->layout_sizes.clear();
+		this->current_pool = VK_NULL_HANDLE;
+		this->logical_device = VK_NULL_HANDLE;
+	}
+
+	void VulkanDescriptorAllocator::AddLayout(VkDescriptorSetLayout layout, const std::vector<VkDescriptorSetLayoutBinding>& bindings) {
+		std::vector<VkDescriptorPoolSize> sizes;
+		for (const VkDescriptorSetLayoutBinding& binding : bindings) {
+			auto it = std::find_if(sizes.begin(), sizes.end(), [&binding](VkDescriptorPoolSize& size) { return size.type == binding.descriptorType; });
+			if (it == sizes.end()) {
+				sizes.push_back({ binding.descriptorType, binding.descriptorCount });
+			}
+			else {
+				it->descriptorCount += binding.descriptorCount;
+			}
+		}
+		this->layout_sizes[layout] = sizes;
+	}
+
+	void VulkanDescriptorAllocator::Allocate(std::vector<VkDescriptorSetLayout>& layouts, std::vector<VkDescriptorSet>& sets) {
+		CPU_PROFILE_FUNCTION();
+		sets.resize(layouts.size());
+		if (this->current_pool == VK_NULL_HANDLE) {
+			this->current_pool = NextPool();
+		}
+		VkResult result = TryAllocate(this->current_pool, layouts, sets);
+		while (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+			bool reuses_pool = !this->free_pools.empty();
+			this->current_pool = NextPool();
+			result = TryAllocate(this->current_pool, layouts, sets);
+			if (!reuses_pool) {
+				break; // a brand new pool was too small as well
+			}
+		}
+		if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+			this->current_pool = CreateFittingPool(layouts);
+			result = TryAllocate(this->current_pool, layouts, sets);
+		}
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("fail to allocate descriptor sets");
+		}
+	}
+
+	VkDescriptorSet VulkanDescriptorAllocator::Allocate(VkDescriptorSetLayout layout) {
+		std::vector<VkDescriptorSetLayout> layouts = { layout };
+		std::vector<VkDescriptorSet> sets(1);
+		Allocate(layouts, sets);
+		return sets[0];
+	}
+
+	void VulkanDescriptorAllocator::Reset() {
+		for (VkDescriptorPool pool : this->used_pools) {
+			vkResetDescriptorPool(this->logical_device, pool, 0);
+			this->free_pools.push_back(pool);
+		}
+		this->used_pools.clear();
+		this->current_pool = VK_NULL_HANDLE;
+	}
+
+	std::vector<DescriptorPoolRatio> VulkanDescriptorAllocator::GetDefaultRatios() {
+		return {
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.0f },
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.0f },
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2.0f },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0.5f },
+			{ VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1.0f }
+		};
+	}
+
+	VkDescriptorPool VulkanDescriptorAllocator::NextPool() {
+		if (!this->free_pools.empty()) {
+			VkDescriptorPool pool = this->free_pools.back();
+			this->free_pools.pop_back();
+			this->used_pools.push_back(pool);
+			return pool;
+		}
+		std::vector<VkDescriptorPoolSize> poolsizes;
+		for (DescriptorPoolRatio& ratio : this->ratios) {
+			uint32_t count = std::max(static_cast<uint32_t>(ratio.per_set * this->next_pool_sets), 1u);
+			poolsizes.push_back({ ratio.type, count });
+		}
+		VkDescriptorPool pool;
+		vk::init::CreateDescriptorPool(this->logical_device, poolsizes, this->next_pool_sets, &pool);
+		this->next_pool_sets = std::min(this->next_pool_sets * 2, max_pool_sets);
+		this->used_pools.push_back(pool);
+		return pool;
+	}
+
+	// holds the requested sets on top of what a new pool of the ratios holds, so later small allocations still fit in it
+	VkDescriptorPool VulkanDescriptorAllocator::CreateFittingPool(std::vector<VkDescriptorSetLayout>& layouts) {
+		std::vector<VkDescriptorPoolSize> poolsizes;
+		for (DescriptorPoolRatio& ratio : this->ratios) {
+			poolsizes.push_back({ ratio.type, std::max(static_cast<uint32_t>(ratio.per_set * this->next_pool_sets), 1u) });
+		}
+		for (VkDescriptorSetLayout layout : layouts) {
+			auto sizes = this->layout_sizes.find(layout);
+			if (sizes == this->layout_sizes.end()) {
+				throw std::runtime_error("fail to allocate descriptor sets"); // the layout wasn't added, so its descriptors are unknown
+			}
+			for (const VkDescriptorPoolSize& size : sizes->second) {
+				auto it = std::find_if(poolsizes.begin(), poolsizes.end(), [&size](VkDescriptorPoolSize& poolsize) { return poolsize.type == size.type; });
+				if (it == poolsizes.end()) {
+					poolsizes.push_back(size);
+				}
+				else {
+					it->descriptorCount += size.descriptorCount;
+				}
+			}
+		}
+		VkDescriptorPool pool;
+		vk::init::CreateDescriptorPool(this->logical_device, poolsizes, this->next_pool_sets + static_cast<uint32_t>(layouts.size()), &pool);
+		this->used_pools.push_back(pool);
+		return pool;
+	}
+
+	VkResult VulkanDescriptorAllocator::TryAllocate(VkDescriptorPool pool, std::vector<VkDescriptorSetLayout>& layouts, std::vector<VkDescriptorSet>& sets) {
+		VkDescriptorSetAllocateInfo alloc_info = {};
+		alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		alloc_info.descriptorPool = pool;
+		alloc_info.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+		alloc_info.pSetLayouts = layouts.data();
+		return vkAllocateDescriptorSets(this->logical_device, &alloc_info, sets.data());
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "vulkan/vulkan.h"
+#include <vector>
+#include <unordered_map>
+
+namespace vk {
+
+	// descriptors of a type reserved in a pool for each set it can hold
+	struct DescriptorPoolRatio {
+		VkDescriptorType type;
+		float per_set;
+	};
+
+	// allocates descriptor sets from a list of pools. When the current pool runs out (VK_ERROR_OUT_OF_POOL_MEMORY or VK_ERROR_FRAGMENTED_POOL),
+	// the allocation is retried from a new pool, each one holding twice as many sets as the previous one, so nothing has to be sized by hand.
+	// If even a new pool is too small, a pool is sized from the descriptor counts of the requested layouts, which must have been added first.
+	// Sets are never freed one by one: Reset releases all of them at once and keeps the pools for the next allocations
+	class VulkanDescriptorAllocator {
+	public:
+		void Create(VkDevice logical_device, uint32_t initial_sets = 64, std::vector<DescriptorPoolRatio> ratios = GetDefaultRatios());
+		void Destroy();
+		// records the descriptors a set of layout holds, replacing what was recorded for a destroyed layout with the same handle
+		void AddLayout(VkDescriptorSetLayout layout, const std::vector<VkDescriptorSetLayoutBinding>& bindings);
+		void Allocate(std::vector<VkDescriptorSetLayout>& layouts, std::vector<VkDescriptorSet>& sets);
+		VkDescriptorSet Allocate(VkDescriptorSetLayout layout);
+		// every set allocated so far becomes invalid, so the gpu must be done with all of them
+		void Reset();
+		static std::vector<DescriptorPoolRatio> GetDefaultRatios();
+	private:
+		VkDescriptorPool NextPool();
+		VkDescriptorPool CreateFittingPool(std::vector<VkDescriptorSetLayout>& layouts);
+		VkResult TryAllocate(VkDescriptorPool pool, std::vector<VkDescriptorSetLayout>& layouts, std::vector<VkDescriptorSet>& sets);
+	private:
+		VkDevice logical_device = VK_NULL_HANDLE;
+		std::vector<DescriptorPoolRatio> ratios;
+		uint32_t next_pool_sets = 0;
+		VkDescriptorPool current_pool = VK_NULL_HANDLE;
+		std::vector<VkDescriptorPool> used_pools; // current_pool included
+		std::vector<VkDescriptorPool> free_pools; // reset and ready to be used again
+		std::unordered_map<VkDescriptorSetLayout, std::vector<VkDescriptorPoolSize>> layout_sizes;
+	};
+}
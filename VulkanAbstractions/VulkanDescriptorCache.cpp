@@ -0,0 +1,231 @@
+#include "VulkanDescriptorCache.h"
+#include <stdexcept>
+#include <algorithm>
+#include "VulkanHelper.h"
+#include "VulkanCpuProfiler.h"
+
+namespace vk {
+
+	namespace {
+		// non-dispatchable handles are pointers on 64 bit platforms and uint64_t on 32 bit ones
+		template <typename T>
+		uint64_t HandleWord(T handle) {
+			return (uint64_t)handle;
+		}
+
+		bool UsesImageInfo(VkDescriptorType type) {
+			return type == VK_DESCRIPTOR_TYPE_SAMPLER || type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER || type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE
+				|| type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE || type == VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+		}
+
+		bool UsesTexelBufferView(VkDescriptorType type) {
+			return type == VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER || type == VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER;
+		}
+
+		// descriptors are keyed field by field so the padding of the info structs never gets hashed, and a set written from
+		// VkWriteDescriptorSet and one written through an update template get the same key
+		void PushDescriptorWords(std::vector<uint64_t>& words, uint32_t binding, uint32_t array_element, VkDescriptorType type, uint32_t count,
+			const VkDescriptorImageInfo* image_infos, const VkDescriptorBufferInfo* buffer_infos, const VkBufferView* texel_buffer_views, size_t stride) {
+			words.push_back(binding);
+			words.push_back(array_element);
+			words.push_back(type);
+			words.push_back(count);
+			for (uint32_t i = 0; i < count; i++) {
+				if (UsesImageInfo(type)) {
+					const VkDescriptorImageInfo* info = reinterpret_cast<const VkDescriptorImageInfo*>(reinterpret_cast<const char*>(image_infos) + i * stride);
+					words.push_back(HandleWord(info->sampler));
+					words.push_back(HandleWord(info->imageView));
+					words.push_back(info->imageLayout);
+				}
+				else if (UsesTexelBufferView(type)) {
+					const VkBufferView* view = reinterpret_cast<const VkBufferView*>(reinterpret_cast<const char*>(texel_buffer_views) + i * stride);
+					words.push_back(HandleWord(*view));
+				}
+				else {
+					const VkDescriptorBufferInfo* info = reinterpret_cast<const VkDescriptorBufferInfo*>(reinterpret_cast<const char*>(buffer_infos) + i * stride);
+					words.push_back(HandleWord(info->buffer));
+					words.push_back(info->offset);
+					words.push_back(info->range);
+				}
+			}
+		}
+	}
+
+	void VulkanDescriptorLayoutCache::Create(VkDevice logical_device, VulkanDescriptorAllocator* allocator) {
+		if (this->logical_device != VK_NULL_HANDLE) {
+			throw std::runtime_error("descriptor layout cache is already created");
+		}
+		this->logical_device = logical_device;
+		this->allocator = allocator;
+		this->hit_count = 0;
+	}
+
+	void VulkanDescriptorLayoutCache::Destroy() {
+		if (this->logical_device == VK_NULL_HANDLE) {
+			return;
+		}
+		for (auto& entry : this->layouts) {
+			vkDestroyDescriptorSetLayout(this->logical_device, entry.second, nullptr);
+		}
+		this->layouts.clear();
+		this->allocator = nullptr;
+		this->logical_device = VK_NULL_HANDLE;
+	}
+
+	VkDescriptorSetLayout VulkanDescriptorLayoutCache::CreateDescriptorSetLayout(std::vector<VkDescriptorSetLayoutBinding>& bindings,
+		VkDescriptorSetLayoutCreateFlags flags, const std::vector<VkDescriptorBindingFlags>& binding_flags) {
+		if (!binding_flags.empty() && binding_flags.size() != bindings.size()) {
+			throw std::runtime_error("descriptor binding flags must be empty or one per binding");
+		}
+		// the binding flags follow their binding when sorting
+		std::vector<uint32_t> order(bindings.size());
+		for (uint32_t i = 0; i < order.size(); i++) {
+			order[i] = i;
+		}
+		std::sort(order.begin(), order.end(), [&bindings](uint32_t a, uint32_t b) {
+			return bindings[a].binding < bindings[b].binding;
+		});
+		std::vector<VkDescriptorSetLayoutBinding> sorted;
+		std::vector<VkDescriptorBindingFlags> sorted_flags;
+		for (uint32_t i : order) {
+			sorted.push_back(bindings[i]);
+			if (!binding_flags.empty()) {
+				sorted_flags.push_back(binding_flags[i]);
+			}
+		}
+		detail::DescriptorCacheKey key;
+		key.words.push_back(flags);
+		key.words.push_back(!sorted_flags.empty());
+		for (uint32_t i = 0; i < sorted.size(); i++) {
+			VkDescriptorSetLayoutBinding& binding = sorted[i];
+			key.words.push_back(binding.binding);
+			key.words.push_back(binding.descriptorType);
+			key.words.push_back(binding.descriptorCount);
+			key.words.push_back(binding.stageFlags);
+			bool immutable_samplers = binding.pImmutableSamplers != nullptr;
+			key.words.push_back(immutable_samplers);
+			for (uint32_t j = 0; immutable_samplers && j < binding.descriptorCount; j++) {
+				key.words.push_back(HandleWord(binding.pImmutableSamplers[j]));
+			}
+			if (!sorted_flags.empty()) {
+				key.words.push_back(sorted_flags[i]);
+			}
+		}
+		key.hash = vk::util::HashWords(key.words);
+
+		auto cached = this->layouts.find(key);
+		if (cached != this->layouts.end()) {
+			this->hit_count++;
+			return cached->second;
+		}
+		VkDescriptorSetLayoutBindingFlagsCreateInfo flags_info = {};
+		flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+		flags_info.bindingCount = static_cast<uint32_t>(sorted_flags.size());
+		flags_info.pBindingFlags = sorted_flags.data();
+		VkDescriptorSetLayoutCreateInfo layout_info = {};
+		layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layout_info.pNext = sorted_flags.empty() ? nullptr : &flags_info;
+		layout_info.flags = flags;
+		layout_info.bindingCount = static_cast<uint32_t>(sorted.size());
+		layout_info.pBindings = sorted.data();
+		VkDescriptorSetLayout layout;
+		if (vkCreateDescriptorSetLayout(this->logical_device, &layout_info, nullptr, &layout) != VK_SUCCESS) {
+			throw std::runtime_error("fail to create descriptor set layout");
+		}
+		this->allocator->AddLayout(layout, sorted);
+		this->layouts.emplace(std::move(key), layout);
+		return layout;
+	}
+
+	uint32_t VulkanDescriptorLayoutCache::GetLayoutCount() {
+		return static_cast<uint32_t>(this->layouts.size());
+	}
+
+	uint64_t VulkanDescriptorLayoutCache::GetHitCount() {
+		return this->hit_count;
+	}
+
+	void VulkanDescriptorSetCache::Create(VkDevice logical_device, VulkanDescriptorAllocator* allocator) {
+		if (this->logical_device != VK_NULL_HANDLE) {
+			throw std::runtime_error("descriptor set cache is already created");
+		}
+		this->logical_device = logical_device;
+		this->allocator = allocator;
+		this->hit_count = 0;
+		this->miss_count = 0;
+	}
+
+	void VulkanDescriptorSetCache::Destroy() {
+		// the sets belong to the allocator
+		this->sets.clear();
+		this->allocator = nullptr;
+		this->logical_device = VK_NULL_HANDLE;
+	}
+
+	VkDescriptorSet VulkanDescriptorSetCache::Get(VkDescriptorSetLayout layout, std::vector<VkWriteDescriptorSet>& writes) {
+		detail::DescriptorCacheKey key;
+		key.words.push_back(HandleWord(layout));
+		for (VkWriteDescriptorSet& write : writes) {
+			size_t stride = UsesImageInfo(write.descriptorType) ? sizeof(VkDescriptorImageInfo)
+				: UsesTexelBufferView(write.descriptorType) ? sizeof(VkBufferView) : sizeof(VkDescriptorBufferInfo);
+			PushDescriptorWords(key.words, write.dstBinding, write.dstArrayElement, write.descriptorType, write.descriptorCount,
+				write.pImageInfo, write.pBufferInfo, write.pTexelBufferView, stride);
+		}
+		key.hash = vk::util::HashWords(key.words);
+
+		auto cached = this->sets.find(key);
+		if (cached != this->sets.end()) {
+			this->hit_count++;
+			return cached->second;
+		}
+		CPU_PROFILE_FUNCTION();
+		VkDescriptorSet set = this->allocator->Allocate(layout);
+		for (VkWriteDescriptorSet& write : writes) {
+			write.dstSet = set;
+		}
+		vkUpdateDescriptorSets(this->logical_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+		this->sets.emplace(std::move(key), set);
+		this->miss_count++;
+		return set;
+	}
+
+	VkDescriptorSet VulkanDescriptorSetCache::Get(VulkanDescriptorUpdateTemplate& update_template, const void* data) {
+		detail::DescriptorCacheKey key;
+		key.words.push_back(HandleWord(update_template.layout));
+		const char* bytes = static_cast<const char*>(data);
+		for (VkDescriptorUpdateTemplateEntry& entry : update_template.entries) {
+			const void* infos = bytes + entry.offset;
+			PushDescriptorWords(key.words, entry.dstBinding, entry.dstArrayElement, entry.descriptorType, entry.descriptorCount,
+				static_cast<const VkDescriptorImageInfo*>(infos), static_cast<const VkDescriptorBufferInfo*>(infos), static_cast<const VkBufferView*>(infos), entry.stride);
+		}
+		key.hash = vk::util::HashWords(key.words);
+
+		auto cached = this->sets.find(key);
+		if (cached != this->sets.end()) {
+			this->hit_count++;
+			return cached->second;
+		}
+		CPU_PROFILE_FUNCTION();
+		VkDescriptorSet set = this->allocator->Allocate(update_template.layout);
+		update_template.Update(set, data);
+		this->sets.emplace(std::move(key), set);
+		this->miss_count++;
+		return set;
+	}
+
+	void VulkanDescriptorSetCache::Clear() {
+		this->sets.clear();
+	}
+
+	uint32_t VulkanDescriptorSetCache::GetSetCount() {
+		return static_cast<uint32_t>(this->sets.size());
+	}
+
+	uint64_t VulkanDescriptorSetCache::GetHitCount() {
+		return this->hit_count;
+	}
+
+	uint64_t VulkanDescriptorSetCache::GetMissCount() {
+		return this->miss_count;
+	}
+}
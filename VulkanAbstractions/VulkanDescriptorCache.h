@@ -0,0 +1,74 @@
+#pragma once
+#include "vulkan/vulkan.h"
+#include <vector>
+#include <unordered_map>
+#include "VulkanDescriptorAllocator.h"
+#include "VulkanDescriptorUpdateTemplate.h"
+
+namespace vk {
+
+	namespace detail {
+		// flattened description of what a layout or a set holds, hashed once and compared word by word on collisions
+		struct DescriptorCacheKey {
+			std::vector<uint64_t> words;
+			uint64_t hash;
+			bool operator==(const DescriptorCacheKey& other) const {
+				return this->hash == other.hash && this->words == other.words;
+			}
+		};
+
+		struct DescriptorCacheKeyHash {
+			size_t operator()(const DescriptorCacheKey& key) const {
+				return static_cast<size_t>(key.hash);
+			}
+		};
+	}
+
+	// creates descriptor set layouts once per distinct array of bindings, create flags and binding flags. The bindings are keyed in binding
+	// order, so the same bindings listed in another order share a layout too. The cache owns the layouts, they live until Destroy
+	class VulkanDescriptorLayoutCache {
+	public:
+		// new layouts are added to allocator, which then knows how to size a pool for their sets
+		void Create(VkDevice logical_device, VulkanDescriptorAllocator* allocator);
+		void Destroy();
+		// binding_flags is empty or has the VkDescriptorBindingFlags of each binding, in the order of bindings, chained to the create info
+		VkDescriptorSetLayout CreateDescriptorSetLayout(std::vector<VkDescriptorSetLayoutBinding>& bindings, VkDescriptorSetLayoutCreateFlags flags = 0,
+			const std::vector<VkDescriptorBindingFlags>& binding_flags = {});
+		uint32_t GetLayoutCount();
+		uint64_t GetHitCount(); // CreateDescriptorSetLayout calls that returned an existing layout
+	private:
+		VkDevice logical_device = VK_NULL_HANDLE;
+		VulkanDescriptorAllocator* allocator = nullptr;
+		std::unordered_map<detail::DescriptorCacheKey, VkDescriptorSetLayout, detail::DescriptorCacheKeyHash> layouts;
+		uint64_t hit_count = 0;
+	};
+
+	// hands out descriptor sets keyed by their layout and the resources written to them: a set is allocated and written with
+	// vkUpdateDescriptorSets only the first time a combination is asked for, later requests get the same set back.
+	// Cached sets are shared, so they must never be written to directly. They are forgotten by Clear, which has to be called when
+	// the allocator is reset or when a resource they reference is destroyed, since a new resource may get the same handle
+	class VulkanDescriptorSetCache {
+	public:
+		void Create(VkDevice logical_device, VulkanDescriptorAllocator* allocator);
+		void Destroy();
+		// dstSet of the writes is ignored and overwritten
+		VkDescriptorSet Get(VkDescriptorSetLayout layout, std::vector<VkWriteDescriptorSet>& writes);
+		// same for the packed host struct of an update template, a miss writes the set with a single template update
+		VkDescriptorSet Get(VulkanDescriptorUpdateTemplate& update_template, const void* data);
+		template <typename T>
+		VkDescriptorSet Get(VulkanDescriptorUpdateTemplate& update_template, const T& data) {
+			update_template.CheckDataSize(sizeof(T));
+			return Get(update_template, static_cast<const void*>(&data));
+		}
+		void Clear();
+		uint32_t GetSetCount();
+		uint64_t GetHitCount();
+		uint64_t GetMissCount(); // sets allocated and written
+	private:
+		VkDevice logical_device = VK_NULL_HANDLE;
+		VulkanDescriptorAllocator* allocator = nullptr;
+		std::unordered_map<detail::DescriptorCacheKey, VkDescriptorSet, detail::DescriptorCacheKeyHash> sets;
+		uint64_t hit_count = 0;
+		uint64_t miss_count = 0;
+	};
+}
@@ -0,0 +1,81 @@
+#include "VulkanDescriptorUpdateTemplate.h"
+#include <stdexcept>
+#include <algorithm>
+
+namespace vk {
+
+	void VulkanDescriptorUpdateTemplate::Create(VkDevice logical_device, VkDescriptorSetLayout layout, std::vector<VkDescriptorSetLayoutBinding>& bindings) {
+		if (this->update_template != VK_NULL_HANDLE) {
+			throw std::runtime_error("descriptor update template is already created");
+		}
+		this->logical_device = logical_device;
+		this->layout = layout;
+		std::vector<VkDescriptorSetLayoutBinding> sorted = bindings;
+		std::sort(sorted.begin(), sorted.end(), [](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) {
+			return a.binding < b.binding;
+		});
+		this->entries.clear();
+		this->data_size = 0;
+		for (VkDescriptorSetLayoutBinding& binding : sorted) {
+			VkDescriptorUpdateTemplateEntry entry = {};
+			entry.dstBinding = binding.binding;
+			entry.dstArrayElement = 0;
+			entry.descriptorCount = binding.descriptorCount;
+			entry.descriptorType = binding.descriptorType;
+			entry.offset = this->data_size;
+			entry.stride = GetDescriptorInfoSize(binding.descriptorType);
+			this->entries.push_back(entry);
+			this->data_size += entry.stride * entry.descriptorCount;
+		}
+
+		VkDescriptorUpdateTemplateCreateInfo create_info = {};
+		create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+		create_info.descriptorUpdateEntryCount = static_cast<uint32_t>(this->entries.size());
+		create_info.pDescriptorUpdateEntries = this->entries.data();
+		create_info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+		create_info.descriptorSetLayout = layout;
+		if (vkCreateDescriptorUpdateTemplate(logical_device, &create_info, nullptr, &this->update_template) != VK_SUCCESS) {
+			throw std::runtime_error("fail to create descriptor update template");
+		}
+	}
+
+	void VulkanDescriptorUpdateTemplate::Destroy() {
+		if (this->update_template == VK_NULL_HANDLE) {
+			return;
+		}
+		vkDestroyDescriptorUpdateTemplate(this->logical_device, this->update_template, nullptr);
+		this->update_template = VK_NULL_HANDLE;
+		this->entries.clear();
+	}
+
+	void VulkanDescriptorUpdateTemplate::Update(VkDescriptorSet set, const void* data) {
+		vkUpdateDescriptorSetWithTemplate(this->logical_device, set, this->update_template, data);
+	}
+
+	void VulkanDescriptorUpdateTemplate::CheckDataSize(size_t data_size) {
+		if (data_size != this->data_size) {
+			throw std::runtime_error("descriptor data does not match the update template");
+		}
+	}
+
+	size_t VulkanDescriptorUpdateTemplate::GetDescriptorInfoSize(VkDescriptorType type) {
+		switch (type) {
+		case VK_DESCRIPTOR_TYPE_SAMPLER:
+		case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+		case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+		case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+		case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
+			return sizeof(VkDescriptorImageInfo);
+		case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+		case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+			return sizeof(VkBufferView);
+		case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+		case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+		case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+		case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+			return sizeof(VkDescriptorBufferInfo);
+		default:
+			throw std::runtime_error("descriptor type is not supported by update templates");
+		}
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "vulkan/vulkan.h"
+#include <vector>
+
+namespace vk {
+
+	// writes every binding of a descriptor set in a single vkUpdateDescriptorSetWithTemplate call, reading the descriptors from a
+	// packed host struct instead of a vector of VkWriteDescriptorSet. The entries are generated from the bindings of the layout:
+	// in binding order, each binding takes descriptorCount VkDescriptorBufferInfo, VkDescriptorImageInfo or VkBufferView (depending
+	// on its type) right after the previous one, so the struct is just those members declared in the same order, e.g.
+	// struct { VkDescriptorBufferInfo camera; VkDescriptorImageInfo shadow_map; } for binding 0 a uniform buffer and 1 a sampler
+	class VulkanDescriptorUpdateTemplate {
+	public:
+		void Create(VkDevice logical_device, VkDescriptorSetLayout layout, std::vector<VkDescriptorSetLayoutBinding>& bindings);
+		void Destroy();
+		void Update(VkDescriptorSet set, const void* data);
+		template <typename T>
+		void Update(VkDescriptorSet set, const T& data) {
+			CheckDataSize(sizeof(T));
+			Update(set, static_cast<const void*>(&data));
+		}
+		// throws if a host struct of data_size bytes doesn't match the entries
+		void CheckDataSize(size_t data_size);
+		static size_t GetDescriptorInfoSize(VkDescriptorType type);
+	public:
+		VkDescriptorUpdateTemplate update_template = VK_NULL_HANDLE;
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		std::vector<VkDescriptorUpdateTemplateEntry> entries;
+		size_t data_size = 0;
+	private:
+		VkDevice logical_device = VK_NULL_HANDLE;
+	};
+}
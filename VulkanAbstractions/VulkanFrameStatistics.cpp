@@ -0,0 +1,140 @@
+#include "VulkanFrameStatistics.h"
+#include <stdexcept>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include "VulkanHelper.h"
+
+namespace vk {
+
+	namespace {
+		// upper bounds of the histogram buckets, 60, 30, 20 and 10 fps included
+		const std::vector<float> histogram_edges = { 2.0f, 4.0f, 6.0f, 8.0f, 10.0f, 12.0f, 14.0f, 16.7f, 20.0f, 25.0f, 33.3f, 50.0f, 100.0f };
+		// a frame whose gpu waits are shorter than this didn't really wait, the gpu was done before the cpu needed it
+		const float gpu_bound_threshold_ms = 0.1f;
+	}
+
+	void VulkanFrameStatistics::Create(float budget_ms, uint32_t window) {
+		if (window == 0) {
+			throw std::runtime_error("frame statistics window must not be empty");
+		}
+		this->budget_ms = budget_ms;
+		this->window = window;
+		this->samples.clear();
+		this->samples.reserve(window);
+		this->next_sample = 0;
+		this->frame_count = 0;
+		this->total_over_budget_frames = 0;
+		this->histogram.assign(histogram_edges.size() + 1, 0);
+		this->frame_started = false;
+	}
+
+	void VulkanFrameStatistics::BeginFrame() {
+		auto now = std::chrono::steady_clock::now();
+		if (this->frame_started) {
+			this->current.frame_ms = std::chrono::duration<float, std::milli>(now - this->frame_start).count();
+			if (this->samples.size() < this->window) {
+				this->samples.push_back(this->current);
+			}
+			else {
+				this->samples[this->next_sample] = this->current;
+			}
+			this->next_sample = (this->next_sample + 1) % this->window;
+			this->frame_count++;
+			if (this->current.frame_ms > this->budget_ms) {
+				this->total_over_budget_frames++;
+			}
+			auto edge = std::lower_bound(histogram_edges.begin(), histogram_edges.end(), this->current.frame_ms);
+			this->histogram[edge - histogram_edges.begin()]++;
+		}
+		this->frame_started = true;
+		this->frame_start = now;
+		this->current = {};
+	}
+
+	void VulkanFrameStatistics::AddGpuWait(float ms) {
+		this->current.gpu_wait_ms += ms;
+	}
+
+	void VulkanFrameStatistics::AddAcquireWait(float ms) {
+		this->current.acquire_wait_ms += ms;
+	}
+
+	FrameStatisticsReport VulkanFrameStatistics::GetReport() {
+		FrameStatisticsReport report = {};
+		report.frame_count = this->frame_count;
+		report.sample_count = static_cast<uint32_t>(this->samples.size());
+		report.budget_ms = this->budget_ms;
+		report.total_over_budget_frames = this->total_over_budget_frames;
+		report.histogram = this->histogram;
+		if (this->samples.empty()) {
+			return report;
+		}
+		std::vector<float> frame_ms;
+		frame_ms.reserve(this->samples.size());
+		for (FrameSample& sample : this->samples) {
+			frame_ms.push_back(sample.frame_ms);
+			report.mean_ms += sample.frame_ms;
+			report.max_ms = std::max(report.max_ms, sample.frame_ms);
+			report.gpu_wait_ms += sample.gpu_wait_ms;
+			report.acquire_wait_ms += sample.acquire_wait_ms;
+			if (sample.frame_ms > this->budget_ms) {
+				report.over_budget_frames++;
+			}
+			if (sample.gpu_wait_ms > gpu_bound_threshold_ms) {
+				report.gpu_bound_frames++;
+			}
+			else {
+				report.cpu_bound_frames++;
+			}
+		}
+		float count = static_cast<float>(this->samples.size());
+		report.mean_ms /= count;
+		report.gpu_wait_ms /= count;
+		report.acquire_wait_ms /= count;
+		report.cpu_work_ms = std::max(report.mean_ms - report.gpu_wait_ms - report.acquire_wait_ms, 0.0f);
+		float variance = 0.0f;
+		for (FrameSample& sample : this->samples) {
+			variance += (sample.frame_ms - report.mean_ms) * (sample.frame_ms - report.mean_ms);
+		}
+		report.stddev_ms = std::sqrt(variance / count);
+		report.p50_ms = vk::util::Percentile(frame_ms, 50.0f);
+		report.p95_ms = vk::util::Percentile(frame_ms, 95.0f);
+		report.p99_ms = vk::util::Percentile(frame_ms, 99.0f);
+		return report;
+	}
+
+	std::string VulkanFrameStatistics::ToJson() {
+		FrameStatisticsReport report = GetReport();
+		std::ostringstream json;
+		json << "{\"frames\": " << report.frame_count << ", \"samples\": " << report.sample_count << ", \"budget_ms\": " << report.budget_ms
+			<< ", \"mean_ms\": " << report.mean_ms << ", \"stddev_ms\": " << report.stddev_ms
+			<< ", \"p50_ms\": " << report.p50_ms << ", \"p95_ms\": " << report.p95_ms << ", \"p99_ms\": " << report.p99_ms << ", \"max_ms\": " << report.max_ms
+			<< ", \"over_budget_frames\": " << report.over_budget_frames << ", \"total_over_budget_frames\": " << report.total_over_budget_frames
+			<< ", \"gpu_wait_ms\": " << report.gpu_wait_ms << ", \"acquire_wait_ms\": " << report.acquire_wait_ms << ", \"cpu_work_ms\": " << report.cpu_work_ms
+			<< ", \"gpu_bound_frames\": " << report.gpu_bound_frames << ", \"cpu_bound_frames\": " << report.cpu_bound_frames
+			<< ", \"histogram_edges_ms\": [";
+		for (uint32_t i = 0; i < histogram_edges.size(); i++) {
+			json << (i == 0 ? "" : ", ") << histogram_edges[i];
+		}
+		json << "], \"histogram\": [";
+		for (uint32_t i = 0; i < report.histogram.size(); i++) {
+			json << (i == 0 ? "" : ", ") << report.histogram[i];
+		}
+		json << "]}";
+		return json.str();
+	}
+
+	void VulkanFrameStatistics::WriteJson(const char* path) {
+		std::ofstream file(path);
+		if (!file.is_open()) {
+			throw std::runtime_error("fail to open frame statistics file");
+		}
+		file << ToJson() << "\n";
+	}
+
+	const std::vector<float>& VulkanFrameStatistics::GetHistogramEdges() {
+		return histogram_edges;
+	}
+}
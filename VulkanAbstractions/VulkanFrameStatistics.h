@@ -0,0 +1,62 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace vk {
+
+	struct FrameStatisticsReport {
+		uint64_t frame_count; // frames since Create
+		uint32_t sample_count; // frames in the rolling window, the percentiles and means below are taken over them
+		float budget_ms;
+		float mean_ms;
+		float stddev_ms;
+		float p50_ms;
+		float p95_ms;
+		float p99_ms;
+		float max_ms;
+		uint32_t over_budget_frames; // in the window
+		uint64_t total_over_budget_frames; // since Create
+		float gpu_wait_ms; // mean time the cpu blocked waiting for the gpu
+		float acquire_wait_ms; // mean time the cpu blocked in vkAcquireNextImageKHR, waiting for the presentation engine
+		float cpu_work_ms; // mean of the rest of the frame
+		uint32_t gpu_bound_frames; // frames in the window where the cpu had to wait for the gpu
+		uint32_t cpu_bound_frames; // frames in the window where the gpu was already done, so it was the one waiting for the cpu
+		std::vector<uint64_t> histogram; // frames since Create per bucket of GetHistogramEdges, the last bucket is everything above
+	};
+
+	// frame pacing statistics: frame times are the intervals between two BeginFrame calls, kept in a rolling window for percentiles
+	// and in a fixed histogram since Create. Gpu waits reported during a frame split it into time spent waiting for the gpu and cpu work
+	class VulkanFrameStatistics {
+	public:
+		// window is the number of frames the percentiles are taken over
+		void Create(float budget_ms, uint32_t window);
+		// closes the previous frame, if any, and starts timing a new one
+		void BeginFrame();
+		void AddGpuWait(float ms);
+		void AddAcquireWait(float ms);
+		FrameStatisticsReport GetReport();
+		// a single line, so periodic reports can be appended to a log as JSON lines
+		std::string ToJson();
+		void WriteJson(const char* path);
+		static const std::vector<float>& GetHistogramEdges();
+	private:
+		struct FrameSample {
+			float frame_ms;
+			float gpu_wait_ms;
+			float acquire_wait_ms;
+		};
+
+		float budget_ms = 0.0f;
+		uint32_t window = 0;
+		std::vector<FrameSample> samples; // ring buffer of the last window frames
+		uint32_t next_sample = 0;
+		uint64_t frame_count = 0;
+		uint64_t total_over_budget_frames = 0;
+		std::vector<uint64_t> histogram;
+		bool frame_started = false;
+		std::chrono::steady_clock::time_point frame_start;
+		FrameSample current = {};
+	};
+}
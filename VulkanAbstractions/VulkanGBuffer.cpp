@@ -0,0 +1,247 @@
+#include "VulkanGBuffer.h"
+#include <array>
+#include <stdexcept>
+#include "VulkanPhysicalDevice.h"
+
+namespace vk {
+
+	void VulkanGBuffer::Create(VkPhysicalDevice physical_device, VkDevice logical_device, VkExtent2D extent, VkFormat output_format,
+		VkImageLayout output_final_layout, DeferredLightingMode mode) {
+		if (this->renderpass != VK_NULL_HANDLE) {
+			throw std::runtime_error("G-buffer is already created");
+		}
+		this->logical_device = logical_device;
+		this->extent = extent;
+		this->mode = mode;
+		CreateAttachments(physical_device, extent);
+		if (mode == DeferredLightingMode::SUBPASS) {
+			CreateSubpassRenderpass(output_format, output_final_layout);
+		}
+		else {
+			CreateComputeRenderpass();
+		}
+	}
+
+	void VulkanGBuffer::Destroy() {
+		if (this->renderpass == VK_NULL_HANDLE) {
+			throw std::runtime_error("G-buffer is not yet created");
+		}
+		vkDestroyRenderPass(this->logical_device, this->renderpass, nullptr);
+		this->renderpass = VK_NULL_HANDLE;
+		this->depth.Destroy();
+		this->normal.Destroy();
+		this->albedo.Destroy();
+	}
+
+	std::vector<VkImageView> VulkanGBuffer::GetFramebufferAttachments(VkImageView output_view) {
+		if (this->mode == DeferredLightingMode::SUBPASS) {
+			return { output_view, this->albedo.image_view, this->normal.image_view, this->depth.image_view };
+		}
+		return { this->albedo.image_view, this->normal.image_view, this->depth.image_view };
+	}
+
+	std::vector<VkClearValue> VulkanGBuffer::GetClearValues() {
+		std::vector<VkClearValue> clear_values(this->mode == DeferredLightingMode::SUBPASS ? 4 : 3);
+		for (VkClearValue& clear_value : clear_values) {
+			clear_value.color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+		}
+		clear_values.back().depthStencil = { 1.0f, 0 };
+		return clear_values;
+	}
+
+	std::vector<VkDescriptorImageInfo> VulkanGBuffer::GetLightingImageInfos(VkSampler sampler) {
+		if (this->mode == DeferredLightingMode::SUBPASS) {
+			// layouts the lighting subpass sees its input attachments in
+			return {
+				{ VK_NULL_HANDLE, this->albedo.image_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+				{ VK_NULL_HANDLE, this->normal.image_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+				{ VK_NULL_HANDLE, this->depth.image_view, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL }
+			};
+		}
+		// final layouts of the geometry render pass
+		return {
+			{ sampler, this->albedo.image_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+			{ sampler, this->normal.image_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+			{ sampler, this->depth.image_view, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL }
+		};
+	}
+
+	VkDescriptorType VulkanGBuffer::GetLightingDescriptorType() {
+		return (this->mode == DeferredLightingMode::SUBPASS) ? VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	}
+
+	void VulkanGBuffer::CreateAttachments(VkPhysicalDevice physical_device, VkExtent2D extent) {
+		// subpass mode never stores the g-buffer, so on tilers it doesn't need any backing memory
+		VkImageUsageFlags read_usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+		VkMemoryPropertyFlags mem_properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		if (this->mode == DeferredLightingMode::SUBPASS) {
+			read_usage = VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+			if (IsMemoryTypeAvailable(physical_device, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)) {
+				mem_properties |= VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+			}
+		}
+
+		VkImageCreateInfo create_info = {};
+		create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		create_info.imageType = VK_IMAGE_TYPE_2D;
+		create_info.extent = { extent.width, extent.height, 1 };
+		create_info.mipLevels = 1;
+		create_info.arrayLayers = 1;
+		create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+		create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+
+		create_info.format = VK_FORMAT_R8G8B8A8_UNORM;
+		create_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | read_usage;
+		this->albedo.Create(physical_device, this->logical_device, create_info, mem_properties, VK_IMAGE_ASPECT_COLOR_BIT);
+
+		// octahedral normals are in [-1, 1]. Rendering to snorm is optional, half float is always supported
+		VkFormatProperties format_properties;
+		vkGetPhysicalDeviceFormatProperties(physical_device, VK_FORMAT_R16G16_SNORM, &format_properties);
+		create_info.format = (format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT) ? VK_FORMAT_R16G16_SNORM : VK_FORMAT_R16G16_SFLOAT;
+		this->normal.Create(physical_device, this->logical_device, create_info, mem_properties, VK_IMAGE_ASPECT_COLOR_BIT);
+
+		create_info.format = GetSupportedDepthFormat(physical_device);
+		create_info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | read_usage;
+		this->depth.Create(physical_device, this->logical_device, create_info, mem_properties, VK_IMAGE_ASPECT_DEPTH_BIT);
+	}
+
+	void VulkanGBuffer::CreateSubpassRenderpass(VkFormat output_format, VkImageLayout output_final_layout) {
+		std::array<VkAttachmentDescription, 4> attachments = {};
+		// lit output, only written by the lighting subpass
+		attachments[0].format = output_format;
+		attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+		attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		attachments[0].finalLayout = output_final_layout;
+
+		// g-buffer, dead after the render pass
+		std::array<VulkanCompositeImage*, 3> gbuffer_images = { &this->albedo, &this->normal, &this->depth };
+		for (uint32_t i = 1; i < attachments.size(); i++) {
+			attachments[i].format = gbuffer_images[i - 1]->format;
+			attachments[i].samples = VK_SAMPLE_COUNT_1_BIT;
+			attachments[i].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+			attachments[i].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachments[i].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			attachments[i].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachments[i].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			attachments[i].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		}
+		attachments[3].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+		std::vector<VkAttachmentReference> geometry_color_refs = { {1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL}, {2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL} };
+		VkAttachmentReference geometry_depth_ref = { 3, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+		std::vector<VkAttachmentReference> lighting_color_refs = { {0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL} };
+		std::vector<VkAttachmentReference> lighting_input_refs = {
+			{1, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL}, {2, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL}, {3, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL}
+		};
+
+		std::array<VkSubpassDescription, 2> subpasses = {};
+		subpasses[geometry_subpass].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpasses[geometry_subpass].colorAttachmentCount = static_cast<uint32_t>(geometry_color_refs.size());
+		subpasses[geometry_subpass].pColorAttachments = geometry_color_refs.data();
+		subpasses[geometry_subpass].pDepthStencilAttachment = &geometry_depth_ref;
+
+		subpasses[lighting_subpass].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpasses[lighting_subpass].colorAttachmentCount = static_cast<uint32_t>(lighting_color_refs.size());
+		subpasses[lighting_subpass].pColorAttachments = lighting_color_refs.data();
+		subpasses[lighting_subpass].inputAttachmentCount = static_cast<uint32_t>(lighting_input_refs.size());
+		subpasses[lighting_subpass].pInputAttachments = lighting_input_refs.data();
+
+		std::vector<VkSubpassDependency> dependencies = { {}, {}, {} };
+		// previous readers of the output are done before it's overwritten
+		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[0].dstSubpass = geometry_subpass;
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		dependencies[0].srcAccessMask = 0;
+		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+		// lighting reads the g-buffer texel of its own pixel only, so the dependency is by region and the data never has to leave the tile
+		dependencies[1].srcSubpass = geometry_subpass;
+		dependencies[1].dstSubpass = lighting_subpass;
+		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		dependencies[1].dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+		dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+		// the lit output is sampled afterwards
+		dependencies[2].srcSubpass = lighting_subpass;
+		dependencies[2].dstSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[2].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[2].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[2].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		dependencies[2].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		VkRenderPassCreateInfo create_info = {};
+		create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		create_info.attachmentCount = static_cast<uint32_t>(attachments.size());
+		create_info.pAttachments = attachments.data();
+		create_info.subpassCount = static_cast<uint32_t>(subpasses.size());
+		create_info.pSubpasses = subpasses.data();
+		create_info.dependencyCount = static_cast<uint32_t>(dependencies.size());
+		create_info.pDependencies = dependencies.data();
+
+		if (vkCreateRenderPass(this->logical_device, &create_info, nullptr, &this->renderpass) != VK_SUCCESS) {
+			throw std::runtime_error("fail to create g-buffer renderpass");
+		}
+	}
+
+	void VulkanGBuffer::CreateComputeRenderpass() {
+		std::array<VkAttachmentDescription, 3> attachments = {};
+		std::array<VulkanCompositeImage*, 3> gbuffer_images = { &this->albedo, &this->normal, &this->depth };
+		for (uint32_t i = 0; i < attachments.size(); i++) {
+			attachments[i].format = gbuffer_images[i]->format;
+			attachments[i].samples = VK_SAMPLE_COUNT_1_BIT;
+			attachments[i].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+			attachments[i].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			attachments[i].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			attachments[i].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachments[i].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			attachments[i].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		}
+		attachments[2].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+		std::vector<VkAttachmentReference> color_refs = { {0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL}, {1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL} };
+		VkAttachmentReference depth_ref = { 2, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+		VkSubpassDescription subpass_desc = {};
+		subpass_desc.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass_desc.colorAttachmentCount = static_cast<uint32_t>(color_refs.size());
+		subpass_desc.pColorAttachments = color_refs.data();
+		subpass_desc.pDepthStencilAttachment = &depth_ref;
+
+		std::vector<VkSubpassDependency> dependencies = { {}, {} };
+		// the previous lighting dispatch is done reading the g-buffer before it's overwritten
+		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[0].dstSubpass = 0;
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		dependencies[0].srcAccessMask = 0;
+		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+		dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+		// g-buffer writes are visible to the lighting dispatch
+		dependencies[1].srcSubpass = 0;
+		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		VkRenderPassCreateInfo create_info = {};
+		create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		create_info.attachmentCount = static_cast<uint32_t>(attachments.size());
+		create_info.pAttachments = attachments.data();
+		create_info.subpassCount = 1;
+		create_info.pSubpasses = &subpass_desc;
+		create_info.dependencyCount = static_cast<uint32_t>(dependencies.size());
+		create_info.pDependencies = dependencies.data();
+
+		if (vkCreateRenderPass(this->logical_device, &create_info, nullptr, &this->renderpass) != VK_SUCCESS) {
+			throw std::runtime_error("fail to create g-buffer renderpass");
+		}
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "vulkan/vulkan.h"
+#include <vector>
+#include "VulkanCompositeImage.h"
+
+namespace vk {
+
+	enum class DeferredLightingMode {
+		SUBPASS, // lighting is a second subpass reading the g-buffer as input attachments, so it can stay in tile memory
+		COMPUTE // g-buffer is stored, lighting is a compute dispatch after the render pass
+	};
+
+	// compact g-buffer for deferred shading: albedo (rgba8, alpha is free for the demo), octahedral encoded normal (rg16) and depth.
+	// There is no position target, positions are reconstructed from depth and the inverse projection.
+	// In SUBPASS mode the render pass has 2 subpasses and 4 attachments: output color, albedo, normal, depth. The g-buffer attachments are
+	// transient and never stored. In COMPUTE mode the render pass only has the geometry subpass and 3 attachments: albedo, normal, depth
+	class VulkanGBuffer {
+	public:
+		// output_format and output_final_layout describe the lit color image, which is owned by the caller
+		void Create(VkPhysicalDevice physical_device, VkDevice logical_device, VkExtent2D extent, VkFormat output_format, VkImageLayout output_final_layout,
+			DeferredLightingMode mode);
+		void Destroy();
+		// attachments for a framebuffer of renderpass, output_view is ignored in COMPUTE mode
+		std::vector<VkImageView> GetFramebufferAttachments(VkImageView output_view);
+		// clear values matching GetFramebufferAttachments
+		std::vector<VkClearValue> GetClearValues();
+		// in SUBPASS mode, infos for input attachments (sampler is ignored), in COMPUTE mode for combined image samplers. Order is albedo, normal, depth
+		std::vector<VkDescriptorImageInfo> GetLightingImageInfos(VkSampler sampler);
+		VkDescriptorType GetLightingDescriptorType();
+	private:
+		void CreateAttachments(VkPhysicalDevice physical_device, VkExtent2D extent);
+		void CreateSubpassRenderpass(VkFormat output_format, VkImageLayout output_final_layout);
+		void CreateComputeRenderpass();
+	public:
+		DeferredLightingMode mode;
+		VkExtent2D extent;
+		VkRenderPass renderpass = VK_NULL_HANDLE;
+		VulkanCompositeImage albedo;
+		VulkanCompositeImage normal;
+		VulkanCompositeImage depth;
+		const static uint32_t geometry_subpass = 0;
+		const static uint32_t lighting_subpass = 1; // SUBPASS mode only
+	private:
+		VkDevice logical_device = VK_NULL_HANDLE;
+	};
+}
@@ -0,0 +1,268 @@
+#include "VulkanGpuProfiler.h"
+#include <stdexcept>
+#include <fstream>
+#include <sstream>
+#include "VulkanHelper.h"
+#include "VulkanCpuProfiler.h"
+
+namespace vk {
+
+	namespace {
+		// names of the VkQueryPipelineStatisticFlagBits, lowest bit first
+		const char* pipeline_statistic_names[] = {
+			"input_assembly_vertices",
+			"input_assembly_primitives",
+			"vertex_shader_invocations",
+			"geometry_shader_invocations",
+			"geometry_shader_primitives",
+			"clipping_invocations",
+			"clipping_primitives",
+			"fragment_shader_invocations",
+			"tessellation_control_shader_patches",
+			"tessellation_evaluation_shader_invocations",
+			"compute_shader_invocations"
+		};
+
+		std::string EscapeJson(const std::string& text) {
+			std::string escaped;
+			for (char c : text) {
+				if (c == '"' || c == '\\') {
+					escaped.push_back('\\');
+				}
+				escaped.push_back(c);
+			}
+			return escaped;
+		}
+	}
+
+	void VulkanGpuProfiler::Create(VkPhysicalDevice physical_device, VkDevice logical_device, uint32_t queue_family_index, uint32_t max_scopes,
+		VkQueryPipelineStatisticFlags pipeline_statistics, uint32_t window) {
+		if (this->logical_device != VK_NULL_HANDLE) {
+			throw std::runtime_error("gpu profiler is already created");
+		}
+		this->logical_device = logical_device;
+		this->max_scopes = max_scopes;
+		this->pipeline_statistics = pipeline_statistics;
+		this->window = window;
+
+		uint32_t family_count = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, nullptr);
+		std::vector<VkQueueFamilyProperties> families(family_count);
+		vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, families.data());
+		uint32_t valid_bits = families[queue_family_index].timestampValidBits;
+		this->timestamp_mask = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+		VkPhysicalDeviceProperties device_properties;
+		vkGetPhysicalDeviceProperties(physical_device, &device_properties);
+		this->timestamp_period = device_properties.limits.timestampPeriod;
+	}
+
+	void VulkanGpuProfiler::Destroy() {
+		if (this->logical_device == VK_NULL_HANDLE) {
+			throw std::runtime_error("gpu profiler is not yet created");
+		}
+		DestroyQueryPools();
+		this->scopes.clear();
+		this->scope_ids.clear();
+		this->logical_device = VK_NULL_HANDLE;
+	}
+
+	void VulkanGpuProfiler::CreateQueryPools(uint32_t frame_count) {
+		this->frames.assign(frame_count, {});
+		if (!IsSupported()) {
+			return;
+		}
+		VkQueryPoolCreateInfo create_info = {};
+		create_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		create_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		create_info.queryCount = 2 * this->max_scopes * frame_count; // begin and end of every scope
+		if (vkCreateQueryPool(this->logical_device, &create_info, nullptr, &this->timestamp_pool) != VK_SUCCESS) {
+			throw std::runtime_error("fail to create timestamp query pool");
+		}
+		if (this->pipeline_statistics == 0) {
+			return;
+		}
+		create_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+		create_info.queryCount = this->max_scopes * frame_count;
+		create_info.pipelineStatistics = this->pipeline_statistics;
+		if (vkCreateQueryPool(this->logical_device, &create_info, nullptr, &this->statistics_pool) != VK_SUCCESS) {
+			throw std::runtime_error("fail to create pipeline statistics query pool");
+		}
+	}
+
+	void VulkanGpuProfiler::DestroyQueryPools() {
+		if (this->statistics_pool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(this->logical_device, this->statistics_pool, nullptr);
+			this->statistics_pool = VK_NULL_HANDLE;
+		}
+		if (this->timestamp_pool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(this->logical_device, this->timestamp_pool, nullptr);
+			this->timestamp_pool = VK_NULL_HANDLE;
+		}
+		this->frames.clear();
+	}
+
+	bool VulkanGpuProfiler::IsSupported() {
+		return this->timestamp_mask != 0;
+	}
+
+	void VulkanGpuProfiler::CmdBeginFrame(VkCommandBuffer cmd_buffer, uint32_t frame) {
+		if (!IsSupported()) {
+			return;
+		}
+		this->frames[frame].scope_ids.clear();
+		this->frames[frame].open_scopes.clear();
+		vkCmdResetQueryPool(cmd_buffer, this->timestamp_pool, 2 * this->max_scopes * frame, 2 * this->max_scopes);
+		if (this->statistics_pool != VK_NULL_HANDLE) {
+			vkCmdResetQueryPool(cmd_buffer, this->statistics_pool, this->max_scopes * frame, this->max_scopes);
+		}
+	}
+
+	void VulkanGpuProfiler::CmdBeginScope(VkCommandBuffer cmd_buffer, uint32_t frame, const char* name) {
+		if (!IsSupported()) {
+			return;
+		}
+		FrameScopes& frame_scopes = this->frames[frame];
+		if (frame_scopes.scope_ids.size() >= this->max_scopes) {
+			throw std::runtime_error("too many gpu profiler scopes in a frame");
+		}
+		uint32_t index = static_cast<uint32_t>(frame_scopes.scope_ids.size());
+		frame_scopes.scope_ids.push_back(GetScopeId(name));
+		frame_scopes.open_scopes.push_back(index);
+		vkCmdWriteTimestamp(cmd_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, this->timestamp_pool, 2 * (this->max_scopes * frame + index));
+		if (this->statistics_pool != VK_NULL_HANDLE) {
+			vkCmdBeginQuery(cmd_buffer, this->statistics_pool, this->max_scopes * frame + index, 0);
+		}
+	}
+
+	void VulkanGpuProfiler::CmdEndScope(VkCommandBuffer cmd_buffer, uint32_t frame) {
+		if (!IsSupported()) {
+			return;
+		}
+		FrameScopes& frame_scopes = this->frames[frame];
+		if (frame_scopes.open_scopes.empty()) {
+			throw std::runtime_error("gpu profiler scope ended without being begun");
+		}
+		uint32_t index = frame_scopes.open_scopes.back();
+		frame_scopes.open_scopes.pop_back();
+		if (this->statistics_pool != VK_NULL_HANDLE) {
+			vkCmdEndQuery(cmd_buffer, this->statistics_pool, this->max_scopes * frame + index);
+		}
+		vkCmdWriteTimestamp(cmd_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, this->timestamp_pool, 2 * (this->max_scopes * frame + index) + 1);
+	}
+
+	void VulkanGpuProfiler::ReadResults(uint32_t frame) {
+		CPU_PROFILE_FUNCTION();
+		if (!IsSupported()) {
+			return;
+		}
+		FrameScopes& frame_scopes = this->frames[frame];
+		uint32_t scope_count = static_cast<uint32_t>(frame_scopes.scope_ids.size());
+		if (scope_count == 0) {
+			return;
+		}
+		std::vector<uint64_t> timestamps(2 * scope_count);
+		if (vkGetQueryPoolResults(this->logical_device, this->timestamp_pool, 2 * this->max_scopes * frame, 2 * scope_count,
+			timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+			return; // not available (yet), skip rather than stall
+		}
+		uint32_t statistics_count = GetStatisticsCount();
+		std::vector<uint64_t> statistics(scope_count * statistics_count);
+		bool has_statistics = this->statistics_pool != VK_NULL_HANDLE && vkGetQueryPoolResults(this->logical_device, this->statistics_pool,
+			this->max_scopes * frame, scope_count, statistics.size() * sizeof(uint64_t), statistics.data(), statistics_count * sizeof(uint64_t),
+			VK_QUERY_RESULT_64_BIT) == VK_SUCCESS;
+
+		for (uint32_t i = 0; i < scope_count; i++) {
+			ScopeSamples& samples = this->scopes[frame_scopes.scope_ids[i]];
+			uint64_t ticks = (timestamps[2 * i + 1] - timestamps[2 * i]) & this->timestamp_mask;
+			float gpu_ms = static_cast<float>(ticks * static_cast<double>(this->timestamp_period) / 1e6);
+			if (samples.gpu_ms.size() < this->window) {
+				samples.gpu_ms.push_back(gpu_ms);
+			}
+			else {
+				samples.gpu_ms[samples.next_sample] = gpu_ms;
+			}
+			samples.next_sample = (samples.next_sample + 1) % this->window;
+			if (has_statistics) {
+				samples.statistics_totals.resize(statistics_count, 0);
+				for (uint32_t j = 0; j < statistics_count; j++) {
+					samples.statistics_totals[j] += statistics[i * statistics_count + j];
+				}
+				samples.statistics_frames++;
+			}
+		}
+	}
+
+	std::vector<GpuScopeStatistics> VulkanGpuProfiler::GetStatistics() {
+		std::vector<GpuScopeStatistics> statistics;
+		for (ScopeSamples& samples : this->scopes) {
+			GpuScopeStatistics scope_statistics = {};
+			scope_statistics.name = samples.name;
+			scope_statistics.sample_count = static_cast<uint32_t>(samples.gpu_ms.size());
+			scope_statistics.p50_ms = util::Percentile(samples.gpu_ms, 50.0f);
+			scope_statistics.p95_ms = util::Percentile(samples.gpu_ms, 95.0f);
+			scope_statistics.p99_ms = util::Percentile(samples.gpu_ms, 99.0f);
+			for (uint64_t total : samples.statistics_totals) {
+				scope_statistics.pipeline_statistics.push_back(static_cast<double>(total) / samples.statistics_frames);
+			}
+			statistics.push_back(scope_statistics);
+		}
+		return statistics;
+	}
+
+	std::string VulkanGpuProfiler::ToJson() {
+		std::vector<const char*> statistic_names;
+		for (uint32_t bit = 0; bit < sizeof(pipeline_statistic_names) / sizeof(pipeline_statistic_names[0]); bit++) {
+			if (this->pipeline_statistics & (1u << bit)) {
+				statistic_names.push_back(pipeline_statistic_names[bit]);
+			}
+		}
+		std::ostringstream json;
+		json << "{\n\t\"scopes\": [";
+		std::vector<GpuScopeStatistics> statistics = GetStatistics();
+		for (uint32_t i = 0; i < statistics.size(); i++) {
+			GpuScopeStatistics& scope = statistics[i];
+			json << (i == 0 ? "\n" : ",\n") << "\t\t{\"name\": \"" << EscapeJson(scope.name) << "\", \"samples\": " << scope.sample_count
+				<< ", \"p50_ms\": " << scope.p50_ms << ", \"p95_ms\": " << scope.p95_ms << ", \"p99_ms\": " << scope.p99_ms;
+			if (!scope.pipeline_statistics.empty()) {
+				json << ", \"pipeline_statistics\": {";
+				for (uint32_t j = 0; j < scope.pipeline_statistics.size() && j < statistic_names.size(); j++) {
+					json << (j == 0 ? "" : ", ") << "\"" << statistic_names[j] << "\": " << scope.pipeline_statistics[j];
+				}
+				json << "}";
+			}
+			json << "}";
+		}
+		json << "\n\t]\n}\n";
+		return json.str();
+	}
+
+	void VulkanGpuProfiler::WriteJson(const char* path) {
+		std::ofstream file(path);
+		if (!file.is_open()) {
+			throw std::runtime_error("fail to open gpu profile file");
+		}
+		file << ToJson();
+	}
+
+	uint32_t VulkanGpuProfiler::GetScopeId(const char* name) {
+		auto it = this->scope_ids.find(name);
+		if (it != this->scope_ids.end()) {
+			return it->second;
+		}
+		uint32_t id = static_cast<uint32_t>(this->scopes.size());
+		ScopeSamples samples;
+		samples.name = name;
+		samples.gpu_ms.reserve(this->window);
+		this->scopes.push_back(samples);
+		this->scope_ids[name] = id;
+		return id;
+	}
+
+	uint32_t VulkanGpuProfiler::GetStatisticsCount() {
+		uint32_t count = 0;
+		for (VkQueryPipelineStatisticFlags flags = this->pipeline_statistics; flags != 0; flags &= flags - 1) {
+			count++;
+		}
+		return count;
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "vulkan/vulkan.h"
+#include <vector>
+#include <string>
+#include <map>
+
+namespace vk {
+
+	struct GpuScopeStatistics {
+		std::string name;
+		uint32_t sample_count; // samples in the rolling window
+		float p50_ms;
+		float p95_ms;
+		float p99_ms;
+		std::vector<double> pipeline_statistics; // per frame average of every enabled counter, in VkQueryPipelineStatisticFlagBits order
+	};
+
+	// gpu time of named scopes (usually one per render pass) from timestamp queries, plus optional pipeline statistics.
+	// Every frame slot (a swapchain image when command buffers are pre-recorded) owns a range of queries that CmdBeginFrame resets, so the command
+	// buffers of a frame must be recorded in submission order, starting with the one that calls CmdBeginFrame.
+	// ReadResults never waits: call it once the slot's previous submission is known to be complete.
+	// Scopes can nest, except that pipeline statistics queries of a scope can't overlap with any other pipeline statistics query
+	class VulkanGpuProfiler {
+	public:
+		// max_scopes is per frame, window is the number of samples per scope the percentiles are taken over.
+		// pipeline_statistics needs the pipelineStatisticsQuery feature, 0 disables them
+		void Create(VkPhysicalDevice physical_device, VkDevice logical_device, uint32_t queue_family_index, uint32_t max_scopes,
+			VkQueryPipelineStatisticFlags pipeline_statistics, uint32_t window);
+		void Destroy();
+		// query pools are sized for frame_count slots, samples collected so far are kept when they are recreated
+		void CreateQueryPools(uint32_t frame_count);
+		void DestroyQueryPools();
+		// false if the queue family has no timestamps, every command is then a no-op
+		bool IsSupported();
+		void CmdBeginFrame(VkCommandBuffer cmd_buffer, uint32_t frame);
+		void CmdBeginScope(VkCommandBuffer cmd_buffer, uint32_t frame, const char* name);
+		void CmdEndScope(VkCommandBuffer cmd_buffer, uint32_t frame);
+		void ReadResults(uint32_t frame);
+		std::vector<GpuScopeStatistics> GetStatistics();
+		std::string ToJson();
+		void WriteJson(const char* path);
+	private:
+		uint32_t GetScopeId(const char* name);
+		uint32_t GetStatisticsCount();
+	private:
+		struct FrameScopes {
+			std::vector<uint32_t> scope_ids; // in recording order, the i-th scope uses the frame's i-th queries
+			std::vector<uint32_t> open_scopes; // indices into scope_ids, while recording
+		};
+
+		struct ScopeSamples {
+			std::string name;
+			std::vector<float> gpu_ms; // ring buffer of the last window samples
+			uint32_t next_sample = 0;
+			std::vector<uint64_t> statistics_totals;
+			uint64_t statistics_frames = 0;
+		};
+
+		VkDevice logical_device = VK_NULL_HANDLE;
+		VkQueryPool timestamp_pool = VK_NULL_HANDLE;
+		VkQueryPool statistics_pool = VK_NULL_HANDLE;
+		VkQueryPipelineStatisticFlags pipeline_statistics = 0;
+		float timestamp_period = 0.0f; // nanoseconds per tick
+		uint64_t timestamp_mask = 0; // timestamps only have timestampValidBits valid bits
+		uint32_t max_scopes = 0;
+		uint32_t window = 0;
+		std::vector<FrameScopes> frames;
+		std::vector<ScopeSamples> scopes;
+		std::map<std::string, uint32_t> scope_ids;
+	};
+}
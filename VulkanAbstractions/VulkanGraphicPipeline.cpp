@@ -1,5 +1,7 @@
 #include "VulkanGraphicPipeline.h"
 #include "VulkanHelper.h"
+#include "VulkanCpuProfiler.h"
+#include "VulkanShaderReflection.h"
 #include <array>
 
 namespace vk {
@@ -18,6 +20,7 @@ namespace vk {
 		}
 	}
 	VkShaderModule CreateShaderModule(VkDevice logical_device, const char* filename) {
+		CPU_PROFILE_FUNCTION();
 		std::vector<char> code = ReadFile(filename);
 		VkShaderModuleCreateInfo create_info = {};
 		create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
@@ -30,6 +33,24 @@ namespace vk {
 		return shader_module;
 	}
 
+	VkShaderModule CreateShaderModule(VkDevice logical_device, const char* filename, ShaderReflection& reflection) {
+		CPU_PROFILE_FUNCTION();
+		std::vector<char> code = ReadFile(filename);
+		if (code.size() % sizeof(uint32_t) != 0) {
+			throw std::runtime_error("shader code is not made of 32 bit words");
+		}
+		reflection.Reflect(reinterpret_cast<const uint32_t*>(code.data()), code.size() / sizeof(uint32_t));
+		VkShaderModuleCreateInfo create_info = {};
+		create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		create_info.codeSize = code.size();
+		create_info.pCode = reinterpret_cast<const uint32_t*>(code.data());
+		VkShaderModule shader_module;
+		if (vkCreateShaderModule(logical_device, &create_info, nullptr, &shader_module) != VK_SUCCESS) {
+			throw std::runtime_error("fail to create shader module");
+		}
+		return shader_module;
+	}
+
 	VkPipelineShaderStageCreateInfo CreateShaderStageCreateInfo(VkShaderModule shader_module, VkShaderStageFlagBits stage) {
 		VkPipelineShaderStageCreateInfo create_info = {};
 		create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -11,6 +11,10 @@ namespace vk {
 
 	VkShaderModule CreateShaderModule(VkDevice logical_device, const char* filename);
 
+	class ShaderReflection;
+	// also reflects the interface of the module's code
+	VkShaderModule CreateShaderModule(VkDevice logical_device, const char* filename, ShaderReflection& reflection);
+
 	VkPipelineShaderStageCreateInfo CreateShaderStageCreateInfo(VkShaderModule shader_module, VkShaderStageFlagBits stage);
 
 	VkPipelineVertexInputStateCreateInfo CreateVertexInputStateCreateInfo(std::vector<VkVertexInputBindingDescription>& input_binding_descs,
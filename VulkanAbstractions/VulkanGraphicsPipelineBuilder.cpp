@@ -0,0 +1,209 @@
+#include "VulkanGraphicsPipelineBuilder.h"
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+#include "VulkanHelper.h"
+#include "VulkanGraphicPipeline.h"
+#include "VulkanCpuProfiler.h"
+
+namespace vk {
+
+	namespace {
+		// non-dispatchable handles are pointers on 64 bit platforms and uint64_t on 32 bit ones
+		template <typename T>
+		uint64_t HandleWord(T handle) {
+			return (uint64_t)handle;
+		}
+
+		uint64_t FloatWord(float value) {
+			uint32_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+			return bits;
+		}
+	}
+
+	void GraphicsPipelineState::AppendKeyWords(std::vector<uint64_t>& words) const {
+		words.push_back(this->topology);
+		words.push_back(this->polygon_mode);
+		words.push_back(this->cull_mode);
+		words.push_back(this->front_face);
+		words.push_back(this->depth_bias);
+		words.push_back(FloatWord(this->depth_bias_constant_factor));
+		words.push_back(FloatWord(this->depth_bias_slope_factor));
+		words.push_back(this->depth_test);
+		words.push_back(this->depth_write);
+		words.push_back(this->depth_compare_op);
+		words.push_back(this->samples);
+		words.push_back(this->color_attachment_count);
+		words.push_back(this->color_write_mask);
+		words.push_back(this->blend);
+		words.push_back(this->src_blend_factor);
+		words.push_back(this->dst_blend_factor);
+		words.push_back(this->blend_op);
+		words.push_back(this->viewport_extent.width);
+		words.push_back(this->viewport_extent.height);
+	}
+
+	uint64_t GraphicsPipelineState::Hash() const {
+		std::vector<uint64_t> words;
+		AppendKeyWords(words);
+		return vk::util::HashWords(words);
+	}
+
+	bool GraphicsPipelineState::operator==(const GraphicsPipelineState& other) const {
+		std::vector<uint64_t> words, other_words;
+		AppendKeyWords(words);
+		other.AppendKeyWords(other_words);
+		return words == other_words;
+	}
+
+	bool GraphicsPipelineState::operator!=(const GraphicsPipelineState& other) const {
+		return !(*this == other);
+	}
+
+	void GraphicsPipelineBuilder::SetShader(VkShaderStageFlagBits stage, VkShaderModule shader_module) {
+		RemoveShader(stage);
+		ShaderStage shader_stage = {};
+		shader_stage.stage = stage;
+		shader_stage.shader_module = shader_module;
+		auto position = std::find_if(this->stages.begin(), this->stages.end(), [stage](const ShaderStage& other) { return other.stage > stage; });
+		this->stages.insert(position, std::move(shader_stage));
+	}
+
+	void GraphicsPipelineBuilder::RemoveShader(VkShaderStageFlagBits stage) {
+		this->stages.erase(std::remove_if(this->stages.begin(), this->stages.end(), [stage](const ShaderStage& other) { return other.stage == stage; }),
+			this->stages.end());
+	}
+
+	void GraphicsPipelineBuilder::SetSpecialization(VkShaderStageFlagBits stage, const std::vector<VkSpecializationMapEntry>& map_entries,
+		const void* data, size_t data_size) {
+		auto shader_stage = std::find_if(this->stages.begin(), this->stages.end(), [stage](const ShaderStage& other) { return other.stage == stage; });
+		if (shader_stage == this->stages.end()) {
+			throw std::runtime_error("pipeline builder has no shader for the specialized stage");
+		}
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		shader_stage->map_entries = map_entries;
+		shader_stage->data.assign(bytes, bytes + data_size);
+	}
+
+	void GraphicsPipelineBuilder::SetVertexInput(const std::vector<VkVertexInputBindingDescription>& bindings,
+		const std::vector<VkVertexInputAttributeDescription>& attributes) {
+		this->vertex_bindings = bindings;
+		this->vertex_attributes = attributes;
+	}
+
+	void GraphicsPipelineBuilder::SetLayout(VkPipelineLayout pipeline_layout) {
+		this->pipeline_layout = pipeline_layout;
+	}
+
+	void GraphicsPipelineBuilder::SetRenderPass(VkRenderPass renderpass, uint32_t subpass) {
+		this->renderpass = renderpass;
+		this->subpass = subpass;
+	}
+
+	VkPipeline GraphicsPipelineBuilder::Build(VkDevice logical_device, VkPipelineCache pipeline_cache) const {
+		CPU_PROFILE_FUNCTION();
+		std::vector<VkPipelineShaderStageCreateInfo> shader_stages(this->stages.size());
+		std::vector<VkSpecializationInfo> specialization_infos(this->stages.size());
+		for (size_t i = 0; i < this->stages.size(); i++) {
+			const ShaderStage& stage = this->stages[i];
+			shader_stages[i] = vk::CreateShaderStageCreateInfo(stage.shader_module, stage.stage);
+			if (stage.map_entries.empty()) {
+				continue;
+			}
+			specialization_infos[i].mapEntryCount = static_cast<uint32_t>(stage.map_entries.size());
+			specialization_infos[i].pMapEntries = stage.map_entries.data();
+			specialization_infos[i].dataSize = stage.data.size();
+			specialization_infos[i].pData = stage.data.data();
+			shader_stages[i].pSpecializationInfo = &specialization_infos[i];
+		}
+
+		std::vector<VkVertexInputBindingDescription> vertex_bindings = this->vertex_bindings;
+		std::vector<VkVertexInputAttributeDescription> vertex_attributes = this->vertex_attributes;
+		VkPipelineVertexInputStateCreateInfo vertex_input_info = vk::CreateVertexInputStateCreateInfo(vertex_bindings, vertex_attributes);
+		VkPipelineInputAssemblyStateCreateInfo assembly_state_info = vk::CreateInputAssemblyStateCreateInfo(false, this->state.topology);
+
+		bool dynamic_viewport = this->state.viewport_extent.width == 0 || this->state.viewport_extent.height == 0;
+		std::vector<VkViewport> viewports = { {} };
+		viewports[0].width = static_cast<float>(this->state.viewport_extent.width);
+		viewports[0].height = static_cast<float>(this->state.viewport_extent.height);
+		viewports[0].minDepth = 0.0f;
+		viewports[0].maxDepth = 1.0f;
+		std::vector<VkRect2D> scissors = { {} };
+		scissors[0].extent = this->state.viewport_extent;
+		VkPipelineViewportStateCreateInfo viewport_state_info = vk::CreateViewportStateCreateInfo(viewports, scissors);
+		std::vector<VkDynamicState> dynamic_states = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+		VkPipelineDynamicStateCreateInfo dynamic_state = vk::CreateDynamicStateCreateInfo(dynamic_states);
+
+		VkPipelineRasterizationStateCreateInfo rasterizer = vk::CreateRasterizationStateCreateInfo(false, false, this->state.polygon_mode, 1.0f,
+			this->state.cull_mode, this->state.front_face, this->state.depth_bias, this->state.depth_bias_constant_factor, 0.0f, this->state.depth_bias_slope_factor);
+		VkPipelineMultisampleStateCreateInfo multisample = vk::CreateMultisampleStateCreateInfo(false, this->state.samples);
+		VkPipelineDepthStencilStateCreateInfo depth_stencil = vk::CreateDepthStencilStateCreateInfo(this->state.depth_test, this->state.depth_write,
+			this->state.depth_compare_op, false, false);
+		std::vector<VkPipelineColorBlendAttachmentState> blend_attachment_states(this->state.color_attachment_count,
+			vk::CreateColorBlendAttachmentState(this->state.color_write_mask, this->state.blend, this->state.src_blend_factor, this->state.dst_blend_factor,
+				this->state.blend_op, this->state.src_blend_factor, this->state.dst_blend_factor, this->state.blend_op));
+		VkPipelineColorBlendStateCreateInfo color_blend_state = vk::CreateColorBlendStateCreateInfo(false, blend_attachment_states);
+
+		VkGraphicsPipelineCreateInfo pipeline_info = {};
+		pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		pipeline_info.stageCount = static_cast<uint32_t>(shader_stages.size());
+		pipeline_info.pStages = shader_stages.data();
+		pipeline_info.pVertexInputState = &vertex_input_info;
+		pipeline_info.pInputAssemblyState = &assembly_state_info;
+		pipeline_info.pViewportState = &viewport_state_info;
+		pipeline_info.pRasterizationState = &rasterizer;
+		pipeline_info.pMultisampleState = &multisample;
+		pipeline_info.pDepthStencilState = &depth_stencil;
+		pipeline_info.pColorBlendState = &color_blend_state;
+		pipeline_info.pDynamicState = dynamic_viewport ? &dynamic_state : nullptr;
+		pipeline_info.layout = this->pipeline_layout;
+		pipeline_info.renderPass = this->renderpass;
+		pipeline_info.subpass = this->subpass;
+		pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+		pipeline_info.basePipelineIndex = -1;
+
+		VkPipeline pipeline;
+		if (vkCreateGraphicsPipelines(logical_device, pipeline_cache, 1, &pipeline_info, nullptr, &pipeline) != VK_SUCCESS) {
+			throw std::runtime_error("fail to create graphics pipeline");
+		}
+		return pipeline;
+	}
+
+	detail::PipelineKey GraphicsPipelineBuilder::GetKey() const {
+		detail::PipelineKey key;
+		for (const ShaderStage& stage : this->stages) {
+			key.words.push_back(stage.stage);
+			key.words.push_back(HandleWord(stage.shader_module));
+			key.words.push_back(stage.map_entries.size());
+			for (const VkSpecializationMapEntry& entry : stage.map_entries) {
+				key.words.push_back(entry.constantID);
+				key.words.push_back(entry.offset);
+				key.words.push_back(entry.size);
+			}
+			key.words.push_back(stage.data.size());
+			for (unsigned char byte : stage.data) {
+				key.words.push_back(byte);
+			}
+		}
+		key.words.push_back(this->vertex_bindings.size());
+		for (const VkVertexInputBindingDescription& binding : this->vertex_bindings) {
+			key.words.push_back(binding.binding);
+			key.words.push_back(binding.stride);
+			key.words.push_back(binding.inputRate);
+		}
+		key.words.push_back(this->vertex_attributes.size());
+		for (const VkVertexInputAttributeDescription& attribute : this->vertex_attributes) {
+			key.words.push_back(attribute.location);
+			key.words.push_back(attribute.binding);
+			key.words.push_back(attribute.format);
+			key.words.push_back(attribute.offset);
+		}
+		this->state.AppendKeyWords(key.words);
+		key.words.push_back(HandleWord(this->pipeline_layout));
+		key.words.push_back(HandleWord(this->renderpass));
+		key.words.push_back(this->subpass);
+		key.hash = vk::util::HashWords(key.words);
+		return key;
+	}
+}
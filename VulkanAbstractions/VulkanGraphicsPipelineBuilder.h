@@ -0,0 +1,91 @@
+#pragma once
+#include "vulkan/vulkan.h"
+#include <vector>
+#include <cstdint>
+
+namespace vk {
+
+	namespace detail {
+		// flattened description of a pipeline, hashed once and compared word by word on collisions
+		struct PipelineKey {
+			std::vector<uint64_t> words;
+			uint64_t hash;
+			bool operator==(const PipelineKey& other) const {
+				return this->hash == other.hash && this->words == other.words;
+			}
+		};
+
+		struct PipelineKeyHash {
+			size_t operator()(const PipelineKey& key) const {
+				return static_cast<size_t>(key.hash);
+			}
+		};
+	}
+
+	// fixed function state of a graphics pipeline as a plain value without pointers, compared and hashed member by member.
+	// The defaults are the opaque scene state of the demos: triangle lists, back face culling, depth test and write with LESS and
+	// one color attachment written without blending
+	struct GraphicsPipelineState {
+		VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+		VkPolygonMode polygon_mode = VK_POLYGON_MODE_FILL;
+		VkCullModeFlags cull_mode = VK_CULL_MODE_BACK_BIT;
+		VkFrontFace front_face = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+		bool depth_bias = false;
+		float depth_bias_constant_factor = 0.0f;
+		float depth_bias_slope_factor = 0.0f;
+		bool depth_test = true;
+		bool depth_write = true;
+		VkCompareOp depth_compare_op = VK_COMPARE_OP_LESS;
+		VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+		uint32_t color_attachment_count = 1; // every attachment has the write mask and blending below
+		VkColorComponentFlags color_write_mask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+		bool blend = false;
+		VkBlendFactor src_blend_factor = VK_BLEND_FACTOR_ONE; // for color and alpha
+		VkBlendFactor dst_blend_factor = VK_BLEND_FACTOR_ZERO;
+		VkBlendOp blend_op = VK_BLEND_OP_ADD;
+		// static viewport and scissor covering the extent, dynamic ones set while recording if it is 0 x 0
+		VkExtent2D viewport_extent = { 0, 0 };
+
+		void AppendKeyWords(std::vector<uint64_t>& words) const;
+		uint64_t Hash() const;
+		bool operator==(const GraphicsPipelineState& other) const;
+		bool operator!=(const GraphicsPipelineState& other) const;
+	};
+
+	// what a graphics pipeline is made of: shader stages with their specialization, vertex input, fixed function state, layout and
+	// render pass. A builder is a value too, so variants are copies with a few members changed. Build compiles the pipeline,
+	// PipelineRegistry::Get compiles it once per distinct description
+	class GraphicsPipelineBuilder {
+	public:
+		// replaces the module of the stage and drops its specialization
+		void SetShader(VkShaderStageFlagBits stage, VkShaderModule shader_module);
+		void RemoveShader(VkShaderStageFlagBits stage);
+		// the map entries and data are copied. Throws if the stage has no shader
+		void SetSpecialization(VkShaderStageFlagBits stage, const std::vector<VkSpecializationMapEntry>& map_entries, const void* data, size_t data_size);
+		template <typename T>
+		void SetSpecialization(VkShaderStageFlagBits stage, const std::vector<VkSpecializationMapEntry>& map_entries, const T& data) {
+			SetSpecialization(stage, map_entries, &data, sizeof(T));
+		}
+		void SetVertexInput(const std::vector<VkVertexInputBindingDescription>& bindings, const std::vector<VkVertexInputAttributeDescription>& attributes);
+		void SetLayout(VkPipelineLayout pipeline_layout);
+		void SetRenderPass(VkRenderPass renderpass, uint32_t subpass = 0);
+		VkPipeline Build(VkDevice logical_device, VkPipelineCache pipeline_cache = VK_NULL_HANDLE) const;
+		detail::PipelineKey GetKey() const;
+	public:
+		GraphicsPipelineState state;
+	private:
+		struct ShaderStage {
+			VkShaderStageFlagBits stage;
+			VkShaderModule shader_module;
+			std::vector<VkSpecializationMapEntry> map_entries;
+			std::vector<unsigned char> data;
+		};
+	private:
+		std::vector<ShaderStage> stages; // sorted by stage bit, so the vertex stage comes first
+		std::vector<VkVertexInputBindingDescription> vertex_bindings;
+		std::vector<VkVertexInputAttributeDescription> vertex_attributes;
+		VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+		VkRenderPass renderpass = VK_NULL_HANDLE;
+		uint32_t subpass = 0;
+	};
+}
@@ -1,5 +1,7 @@
 #include "VulkanHelper.h"
 #include <stdexcept>
+#include <algorithm>
+#include <cmath>
 #include "VulkanPhysicalDevice.h"
 
 namespace vk {
@@ -209,6 +211,26 @@ namespace vk {
 			vkCmdBeginRenderPass(command_buffer, &render_pass_info, supbass_contents);
 		}
 
+		void TransitionImageLayout(VkCommandBuffer command_buffer, VkImage image, VkImageAspectFlags aspect_flag, uint32_t layer_count,
+			VkImageLayout old_layout, VkImageLayout new_layout, VkPipelineStageFlags src_stage, VkAccessFlags src_access,
+			VkPipelineStageFlags dst_stage, VkAccessFlags dst_access) {
+			VkImageMemoryBarrier barrier = {};
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.srcAccessMask = src_access;
+			barrier.dstAccessMask = dst_access;
+			barrier.oldLayout = old_layout;
+			barrier.newLayout = new_layout;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.image = image;
+			barrier.subresourceRange.aspectMask = aspect_flag;
+			barrier.subresourceRange.baseMipLevel = 0;
+			barrier.subresourceRange.levelCount = 1;
+			barrier.subresourceRange.baseArrayLayer = 0;
+			barrier.subresourceRange.layerCount = layer_count;
+			vkCmdPipelineBarrier(command_buffer, src_stage, dst_stage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+		}
+
 		uint32_t GetVkBoolean(bool boolean) {
 			return (boolean)? 1: 0;
 		}
@@ -218,5 +240,36 @@ namespace vk {
 			return times * alignment;
 		}
 
+		float Percentile(std::vector<float> values, float percentile) {
+			if (values.empty()) {
+				return 0.0f;
+			}
+			size_t rank = static_cast<size_t>(std::ceil(percentile / 100.0f * values.size()));
+			size_t index = std::min(std::max(rank, static_cast<size_t>(1)), values.size()) - 1;
+			std::nth_element(values.begin(), values.begin() + index, values.end());
+			return values[index];
+		}
+
+		uint64_t HashWords(const std::vector<uint64_t>& words) {
+			uint64_t hash = 14695981039346656037ull;
+			for (uint64_t word : words) {
+				for (uint32_t i = 0; i < 8; i++) {
+					hash ^= (word >> (i * 8)) & 0xff;
+					hash *= 1099511628211ull;
+				}
+			}
+			return hash;
+		}
+
+		uint64_t HashBytes(const void* data, size_t size) {
+			const unsigned char* bytes = static_cast<const unsigned char*>(data);
+			uint64_t hash = 14695981039346656037ull;
+			for (size_t i = 0; i < size; i++) {
+				hash ^= bytes[i];
+				hash *= 1099511628211ull;
+			}
+			return hash;
+		}
+
 	}
 }
\ No newline at end of file
@@ -62,10 +62,24 @@ namespace vk {
 		void BeginRenderpass(VkCommandBuffer command_buffer, VkRenderPass renderpass, VkFramebuffer framebuffer, VkOffset2D offset, VkExtent2D extent,
 			std::vector<VkClearValue> & clear_values, VkSubpassContents supbass_contents);
 
+		// records a pipeline barrier that moves layers [0, layer_count) of the image from old_layout to new_layout
+		void TransitionImageLayout(VkCommandBuffer command_buffer, VkImage image, VkImageAspectFlags aspect_flag, uint32_t layer_count,
+			VkImageLayout old_layout, VkImageLayout new_layout, VkPipelineStageFlags src_stage, VkAccessFlags src_access,
+			VkPipelineStageFlags dst_stage, VkAccessFlags dst_access);
+
 		uint32_t GetVkBoolean(bool boolean);
 
 		uint32_t CalculateObjectSize(uint32_t actual_object_size, uint32_t alignment);
 
+		// nearest rank percentile (0 to 100) of the values, 0 if there are none
+		float Percentile(std::vector<float> values, float percentile);
+
+		// 64 bit FNV-1a over the words, for the keys of the caches
+		uint64_t HashWords(const std::vector<uint64_t>& words);
+
+		// same over raw bytes, i.e. file contents
+		uint64_t HashBytes(const void* data, size_t size);
+
 	}
 
 }
\ No newline at end of file
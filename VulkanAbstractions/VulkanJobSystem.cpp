@@ -0,0 +1,211 @@
+#include "VulkanJobSystem.h"
+#include <stdexcept>
+#include <string>
+#include "VulkanCpuProfiler.h"
+
+namespace vk {
+
+	namespace {
+		thread_local uint32_t current_thread_index = 0;
+		const uint32_t SPINS_BEFORE_SLEEP = 64;
+	}
+
+	JobSystem::~JobSystem() {
+		Stop();
+	}
+
+	void JobSystem::Start(uint32_t worker_count) {
+		if (this->running) {
+			throw std::runtime_error("job system is already started");
+		}
+		if (worker_count == 0) {
+			uint32_t hardware_threads = std::thread::hardware_concurrency();
+			worker_count = hardware_threads > 1 ? hardware_threads - 1 : 0;
+		}
+		this->queues.clear();
+		for (uint32_t i = 0; i <= worker_count; i++) {
+			this->queues.push_back(std::make_unique<WorkQueue>());
+		}
+		this->first_exception = nullptr;
+		this->running = true;
+		current_thread_index = 0;
+		for (uint32_t i = 1; i <= worker_count; i++) {
+			this->workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+		}
+	}
+
+	void JobSystem::Stop() {
+		if (!this->running) {
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(this->sleep_mutex);
+			this->running = false;
+		}
+		this->sleep_condition.notify_all();
+		for (std::thread& worker : this->workers) {
+			worker.join();
+		}
+		this->workers.clear();
+		this->queues.clear();
+		this->queued_count = 0;
+	}
+
+	void JobSystem::Run(std::function<void()> function, JobCounter* counter, JobCounter* dependency) {
+		if (counter != nullptr) {
+			counter->count.fetch_add(1, std::memory_order_relaxed);
+		}
+		JobCounter::Job job = { std::move(function), counter };
+		if (dependency != nullptr) {
+			std::lock_guard<std::mutex> lock(dependency->mutex);
+			if (!dependency->IsDone()) {
+				dependency->waiting_jobs.push_back(std::move(job));
+				return;
+			}
+		}
+		Push(std::move(job));
+	}
+
+	void JobSystem::ParallelFor(uint32_t count, uint32_t batch_size, const std::function<void(uint32_t, uint32_t)>& function, JobCounter* counter,
+		JobCounter* dependency) {
+		if (batch_size == 0) {
+			throw std::runtime_error("parallel for batch size can't be 0");
+		}
+		for (uint32_t begin = 0; begin < count; begin += batch_size) {
+			uint32_t end = count - begin > batch_size ? begin + batch_size : count;
+			Run([function, begin, end]() { function(begin, end); }, counter, dependency);
+		}
+	}
+
+	void JobSystem::Wait(JobCounter& counter) {
+		CPU_PROFILE_FUNCTION();
+		uint32_t thread_index = current_thread_index;
+		while (!counter.IsDone()) {
+			JobCounter::Job job;
+			if (PopOrSteal(thread_index, job)) {
+				Execute(job);
+			}
+			else {
+				std::this_thread::yield();
+			}
+		}
+		// the job that released the counter may still hold its mutex
+		{
+			std::lock_guard<std::mutex> lock(counter.mutex);
+		}
+		std::lock_guard<std::mutex> lock(this->exception_mutex);
+		if (this->first_exception) {
+			std::exception_ptr exception = this->first_exception;
+			this->first_exception = nullptr;
+			std::rethrow_exception(exception);
+		}
+	}
+
+	bool JobSystem::IsRunning() {
+		return this->running;
+	}
+
+	uint32_t JobSystem::GetThreadCount() {
+		return this->running ? static_cast<uint32_t>(this->queues.size()) : 1;
+	}
+
+	uint32_t JobSystem::GetThreadIndex() {
+		return current_thread_index;
+	}
+
+	void JobSystem::Push(JobCounter::Job job) {
+		if (!this->running) {
+			Execute(job);
+			return;
+		}
+		// threads outside the system share the queue of the thread that started it
+		uint32_t thread_index = current_thread_index < this->queues.size() ? current_thread_index : 0;
+		{
+			std::lock_guard<std::mutex> lock(this->queues[thread_index]->mutex);
+			this->queues[thread_index]->jobs.push_back(std::move(job));
+		}
+		this->queued_count.fetch_add(1, std::memory_order_release);
+		// a worker checks queued_count under sleep_mutex before sleeping, taking it here means the notification can't fall in between
+		{
+			std::lock_guard<std::mutex> lock(this->sleep_mutex);
+		}
+		this->sleep_condition.notify_one();
+	}
+
+	bool JobSystem::PopOrSteal(uint32_t thread_index, JobCounter::Job& job) {
+		if (this->queued_count.load(std::memory_order_acquire) == 0) {
+			return false;
+		}
+		uint32_t queue_count = static_cast<uint32_t>(this->queues.size());
+		for (uint32_t i = 0; i < queue_count; i++) {
+			WorkQueue& queue = *this->queues[(thread_index + i) % queue_count];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (queue.jobs.empty()) {
+				continue;
+			}
+			if (i == 0) {
+				job = std::move(queue.jobs.back());
+				queue.jobs.pop_back();
+			}
+			else {
+				job = std::move(queue.jobs.front());
+				queue.jobs.pop_front();
+			}
+			this->queued_count.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+		return false;
+	}
+
+	void JobSystem::Execute(JobCounter::Job& job) {
+		try {
+			job.function();
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> lock(this->exception_mutex);
+			if (!this->first_exception) {
+				this->first_exception = std::current_exception();
+			}
+		}
+		Finish(job.counter);
+	}
+
+	void JobSystem::Finish(JobCounter* counter) {
+		if (counter == nullptr) {
+			return;
+		}
+		std::vector<JobCounter::Job> released_jobs;
+		{
+			std::lock_guard<std::mutex> lock(counter->mutex);
+			if (counter->count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+				released_jobs.swap(counter->waiting_jobs);
+			}
+		}
+		// the counter may be gone from here on
+		for (JobCounter::Job& job : released_jobs) {
+			Push(std::move(job));
+		}
+	}
+
+	void JobSystem::WorkerLoop(uint32_t thread_index) {
+		current_thread_index = thread_index;
+		std::string thread_name = "job worker " + std::to_string(thread_index);
+		VulkanCpuProfiler::SetThreadName(thread_name.c_str());
+		uint32_t idle_spins = 0;
+		while (this->running) {
+			JobCounter::Job job;
+			if (PopOrSteal(thread_index, job)) {
+				Execute(job);
+				idle_spins = 0;
+				continue;
+			}
+			if (++idle_spins < SPINS_BEFORE_SLEEP) {
+				std::this_thread::yield();
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(this->sleep_mutex);
+			this->sleep_condition.wait(lock, [this]() { return !this->running || this->queued_count.load(std::memory_order_acquire) > 0; });
+			idle_spins = 0;
+		}
+	}
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vk {
+
+	class JobSystem;
+
+	// jobs left to finish. Run increments it and each job decrements it once done. Jobs run with a dependency are only queued once the
+	// dependency's count is back to 0, and JobSystem::Wait helps with the queued jobs until it is
+	class JobCounter {
+	public:
+		bool IsDone() const {
+			return this->count.load(std::memory_order_acquire) == 0;
+		}
+	private:
+		friend class JobSystem;
+		struct Job {
+			std::function<void()> function;
+			JobCounter* counter;
+		};
+		std::atomic<uint32_t> count{ 0 };
+		std::mutex mutex; // taken by the last job finishing, so a waiter can't destroy the counter while it is being released
+		std::vector<Job> waiting_jobs;
+	};
+
+	// runs small jobs on a worker per hardware thread. Each thread has its own deque: it pushes and pops its jobs at the back, and a thread
+	// that runs out of jobs steals the oldest one at the front of another deque, so a job spawning more jobs keeps them local while idle
+	// threads pick up the rest. The thread that started the system takes part in the work while it waits on a counter.
+	// Without Start, Run executes the jobs on the calling thread
+	class JobSystem {
+	public:
+		~JobSystem();
+		// worker_count 0 starts one worker per hardware thread besides the calling one
+		void Start(uint32_t worker_count = 0);
+		void Stop(); // jobs still queued are dropped
+		// counter and dependency may be null
+		void Run(std::function<void()> function, JobCounter* counter, JobCounter* dependency = nullptr);
+		// function(begin, end) for each batch_size range of [0, count)
+		void ParallelFor(uint32_t count, uint32_t batch_size, const std::function<void(uint32_t, uint32_t)>& function, JobCounter* counter,
+			JobCounter* dependency = nullptr);
+		// runs queued jobs on the calling thread until the counter is done, then rethrows the first exception a job threw
+		void Wait(JobCounter& counter);
+		bool IsRunning();
+		uint32_t GetThreadCount(); // workers plus the thread that started the system
+		// 0 for the thread that started the system and threads outside it, 1 and up for the workers: an index into per thread data
+		static uint32_t GetThreadIndex();
+	private:
+		void Push(JobCounter::Job job);
+		bool PopOrSteal(uint32_t thread_index, JobCounter::Job& job);
+		void Execute(JobCounter::Job& job);
+		void Finish(JobCounter* counter);
+		void WorkerLoop(uint32_t thread_index);
+	private:
+		struct WorkQueue {
+			std::mutex mutex;
+			std::deque<JobCounter::Job> jobs;
+		};
+		std::vector<std::unique_ptr<WorkQueue>> queues; // per thread
+		std::vector<std::thread> workers;
+		std::atomic<bool> running{ false };
+		std::atomic<uint32_t> queued_count{ 0 };
+		std::mutex sleep_mutex;
+		std::condition_variable sleep_condition;
+		std::mutex exception_mutex;
+		std::exception_ptr first_exception;
+	};
+}
@@ -2,8 +2,8 @@
 #include <stdexcept>
 
 namespace vk {
-	void CreateLogicalDevice(std::vector<QueueCreationRequirement>& reqs, std::vector<uint32_t> & queue_family_indices, std::vector<const char*>& device_extensions, 
-		bool VALIDATION_LAYER_ENABLED, std::vector<const char*> & validation_layers, VkPhysicalDevice physical_device, VkDevice & logical_device) {
+	void CreateLogicalDevice(std::vector<QueueCreationRequirement>& reqs, std::vector<uint32_t> & queue_family_indices, std::vector<const char*>& device_extensions,
+		VkPhysicalDeviceFeatures& device_features, const void* next, bool VALIDATION_LAYER_ENABLED, std::vector<const char*> & validation_layers, VkPhysicalDevice physical_device, VkDevice & logical_device) {
 		std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
 		for (uint32_t i = 0; i < reqs.size(); i++) {
 			VkDeviceQueueCreateInfo queue_create_info = {};
@@ -14,9 +14,9 @@ namespace vk {
 			queue_create_infos.push_back(queue_create_info);
 		}
 
-		VkPhysicalDeviceFeatures device_features = {};
 		VkDeviceCreateInfo device_create_info = {};
 		device_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+		device_create_info.pNext = next;
 		device_create_info.pQueueCreateInfos = queue_create_infos.data();
 		device_create_info.queueCreateInfoCount = static_cast<uint32_t>(queue_create_infos.size());
 		device_create_info.pEnabledFeatures = &device_features;
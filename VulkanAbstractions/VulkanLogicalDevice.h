@@ -4,6 +4,7 @@
 #include "VulkanPhysicalDevice.h"
 
 namespace vk {
+	// next is the pNext chain of the device create info, i.e. VkPhysicalDeviceVulkan12Features
 	void CreateLogicalDevice(std::vector<QueueCreationRequirement>& reqs, std::vector<uint32_t>& queue_family_indices, std::vector<const char*>& device_extensions,
-		bool VALIDATION_LAYER_ENABLED, std::vector<const char*>& validation_layers, VkPhysicalDevice physical_device, VkDevice& logical_device);
+		VkPhysicalDeviceFeatures& device_features, const void* next, bool VALIDATION_LAYER_ENABLED, std::vector<const char*>& validation_layers, VkPhysicalDevice physical_device, VkDevice& logical_device);
 }
\ No newline at end of file
@@ -0,0 +1,88 @@
+#include "VulkanMappedFile.h"
+#include <stdexcept>
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace vk {
+
+	MappedFile::~MappedFile() {
+		Close();
+	}
+
+	void MappedFile::Open(const char* filename) {
+		Close();
+#ifdef _WIN32
+		HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) {
+			throw std::runtime_error("fail to open file");
+		}
+		this->file = file;
+		LARGE_INTEGER file_size;
+		GetFileSizeEx(this->file, &file_size);
+		this->size = static_cast<size_t>(file_size.QuadPart);
+		if (this->size == 0) {
+			throw std::runtime_error("file is empty");
+		}
+		this->mapping = CreateFileMappingA(this->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		this->data = this->mapping != nullptr ? MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+#else
+		this->file = open(filename, O_RDONLY);
+		if (this->file < 0) {
+			throw std::runtime_error("fail to open file");
+		}
+		struct stat file_stat;
+		fstat(this->file, &file_stat);
+		this->size = static_cast<size_t>(file_stat.st_size);
+		if (this->size == 0) {
+			throw std::runtime_error("file is empty");
+		}
+		void* mapped = mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, this->file, 0);
+		this->data = mapped != MAP_FAILED ? mapped : nullptr;
+#endif
+		if (this->data == nullptr) {
+			throw std::runtime_error("fail to map file");
+		}
+	}
+
+	void MappedFile::Close() {
+#ifdef _WIN32
+		if (this->data != nullptr) {
+			UnmapViewOfFile(this->data);
+		}
+		if (this->mapping != nullptr) {
+			CloseHandle(this->mapping);
+		}
+		if (this->file != nullptr) {
+			CloseHandle(this->file);
+		}
+		this->mapping = nullptr;
+		this->file = nullptr;
+#else
+		if (this->data != nullptr) {
+			munmap(const_cast<void*>(this->data), this->size);
+		}
+		if (this->file >= 0) {
+			close(this->file);
+		}
+		this->file = -1;
+#endif
+		this->data = nullptr;
+		this->size = 0;
+	}
+
+	bool MappedFile::IsOpen() {
+		return this->data != nullptr;
+	}
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstddef>
+
+namespace vk {
+
+	// read only view of a whole file, unmapped when it goes out of scope
+	class MappedFile {
+	public:
+		MappedFile() = default;
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		~MappedFile();
+		// throws if the file can't be opened, is empty or can't be mapped
+		void Open(const char* filename);
+		void Close();
+		bool IsOpen();
+	public:
+		const void* data = nullptr; // page aligned, so it can be read as SPIR-V words in place
+		size_t size = 0;
+	private:
+#ifdef _WIN32
+		void* file = nullptr; // HANDLEs, windows.h stays out of the header
+		void* mapping = nullptr;
+#else
+		int file = -1;
+#endif
+	};
+}
@@ -0,0 +1,101 @@
+#include "VulkanPerDrawData.h"
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+#include "VulkanHelper.h"
+#include "VulkanPhysicalDevice.h"
+
+namespace vk {
+
+	namespace {
+		const uint32_t STORAGE_PAYLOAD_ALIGNMENT = 16;
+	}
+
+	void VulkanPerDrawData::Create(VkPhysicalDevice physical_device, VkDevice logical_device, uint32_t payload_size, uint32_t max_draws, uint32_t image_count,
+		VkShaderStageFlags stage_flags, PerDrawDataPath path) {
+		if (this->logical_device != VK_NULL_HANDLE) {
+			throw std::runtime_error("per draw data is already created");
+		}
+		if (payload_size == 0 || payload_size % 4 != 0) {
+			throw std::runtime_error("per draw payload size must be a non zero multiple of 4");
+		}
+		if (path == PerDrawDataPath::AUTOMATIC) {
+			path = ChoosePath(physical_device, payload_size);
+		}
+		else if (path == PerDrawDataPath::PUSH_CONSTANTS && ChoosePath(physical_device, payload_size) != PerDrawDataPath::PUSH_CONSTANTS) {
+			throw std::runtime_error("per draw payload does not fit in push constants");
+		}
+		this->logical_device = logical_device;
+		this->path = path;
+		this->payload_size = payload_size;
+		this->payload_stride = vk::util::CalculateObjectSize(payload_size, STORAGE_PAYLOAD_ALIGNMENT);
+		this->max_draws = max_draws;
+		this->stage_flags = stage_flags;
+		this->staged_draw_count = 0;
+		if (path != PerDrawDataPath::STORAGE_BUFFER) {
+			return;
+		}
+		this->staged_payloads.assign(static_cast<size_t>(this->payload_stride) * max_draws, 0);
+		this->storage_buffers.resize(image_count);
+		for (uint32_t i = 0; i < image_count; i++) {
+			// written once per frame with a single copy, so host coherent memory is enough
+			this->storage_buffers[i].CreateBuffer(logical_device, physical_device, static_cast<VkDeviceSize>(this->payload_stride) * max_draws,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_SHARING_MODE_EXCLUSIVE, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		}
+	}
+
+	void VulkanPerDrawData::Destroy() {
+		if (this->logical_device == VK_NULL_HANDLE) {
+			return;
+		}
+		for (VulkanCompositeBuffer& buffer : this->storage_buffers) {
+			buffer.DestroyBuffer();
+		}
+		this->storage_buffers.clear();
+		this->staged_payloads.clear();
+		this->logical_device = VK_NULL_HANDLE;
+	}
+
+	VkPushConstantRange VulkanPerDrawData::GetPushConstantRange() {
+		uint32_t size = this->path == PerDrawDataPath::PUSH_CONSTANTS ? this->payload_size : sizeof(uint32_t);
+		return { this->stage_flags, 0, size };
+	}
+
+	VkDescriptorBufferInfo VulkanPerDrawData::GetStorageBufferInfo(uint32_t image_index) {
+		if (this->path != PerDrawDataPath::STORAGE_BUFFER) {
+			throw std::runtime_error("per draw data is pushed, it has no storage buffer");
+		}
+		return vk::init::CreateDescriptorBufferInfo(this->storage_buffers[image_index].buffer, 0, this->storage_buffers[image_index].size);
+	}
+
+	void VulkanPerDrawData::Record(VkCommandBuffer cmd_buffer, VkPipelineLayout pipeline_layout, uint32_t draw_index, const void* payload) {
+		if (this->path == PerDrawDataPath::PUSH_CONSTANTS) {
+			vkCmdPushConstants(cmd_buffer, pipeline_layout, this->stage_flags, 0, this->payload_size, payload);
+			return;
+		}
+		if (draw_index >= this->max_draws) {
+			throw std::runtime_error("per draw data has more draws than it was created for");
+		}
+		memcpy(this->staged_payloads.data() + static_cast<size_t>(draw_index) * this->payload_stride, payload, this->payload_size);
+		this->staged_draw_count = std::max(this->staged_draw_count, draw_index + 1);
+		vkCmdPushConstants(cmd_buffer, pipeline_layout, this->stage_flags, 0, sizeof(uint32_t), &draw_index);
+	}
+
+	void VulkanPerDrawData::Flush(uint32_t image_index) {
+		if (this->path != PerDrawDataPath::STORAGE_BUFFER || this->staged_draw_count == 0) {
+			return;
+		}
+		this->storage_buffers[image_index].CopyFromHostData(this->staged_payloads.data(), this->staged_draw_count * this->payload_stride, 0);
+		this->staged_draw_count = 0;
+	}
+
+	void VulkanPerDrawData::CheckPayloadSize(size_t payload_size) {
+		if (payload_size != this->payload_size) {
+			throw std::runtime_error("per draw payload does not match the per draw data");
+		}
+	}
+
+	PerDrawDataPath VulkanPerDrawData::ChoosePath(VkPhysicalDevice physical_device, uint32_t payload_size) {
+		return payload_size <= vk::GetMaxPushConstantsSize(physical_device) ? PerDrawDataPath::PUSH_CONSTANTS : PerDrawDataPath::STORAGE_BUFFER;
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "vulkan/vulkan.h"
+#include <vector>
+#include "VulkanCompositeBuffer.h"
+
+namespace vk {
+
+	enum class PerDrawDataPath {
+		AUTOMATIC, // push constants if the payload fits in the device's push constant budget, a storage buffer otherwise
+		PUSH_CONSTANTS,
+		STORAGE_BUFFER
+	};
+
+	// hands a small payload per draw (model matrix, color, material index...) to the shaders without binding a descriptor set per draw.
+	// On the push constant path the whole payload is pushed before each draw. On the storage buffer path the payloads are written to a
+	// buffer per swapchain image, which the shaders read as an std430 array, and each draw only pushes its index as a uint at offset 0.
+	// Push constants are recorded into the command buffer, so on that path the command buffers have to be recorded again when payloads change
+	class VulkanPerDrawData {
+	public:
+		void Create(VkPhysicalDevice physical_device, VkDevice logical_device, uint32_t payload_size, uint32_t max_draws, uint32_t image_count,
+			VkShaderStageFlags stage_flags, PerDrawDataPath path = PerDrawDataPath::AUTOMATIC);
+		void Destroy();
+		// the range to create the pipeline layouts with
+		VkPushConstantRange GetPushConstantRange();
+		// storage buffer path only, the buffer the shaders of image_index read the payloads from
+		VkDescriptorBufferInfo GetStorageBufferInfo(uint32_t image_index);
+		// pushes the payload, or stages it at draw_index and pushes draw_index
+		void Record(VkCommandBuffer cmd_buffer, VkPipelineLayout pipeline_layout, uint32_t draw_index, const void* payload);
+		template <typename T>
+		void Record(VkCommandBuffer cmd_buffer, VkPipelineLayout pipeline_layout, uint32_t draw_index, const T& payload) {
+			CheckPayloadSize(sizeof(T));
+			Record(cmd_buffer, pipeline_layout, draw_index, static_cast<const void*>(&payload));
+		}
+		// storage buffer path only, copies the payloads staged since the last flush to the buffer of image_index. Must be called before
+		// submitting, once the previous submission reading that buffer is done
+		void Flush(uint32_t image_index);
+		void CheckPayloadSize(size_t payload_size);
+		static PerDrawDataPath ChoosePath(VkPhysicalDevice physical_device, uint32_t payload_size);
+	public:
+		PerDrawDataPath path = PerDrawDataPath::AUTOMATIC;
+		uint32_t payload_size = 0;
+		uint32_t payload_stride = 0; // of the storage buffer array, 16 bytes aligned like an std430 struct of vec4/mat4 members
+		uint32_t max_draws = 0;
+	private:
+		VkDevice logical_device = VK_NULL_HANDLE;
+		VkShaderStageFlags stage_flags = 0;
+		std::vector<VulkanCompositeBuffer> storage_buffers; // per image
+		std::vector<unsigned char> staged_payloads;
+		uint32_t staged_draw_count = 0; // highest staged draw index + 1
+	};
+}
@@ -7,7 +7,8 @@
 namespace vk {
 
 	VkPhysicalDevice PickPhysicalDevice(VkInstance vk_instance, VkSurfaceKHR surface,
-		std::vector<QueueCreationRequirement>& queue_family_requirements, std::vector<const char*>& device_extensions, std::vector<uint32_t>& queue_family_indices) {
+		std::vector<QueueCreationRequirement>& queue_family_requirements, std::vector<const char*>& device_extensions, std::vector<uint32_t>& queue_family_indices,
+		const std::function<bool(VkPhysicalDevice)>& is_device_suitable) {
 
 		uint32_t device_count = 0;
 		vkEnumeratePhysicalDevices(vk_instance, &device_count, nullptr);
@@ -20,12 +21,15 @@ namespace vk {
 		for (VkPhysicalDevice& device : physical_devices) {
 			if (FindQueueFamilies(device, surface, queue_family_requirements, queue_family_indices) 
 				&& AreDeviceExtensionsSupported(device, device_extensions) && 
-				IsSwapchainAdequate(device, surface)) {
+				IsSwapchainAdequate(device, surface) && IsTimelineSemaphoreSupported(device) && (!is_device_suitable || is_device_suitable(device))) {
 				// if a physical device satisfy all the queue property requirement
 				// supports all the device extensions
-				// and capable of creating swapchain for the surface
+				// capable of creating swapchain for the surface
+				// has timeline semaphores
+				// and has the features the caller asks for
 				return device;
 			}
+			queue_family_indices.clear();
 		}
 		return VK_NULL_HANDLE;
 	}
@@ -90,12 +94,29 @@ namespace vk {
 		throw std::runtime_error("failed to find suitable memory type");
 	}
 
+	bool IsMemoryTypeAvailable(VkPhysicalDevice physical_device, VkMemoryPropertyFlags properties) {
+		VkPhysicalDeviceMemoryProperties mem_properties;
+		vkGetPhysicalDeviceMemoryProperties(physical_device, &mem_properties);
+		for (uint32_t i = 0; i < mem_properties.memoryTypeCount; i++) {
+			if ((mem_properties.memoryTypes[i].propertyFlags & properties) == properties) {
+				return true;
+			}
+		}
+		return false;
+	}
+
 	uint32_t GetMinUniformBufferAlignment(VkPhysicalDevice physical_device) {
 		VkPhysicalDeviceProperties device_property;
 		vkGetPhysicalDeviceProperties(physical_device, &device_property);
 		return device_property.limits.minUniformBufferOffsetAlignment;
 	}
 
+	uint32_t GetMaxPushConstantsSize(VkPhysicalDevice physical_device) {
+		VkPhysicalDeviceProperties device_property;
+		vkGetPhysicalDeviceProperties(physical_device, &device_property);
+		return device_property.limits.maxPushConstantsSize;
+	}
+
 	namespace {
 		// check if a queue family satisfies all its requirements
 		bool IsQueueFamilySuitable(VkQueueFamilyProperties queue_family, QueueCreationRequirement& queue_family_requirement, VkSurfaceKHR surface, VkPhysicalDevice physical_device, uint32_t queue_idx) {
@@ -146,6 +167,21 @@ namespace vk {
 			return !details.formats.empty() && !details.present_modes.empty();
 		}
 
+		bool IsTimelineSemaphoreSupported(VkPhysicalDevice physical_device) {
+			VkPhysicalDeviceProperties properties;
+			vkGetPhysicalDeviceProperties(physical_device, &properties);
+			if (properties.apiVersion < VK_API_VERSION_1_2) {
+				return false;
+			}
+			VkPhysicalDeviceVulkan12Features vulkan12_features = {};
+			vulkan12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+			VkPhysicalDeviceFeatures2 features = {};
+			features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			features.pNext = &vulkan12_features;
+			vkGetPhysicalDeviceFeatures2(physical_device, &features);
+			return vulkan12_features.timelineSemaphore == VK_TRUE;
+		}
+
 	}
 	
 
@@ -4,6 +4,7 @@
 #include <vector>
 #include <set>
 #include <string>
+#include <functional>
 #include "VulkanQueue.h"
 
 namespace vk {
@@ -14,8 +15,10 @@ namespace vk {
 		std::vector<float> priorities; // size of vector must match num_queue
 	};
 
+	// is_device_suitable, if set, lets the caller reject devices missing the features it will request
 	VkPhysicalDevice PickPhysicalDevice(VkInstance vk_instance, VkSurfaceKHR surface, 
-		std::vector<QueueCreationRequirement>& queue_family_requirements, std::vector<const char*> & device_extensions, std::vector<uint32_t>& queue_family_indices);
+		std::vector<QueueCreationRequirement>& queue_family_requirements, std::vector<const char*> & device_extensions, std::vector<uint32_t>& queue_family_indices,
+		const std::function<bool(VkPhysicalDevice)>& is_device_suitable = nullptr);
 
 	bool FindQueueFamilies(VkPhysicalDevice physical_device, VkSurfaceKHR surface, 
 		std::vector<QueueCreationRequirement> & queue_family_requirements, std::vector<uint32_t> & queue_family_indices);
@@ -24,7 +27,13 @@ namespace vk {
 
 	uint32_t FindMemoryType(VkPhysicalDevice physical_device, uint32_t type_filter, VkMemoryPropertyFlags properties);
 
+	// whether any memory type has all the properties, i.e. lazily allocated memory only exists on tile based gpus
+	bool IsMemoryTypeAvailable(VkPhysicalDevice physical_device, VkMemoryPropertyFlags properties);
+
 	uint32_t GetMinUniformBufferAlignment(VkPhysicalDevice physical_device);
+
+	// every device supports at least 128 bytes
+	uint32_t GetMaxPushConstantsSize(VkPhysicalDevice physical_device);
 	
 	namespace {
 
@@ -36,6 +45,9 @@ namespace vk {
 		// check if the physical device can make a swapchain supporting this surface
 		bool IsSwapchainAdequate(VkPhysicalDevice physical_device, VkSurfaceKHR surface);
 
+		// frames are synchronized with timeline semaphores, core in Vulkan 1.2
+		bool IsTimelineSemaphoreSupported(VkPhysicalDevice physical_device);
+
 	}
 
 };
\ No newline at end of file
@@ -0,0 +1,180 @@
+#include "VulkanPipelinePermutations.h"
+#include <stdexcept>
+#include <fstream>
+#include <algorithm>
+#include <iostream>
+#include "VulkanCpuProfiler.h"
+
+namespace vk {
+
+	namespace {
+		uint32_t BitsFor(size_t value_count) {
+			uint32_t bits = 0;
+			while ((size_t(1) << bits) < value_count) {
+				bits++;
+			}
+			return bits;
+		}
+	}
+
+	void PipelineUsageLog::Load(const char* filename) {
+		std::ifstream file(filename);
+		std::string set_name;
+		uint64_t key, count;
+		while (file >> set_name >> key >> count) {
+			this->previous_counts[set_name][key] += count;
+		}
+	}
+
+	void PipelineUsageLog::Save(const char* filename) {
+		std::ofstream file(filename, std::ios::trunc);
+		if (!file.is_open()) {
+			std::cerr << "pipeline usage log: fail to open " << filename << ", the uses of this run are not saved\n";
+			return;
+		}
+		for (auto& set : this->counts) {
+			for (auto& permutation : set.second) {
+				file << set.first << " " << permutation.first << " " << permutation.second << "\n";
+			}
+		}
+	}
+
+	void PipelineUsageLog::Record(const std::string& set_name, uint64_t key) {
+		this->counts[set_name][key]++;
+	}
+
+	std::vector<uint64_t> PipelineUsageLog::GetMostUsed(const std::string& set_name, uint32_t max_count) {
+		auto set = this->previous_counts.find(set_name);
+		if (set == this->previous_counts.end()) {
+			return {};
+		}
+		std::vector<std::pair<uint64_t, uint64_t>> used(set->second.begin(), set->second.end());
+		std::sort(used.begin(), used.end(), [](const std::pair<uint64_t, uint64_t>& a, const std::pair<uint64_t, uint64_t>& b) {
+			return a.second != b.second ? a.second > b.second : a.first < b.first;
+		});
+		std::vector<uint64_t> keys;
+		for (size_t i = 0; i < used.size() && i < max_count; i++) {
+			keys.push_back(used[i].first);
+		}
+		return keys;
+	}
+
+	void PipelinePermutations::Create(PipelineRegistry* registry, PipelineUsageLog* usage_log, const std::string& name,
+		const GraphicsPipelineBuilder& builder, const std::vector<SpecializationAxis>& axes) {
+		if (this->registry != nullptr) {
+			throw std::runtime_error("pipeline permutations are already created");
+		}
+		if (name.find_first_of(" \t\n") != std::string::npos) {
+			throw std::runtime_error("pipeline permutation set name can't have spaces, it is written to the usage log");
+		}
+		uint32_t total_bits = 0;
+		this->axis_bits.clear();
+		for (const SpecializationAxis& axis : axes) {
+			if (axis.values.empty()) {
+				throw std::runtime_error("specialization axis has no value");
+			}
+			this->axis_bits.push_back(BitsFor(axis.values.size()));
+			total_bits += this->axis_bits.back();
+		}
+		if (total_bits > 64) {
+			throw std::runtime_error("specialization axes need more than 64 bits of permutation key");
+		}
+		this->registry = registry;
+		this->usage_log = usage_log;
+		this->name = name;
+		this->builder = builder;
+		this->axes = axes;
+		this->warmed_count = 0;
+		if (usage_log == nullptr) {
+			return;
+		}
+		CPU_PROFILE_ZONE("WarmPipelinePermutations");
+		for (uint64_t key : usage_log->GetMostUsed(name, MAX_WARMED_PERMUTATIONS)) {
+			try {
+				CreatePipeline(key);
+				this->warmed_count++;
+			}
+			catch (const std::out_of_range&) {
+				// the axes changed since the log was written, the key means nothing now
+			}
+		}
+	}
+
+	void PipelinePermutations::Destroy() {
+		if (this->registry == nullptr) {
+			return;
+		}
+		for (auto& entry : this->pipelines) {
+			this->registry->Release(entry.second);
+		}
+		this->pipelines.clear();
+		this->registry = nullptr;
+	}
+
+	VkPipeline PipelinePermutations::Get(const std::vector<uint32_t>& values) {
+		return GetByKey(GetKey(values));
+	}
+
+	VkPipeline PipelinePermutations::GetByKey(uint64_t key) {
+		if (this->usage_log != nullptr) {
+			this->usage_log->Record(this->name, key);
+		}
+		auto created = this->pipelines.find(key);
+		if (created != this->pipelines.end()) {
+			return created->second;
+		}
+		return CreatePipeline(key);
+	}
+
+	uint64_t PipelinePermutations::GetKey(const std::vector<uint32_t>& values) {
+		if (values.size() != this->axes.size()) {
+			throw std::runtime_error("permutation needs one value per specialization axis");
+		}
+		uint64_t key = 0;
+		uint32_t shift = 0;
+		for (size_t i = 0; i < this->axes.size(); i++) {
+			const std::vector<uint32_t>& axis_values = this->axes[i].values;
+			auto value = std::find(axis_values.begin(), axis_values.end(), values[i]);
+			if (value == axis_values.end()) {
+				throw std::runtime_error("value is not one of its specialization axis");
+			}
+			key |= static_cast<uint64_t>(value - axis_values.begin()) << shift;
+			shift += this->axis_bits[i];
+		}
+		return key;
+	}
+
+	uint32_t PipelinePermutations::GetPipelineCount() {
+		return static_cast<uint32_t>(this->pipelines.size());
+	}
+
+	uint32_t PipelinePermutations::GetWarmedCount() {
+		return this->warmed_count;
+	}
+
+	// throws std::out_of_range for a key with a value index past its axis
+	VkPipeline PipelinePermutations::CreatePipeline(uint64_t key) {
+		GraphicsPipelineBuilder permutation = this->builder;
+		std::unordered_map<uint32_t, std::vector<VkSpecializationMapEntry>> stage_entries;
+		std::unordered_map<uint32_t, std::vector<uint32_t>> stage_data;
+		uint32_t shift = 0;
+		for (size_t i = 0; i < this->axes.size(); i++) {
+			const SpecializationAxis& axis = this->axes[i];
+			uint64_t value_index = (key >> shift) & ((uint64_t(1) << this->axis_bits[i]) - 1);
+			shift += this->axis_bits[i];
+			std::vector<uint32_t>& data = stage_data[axis.stage];
+			stage_entries[axis.stage].push_back({ axis.constant_id, static_cast<uint32_t>(data.size() * sizeof(uint32_t)), sizeof(uint32_t) });
+			data.push_back(axis.values.at(value_index));
+		}
+		if (shift < 64 && (key >> shift) != 0) {
+			throw std::out_of_range("permutation key has bits past its axes");
+		}
+		for (auto& entries : stage_entries) {
+			std::vector<uint32_t>& data = stage_data[entries.first];
+			permutation.SetSpecialization(static_cast<VkShaderStageFlagBits>(entries.first), entries.second, data.data(), data.size() * sizeof(uint32_t));
+		}
+		VkPipeline pipeline = this->registry->Get(permutation);
+		this->pipelines.emplace(key, pipeline);
+		return pipeline;
+	}
+}
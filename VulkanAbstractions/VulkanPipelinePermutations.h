@@ -0,0 +1,63 @@
+#pragma once
+#include "vulkan/vulkan.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "VulkanGraphicsPipelineBuilder.h"
+#include "VulkanPipelineRegistry.h"
+
+namespace vk {
+
+	// one specialization constant of a shader and the values pipelines are created with. Values are the 32 bit words of the constant:
+	// uint, int, VkBool32, or the bits of a float
+	struct SpecializationAxis {
+		std::string name;
+		VkShaderStageFlagBits stage;
+		uint32_t constant_id;
+		std::vector<uint32_t> values;
+	};
+
+	// how many times each permutation was used, by permutation set name and key. Loaded from the file of the previous run and saved
+	// with the uses of this one, a line per permutation: <set name> <key> <count>
+	class PipelineUsageLog {
+	public:
+		void Load(const char* filename); // a missing file is an empty log
+		void Save(const char* filename); // saved during teardown, so a file that can't be written is only reported
+		void Record(const std::string& set_name, uint64_t key);
+		// keys of the set used in the previous run, most used first
+		std::vector<uint64_t> GetMostUsed(const std::string& set_name, uint32_t max_count);
+	private:
+		std::unordered_map<std::string, std::unordered_map<uint64_t, uint64_t>> previous_counts;
+		std::unordered_map<std::string, std::unordered_map<uint64_t, uint64_t>> counts;
+	};
+
+	// the pipelines of a builder for every combination of values of its specialization axes. A permutation key packs the index of the
+	// value of each axis, the first axis in the lowest bits. The pipeline of a permutation is created through the registry the first time
+	// it is asked for, and the permutations most used in the previous run are created by Create, so frames don't stall on them
+	class PipelinePermutations {
+	public:
+		// throws if an axis has no value, or the keys would need more than 64 bits
+		void Create(PipelineRegistry* registry, PipelineUsageLog* usage_log, const std::string& name, const GraphicsPipelineBuilder& builder,
+			const std::vector<SpecializationAxis>& axes);
+		void Destroy(); // releases the pipelines created
+		// values of the axes in their order, each one of the values its axis declares
+		VkPipeline Get(const std::vector<uint32_t>& values);
+		VkPipeline GetByKey(uint64_t key);
+		uint64_t GetKey(const std::vector<uint32_t>& values);
+		uint32_t GetPipelineCount();
+		uint32_t GetWarmedCount(); // created by Create from the usage log
+	public:
+		const static uint32_t MAX_WARMED_PERMUTATIONS = 16;
+	private:
+		VkPipeline CreatePipeline(uint64_t key);
+	private:
+		PipelineRegistry* registry = nullptr;
+		PipelineUsageLog* usage_log = nullptr;
+		std::string name;
+		GraphicsPipelineBuilder builder;
+		std::vector<SpecializationAxis> axes;
+		std::vector<uint32_t> axis_bits;
+		std::unordered_map<uint64_t, VkPipeline> pipelines; // by key
+		uint32_t warmed_count = 0;
+	};
+}
@@ -0,0 +1,101 @@
+#include "VulkanPipelineRegistry.h"
+#include <stdexcept>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+
+namespace vk {
+
+	void PipelineRegistry::Create(VkDevice logical_device, const char* cache_filename) {
+		if (this->logical_device != VK_NULL_HANDLE) {
+			throw std::runtime_error("pipeline registry is already created");
+		}
+		// the driver checks the header of the data and ignores data from another device or driver version
+		std::vector<char> initial_data;
+		this->cache_filename = cache_filename != nullptr ? cache_filename : "";
+		if (cache_filename != nullptr) {
+			std::ifstream file(cache_filename, std::ios::binary);
+			initial_data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		}
+		VkPipelineCacheCreateInfo create_info = {};
+		create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		create_info.initialDataSize = initial_data.size();
+		create_info.pInitialData = initial_data.empty() ? nullptr : initial_data.data();
+		if (vkCreatePipelineCache(logical_device, &create_info, nullptr, &this->pipeline_cache) != VK_SUCCESS) {
+			throw std::runtime_error("fail to create pipeline cache");
+		}
+		this->logical_device = logical_device;
+		this->hit_count = 0;
+	}
+
+	void PipelineRegistry::Destroy() {
+		if (this->logical_device == VK_NULL_HANDLE) {
+			return;
+		}
+		for (auto& entry : this->pipelines) {
+			vkDestroyPipeline(this->logical_device, entry.second, nullptr);
+		}
+		this->pipelines.clear();
+		this->references.clear();
+		if (!this->cache_filename.empty()) {
+			SaveCache();
+		}
+		vkDestroyPipelineCache(this->logical_device, this->pipeline_cache, nullptr);
+		this->pipeline_cache = VK_NULL_HANDLE;
+		this->logical_device = VK_NULL_HANDLE;
+	}
+
+	VkPipeline PipelineRegistry::Get(const GraphicsPipelineBuilder& builder) {
+		detail::PipelineKey key = builder.GetKey();
+		auto cached = this->pipelines.find(key);
+		if (cached != this->pipelines.end()) {
+			this->hit_count++;
+			this->references.at(cached->second).count++;
+			return cached->second;
+		}
+		VkPipeline pipeline = builder.Build(this->logical_device, this->pipeline_cache);
+		this->references.emplace(pipeline, PipelineReferences{ key, 1 });
+		this->pipelines.emplace(std::move(key), pipeline);
+		return pipeline;
+	}
+
+	void PipelineRegistry::Release(VkPipeline pipeline) {
+		if (pipeline == VK_NULL_HANDLE) {
+			return;
+		}
+		auto referenced = this->references.find(pipeline);
+		if (referenced == this->references.end()) {
+			throw std::runtime_error("pipeline is not from the registry");
+		}
+		if (--referenced->second.count > 0) {
+			return;
+		}
+		this->pipelines.erase(referenced->second.key);
+		this->references.erase(referenced);
+		vkDestroyPipeline(this->logical_device, pipeline, nullptr);
+	}
+
+	void PipelineRegistry::SaveCache() {
+		size_t data_size = 0;
+		std::vector<char> data;
+		if (vkGetPipelineCacheData(this->logical_device, this->pipeline_cache, &data_size, nullptr) == VK_SUCCESS) {
+			data.resize(data_size);
+		}
+		if (data.empty() || vkGetPipelineCacheData(this->logical_device, this->pipeline_cache, &data_size, data.data()) != VK_SUCCESS) {
+			std::cerr << "pipeline registry: fail to get pipeline cache data, the cache is not saved\n";
+			return;
+		}
+		std::ofstream file(this->cache_filename, std::ios::binary | std::ios::trunc);
+		if (!file.is_open() || !file.write(data.data(), data_size)) {
+			std::cerr << "pipeline registry: fail to save the pipeline cache to " << this->cache_filename << "\n";
+		}
+	}
+
+	uint32_t PipelineRegistry::GetPipelineCount() {
+		return static_cast<uint32_t>(this->pipelines.size());
+	}
+
+	uint64_t PipelineRegistry::GetHitCount() {
+		return this->hit_count;
+	}
+}
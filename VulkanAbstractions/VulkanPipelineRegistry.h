@@ -0,0 +1,38 @@
+#pragma once
+#include "vulkan/vulkan.h"
+#include <unordered_map>
+#include <string>
+#include "VulkanGraphicsPipelineBuilder.h"
+
+namespace vk {
+
+	// compiles each distinct graphics pipeline description once, through a VkPipelineCache shared by all of them. Get returns the same
+	// VkPipeline for identical descriptions and counts the references, Release destroys the pipeline with its last reference.
+	// Descriptions are keyed by the handles of their modules, layout and render pass, so pipelines must be released before those are
+	// destroyed: a new object may get the same handle. With a cache file, the VkPipelineCache starts from the data saved by the previous
+	// run and is saved back by Destroy, so the driver skips compiling pipelines it already compiled
+	class PipelineRegistry {
+	public:
+		void Create(VkDevice logical_device, const char* cache_filename = nullptr);
+		void Destroy(); // also destroys the pipelines still referenced
+		VkPipeline Get(const GraphicsPipelineBuilder& builder);
+		// VK_NULL_HANDLE is ignored, throws for a pipeline the registry didn't create
+		void Release(VkPipeline pipeline);
+		uint32_t GetPipelineCount();
+		uint64_t GetHitCount(); // Get calls that returned an existing pipeline
+	private:
+		void SaveCache(); // called from Destroy, so a failure is only reported and the registry is still torn down
+	private:
+		struct PipelineReferences {
+			detail::PipelineKey key;
+			uint32_t count;
+		};
+	private:
+		VkDevice logical_device = VK_NULL_HANDLE;
+		VkPipelineCache pipeline_cache = VK_NULL_HANDLE;
+		std::string cache_filename;
+		std::unordered_map<detail::PipelineKey, VkPipeline, detail::PipelineKeyHash> pipelines;
+		std::unordered_map<VkPipeline, PipelineReferences> references;
+		uint64_t hit_count = 0;
+	};
+}
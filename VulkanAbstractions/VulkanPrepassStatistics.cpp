@@ -0,0 +1,118 @@
+#include "VulkanPrepassStatistics.h"
+#include <stdexcept>
+#include <iostream>
+
+namespace vk {
+
+	namespace {
+		uint32_t Query(uint32_t frame, bool use_depth_prepass) {
+			return 2 * frame + (use_depth_prepass ? 1 : 0);
+		}
+	}
+
+	bool VulkanPrepassStatistics::IsSupported(VkPhysicalDevice physical_device) {
+		VkPhysicalDeviceFeatures supported_features;
+		vkGetPhysicalDeviceFeatures(physical_device, &supported_features);
+		return supported_features.pipelineStatisticsQuery == VK_TRUE;
+	}
+
+	void VulkanPrepassStatistics::EnableRequiredFeatures(VkPhysicalDevice physical_device, VkPhysicalDeviceFeatures& features) {
+		if (IsSupported(physical_device)) {
+			features.pipelineStatisticsQuery = VK_TRUE;
+		}
+	}
+
+	void VulkanPrepassStatistics::Create(VkPhysicalDevice physical_device, VkDevice logical_device, uint32_t frame_count, const char* name,
+		uint32_t report_interval, uint32_t sample_interval) {
+		if (this->query_pool != VK_NULL_HANDLE) {
+			throw std::runtime_error("pre-pass statistics are already created");
+		}
+		if (!IsSupported(physical_device)) {
+			return;
+		}
+		this->logical_device = logical_device;
+		this->name = name;
+		this->report_interval = report_interval;
+		this->sample_interval = sample_interval;
+		VkQueryPoolCreateInfo create_info = {};
+		create_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		create_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+		create_info.queryCount = 2 * frame_count; // without and with pre-pass per slot
+		create_info.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+		if (vkCreateQueryPool(logical_device, &create_info, nullptr, &this->query_pool) != VK_SUCCESS) {
+			throw std::runtime_error("fail to create pipeline statistics query pool");
+		}
+		this->submitted_variants.assign(frame_count, -1);
+	}
+
+	// the averages collected so far are kept, the pool is recreated with the swapchain
+	void VulkanPrepassStatistics::Destroy() {
+		if (this->query_pool == VK_NULL_HANDLE) {
+			return;
+		}
+		vkDestroyQueryPool(this->logical_device, this->query_pool, nullptr);
+		this->query_pool = VK_NULL_HANDLE;
+		this->submitted_variants.clear();
+	}
+
+	bool VulkanPrepassStatistics::IsEnabled() {
+		return this->query_pool != VK_NULL_HANDLE;
+	}
+
+	bool VulkanPrepassStatistics::IsReferenceFrame(uint32_t frame_number) {
+		return IsEnabled() && this->sample_interval != 0 && frame_number % this->sample_interval == 0;
+	}
+
+	void VulkanPrepassStatistics::CmdBegin(VkCommandBuffer cmd_buffer, uint32_t frame, bool use_depth_prepass) {
+		if (!IsEnabled()) {
+			return;
+		}
+		vkCmdResetQueryPool(cmd_buffer, this->query_pool, Query(frame, use_depth_prepass), 1);
+		vkCmdBeginQuery(cmd_buffer, this->query_pool, Query(frame, use_depth_prepass), 0);
+	}
+
+	void VulkanPrepassStatistics::CmdEnd(VkCommandBuffer cmd_buffer, uint32_t frame, bool use_depth_prepass) {
+		if (!IsEnabled()) {
+			return;
+		}
+		vkCmdEndQuery(cmd_buffer, this->query_pool, Query(frame, use_depth_prepass));
+	}
+
+	void VulkanPrepassStatistics::SetSubmitted(uint32_t frame, bool use_depth_prepass) {
+		if (!IsEnabled()) {
+			return;
+		}
+		this->submitted_variants[frame] = use_depth_prepass ? 1 : 0;
+	}
+
+	bool VulkanPrepassStatistics::WasSubmitted(uint32_t frame, bool use_depth_prepass) {
+		return IsEnabled() && this->submitted_variants[frame] == (use_depth_prepass ? 1 : 0);
+	}
+
+	void VulkanPrepassStatistics::ReadResults(uint32_t frame) {
+		if (!IsEnabled() || this->submitted_variants[frame] < 0) {
+			return;
+		}
+		uint32_t variant = static_cast<uint32_t>(this->submitted_variants[frame]);
+		uint64_t invocations;
+		if (vkGetQueryPoolResults(this->logical_device, this->query_pool, Query(frame, variant == 1), 1, sizeof(invocations), &invocations,
+			sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+			return;
+		}
+		this->fragment_invocations[variant] += invocations;
+		this->statistics_frames[variant]++;
+		if (this->statistics_frames[0] + this->statistics_frames[1] < this->report_interval || this->statistics_frames[0] == 0 || this->statistics_frames[1] == 0) {
+			return;
+		}
+		double without_prepass = static_cast<double>(this->fragment_invocations[0]) / this->statistics_frames[0];
+		double with_prepass = static_cast<double>(this->fragment_invocations[1]) / this->statistics_frames[1];
+		std::cout << this->name << " fragment shader invocations per frame: " << without_prepass << " without depth pre-pass, " << with_prepass
+			<< " with depth pre-pass";
+		if (without_prepass > 0.0) {
+			std::cout << " (" << 100.0 * (1.0 - with_prepass / without_prepass) << "% saved)";
+		}
+		std::cout << std::endl;
+		this->fragment_invocations[0] = this->fragment_invocations[1] = 0;
+		this->statistics_frames[0] = this->statistics_frames[1] = 0;
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "vulkan/vulkan.h"
+#include <vector>
+#include <string>
+
+namespace vk {
+
+	// fragment shader invocations of a pass recorded in two variants, without (variant 0) and with (variant 1) a depth pre-pass.
+	// The enabled variant is submitted every frame, except once every sample_interval frames where the other one is, so that both are measured.
+	// Every frame slot (a swapchain image) owns a query per variant, ReadResults never waits: call it once the slot's previous submission
+	// is known to be complete. The per frame averages of both variants are printed every report_interval frames read
+	class VulkanPrepassStatistics {
+	public:
+		static bool IsSupported(VkPhysicalDevice physical_device);
+		// sets pipelineStatisticsQuery when it is supported, the statistics are only used for reporting
+		static void EnableRequiredFeatures(VkPhysicalDevice physical_device, VkPhysicalDeviceFeatures& features);
+		// does nothing when the feature is not supported, every command is then a no-op. name prefixes the printed report
+		void Create(VkPhysicalDevice physical_device, VkDevice logical_device, uint32_t frame_count, const char* name, uint32_t report_interval,
+			uint32_t sample_interval);
+		void Destroy();
+		bool IsEnabled();
+		// true when the frame should submit the variant that isn't enabled
+		bool IsReferenceFrame(uint32_t frame_number);
+		void CmdBegin(VkCommandBuffer cmd_buffer, uint32_t frame, bool use_depth_prepass);
+		void CmdEnd(VkCommandBuffer cmd_buffer, uint32_t frame, bool use_depth_prepass);
+		// notes the variant submitted in the slot, for ReadResults to read its query
+		void SetSubmitted(uint32_t frame, bool use_depth_prepass);
+		bool WasSubmitted(uint32_t frame, bool use_depth_prepass);
+		void ReadResults(uint32_t frame);
+	private:
+		VkDevice logical_device = VK_NULL_HANDLE;
+		VkQueryPool query_pool = VK_NULL_HANDLE;
+		std::string name;
+		uint32_t report_interval = 0;
+		uint32_t sample_interval = 0;
+		std::vector<int32_t> submitted_variants; // per slot: 1 with pre-pass, 0 without, -1 nothing submitted yet
+		uint64_t fragment_invocations[2] = {}; // indexed by variant
+		uint32_t statistics_frames[2] = {};
+	};
+}
@@ -1,6 +1,7 @@
 #include "VulkanQueue.h"
 #include <stdexcept>
 #include "VulkanHelper.h"
+#include "VulkanCpuProfiler.h"
 
 namespace vk {
 
@@ -19,6 +20,7 @@ namespace vk {
 
 	void VulkanQueue::SubmitSingleCmdBuffer(std::vector<VkSemaphore>& wait_semaphores, std::vector<VkPipelineStageFlags>& waitstage_flags,
 		VkCommandBuffer command_buffer, std::vector<VkSemaphore>& signal_semaphores, VkFence fence) {
+		CPU_PROFILE_FUNCTION();
 		std::vector<VkCommandBuffer> command_buffers = { command_buffer };
 		VkSubmitInfo submit_info = vk::init::CreateSubmitInfo(wait_semaphores, waitstage_flags, command_buffers, signal_semaphores);
 		if (vkQueueSubmit(queue, 1, &submit_info, fence) != VK_SUCCESS) {
@@ -28,6 +30,7 @@ namespace vk {
 
 	void VulkanQueue::SubmitMultipleCmdBuffers(std::vector<VkSemaphore>& wait_semaphores, std::vector<VkPipelineStageFlags>& waitstage_flags,
 		std::vector<VkCommandBuffer>& command_buffers, std::vector<VkSemaphore>& signal_semaphores, VkFence fence) {
+		CPU_PROFILE_FUNCTION();
 		VkSubmitInfo submit_info = vk::init::CreateSubmitInfo(wait_semaphores, waitstage_flags, command_buffers, signal_semaphores);
 		if (vkQueueSubmit(queue, 1, &submit_info, fence) != VK_SUCCESS) {
 			throw std::runtime_error("fail to submit multiple command buffers!");
@@ -35,12 +38,44 @@ namespace vk {
 	}
 
 	void VulkanQueue::SubmitMultipleVkSubmitInfos(std::vector<VkSubmitInfo>& submit_infos, VkFence fence) {
+		CPU_PROFILE_FUNCTION();
 		if (vkQueueSubmit(queue, static_cast<uint32_t>(submit_infos.size()), submit_infos.data(), fence) != VK_SUCCESS) {
 			throw std::runtime_error("fail to submit multiple VkSubmitInfo!");
 		}
 	}
 
+	uint64_t VulkanQueue::Submit(std::vector<SemaphoreWait>& waits, std::vector<VkCommandBuffer>& command_buffers, std::vector<VkSemaphore>& signal_semaphores) {
+		CPU_PROFILE_FUNCTION();
+		std::vector<VkSemaphore> wait_semaphores;
+		std::vector<uint64_t> wait_values;
+		std::vector<VkPipelineStageFlags> wait_stages;
+		for (SemaphoreWait& wait : waits) {
+			wait_semaphores.push_back(wait.semaphore);
+			wait_values.push_back(wait.value);
+			wait_stages.push_back(wait.stage);
+		}
+		uint64_t value = timeline.Reserve();
+		std::vector<VkSemaphore> semaphores = signal_semaphores;
+		semaphores.push_back(timeline.semaphore);
+		std::vector<uint64_t> signal_values(signal_semaphores.size(), 0); // ignored for binary semaphores
+		signal_values.push_back(value);
+
+		VkTimelineSemaphoreSubmitInfo timeline_info = {};
+		timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timeline_info.waitSemaphoreValueCount = static_cast<uint32_t>(wait_values.size());
+		timeline_info.pWaitSemaphoreValues = wait_values.data();
+		timeline_info.signalSemaphoreValueCount = static_cast<uint32_t>(signal_values.size());
+		timeline_info.pSignalSemaphoreValues = signal_values.data();
+		VkSubmitInfo submit_info = vk::init::CreateSubmitInfo(wait_semaphores, wait_stages, command_buffers, semaphores);
+		submit_info.pNext = &timeline_info;
+		if (vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+			throw std::runtime_error("fail to submit command buffers!");
+		}
+		return value;
+	}
+
 	VkResult VulkanQueue::PresentImage(std::vector<VkSemaphore>& wait_semaphores, VkSwapchainKHR swapchain, uint32_t image_index) {
+		CPU_PROFILE_FUNCTION();
 		if (!characteristic.is_present) {
 			throw std::runtime_error("cannot present because this is not a present queue");
 		}
@@ -57,6 +92,7 @@ namespace vk {
 	}
 
 	void VulkanQueue::WaitIdle() {
+		CPU_PROFILE_FUNCTION();
 		vkQueueWaitIdle(queue);
 	}
 
@@ -1,6 +1,7 @@
 #pragma once
 #include "vulkan/vulkan.h"
 #include <vector>
+#include "VulkanTimelineSemaphore.h"
 namespace vk {
 
 	struct VulkanQueueCharacteristic {
@@ -24,6 +25,9 @@ namespace vk {
 
 		void SubmitMultipleVkSubmitInfos(std::vector<VkSubmitInfo> & submit_infos, VkFence fence);
 
+		// waits can mix binary and timeline semaphores. Signals signal_semaphores (binary) and the queue's timeline, returns the timeline value
+		uint64_t Submit(std::vector<SemaphoreWait>& waits, std::vector<VkCommandBuffer>& command_buffers, std::vector<VkSemaphore>& signal_semaphores);
+
 		VkResult PresentImage(std::vector<VkSemaphore> & wait_semaphores, VkSwapchainKHR swapchain, uint32_t image_index);
 
 		void WaitIdle();
@@ -34,6 +38,7 @@ namespace vk {
 		VkQueue queue;
 		VulkanQueueCharacteristic characteristic;
 		uint32_t index; // the index of the queue, shouldnt be confused with family index
+		VulkanTimelineSemaphore timeline; // signaled by every Submit, created and destroyed with the logical device
 	
 	};
 }
\ No newline at end of file
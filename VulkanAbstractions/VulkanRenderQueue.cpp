@@ -0,0 +1,206 @@
+#include "VulkanRenderQueue.h"
+#include <stdexcept>
+#include <cstring>
+#include "VulkanCpuProfiler.h"
+
+namespace vk {
+
+	namespace {
+		const uint32_t DEPTH_SHIFT = 0;
+		const uint32_t MESH_SHIFT = RenderQueue::DEPTH_BITS;
+		const uint32_t DESCRIPTOR_SET_SHIFT = MESH_SHIFT + RenderQueue::MESH_BITS;
+		const uint32_t PIPELINE_SHIFT = DESCRIPTOR_SET_SHIFT + RenderQueue::DESCRIPTOR_SET_BITS;
+		static_assert(PIPELINE_SHIFT + RenderQueue::PIPELINE_BITS == 64, "render queue key fields must fill 64 bits");
+
+		const uint32_t RADIX_BITS = 8;
+		const uint32_t RADIX_PASSES = 64 / RADIX_BITS;
+		const uint32_t RADIX_BUCKETS = 1 << RADIX_BITS;
+
+		uint32_t Field(uint64_t key, uint32_t shift, uint32_t bits) {
+			return static_cast<uint32_t>((key >> shift) & ((uint64_t(1) << bits) - 1));
+		}
+
+		// same order as the floats: positive floats get the sign bit set, negative floats get every bit flipped
+		uint32_t FloatSortKey(float value) {
+			uint32_t bits;
+			std::memcpy(&bits, &value, sizeof(float));
+			return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+		}
+	}
+
+	uint32_t RenderQueue::AddPipeline(VkPipeline pipeline, VkPipelineLayout pipeline_layout) {
+		if (this->pipelines.size() >= (size_t(1) << PIPELINE_BITS)) {
+			throw std::runtime_error("too many pipelines in render queue");
+		}
+		this->pipelines.push_back({ pipeline, pipeline_layout });
+		return static_cast<uint32_t>(this->pipelines.size() - 1);
+	}
+
+	uint32_t RenderQueue::AddDescriptorSet(VkDescriptorSet descriptor_set) {
+		if (this->descriptor_sets.size() >= (size_t(1) << DESCRIPTOR_SET_BITS)) {
+			throw std::runtime_error("too many descriptor sets in render queue");
+		}
+		this->descriptor_sets.push_back(descriptor_set);
+		return static_cast<uint32_t>(this->descriptor_sets.size() - 1);
+	}
+
+	uint32_t RenderQueue::AddMesh(const RenderMesh& mesh) {
+		if (this->meshes.size() >= (size_t(1) << MESH_BITS)) {
+			throw std::runtime_error("too many meshes in render queue");
+		}
+		this->meshes.push_back(mesh);
+		return static_cast<uint32_t>(this->meshes.size() - 1);
+	}
+
+	void RenderQueue::Reset() {
+		this->pipelines.clear();
+		this->descriptor_sets.clear();
+		this->meshes.clear();
+		Clear();
+	}
+
+	void RenderQueue::Clear() {
+		this->draws.clear();
+	}
+
+	void RenderQueue::Push(uint32_t pipeline, uint32_t descriptor_set, uint32_t mesh, float depth, uint32_t draw_data) {
+		if (pipeline >= this->pipelines.size() || descriptor_set >= this->descriptor_sets.size() || mesh >= this->meshes.size()) {
+			throw std::runtime_error("render queue draw refers to a pipeline, descriptor set or mesh that was not added");
+		}
+		this->draws.push_back({ MakeKey(pipeline, descriptor_set, mesh, depth), draw_data });
+	}
+
+	// least significant byte first, each pass is stable so the order of the previous ones is kept within equal bytes. Passes where every
+	// key has the same byte, typically the high bytes of a frame with few pipelines and sets, would not move anything and are skipped
+	void RenderQueue::Sort() {
+		CPU_PROFILE_FUNCTION();
+		size_t count = this->draws.size();
+		if (count < 2) {
+			return;
+		}
+		std::vector<uint32_t>& histograms = this->sort_histograms;
+		histograms.assign(RADIX_PASSES * RADIX_BUCKETS, 0);
+		for (const DrawItem& draw : this->draws) {
+			for (uint32_t pass = 0; pass < RADIX_PASSES; pass++) {
+				histograms[pass * RADIX_BUCKETS + Field(draw.key, pass * RADIX_BITS, RADIX_BITS)]++;
+			}
+		}
+		this->sort_scratch.resize(count);
+		for (uint32_t pass = 0; pass < RADIX_PASSES; pass++) {
+			uint32_t shift = pass * RADIX_BITS;
+			uint32_t* histogram = &histograms[pass * RADIX_BUCKETS];
+			if (histogram[Field(this->draws[0].key, shift, RADIX_BITS)] == count) {
+				continue;
+			}
+			uint32_t offset = 0;
+			for (uint32_t bucket = 0; bucket < RADIX_BUCKETS; bucket++) {
+				uint32_t bucket_count = histogram[bucket];
+				histogram[bucket] = offset;
+				offset += bucket_count;
+			}
+			for (const DrawItem& draw : this->draws) {
+				this->sort_scratch[histogram[Field(draw.key, shift, RADIX_BITS)]++] = draw;
+			}
+			this->draws.swap(this->sort_scratch);
+		}
+	}
+
+	void RenderQueue::Record(VkCommandBuffer cmd_buffer, const std::function<void(VkCommandBuffer, VkPipelineLayout, uint32_t)>& record_draw_data) {
+		CPU_PROFILE_FUNCTION();
+		this->statistics = {};
+		RecordRange(cmd_buffer, 0, static_cast<uint32_t>(this->draws.size()), record_draw_data, &this->statistics);
+	}
+
+	// only reads the queue, so threads recording their own ranges don't share anything
+	void RenderQueue::RecordRange(VkCommandBuffer cmd_buffer, uint32_t first_draw, uint32_t draw_count,
+		const std::function<void(VkCommandBuffer, VkPipelineLayout, uint32_t)>& record_draw_data, RenderQueueStatistics* statistics) {
+		if (static_cast<size_t>(first_draw) + draw_count > this->draws.size()) {
+			throw std::runtime_error("render queue range is past its draws");
+		}
+		RenderQueueStatistics range_statistics = {};
+		range_statistics.draw_count = draw_count;
+		uint32_t bound_pipeline = UINT32_MAX;
+		VkPipelineLayout bound_layout = VK_NULL_HANDLE;
+		uint32_t bound_descriptor_set = UINT32_MAX;
+		const RenderMesh* bound_vertex_mesh = nullptr;
+		const RenderMesh* bound_index_mesh = nullptr;
+		for (uint32_t i = first_draw; i < first_draw + draw_count; i++) {
+			const DrawItem& draw = this->draws[i];
+			uint32_t pipeline_id = Field(draw.key, PIPELINE_SHIFT, PIPELINE_BITS);
+			uint32_t descriptor_set_id = Field(draw.key, DESCRIPTOR_SET_SHIFT, DESCRIPTOR_SET_BITS);
+			const RenderMesh& mesh = this->meshes[Field(draw.key, MESH_SHIFT, MESH_BITS)];
+			const PipelineEntry& pipeline = this->pipelines[pipeline_id];
+
+			if (pipeline_id != bound_pipeline) {
+				vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.pipeline);
+				bound_pipeline = pipeline_id;
+				range_statistics.pipeline_binds++;
+			}
+			else {
+				range_statistics.skipped_pipeline_binds++;
+			}
+			// a set stays bound across pipelines with the same layout
+			VkDescriptorSet descriptor_set = this->descriptor_sets[descriptor_set_id];
+			if (descriptor_set_id != bound_descriptor_set || pipeline.pipeline_layout != bound_layout) {
+				if (descriptor_set != VK_NULL_HANDLE) {
+					vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.pipeline_layout, 0, 1, &descriptor_set, 0, nullptr);
+					range_statistics.descriptor_set_binds++;
+				}
+				bound_descriptor_set = descriptor_set_id;
+				bound_layout = pipeline.pipeline_layout;
+			}
+			else {
+				range_statistics.skipped_descriptor_set_binds++;
+			}
+			if (bound_vertex_mesh == nullptr || mesh.vertex_buffer != bound_vertex_mesh->vertex_buffer
+				|| mesh.vertex_buffer_offset != bound_vertex_mesh->vertex_buffer_offset) {
+				vkCmdBindVertexBuffers(cmd_buffer, 0, 1, &mesh.vertex_buffer, &mesh.vertex_buffer_offset);
+				bound_vertex_mesh = &mesh;
+				range_statistics.vertex_buffer_binds++;
+			}
+			else {
+				range_statistics.skipped_vertex_buffer_binds++;
+			}
+			if (bound_index_mesh == nullptr || mesh.index_buffer != bound_index_mesh->index_buffer
+				|| mesh.index_buffer_offset != bound_index_mesh->index_buffer_offset || mesh.index_type != bound_index_mesh->index_type) {
+				vkCmdBindIndexBuffer(cmd_buffer, mesh.index_buffer, mesh.index_buffer_offset, mesh.index_type);
+				bound_index_mesh = &mesh;
+				range_statistics.index_buffer_binds++;
+			}
+			else {
+				range_statistics.skipped_index_buffer_binds++;
+			}
+
+			if (record_draw_data) {
+				record_draw_data(cmd_buffer, pipeline.pipeline_layout, draw.draw_data);
+			}
+			vkCmdDrawIndexed(cmd_buffer, mesh.index_count, 1, mesh.first_index, mesh.vertex_offset, 0);
+		}
+		if (statistics != nullptr) {
+			statistics->draw_count += range_statistics.draw_count;
+			statistics->pipeline_binds += range_statistics.pipeline_binds;
+			statistics->skipped_pipeline_binds += range_statistics.skipped_pipeline_binds;
+			statistics->descriptor_set_binds += range_statistics.descriptor_set_binds;
+			statistics->skipped_descriptor_set_binds += range_statistics.skipped_descriptor_set_binds;
+			statistics->vertex_buffer_binds += range_statistics.vertex_buffer_binds;
+			statistics->skipped_vertex_buffer_binds += range_statistics.skipped_vertex_buffer_binds;
+			statistics->index_buffer_binds += range_statistics.index_buffer_binds;
+			statistics->skipped_index_buffer_binds += range_statistics.skipped_index_buffer_binds;
+		}
+	}
+
+	uint32_t RenderQueue::GetDrawCount() {
+		return static_cast<uint32_t>(this->draws.size());
+	}
+
+	const RenderQueueStatistics& RenderQueue::GetStatistics() {
+		return this->statistics;
+	}
+
+	uint64_t RenderQueue::MakeKey(uint32_t pipeline, uint32_t descriptor_set, uint32_t mesh, float depth) {
+		return (static_cast<uint64_t>(pipeline) << PIPELINE_SHIFT)
+			| (static_cast<uint64_t>(descriptor_set) << DESCRIPTOR_SET_SHIFT)
+			| (static_cast<uint64_t>(mesh) << MESH_SHIFT)
+			| (static_cast<uint64_t>(FloatSortKey(depth) >> (32 - DEPTH_BITS)) << DEPTH_SHIFT);
+	}
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include "vulkan/vulkan.h"
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+namespace vk {
+
+	// index range of a vertex and index buffer pair. Meshes sharing the buffers only change the draw parameters between them
+	struct RenderMesh {
+		VkBuffer vertex_buffer = VK_NULL_HANDLE;
+		VkDeviceSize vertex_buffer_offset = 0;
+		VkBuffer index_buffer = VK_NULL_HANDLE;
+		VkDeviceSize index_buffer_offset = 0;
+		VkIndexType index_type = VK_INDEX_TYPE_UINT16;
+		uint32_t first_index = 0;
+		uint32_t index_count = 0;
+		int32_t vertex_offset = 0;
+	};
+
+	// binds recorded and skipped by the last RenderQueue::Record
+	struct RenderQueueStatistics {
+		uint32_t draw_count = 0;
+		uint32_t pipeline_binds = 0;
+		uint32_t skipped_pipeline_binds = 0;
+		uint32_t descriptor_set_binds = 0;
+		uint32_t skipped_descriptor_set_binds = 0;
+		uint32_t vertex_buffer_binds = 0;
+		uint32_t skipped_vertex_buffer_binds = 0;
+		uint32_t index_buffer_binds = 0;
+		uint32_t skipped_index_buffer_binds = 0;
+	};
+
+	// draws of a frame, sorted by a 64 bit key before they are recorded so that draws sharing state are next to each other, and recorded
+	// without binding what is already bound. From the most significant bits: pipeline id, descriptor set id, mesh id, then depth, nearest
+	// first. Ids are given by the Add methods in the order they are called, so draws are grouped by pipeline in the order the pipelines were
+	// added: add them in the order their passes must run
+	class RenderQueue {
+	public:
+		uint32_t AddPipeline(VkPipeline pipeline, VkPipelineLayout pipeline_layout);
+		uint32_t AddDescriptorSet(VkDescriptorSet descriptor_set); // bound as set 0, VK_NULL_HANDLE binds nothing
+		uint32_t AddMesh(const RenderMesh& mesh);
+		void Reset(); // forgets the pipelines, descriptor sets and meshes along with the draws
+		void Clear(); // forgets the draws, to push the next frame's
+		// draw_data is handed back to Record's callback, i.e. the index of the draw's per object data
+		void Push(uint32_t pipeline, uint32_t descriptor_set, uint32_t mesh, float depth, uint32_t draw_data);
+		// stable radix sort on the keys, draws with the same key stay in the order they were pushed
+		void Sort();
+		// records the draws in their current order. record_draw_data is called before each draw, with the layout of its pipeline
+		void Record(VkCommandBuffer cmd_buffer, const std::function<void(VkCommandBuffer, VkPipelineLayout, uint32_t)>& record_draw_data);
+		// records the draws [first_draw, first_draw + draw_count) as if nothing was bound before, i.e. into a secondary command buffer. Once the
+		// queue is sorted, ranges that don't overlap can be recorded by several threads at once, each adding its binds to its own statistics,
+		// which may be null
+		void RecordRange(VkCommandBuffer cmd_buffer, uint32_t first_draw, uint32_t draw_count,
+			const std::function<void(VkCommandBuffer, VkPipelineLayout, uint32_t)>& record_draw_data, RenderQueueStatistics* statistics);
+		uint32_t GetDrawCount();
+		const RenderQueueStatistics& GetStatistics();
+		static uint64_t MakeKey(uint32_t pipeline, uint32_t descriptor_set, uint32_t mesh, float depth);
+	public:
+		const static uint32_t PIPELINE_BITS = 12;
+		const static uint32_t DESCRIPTOR_SET_BITS = 12;
+		const static uint32_t MESH_BITS = 16;
+		const static uint32_t DEPTH_BITS = 24; // the high bits of the float, enough to order the draws
+	private:
+		struct PipelineEntry {
+			VkPipeline pipeline;
+			VkPipelineLayout pipeline_layout;
+		};
+		struct DrawItem {
+			uint64_t key;
+			uint32_t draw_data;
+		};
+	private:
+		std::vector<PipelineEntry> pipelines;
+		std::vector<VkDescriptorSet> descriptor_sets;
+		std::vector<RenderMesh> meshes;
+		std::vector<DrawItem> draws;
+		std::vector<DrawItem> sort_scratch;
+		std::vector<uint32_t> sort_histograms; // a bucket count per byte of the key
+		RenderQueueStatistics statistics;
+	};
+}
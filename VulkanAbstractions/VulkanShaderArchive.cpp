@@ -0,0 +1,71 @@
+#include "VulkanShaderArchive.h"
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+#include "VulkanHelper.h"
+
+namespace vk {
+
+	void ShaderArchive::Open(const char* filename) {
+		if (this->file.IsOpen()) {
+			throw std::runtime_error("shader archive is already open");
+		}
+		this->file.Open(filename);
+		const unsigned char* bytes = static_cast<const unsigned char*>(this->file.data);
+		this->header = reinterpret_cast<const ShaderArchiveHeader*>(bytes);
+		if (this->file.size < sizeof(ShaderArchiveHeader) || memcmp(this->header->magic, "SPVA", 4) != 0 || this->header->version != VERSION) {
+			Close();
+			throw std::runtime_error("file is not a shader archive of this version");
+		}
+		if (this->file.size < sizeof(ShaderArchiveHeader) + static_cast<size_t>(this->header->entry_count) * sizeof(ShaderArchiveEntry)) {
+			Close();
+			throw std::runtime_error("shader archive is truncated");
+		}
+		this->entries = reinterpret_cast<const ShaderArchiveEntry*>(bytes + sizeof(ShaderArchiveHeader));
+		for (uint32_t i = 0; i < this->header->entry_count; i++) {
+			const ShaderArchiveEntry& entry = this->entries[i];
+			if (static_cast<size_t>(entry.name_offset) + entry.name_size > this->file.size || static_cast<size_t>(entry.code_offset) + entry.code_size > this->file.size
+				|| entry.code_offset % sizeof(uint32_t) != 0 || entry.code_size % sizeof(uint32_t) != 0) {
+				Close();
+				throw std::runtime_error("shader archive entry is out of the file");
+			}
+		}
+	}
+
+	void ShaderArchive::Close() {
+		this->file.Close();
+		this->header = nullptr;
+		this->entries = nullptr;
+	}
+
+	bool ShaderArchive::IsOpen() {
+		return this->file.IsOpen();
+	}
+
+	const ShaderArchiveEntry* ShaderArchive::Find(const char* name) {
+		if (!IsOpen()) {
+			return nullptr;
+		}
+		size_t name_size = strlen(name);
+		uint64_t name_hash = vk::util::HashBytes(name, name_size);
+		const ShaderArchiveEntry* end = this->entries + this->header->entry_count;
+		const ShaderArchiveEntry* entry = std::lower_bound(this->entries, end, name_hash,
+			[](const ShaderArchiveEntry& entry, uint64_t hash) { return entry.name_hash < hash; });
+		const char* names = static_cast<const char*>(this->file.data);
+		// the name is compared too, in case two paths share a hash
+		for (; entry != end && entry->name_hash == name_hash; entry++) {
+			if (entry->name_size == name_size && memcmp(names + entry->name_offset, name, name_size) == 0) {
+				return entry;
+			}
+		}
+		return nullptr;
+	}
+
+	const uint32_t* ShaderArchive::GetCode(const ShaderArchiveEntry& entry) {
+		return reinterpret_cast<const uint32_t*>(static_cast<const unsigned char*>(this->file.data) + entry.code_offset);
+	}
+
+	uint32_t ShaderArchive::GetEntryCount() {
+		return IsOpen() ? this->header->entry_count : 0;
+	}
+}
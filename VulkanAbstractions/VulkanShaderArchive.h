@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include "VulkanMappedFile.h"
+
+namespace vk {
+
+	// one module packed by tools/build_shaders.py. name_hash is vk::util::HashBytes of the path the demos load the module by
+	// (shaders/blur_frag.spv), code_hash the same over the code, so the library doesn't hash archived code at startup
+	struct ShaderArchiveEntry {
+		uint64_t name_hash;
+		uint64_t code_hash;
+		uint32_t name_offset; // from the start of the file, names are not null terminated
+		uint32_t name_size;
+		uint32_t code_offset; // 16 bytes aligned
+		uint32_t code_size;
+	};
+
+	struct ShaderArchiveHeader {
+		char magic[4]; // SPVA
+		uint32_t version;
+		uint32_t entry_count;
+		uint32_t reserved;
+	};
+
+	// every SPIR-V module of a demo in a single memory mapped file: the header, the entries sorted by name_hash, then names and code.
+	// Modules are read in place, so startup maps one file instead of opening one per shader
+	class ShaderArchive {
+	public:
+		// throws if the file is missing or not an archive of this version
+		void Open(const char* filename);
+		void Close();
+		bool IsOpen();
+		// nullptr if the archive has no module for the path
+		const ShaderArchiveEntry* Find(const char* name);
+		const uint32_t* GetCode(const ShaderArchiveEntry& entry);
+		uint32_t GetEntryCount();
+	public:
+		const static uint32_t VERSION = 1;
+	private:
+		MappedFile file;
+		const ShaderArchiveHeader* header = nullptr;
+		const ShaderArchiveEntry* entries = nullptr;
+	};
+}
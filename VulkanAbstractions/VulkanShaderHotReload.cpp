@@ -0,0 +1,223 @@
+#include "VulkanShaderHotReload.h"
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include "VulkanCpuProfiler.h"
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace vk {
+
+	namespace {
+		const char* const SOURCE_EXTENSIONS[] = { ".vert", ".frag", ".comp", ".geom", ".tesc", ".tese" };
+		const char* const INCLUDE_EXTENSION = ".glsl";
+
+		bool IsStageSource(const std::string& path) {
+			std::string extension = std::filesystem::path(path).extension().string();
+			return std::find(std::begin(SOURCE_EXTENSIONS), std::end(SOURCE_EXTENSIONS), extension) != std::end(SOURCE_EXTENSIONS);
+		}
+
+		bool IsInclude(const std::string& path) {
+			return std::filesystem::path(path).extension().string() == INCLUDE_EXTENSION;
+		}
+
+		void AddUnique(std::vector<std::string>& paths, const std::string& path) {
+			if (std::find(paths.begin(), paths.end(), path) == paths.end()) {
+				paths.push_back(path);
+			}
+		}
+
+		// paths are joined with '/' so they match the relative paths the demos use, on windows too
+		std::vector<std::string> ListSources(const std::string& directory) {
+			std::vector<std::string> sources;
+			std::error_code error;
+			for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(directory, error)) {
+				std::string path = directory + "/" + entry.path().filename().string();
+				if (entry.is_regular_file(error) && (IsStageSource(path) || IsInclude(path))) {
+					sources.push_back(path);
+				}
+			}
+			return sources;
+		}
+	}
+
+	ShaderHotReload::~ShaderHotReload() {
+		Stop();
+	}
+
+	void ShaderHotReload::Start(const std::vector<std::string>& directories, const std::string& compiler_command, const std::string& optimizer_command) {
+		if (this->running) {
+			throw std::runtime_error("shader hot reload is already started");
+		}
+		this->directories = directories;
+		this->compiler_command = compiler_command;
+		this->optimizer_command = optimizer_command;
+#ifdef __linux__
+		this->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (this->inotify_fd < 0) {
+			throw std::runtime_error("fail to initialize inotify");
+		}
+		for (const std::string& directory : directories) {
+			// editors saving through a temporary file rename it over the source
+			int watch_descriptor = inotify_add_watch(this->inotify_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+			if (watch_descriptor < 0) {
+				close(this->inotify_fd);
+				this->inotify_fd = -1;
+				this->watched_directories.clear();
+				throw std::runtime_error("fail to watch shader directory");
+			}
+			this->watched_directories.emplace(watch_descriptor, directory);
+		}
+#else
+		for (const std::string& directory : directories) {
+			for (const std::string& source : ListSources(directory)) {
+				std::error_code error;
+				this->write_times[source] = std::filesystem::last_write_time(source, error);
+			}
+		}
+#endif
+		this->running = true;
+		this->watch_thread = std::thread(&ShaderHotReload::Watch, this);
+	}
+
+	void ShaderHotReload::Stop() {
+		if (!this->running) {
+			return;
+		}
+		this->running = false;
+		this->watch_thread.join(); // after the source being compiled, if any
+#ifdef __linux__
+		close(this->inotify_fd);
+		this->inotify_fd = -1;
+		this->watched_directories.clear();
+#else
+		this->write_times.clear();
+#endif
+		std::lock_guard<std::mutex> lock(this->compiled_mutex);
+		this->compiled_modules.clear();
+	}
+
+	std::vector<std::string> ShaderHotReload::TakeCompiledModules() {
+		std::lock_guard<std::mutex> lock(this->compiled_mutex);
+		std::vector<std::string> modules;
+		modules.swap(this->compiled_modules);
+		return modules;
+	}
+
+	bool ShaderHotReload::IsRunning() {
+		return this->running;
+	}
+
+	void ShaderHotReload::Watch() {
+		vk::VulkanCpuProfiler::SetThreadName("shader hot reload");
+		while (this->running) {
+			std::vector<std::string> sources;
+			for (const std::string& changed : WaitForChangedSources()) {
+				if (!IsInclude(changed)) {
+					AddUnique(sources, changed);
+					continue;
+				}
+				for (const std::string& source : GetIncludingSources(changed)) {
+					AddUnique(sources, source);
+				}
+			}
+			for (const std::string& source : sources) {
+				Compile(source);
+			}
+		}
+	}
+
+	std::vector<std::string> ShaderHotReload::WaitForChangedSources() {
+		std::vector<std::string> changed;
+#ifdef __linux__
+		alignas(inotify_event) char buffer[4096];
+		int timeout_ms = WATCH_POLL_INTERVAL_MS; // wakes up to see if Stop was called
+		while (this->running) {
+			pollfd poll_fd = { this->inotify_fd, POLLIN, 0 };
+			if (poll(&poll_fd, 1, timeout_ms) <= 0) {
+				if (!changed.empty()) {
+					return changed; // nothing written for DEBOUNCE_MS
+				}
+				continue;
+			}
+			ssize_t length = read(this->inotify_fd, buffer, sizeof(buffer));
+			for (ssize_t offset = 0; offset < length;) {
+				const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+				offset += sizeof(inotify_event) + event->len;
+				auto directory = this->watched_directories.find(event->wd);
+				if (event->len == 0 || directory == this->watched_directories.end()) {
+					continue;
+				}
+				std::string path = directory->second + "/" + event->name;
+				if (IsStageSource(path) || IsInclude(path)) {
+					AddUnique(changed, path);
+				}
+			}
+			if (!changed.empty()) {
+				timeout_ms = DEBOUNCE_MS;
+			}
+		}
+#else
+		while (this->running && changed.empty()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(WATCH_POLL_INTERVAL_MS));
+			for (const std::string& directory : this->directories) {
+				for (const std::string& source : ListSources(directory)) {
+					std::error_code error;
+					std::filesystem::file_time_type write_time = std::filesystem::last_write_time(source, error);
+					auto known = this->write_times.find(source);
+					if (known == this->write_times.end() || known->second != write_time) {
+						this->write_times[source] = write_time;
+						changed.push_back(source);
+					}
+				}
+			}
+		}
+#endif
+		return changed;
+	}
+
+	void ShaderHotReload::Compile(const std::string& source) {
+		CPU_PROFILE_FUNCTION();
+		std::string stage = std::filesystem::path(source).extension().string().substr(1);
+		std::string module = source.substr(0, source.size() - stage.size() - 1) + "_" + stage + ".spv";
+		std::string command = this->compiler_command + " \"" + source + "\" -o \"" + module + "\"";
+		if (std::system(command.c_str()) != 0) {
+			std::cerr << "shader hot reload: fail to compile " << source << ", keeping the previous module\n";
+			return;
+		}
+		if (!this->optimizer_command.empty()) {
+			std::string optimize = this->optimizer_command + " \"" + module + "\" -o \"" + module + "\"";
+			if (std::system(optimize.c_str()) != 0) {
+				// the unoptimized module is still valid
+				std::cerr << "shader hot reload: fail to optimize " << module << "\n";
+			}
+		}
+		std::lock_guard<std::mutex> lock(this->compiled_mutex);
+		AddUnique(this->compiled_modules, module);
+	}
+
+	std::vector<std::string> ShaderHotReload::GetIncludingSources(const std::string& include) {
+		std::string directive = "#include \"" + std::filesystem::path(include).filename().string() + "\"";
+		std::string directory = include.substr(0, include.find_last_of('/'));
+		std::vector<std::string> sources;
+		for (const std::string& source : ListSources(directory)) {
+			if (!IsStageSource(source)) {
+				continue;
+			}
+			std::ifstream file(source);
+			std::stringstream contents;
+			contents << file.rdbuf();
+			if (contents.str().find(directive) != std::string::npos) {
+				sources.push_back(source);
+			}
+		}
+		return sources;
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <filesystem>
+
+namespace vk {
+
+	// watches directories of GLSL sources on a background thread and compiles the sources that change to SPIR-V next to them, named the way
+	// the demos load them (blur.frag to blur_frag.spv). A changed .glsl include compiles again the sources of its directory including it.
+	// The tree has no in-process GLSL compiler, so compiler_command is run for every source, with the source and -o <spv> appended, then
+	// optimizer_command with <spv> -o <spv> appended unless it is empty. The defaults match tools/build_shaders.py, so a reloaded module is
+	// the one the offline build makes.
+	// Watching uses inotify on linux and compares write times every WATCH_POLL_INTERVAL_MS elsewhere
+	class ShaderHotReload {
+	public:
+		~ShaderHotReload();
+		void Start(const std::vector<std::string>& directories, const std::string& compiler_command = DEFAULT_COMPILER_COMMAND,
+			const std::string& optimizer_command = DEFAULT_OPTIMIZER_COMMAND);
+		void Stop();
+		// SPIR-V files compiled since the last call, as the demos pass them to the shader library (shaders/blur_frag.spv)
+		std::vector<std::string> TakeCompiledModules();
+		bool IsRunning();
+	private:
+		void Watch();
+		std::vector<std::string> WaitForChangedSources(); // blocks until a source changes or Stop is called
+		void Compile(const std::string& source);
+		std::vector<std::string> GetIncludingSources(const std::string& include);
+	public:
+		// keep in sync with build_module of tools/build_shaders.py
+		constexpr static const char* DEFAULT_COMPILER_COMMAND = "glslangValidator -V --target-env vulkan1.2";
+		constexpr static const char* DEFAULT_OPTIMIZER_COMMAND = "spirv-opt -O";
+		const static uint32_t WATCH_POLL_INTERVAL_MS = 250;
+		const static uint32_t DEBOUNCE_MS = 100; // editors write a file in several steps, changes this close are compiled once
+	private:
+		std::vector<std::string> directories;
+		std::string compiler_command;
+		std::string optimizer_command;
+		std::thread watch_thread;
+		std::atomic<bool> running{ false };
+		std::mutex compiled_mutex;
+		std::vector<std::string> compiled_modules; // guarded by compiled_mutex
+#ifdef __linux__
+		int inotify_fd = -1;
+		std::unordered_map<int, std::string> watched_directories; // by watch descriptor
+#else
+		std::unordered_map<std::string, std::filesystem::file_time_type> write_times; // by source path
+#endif
+	};
+}
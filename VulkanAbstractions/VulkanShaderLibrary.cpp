@@ -0,0 +1,134 @@
+#include "VulkanShaderLibrary.h"
+#include <stdexcept>
+#include <cstring>
+#include "VulkanHelper.h"
+#include "VulkanCpuProfiler.h"
+#include "VulkanMappedFile.h"
+
+namespace vk {
+
+	void ShaderLibrary::Create(VkDevice logical_device) {
+		if (this->logical_device != VK_NULL_HANDLE) {
+			throw std::runtime_error("shader library is already created");
+		}
+		this->logical_device = logical_device;
+		this->hit_count = 0;
+		this->archived_file_count = 0;
+	}
+
+	void ShaderLibrary::Destroy() {
+		if (this->logical_device == VK_NULL_HANDLE) {
+			return;
+		}
+		for (auto& entry : this->modules) {
+			vkDestroyShaderModule(this->logical_device, entry.second.module, nullptr);
+		}
+		this->modules.clear();
+		this->file_hashes.clear();
+		this->archive.Close();
+		this->logical_device = VK_NULL_HANDLE;
+	}
+
+	void ShaderLibrary::OpenArchive(const char* filename) {
+		this->archive.Open(filename);
+	}
+
+	bool ShaderLibrary::IsArchived(const char* filename) {
+		return this->archive.Find(filename) != nullptr;
+	}
+
+	VkShaderModule ShaderLibrary::Get(const char* filename) {
+		return Load(filename, true).module;
+	}
+
+	VkShaderModule ShaderLibrary::Get(const char* filename, ShaderReflection& reflection) {
+		ShaderModuleEntry& entry = Load(filename, true);
+		reflection = entry.reflection;
+		return entry.module;
+	}
+
+	void ShaderLibrary::Reload(const char* filename) {
+		auto file_hash = this->file_hashes.find(filename);
+		if (file_hash == this->file_hashes.end()) {
+			Load(filename, false);
+			return;
+		}
+		uint64_t previous_hash = file_hash->second;
+		this->file_hashes.erase(file_hash);
+		try {
+			Load(filename, false);
+		}
+		catch (...) {
+			this->file_hashes.emplace(filename, previous_hash);
+			throw;
+		}
+		for (auto& path_hash : this->file_hashes) {
+			if (path_hash.second == previous_hash) {
+				return;
+			}
+		}
+		auto previous = this->modules.find(previous_hash);
+		vkDestroyShaderModule(this->logical_device, previous->second.module, nullptr);
+		this->modules.erase(previous);
+	}
+
+	uint32_t ShaderLibrary::GetModuleCount() {
+		return static_cast<uint32_t>(this->modules.size());
+	}
+
+	uint32_t ShaderLibrary::GetFileCount() {
+		return static_cast<uint32_t>(this->file_hashes.size());
+	}
+
+	uint64_t ShaderLibrary::GetHitCount() {
+		return this->hit_count;
+	}
+
+	uint32_t ShaderLibrary::GetArchivedFileCount() {
+		return this->archived_file_count;
+	}
+
+	ShaderLibrary::ShaderModuleEntry& ShaderLibrary::Load(const char* filename, bool use_archive) {
+		auto file_hash = this->file_hashes.find(filename);
+		if (file_hash != this->file_hashes.end()) {
+			this->hit_count++;
+			return this->modules.at(file_hash->second);
+		}
+		CPU_PROFILE_FUNCTION();
+		const ShaderArchiveEntry* archived = use_archive ? this->archive.Find(filename) : nullptr;
+		if (archived != nullptr) {
+			this->archived_file_count++;
+			return CreateModule(filename, this->archive.GetCode(*archived), archived->code_size, archived->code_hash);
+		}
+		MappedFile file;
+		file.Open(filename);
+		if (file.size % sizeof(uint32_t) != 0) {
+			throw std::runtime_error("shader code is not made of 32 bit words");
+		}
+		return CreateModule(filename, static_cast<const uint32_t*>(file.data), file.size, vk::util::HashBytes(file.data, file.size));
+	}
+
+	ShaderLibrary::ShaderModuleEntry& ShaderLibrary::CreateModule(const char* filename, const uint32_t* code, size_t code_size, uint64_t hash) {
+		uint64_t key = hash;
+		for (auto cached = this->modules.find(key); cached != this->modules.end(); cached = this->modules.find(++key)) {
+			const std::vector<uint32_t>& cached_code = cached->second.code;
+			if (cached_code.size() * sizeof(uint32_t) == code_size && std::memcmp(cached_code.data(), code, code_size) == 0) {
+				this->file_hashes.emplace(filename, key);
+				return cached->second;
+			}
+		}
+
+		ShaderModuleEntry entry = {};
+		entry.code.assign(code, code + code_size / sizeof(uint32_t));
+		entry.reflection.Reflect(code, code_size / sizeof(uint32_t));
+		VkShaderModuleCreateInfo create_info = {};
+		create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		create_info.codeSize = code_size;
+		create_info.pCode = code;
+		if (vkCreateShaderModule(this->logical_device, &create_info, nullptr, &entry.module) != VK_SUCCESS) {
+			throw std::runtime_error("fail to create shader module");
+		}
+		this->file_hashes.emplace(filename, key);
+		return this->modules.emplace(key, std::move(entry)).first->second;
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "vulkan/vulkan.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "VulkanShaderReflection.h"
+#include "VulkanShaderArchive.h"
+
+namespace vk {
+
+	// creates one VkShaderModule per distinct SPIR-V code and keeps it until Destroy, so pipelines sharing a shader, or created again with
+	// the swapchain, reuse the module instead of reading the file and creating it again. Each file is read once through a memory mapping
+	// and its contents hashed, so paths holding the same code share a module too. The code is compared on hash hits, a different code with
+	// the same hash gets a module of its own.
+	// Pipelines don't need their modules once created, but the library is only destroyed with the device.
+	// With an archive open, paths it holds are created from the archive's mapping and the loose files are not read
+	class ShaderLibrary {
+	public:
+		void Create(VkDevice logical_device);
+		void Destroy();
+		// throws if the file is not a shader archive, the archive stays mapped until Destroy
+		void OpenArchive(const char* filename);
+		bool IsArchived(const char* filename);
+		VkShaderModule Get(const char* filename);
+		// also the interface of the module, reflected once when the module is created
+		VkShaderModule Get(const char* filename, ShaderReflection& reflection);
+		// reads the loose file again for the next Get of the path, archived or not. The previous module is destroyed unless another path uses it, pipelines
+		// created with it don't need it anymore. Throws and keeps the previous module if the new code fails to load
+		void Reload(const char* filename);
+		uint32_t GetModuleCount();
+		uint32_t GetFileCount(); // distinct paths read
+		uint64_t GetHitCount(); // Get calls for a path read before
+		uint32_t GetArchivedFileCount(); // distinct paths read from the archive
+	private:
+		struct ShaderModuleEntry {
+			VkShaderModule module;
+			ShaderReflection reflection;
+			std::vector<uint32_t> code; // compared with the code of later files with the same hash
+		};
+		ShaderModuleEntry& Load(const char* filename, bool use_archive);
+		ShaderModuleEntry& CreateModule(const char* filename, const uint32_t* code, size_t code_size, uint64_t hash);
+	private:
+		VkDevice logical_device = VK_NULL_HANDLE;
+		std::unordered_map<std::string, uint64_t> file_hashes; // path to the key of its module in modules
+		std::unordered_map<uint64_t, ShaderModuleEntry> modules; // by hash of the code, or the next free key on a collision
+		uint64_t hit_count = 0;
+		ShaderArchive archive;
+		uint32_t archived_file_count = 0;
+	};
+}
@@ -0,0 +1,658 @@
+#include "VulkanShaderReflection.h"
+#include <stdexcept>
+#include <algorithm>
+#include "VulkanHelper.h"
+#include "VulkanGraphicPipeline.h"
+
+namespace vk {
+
+	namespace {
+		const uint32_t SPIRV_MAGIC = 0x07230203;
+		const uint32_t SPIRV_HEADER_WORDS = 5;
+		const uint32_t NONE = ~0u;
+
+		// the parts of the SPIR-V specification the reflection reads
+		const uint32_t OP_NAME = 5;
+		const uint32_t OP_MEMBER_NAME = 6;
+		const uint32_t OP_ENTRY_POINT = 15;
+		const uint32_t OP_TYPE_BOOL = 20;
+		const uint32_t OP_TYPE_INT = 21;
+		const uint32_t OP_TYPE_FLOAT = 22;
+		const uint32_t OP_TYPE_VECTOR = 23;
+		const uint32_t OP_TYPE_MATRIX = 24;
+		const uint32_t OP_TYPE_IMAGE = 25;
+		const uint32_t OP_TYPE_SAMPLER = 26;
+		const uint32_t OP_TYPE_SAMPLED_IMAGE = 27;
+		const uint32_t OP_TYPE_ARRAY = 28;
+		const uint32_t OP_TYPE_RUNTIME_ARRAY = 29;
+		const uint32_t OP_TYPE_STRUCT = 30;
+		const uint32_t OP_TYPE_POINTER = 32;
+		const uint32_t OP_CONSTANT = 43;
+		const uint32_t OP_SPEC_CONSTANT_TRUE = 48;
+		const uint32_t OP_SPEC_CONSTANT_FALSE = 49;
+		const uint32_t OP_SPEC_CONSTANT = 50;
+		const uint32_t OP_VARIABLE = 59;
+		const uint32_t OP_DECORATE = 71;
+		const uint32_t OP_MEMBER_DECORATE = 72;
+		const uint32_t OP_TYPE_ACCELERATION_STRUCTURE = 5341;
+
+		const uint32_t DECORATION_SPEC_ID = 1;
+		const uint32_t DECORATION_BUFFER_BLOCK = 3;
+		const uint32_t DECORATION_ROW_MAJOR = 4;
+		const uint32_t DECORATION_ARRAY_STRIDE = 6;
+		const uint32_t DECORATION_MATRIX_STRIDE = 7;
+		const uint32_t DECORATION_BUILT_IN = 11;
+		const uint32_t DECORATION_LOCATION = 30;
+		const uint32_t DECORATION_BINDING = 33;
+		const uint32_t DECORATION_DESCRIPTOR_SET = 34;
+		const uint32_t DECORATION_OFFSET = 35;
+
+		const uint32_t STORAGE_CLASS_UNIFORM_CONSTANT = 0;
+		const uint32_t STORAGE_CLASS_INPUT = 1;
+		const uint32_t STORAGE_CLASS_UNIFORM = 2;
+		const uint32_t STORAGE_CLASS_PUSH_CONSTANT = 9;
+		const uint32_t STORAGE_CLASS_STORAGE_BUFFER = 12;
+
+		const uint32_t IMAGE_DIM_BUFFER = 5;
+		const uint32_t IMAGE_DIM_SUBPASS_DATA = 6;
+		const uint32_t IMAGE_SAMPLED_STORAGE = 2; // the image is read and written without a sampler
+
+		struct SpirvMember {
+			uint32_t offset = 0;
+			uint32_t matrix_stride = 0;
+			bool row_major = false;
+			std::string name;
+		};
+
+		// the instruction defining an id, with the decorations the reflection needs
+		struct SpirvId {
+			uint32_t opcode = 0;
+			uint32_t result_type = 0;
+			std::vector<uint32_t> args; // operands after the result id
+			std::string name;
+			uint32_t set = NONE;
+			uint32_t binding = NONE;
+			uint32_t location = NONE;
+			uint32_t spec_id = NONE;
+			uint32_t array_stride = 0;
+			bool buffer_block = false;
+			bool built_in = false;
+			std::vector<SpirvMember> members;
+		};
+
+		class SpirvModule {
+		public:
+			void Parse(const uint32_t* code, size_t word_count) {
+				if (word_count < SPIRV_HEADER_WORDS || code[0] != SPIRV_MAGIC) {
+					throw std::runtime_error("shader code is not SPIR-V");
+				}
+				this->ids.assign(code[3], SpirvId()); // the bound of the ids
+				for (size_t i = SPIRV_HEADER_WORDS; i < word_count;) {
+					uint32_t opcode = code[i] & 0xffff;
+					uint32_t length = code[i] >> 16;
+					if (length == 0 || i + length > word_count) {
+						throw std::runtime_error("SPIR-V instruction is truncated");
+					}
+					ParseInstruction(opcode, code + i + 1, length - 1);
+					i += length;
+				}
+				if (this->execution_model == NONE) {
+					throw std::runtime_error("SPIR-V module has no entry point");
+				}
+			}
+
+			SpirvId& Get(uint32_t id) {
+				if (id >= this->ids.size()) {
+					throw std::runtime_error("SPIR-V id is out of bounds");
+				}
+				return this->ids[id];
+			}
+
+			// the member is created by its first name or decoration
+			SpirvMember& GetMember(uint32_t id, uint32_t member) {
+				SpirvId& spirv_id = Get(id);
+				if (member >= spirv_id.members.size()) {
+					spirv_id.members.resize(member + 1);
+				}
+				return spirv_id.members[member];
+			}
+
+			uint32_t GetConstantValue(uint32_t id) {
+				SpirvId& constant = Get(id);
+				if (constant.opcode != OP_CONSTANT && constant.opcode != OP_SPEC_CONSTANT) {
+					throw std::runtime_error("SPIR-V array length is not a constant");
+				}
+				return constant.args.at(0);
+			}
+
+			// byte size of a type inside a block, with the strides its enclosing struct and arrays are decorated with
+			uint32_t GetTypeSize(uint32_t type, uint32_t matrix_stride, bool row_major) {
+				SpirvId& spirv_type = Get(type);
+				switch (spirv_type.opcode) {
+				case OP_TYPE_BOOL:
+					return sizeof(VkBool32);
+				case OP_TYPE_INT:
+				case OP_TYPE_FLOAT:
+					return spirv_type.args.at(0) / 8;
+				case OP_TYPE_VECTOR:
+					return spirv_type.args.at(1) * GetTypeSize(spirv_type.args.at(0), 0, false);
+				case OP_TYPE_MATRIX: {
+					uint32_t column_type = spirv_type.args.at(0);
+					uint32_t columns = spirv_type.args.at(1);
+					uint32_t rows = Get(column_type).args.at(1);
+					if (matrix_stride == 0) {
+						matrix_stride = GetTypeAlignment(column_type);
+					}
+					return (row_major ? rows : columns) * matrix_stride;
+				}
+				case OP_TYPE_ARRAY: {
+					uint32_t element_type = spirv_type.args.at(0);
+					uint32_t stride = spirv_type.array_stride;
+					if (stride == 0) {
+						stride = vk::util::CalculateObjectSize(GetTypeSize(element_type, matrix_stride, row_major), GetTypeAlignment(element_type));
+					}
+					return GetConstantValue(spirv_type.args.at(1)) * stride;
+				}
+				case OP_TYPE_RUNTIME_ARRAY:
+					return 0;
+				case OP_TYPE_STRUCT: {
+					uint32_t size = 0;
+					for (uint32_t i = 0; i < spirv_type.args.size(); i++) {
+						SpirvMember member = i < spirv_type.members.size() ? spirv_type.members[i] : SpirvMember();
+						size = std::max(size, member.offset + GetTypeSize(spirv_type.args[i], member.matrix_stride, member.row_major));
+					}
+					return size;
+				}
+				default:
+					throw std::runtime_error("SPIR-V type has no size");
+				}
+			}
+
+			// std430 base alignment
+			uint32_t GetTypeAlignment(uint32_t type) {
+				SpirvId& spirv_type = Get(type);
+				switch (spirv_type.opcode) {
+				case OP_TYPE_VECTOR: {
+					uint32_t components = spirv_type.args.at(1);
+					return (components == 3 ? 4 : components) * GetTypeSize(spirv_type.args.at(0), 0, false);
+				}
+				case OP_TYPE_MATRIX:
+				case OP_TYPE_ARRAY:
+				case OP_TYPE_RUNTIME_ARRAY:
+					return GetTypeAlignment(spirv_type.args.at(0));
+				case OP_TYPE_STRUCT: {
+					uint32_t alignment = 1;
+					for (uint32_t member_type : spirv_type.args) {
+						alignment = std::max(alignment, GetTypeAlignment(member_type));
+					}
+					return alignment;
+				}
+				default:
+					return GetTypeSize(type, 0, false);
+				}
+			}
+
+			// count is the product of the array lengths around the descriptor, 0 if one of them is runtime sized
+			VkDescriptorType GetDescriptorType(uint32_t type, uint32_t storage_class, uint32_t& count) {
+				count = 1;
+				while (Get(type).opcode == OP_TYPE_ARRAY || Get(type).opcode == OP_TYPE_RUNTIME_ARRAY) {
+					SpirvId& array = Get(type);
+					count = array.opcode == OP_TYPE_ARRAY ? count * GetConstantValue(array.args.at(1)) : 0;
+					type = array.args.at(0);
+				}
+				SpirvId& spirv_type = Get(type);
+				switch (spirv_type.opcode) {
+				case OP_TYPE_SAMPLER:
+					return VK_DESCRIPTOR_TYPE_SAMPLER;
+				case OP_TYPE_SAMPLED_IMAGE:
+					return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+				case OP_TYPE_IMAGE: {
+					uint32_t dim = spirv_type.args.at(1);
+					bool storage = spirv_type.args.at(5) == IMAGE_SAMPLED_STORAGE;
+					if (dim == IMAGE_DIM_BUFFER) {
+						return storage ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+					}
+					if (dim == IMAGE_DIM_SUBPASS_DATA) {
+						return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+					}
+					return storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+				}
+				case OP_TYPE_STRUCT:
+					// before SPIR-V 1.3 storage buffers are uniform blocks decorated BufferBlock
+					if (storage_class == STORAGE_CLASS_STORAGE_BUFFER || spirv_type.buffer_block) {
+						return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+					}
+					return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+				case OP_TYPE_ACCELERATION_STRUCTURE:
+					return VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+				default:
+					throw std::runtime_error("descriptor type of a shader variable is not supported by reflection");
+				}
+			}
+
+			// 32 bit scalars and vectors only
+			VkFormat GetVertexInputFormat(uint32_t type) {
+				uint32_t components = 1;
+				if (Get(type).opcode == OP_TYPE_VECTOR) {
+					components = Get(type).args.at(1);
+					type = Get(type).args.at(0);
+				}
+				SpirvId& scalar = Get(type);
+				if ((scalar.opcode != OP_TYPE_FLOAT && scalar.opcode != OP_TYPE_INT) || scalar.args.at(0) != 32 || components > 4) {
+					return VK_FORMAT_UNDEFINED;
+				}
+				const VkFormat float_formats[4] = { VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT };
+				const VkFormat sint_formats[4] = { VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT };
+				const VkFormat uint_formats[4] = { VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT };
+				if (scalar.opcode == OP_TYPE_FLOAT) {
+					return float_formats[components - 1];
+				}
+				return scalar.args.at(1) != 0 ? sint_formats[components - 1] : uint_formats[components - 1];
+			}
+
+			// the variable's name, or the name of its block for an anonymous instance
+			std::string GetVariableName(SpirvId& variable, uint32_t type) {
+				if (!variable.name.empty()) {
+					return variable.name;
+				}
+				while (Get(type).opcode == OP_TYPE_ARRAY || Get(type).opcode == OP_TYPE_RUNTIME_ARRAY) {
+					type = Get(type).args.at(0);
+				}
+				return Get(type).name;
+			}
+
+		private:
+			void ParseInstruction(uint32_t opcode, const uint32_t* operands, uint32_t operand_count) {
+				switch (opcode) {
+				case OP_ENTRY_POINT:
+					if (this->execution_model == NONE && operand_count >= 3) {
+						this->execution_model = operands[0];
+						this->entry_point = ReadString(operands + 2, operand_count - 2);
+					}
+					break;
+				case OP_NAME:
+					Get(operands[0]).name = ReadString(operands + 1, operand_count - 1);
+					break;
+				case OP_MEMBER_NAME:
+					GetMember(operands[0], operands[1]).name = ReadString(operands + 2, operand_count - 2);
+					break;
+				case OP_DECORATE:
+					Decorate(Get(operands[0]), operands[1], operand_count > 2 ? operands[2] : 0);
+					break;
+				case OP_MEMBER_DECORATE:
+					DecorateMember(GetMember(operands[0], operands[1]), operands[2], operand_count > 3 ? operands[3] : 0);
+					break;
+				case OP_TYPE_BOOL:
+				case OP_TYPE_INT:
+				case OP_TYPE_FLOAT:
+				case OP_TYPE_VECTOR:
+				case OP_TYPE_MATRIX:
+				case OP_TYPE_IMAGE:
+				case OP_TYPE_SAMPLER:
+				case OP_TYPE_SAMPLED_IMAGE:
+				case OP_TYPE_ARRAY:
+				case OP_TYPE_RUNTIME_ARRAY:
+				case OP_TYPE_STRUCT:
+				case OP_TYPE_POINTER:
+				case OP_TYPE_ACCELERATION_STRUCTURE: {
+					SpirvId& type = Get(operands[0]);
+					type.opcode = opcode;
+					type.args.assign(operands + 1, operands + operand_count);
+					break;
+				}
+				case OP_CONSTANT:
+				case OP_SPEC_CONSTANT_TRUE:
+				case OP_SPEC_CONSTANT_FALSE:
+				case OP_SPEC_CONSTANT:
+				case OP_VARIABLE: {
+					SpirvId& value = Get(operands[1]);
+					value.opcode = opcode;
+					value.result_type = operands[0];
+					value.args.assign(operands + 2, operands + operand_count);
+					this->values.push_back(operands[1]);
+					break;
+				}
+				default:
+					break;
+				}
+			}
+
+			void Decorate(SpirvId& target, uint32_t decoration, uint32_t value) {
+				switch (decoration) {
+				case DECORATION_SPEC_ID: target.spec_id = value; break;
+				case DECORATION_BUFFER_BLOCK: target.buffer_block = true; break;
+				case DECORATION_ARRAY_STRIDE: target.array_stride = value; break;
+				case DECORATION_BUILT_IN: target.built_in = true; break;
+				case DECORATION_LOCATION: target.location = value; break;
+				case DECORATION_BINDING: target.binding = value; break;
+				case DECORATION_DESCRIPTOR_SET: target.set = value; break;
+				default: break;
+				}
+			}
+
+			void DecorateMember(SpirvMember& member, uint32_t decoration, uint32_t value) {
+				switch (decoration) {
+				case DECORATION_ROW_MAJOR: member.row_major = true; break;
+				case DECORATION_MATRIX_STRIDE: member.matrix_stride = value; break;
+				case DECORATION_OFFSET: member.offset = value; break;
+				default: break;
+				}
+			}
+
+			// literal strings are nul terminated and packed four characters per word, first character in the lowest byte
+			static std::string ReadString(const uint32_t* words, uint32_t word_count) {
+				std::string string;
+				for (uint32_t i = 0; i < word_count * 4; i++) {
+					char c = static_cast<char>((words[i / 4] >> (8 * (i % 4))) & 0xff);
+					if (c == '\0') {
+						break;
+					}
+					string.push_back(c);
+				}
+				return string;
+			}
+
+		public:
+			std::vector<SpirvId> ids;
+			std::vector<uint32_t> values; // constants and variables, in module order
+			uint32_t execution_model = NONE;
+			std::string entry_point;
+		};
+
+		VkShaderStageFlagBits GetShaderStage(uint32_t execution_model) {
+			switch (execution_model) {
+			case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+			case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+			case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+			case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+			case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+			case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+			default: throw std::runtime_error("shader stage is not supported by reflection");
+			}
+		}
+
+		// buffers are the same to a shader whether they are bound with dynamic offsets or not
+		VkDescriptorType GetStaticDescriptorType(VkDescriptorType type) {
+			if (type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC) {
+				return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			}
+			if (type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC) {
+				return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			}
+			return type;
+		}
+
+		enum class NumericType {
+			FLOAT, // normalized and scaled formats included
+			SINT,
+			UINT
+		};
+
+		NumericType GetNumericType(VkFormat format) {
+			switch (format) {
+			case VK_FORMAT_R8_SINT: case VK_FORMAT_R8G8_SINT: case VK_FORMAT_R8G8B8_SINT: case VK_FORMAT_B8G8R8_SINT:
+			case VK_FORMAT_R8G8B8A8_SINT: case VK_FORMAT_B8G8R8A8_SINT: case VK_FORMAT_A8B8G8R8_SINT_PACK32:
+			case VK_FORMAT_A2R10G10B10_SINT_PACK32: case VK_FORMAT_A2B10G10R10_SINT_PACK32:
+			case VK_FORMAT_R16_SINT: case VK_FORMAT_R16G16_SINT: case VK_FORMAT_R16G16B16_SINT: case VK_FORMAT_R16G16B16A16_SINT:
+			case VK_FORMAT_R32_SINT: case VK_FORMAT_R32G32_SINT: case VK_FORMAT_R32G32B32_SINT: case VK_FORMAT_R32G32B32A32_SINT:
+			case VK_FORMAT_R64_SINT: case VK_FORMAT_R64G64_SINT: case VK_FORMAT_R64G64B64_SINT: case VK_FORMAT_R64G64B64A64_SINT:
+				return NumericType::SINT;
+			case VK_FORMAT_R8_UINT: case VK_FORMAT_R8G8_UINT: case VK_FORMAT_R8G8B8_UINT: case VK_FORMAT_B8G8R8_UINT:
+			case VK_FORMAT_R8G8B8A8_UINT: case VK_FORMAT_B8G8R8A8_UINT: case VK_FORMAT_A8B8G8R8_UINT_PACK32:
+			case VK_FORMAT_A2R10G10B10_UINT_PACK32: case VK_FORMAT_A2B10G10R10_UINT_PACK32:
+			case VK_FORMAT_R16_UINT: case VK_FORMAT_R16G16_UINT: case VK_FORMAT_R16G16B16_UINT: case VK_FORMAT_R16G16B16A16_UINT:
+			case VK_FORMAT_R32_UINT: case VK_FORMAT_R32G32_UINT: case VK_FORMAT_R32G32B32_UINT: case VK_FORMAT_R32G32B32A32_UINT:
+			case VK_FORMAT_R64_UINT: case VK_FORMAT_R64G64_UINT: case VK_FORMAT_R64G64B64_UINT: case VK_FORMAT_R64G64B64A64_UINT:
+				return NumericType::UINT;
+			default:
+				return NumericType::FLOAT;
+			}
+		}
+
+		std::string DescribeBinding(uint32_t set, uint32_t binding, const std::string& name) {
+			return "set " + std::to_string(set) + " binding " + std::to_string(binding) + " (" + name + ")";
+		}
+	}
+
+	void ShaderReflection::Reflect(const uint32_t* code, size_t word_count) {
+		SpirvModule spirv;
+		spirv.Parse(code, word_count);
+		this->stage = GetShaderStage(spirv.execution_model);
+		this->entry_point = spirv.entry_point;
+		this->bindings.clear();
+		this->push_constant_offset = 0;
+		this->push_constant_size = 0;
+		this->vertex_inputs.clear();
+		this->specialization_constants.clear();
+
+		for (uint32_t id : spirv.values) {
+			SpirvId& value = spirv.Get(id);
+			if (value.opcode == OP_SPEC_CONSTANT_TRUE || value.opcode == OP_SPEC_CONSTANT_FALSE || value.opcode == OP_SPEC_CONSTANT) {
+				if (value.spec_id != NONE) {
+					uint32_t size = value.opcode == OP_SPEC_CONSTANT ? spirv.GetTypeSize(value.result_type, 0, false) : sizeof(VkBool32);
+					this->specialization_constants.push_back({ value.spec_id, size, value.name });
+				}
+				continue;
+			}
+			if (value.opcode != OP_VARIABLE) {
+				continue;
+			}
+			uint32_t storage_class = value.args.at(0);
+			uint32_t type = spirv.Get(value.result_type).args.at(1); // the pointee of the variable's pointer type
+			switch (storage_class) {
+			case STORAGE_CLASS_UNIFORM_CONSTANT:
+			case STORAGE_CLASS_UNIFORM:
+			case STORAGE_CLASS_STORAGE_BUFFER: {
+				if (value.set == NONE || value.binding == NONE) {
+					break;
+				}
+				ReflectedBinding binding = {};
+				binding.set = value.set;
+				binding.binding = value.binding;
+				binding.type = spirv.GetDescriptorType(type, storage_class, binding.count);
+				binding.stages = this->stage;
+				binding.name = spirv.GetVariableName(value, type);
+				this->bindings.push_back(binding);
+				break;
+			}
+			case STORAGE_CLASS_PUSH_CONSTANT: {
+				SpirvId& block = spirv.Get(type);
+				uint32_t offset = NONE;
+				for (SpirvMember& member : block.members) {
+					offset = std::min(offset, member.offset);
+				}
+				this->push_constant_offset = offset == NONE ? 0 : offset;
+				uint32_t end = vk::util::CalculateObjectSize(spirv.GetTypeSize(type, 0, false), spirv.GetTypeAlignment(type));
+				this->push_constant_size = end - this->push_constant_offset;
+				break;
+			}
+			case STORAGE_CLASS_INPUT: {
+				if (this->stage != VK_SHADER_STAGE_VERTEX_BIT || value.location == NONE || value.built_in) {
+					break;
+				}
+				// a matrix takes a location per column
+				uint32_t columns = 1;
+				if (spirv.Get(type).opcode == OP_TYPE_MATRIX) {
+					columns = spirv.Get(type).args.at(1);
+					type = spirv.Get(type).args.at(0);
+				}
+				for (uint32_t i = 0; i < columns; i++) {
+					this->vertex_inputs.push_back({ value.location + i, spirv.GetVertexInputFormat(type), value.name });
+				}
+				break;
+			}
+			default:
+				break;
+			}
+		}
+
+		std::sort(this->bindings.begin(), this->bindings.end(), [](const ReflectedBinding& a, const ReflectedBinding& b) {
+			return a.set < b.set || (a.set == b.set && a.binding < b.binding);
+		});
+		std::sort(this->vertex_inputs.begin(), this->vertex_inputs.end(), [](const ReflectedVertexInput& a, const ReflectedVertexInput& b) {
+			return a.location < b.location;
+		});
+		std::sort(this->specialization_constants.begin(), this->specialization_constants.end(),
+			[](const ReflectedSpecializationConstant& a, const ReflectedSpecializationConstant& b) {
+			return a.constant_id < b.constant_id;
+		});
+	}
+
+	void ShaderReflection::CheckVertexInputs(const std::vector<VkVertexInputAttributeDescription>& attributes) {
+		for (ReflectedVertexInput& input : this->vertex_inputs) {
+			auto attribute = std::find_if(attributes.begin(), attributes.end(), [&input](const VkVertexInputAttributeDescription& a) {
+				return a.location == input.location;
+			});
+			if (attribute == attributes.end()) {
+				throw std::runtime_error("vertex input " + input.name + " at location " + std::to_string(input.location) + " has no attribute");
+			}
+			if (input.format != VK_FORMAT_UNDEFINED && GetNumericType(input.format) != GetNumericType(attribute->format)) {
+				throw std::runtime_error("vertex input " + input.name + " at location " + std::to_string(input.location)
+					+ " does not have the numeric type of its attribute");
+			}
+		}
+	}
+
+	void PipelineLayoutReflection::AddStage(const ShaderReflection& shader) {
+		for (const ReflectedBinding& binding : shader.bindings) {
+			auto existing = std::find_if(this->bindings.begin(), this->bindings.end(), [&binding](const ReflectedBinding& b) {
+				return b.set == binding.set && b.binding == binding.binding;
+			});
+			if (existing == this->bindings.end()) {
+				this->bindings.push_back(binding);
+				continue;
+			}
+			if (GetStaticDescriptorType(existing->type) != binding.type || existing->count != binding.count) {
+				throw std::runtime_error("shaders disagree on " + DescribeBinding(binding.set, binding.binding, existing->name + ", " + binding.name));
+			}
+			existing->stages |= binding.stages;
+		}
+		std::sort(this->bindings.begin(), this->bindings.end(), [](const ReflectedBinding& a, const ReflectedBinding& b) {
+			return a.set < b.set || (a.set == b.set && a.binding < b.binding);
+		});
+		// a constant id used by several stages is set once by the pipeline, so the stages must agree on its size
+		for (const ReflectedSpecializationConstant& constant : shader.specialization_constants) {
+			auto existing = std::find_if(this->specialization_constants.begin(), this->specialization_constants.end(),
+				[&constant](const ReflectedSpecializationConstant& c) { return c.constant_id == constant.constant_id; });
+			if (existing == this->specialization_constants.end()) {
+				this->specialization_constants.push_back(constant);
+			}
+			else if (existing->size != constant.size) {
+				throw std::runtime_error("shaders disagree on specialization constant " + std::to_string(constant.constant_id) + " (" + existing->name + ", "
+					+ constant.name + ")");
+			}
+		}
+		std::sort(this->specialization_constants.begin(), this->specialization_constants.end(),
+			[](const ReflectedSpecializationConstant& a, const ReflectedSpecializationConstant& b) {
+			return a.constant_id < b.constant_id;
+		});
+
+		if (shader.push_constant_size == 0) {
+			return;
+		}
+		// stages of the same type, i.e. the vertex shaders of a pre-pass and of the color pass, share their range
+		for (VkPushConstantRange& range : this->push_constant_ranges) {
+			if (range.stageFlags == static_cast<VkShaderStageFlags>(shader.stage)) {
+				uint32_t end = std::max(range.offset + range.size, shader.push_constant_offset + shader.push_constant_size);
+				range.offset = std::min(range.offset, shader.push_constant_offset);
+				range.size = end - range.offset;
+				return;
+			}
+		}
+		this->push_constant_ranges.push_back({ static_cast<VkShaderStageFlags>(shader.stage), shader.push_constant_offset, shader.push_constant_size });
+	}
+
+	void PipelineLayoutReflection::SetDynamic(uint32_t set, uint32_t binding) {
+		for (ReflectedBinding& reflected : this->bindings) {
+			if (reflected.set != set || reflected.binding != binding) {
+				continue;
+			}
+			if (reflected.type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
+				reflected.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+			}
+			else if (reflected.type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER) {
+				reflected.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+			}
+			else if (GetStaticDescriptorType(reflected.type) == reflected.type) {
+				throw std::runtime_error("only uniform and storage buffers can be dynamic, " + DescribeBinding(set, binding, reflected.name) + " is not one");
+			}
+			return;
+		}
+		throw std::runtime_error("no shader uses " + DescribeBinding(set, binding, ""));
+	}
+
+	uint32_t PipelineLayoutReflection::GetSetCount() {
+		uint32_t set_count = 0;
+		for (ReflectedBinding& binding : this->bindings) {
+			set_count = std::max(set_count, binding.set + 1);
+		}
+		return set_count;
+	}
+
+	std::vector<VkDescriptorSetLayoutBinding> PipelineLayoutReflection::GetSetBindings(uint32_t set) {
+		std::vector<VkDescriptorSetLayoutBinding> set_bindings;
+		for (ReflectedBinding& binding : this->bindings) {
+			if (binding.set != set) {
+				continue;
+			}
+			if (binding.count == 0) {
+				throw std::runtime_error("runtime sized descriptor array " + DescribeBinding(set, binding.binding, binding.name) + " needs a layout built by hand");
+			}
+			set_bindings.push_back(vk::init::CreateDescriptorSetLayoutBinding(binding.binding, binding.type, binding.count, binding.stages));
+		}
+		return set_bindings;
+	}
+
+	std::vector<VkPushConstantRange> PipelineLayoutReflection::GetPushConstantRanges() {
+		return this->push_constant_ranges;
+	}
+
+	void PipelineLayoutReflection::CreatePipelineLayout(VkDevice logical_device, VulkanDescriptorLayoutCache& layout_cache,
+		std::vector<VkDescriptorSetLayout>& set_layouts, VkPipelineLayout* pipeline_layout) {
+		if (set_layouts.size() < GetSetCount()) {
+			set_layouts.resize(GetSetCount(), VK_NULL_HANDLE);
+		}
+		for (uint32_t set = 0; set < set_layouts.size(); set++) {
+			if (set_layouts[set] != VK_NULL_HANDLE) {
+				continue;
+			}
+			// a set no shader uses gets an empty layout
+			std::vector<VkDescriptorSetLayoutBinding> set_bindings = GetSetBindings(set);
+			set_layouts[set] = layout_cache.CreateDescriptorSetLayout(set_bindings);
+		}
+		std::vector<VkPushConstantRange> ranges = this->push_constant_ranges;
+		vk::CreatePipelineLayout(logical_device, set_layouts, ranges, pipeline_layout);
+	}
+
+	void PipelineLayoutReflection::CheckSetBindings(uint32_t set, const std::vector<VkDescriptorSetLayoutBinding>& bindings) {
+		for (ReflectedBinding& reflected : this->bindings) {
+			if (reflected.set != set) {
+				continue;
+			}
+			auto declared = std::find_if(bindings.begin(), bindings.end(), [&reflected](const VkDescriptorSetLayoutBinding& b) {
+				return b.binding == reflected.binding;
+			});
+			if (declared == bindings.end()) {
+				throw std::runtime_error("set layout is missing " + DescribeBinding(set, reflected.binding, reflected.name));
+			}
+			if (GetStaticDescriptorType(declared->descriptorType) != GetStaticDescriptorType(reflected.type) || declared->descriptorCount < reflected.count
+				|| (declared->stageFlags & reflected.stages) != reflected.stages) {
+				throw std::runtime_error("set layout does not match the shaders at " + DescribeBinding(set, reflected.binding, reflected.name));
+			}
+		}
+	}
+
+	void PipelineLayoutReflection::CheckPushConstantRange(const VkPushConstantRange& range) {
+		for (uint32_t bit = 1; bit != 0 && bit <= range.stageFlags; bit <<= 1) {
+			if ((range.stageFlags & bit) == 0) {
+				continue;
+			}
+			bool covered = std::any_of(this->push_constant_ranges.begin(), this->push_constant_ranges.end(), [&range, bit](const VkPushConstantRange& r) {
+				return (r.stageFlags & bit) != 0 && r.offset <= range.offset && range.offset + range.size <= r.offset + r.size;
+			});
+			if (!covered) {
+				throw std::runtime_error("pushed constants are not covered by the push constant blocks of the shaders");
+			}
+		}
+	}
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "vulkan/vulkan.h"
+#include <vector>
+#include <string>
+#include "VulkanDescriptorCache.h"
+
+namespace vk {
+
+	struct ReflectedBinding {
+		uint32_t set;
+		uint32_t binding;
+		// uniform and storage buffers are never reflected as dynamic, the shader can't tell the difference
+		VkDescriptorType type;
+		uint32_t count; // 0 for runtime sized arrays
+		VkShaderStageFlags stages;
+		std::string name;
+	};
+
+	struct ReflectedVertexInput {
+		uint32_t location;
+		VkFormat format; // 32 bit float, int or uint formats with the shader's component count, VK_FORMAT_UNDEFINED for other types
+		std::string name;
+	};
+
+	struct ReflectedSpecializationConstant {
+		uint32_t constant_id;
+		uint32_t size; // bool constants take a VkBool32
+		std::string name;
+	};
+
+	// the interface of one SPIR-V module, parsed from its words: descriptor bindings, push constant block, vertex inputs and
+	// specialization constants. Only the first entry point is reflected
+	class ShaderReflection {
+	public:
+		// throws if the code is not SPIR-V or uses a stage or descriptor the parser doesn't know
+		void Reflect(const uint32_t* code, size_t word_count);
+		// throws if a location the shader reads has no attribute or one of another numeric type (float, int or uint)
+		void CheckVertexInputs(const std::vector<VkVertexInputAttributeDescription>& attributes);
+	public:
+		VkShaderStageFlagBits stage = VK_SHADER_STAGE_ALL;
+		std::string entry_point;
+		std::vector<ReflectedBinding> bindings;
+		// offset of the first member of the push constant block, and size up to the end of the block rounded up to its alignment.
+		// Size 0 without a block
+		uint32_t push_constant_offset = 0;
+		uint32_t push_constant_size = 0;
+		std::vector<ReflectedVertexInput> vertex_inputs; // vertex shaders only
+		std::vector<ReflectedSpecializationConstant> specialization_constants;
+	};
+
+	// the merged interface of the shaders sharing a pipeline layout. Adding a stage that declares a set and binding with another type or count,
+	// or a specialization constant id with another size, than a stage added before throws, so shaders out of sync with each other fail when
+	// they are loaded instead of on the gpu
+	class PipelineLayoutReflection {
+	public:
+		void AddStage(const ShaderReflection& shader);
+		// the uniform or storage buffer of the binding is dynamic in the layouts, the demos bind per object data with dynamic offsets
+		void SetDynamic(uint32_t set, uint32_t binding);
+		uint32_t GetSetCount(); // highest set used + 1
+		std::vector<VkDescriptorSetLayoutBinding> GetSetBindings(uint32_t set);
+		// one range per stage using push constants
+		std::vector<VkPushConstantRange> GetPushConstantRanges();
+		// builds the layout of every set with the cache, then the pipeline layout. Non null entries of set_layouts are kept, i.e. for the
+		// layout of a bindless table, whose runtime arrays can't be sized from the shaders
+		void CreatePipelineLayout(VkDevice logical_device, VulkanDescriptorLayoutCache& layout_cache, std::vector<VkDescriptorSetLayout>& set_layouts,
+			VkPipelineLayout* pipeline_layout);
+		// throws if the hand written bindings of a set miss a binding the shaders use, or declare it with another type, count or fewer stages
+		void CheckSetBindings(uint32_t set, const std::vector<VkDescriptorSetLayoutBinding>& bindings);
+		// throws if a range the application pushes has stages or bytes the reflected ranges don't cover
+		void CheckPushConstantRange(const VkPushConstantRange& range);
+	public:
+		std::vector<ReflectedBinding> bindings;
+		std::vector<VkPushConstantRange> push_constant_ranges;
+		std::vector<ReflectedSpecializationConstant> specialization_constants;
+	};
+}
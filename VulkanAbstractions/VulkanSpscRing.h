@@ -0,0 +1,53 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+namespace vk {
+
+	// bounded queue between exactly one producer thread and one consumer thread, without locks. The producer only writes tail and the
+	// consumer only writes head: a slot is published by the release store of tail after it is filled, and handed back by the release store
+	// of head after it is emptied. Both counters only grow, so full and empty are told apart without a spare slot
+	template <typename T, uint32_t Capacity>
+	class SpscRing {
+		static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "spsc ring capacity must be a power of 2");
+	public:
+		// producer only, value is moved from only when it returns true
+		bool TryPush(T&& value) {
+			uint64_t tail = this->tail.load(std::memory_order_relaxed);
+			if (tail - this->head.load(std::memory_order_acquire) == Capacity) {
+				return false;
+			}
+			this->slots[tail & (Capacity - 1)] = std::move(value);
+			this->tail.store(tail + 1, std::memory_order_release);
+			return true;
+		}
+
+		// producer only, a slot stays free until this producer pushes into it
+		bool CanPush() {
+			return this->tail.load(std::memory_order_relaxed) - this->head.load(std::memory_order_acquire) < Capacity;
+		}
+
+		// consumer only
+		bool TryPop(T& value) {
+			uint64_t head = this->head.load(std::memory_order_relaxed);
+			if (this->tail.load(std::memory_order_acquire) == head) {
+				return false;
+			}
+			value = std::move(this->slots[head & (Capacity - 1)]);
+			this->head.store(head + 1, std::memory_order_release);
+			return true;
+		}
+
+		// consumer only, with no producer running
+		void Clear() {
+			T value;
+			while (TryPop(value)) {
+			}
+		}
+	private:
+		T slots[Capacity];
+		alignas(64) std::atomic<uint64_t> head{ 0 }; // next slot to pop, on its own cache line so the threads don't share one
+		alignas(64) std::atomic<uint64_t> tail{ 0 }; // next slot to push
+	};
+}
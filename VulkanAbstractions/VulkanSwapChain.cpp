@@ -1,5 +1,6 @@
 #include "VulkanSwapChain.h"
 #include <stdexcept>
+#include "VulkanCpuProfiler.h"
 
 namespace vk {
 
@@ -58,7 +59,7 @@ namespace vk {
 	}
 	
 	void VulkanSwapChain::Create(VkDevice logical_device, VkPhysicalDevice physical_device, VkSurfaceKHR surface, uint32_t width, uint32_t height) {
-	
+		CPU_PROFILE_FUNCTION();
 		VkSwapchainKHR old_swap_chain = this->swap_chain;
 
 		this->logical_device = logical_device;
@@ -0,0 +1,70 @@
+#include "VulkanThreadCommandPools.h"
+#include <stdexcept>
+#include "VulkanHelper.h"
+#include "VulkanJobSystem.h"
+
+namespace vk {
+
+	void VulkanThreadCommandPools::Create(VkDevice logical_device, uint32_t queue_family_index, uint32_t frame_count, uint32_t thread_count) {
+		if (this->logical_device != VK_NULL_HANDLE) {
+			throw std::runtime_error("thread command pools are already created");
+		}
+		this->logical_device = logical_device;
+		this->thread_count = thread_count;
+		for (uint32_t i = 0; i < frame_count * thread_count; i++) {
+			std::unique_ptr<ThreadPool> thread_pool = std::make_unique<ThreadPool>();
+			VkCommandPoolCreateInfo create_info = {};
+			create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			create_info.queueFamilyIndex = queue_family_index;
+			create_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT; // buffers are recorded once per Reset
+			if (vkCreateCommandPool(logical_device, &create_info, nullptr, &thread_pool->pool) != VK_SUCCESS) {
+				Destroy();
+				throw std::runtime_error("fail to create thread command pool");
+			}
+			this->pools.push_back(std::move(thread_pool));
+		}
+	}
+
+	void VulkanThreadCommandPools::Destroy() {
+		if (this->logical_device == VK_NULL_HANDLE) {
+			return;
+		}
+		// destroying a pool frees its command buffers
+		for (std::unique_ptr<ThreadPool>& thread_pool : this->pools) {
+			vkDestroyCommandPool(this->logical_device, thread_pool->pool, nullptr);
+		}
+		this->pools.clear();
+		this->logical_device = VK_NULL_HANDLE;
+	}
+
+	void VulkanThreadCommandPools::Reset(uint32_t frame) {
+		for (uint32_t thread = 0; thread < this->thread_count; thread++) {
+			ThreadPool& thread_pool = *this->pools[frame * this->thread_count + thread];
+			if (thread_pool.used_count == 0) {
+				continue;
+			}
+			if (vkResetCommandPool(this->logical_device, thread_pool.pool, 0) != VK_SUCCESS) {
+				throw std::runtime_error("fail to reset thread command pool");
+			}
+			thread_pool.used_count = 0;
+		}
+	}
+
+	VkCommandBuffer VulkanThreadCommandPools::AllocateSecondary(uint32_t frame) {
+		uint32_t thread = JobSystem::GetThreadIndex();
+		if (thread >= this->thread_count) {
+			throw std::runtime_error("thread command pools were created for fewer threads");
+		}
+		ThreadPool& thread_pool = *this->pools[frame * this->thread_count + thread];
+		if (thread_pool.used_count == thread_pool.cmd_buffers.size()) {
+			VkCommandBuffer cmd_buffer;
+			vk::init::CreateCmdBuffer(this->logical_device, thread_pool.pool, VK_COMMAND_BUFFER_LEVEL_SECONDARY, 1, &cmd_buffer);
+			thread_pool.cmd_buffers.push_back(cmd_buffer);
+		}
+		return thread_pool.cmd_buffers[thread_pool.used_count++];
+	}
+
+	uint32_t VulkanThreadCommandPools::GetThreadCount() {
+		return this->thread_count;
+	}
+}
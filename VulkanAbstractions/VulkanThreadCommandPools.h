@@ -0,0 +1,32 @@
+#pragma once
+#include "vulkan/vulkan.h"
+#include <vector>
+#include <memory>
+
+namespace vk {
+
+	// a command pool per frame slot and per job system thread, to record secondary command buffers from jobs: a pool and its buffers may only
+	// be used by one thread at a time, so each thread allocates from its own, picked with JobSystem::GetThreadIndex. The buffers of a frame
+	// slot are handed out again after Reset, which must wait until the slot's previous submission is done
+	class VulkanThreadCommandPools {
+	public:
+		// thread_count is JobSystem::GetThreadCount once the system is started
+		void Create(VkDevice logical_device, uint32_t queue_family_index, uint32_t frame_count, uint32_t thread_count);
+		void Destroy();
+		// resets every pool of the frame slot, from the thread that submits it while no job records into it
+		void Reset(uint32_t frame);
+		// a secondary command buffer from the calling thread's pool for the frame slot, valid until Reset of the slot
+		VkCommandBuffer AllocateSecondary(uint32_t frame);
+		uint32_t GetThreadCount();
+	private:
+		struct ThreadPool {
+			VkCommandPool pool = VK_NULL_HANDLE;
+			std::vector<VkCommandBuffer> cmd_buffers; // allocated once and reused after each Reset
+			uint32_t used_count = 0;
+		};
+		VkDevice logical_device = VK_NULL_HANDLE;
+		uint32_t thread_count = 0;
+		// frame slot major, allocated one by one so that threads never write to the same cache line
+		std::vector<std::unique_ptr<ThreadPool>> pools;
+	};
+}
@@ -0,0 +1,69 @@
+#include "VulkanTimelineSemaphore.h"
+#include <stdexcept>
+#include "VulkanCpuProfiler.h"
+
+namespace vk {
+
+	void VulkanTimelineSemaphore::Create(VkDevice logical_device) {
+		if (this->semaphore != VK_NULL_HANDLE) {
+			throw std::runtime_error("timeline semaphore is already created");
+		}
+		this->logical_device = logical_device;
+		VkSemaphoreTypeCreateInfo type_info = {};
+		type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+		type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		type_info.initialValue = 0;
+		VkSemaphoreCreateInfo create_info = {};
+		create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		create_info.pNext = &type_info;
+		if (vkCreateSemaphore(logical_device, &create_info, nullptr, &this->semaphore) != VK_SUCCESS) {
+			throw std::runtime_error("fail to create timeline semaphore");
+		}
+		this->last_reserved = 0;
+		this->last_completed = 0;
+	}
+
+	void VulkanTimelineSemaphore::Destroy() {
+		if (this->semaphore == VK_NULL_HANDLE) {
+			return;
+		}
+		vkDestroySemaphore(this->logical_device, this->semaphore, nullptr);
+		this->semaphore = VK_NULL_HANDLE;
+	}
+
+	uint64_t VulkanTimelineSemaphore::Reserve() {
+		this->last_reserved++;
+		return this->last_reserved;
+	}
+
+	uint64_t VulkanTimelineSemaphore::GetCompletedValue() {
+		if (vkGetSemaphoreCounterValue(this->logical_device, this->semaphore, &this->last_completed) != VK_SUCCESS) {
+			throw std::runtime_error("fail to get timeline semaphore value");
+		}
+		return this->last_completed;
+	}
+
+	bool VulkanTimelineSemaphore::IsCompleted(uint64_t value) {
+		return value <= this->last_completed || value <= GetCompletedValue();
+	}
+
+	void VulkanTimelineSemaphore::WaitUntil(uint64_t value) {
+		if (value <= this->last_completed) {
+			return;
+		}
+		CPU_PROFILE_FUNCTION();
+		VkSemaphoreWaitInfo wait_info = {};
+		wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		wait_info.semaphoreCount = 1;
+		wait_info.pSemaphores = &this->semaphore;
+		wait_info.pValues = &value;
+		if (vkWaitSemaphores(this->logical_device, &wait_info, UINT64_MAX) != VK_SUCCESS) {
+			throw std::runtime_error("fail to wait for timeline semaphore");
+		}
+		this->last_completed = value;
+	}
+
+	SemaphoreWait VulkanTimelineSemaphore::WaitFor(uint64_t value, VkPipelineStageFlags stage) {
+		return { this->semaphore, value, stage };
+	}
+}
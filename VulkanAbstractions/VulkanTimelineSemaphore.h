@@ -0,0 +1,33 @@
+#pragma once
+#include "vulkan/vulkan.h"
+#include <cstdint>
+
+namespace vk {
+
+	// a semaphore and the value a submission waits for before its stage. value is ignored for binary semaphores
+	struct SemaphoreWait {
+		VkSemaphore semaphore;
+		uint64_t value;
+		VkPipelineStageFlags stage;
+	};
+
+	// Vulkan 1.2 timeline semaphore whose value only increases. Every submission signaling it gets the next value from Reserve, so
+	// "value reached" means that submission and every earlier one on the same queue have finished. Value 0 is signaled at creation
+	class VulkanTimelineSemaphore {
+	public:
+		void Create(VkDevice logical_device);
+		void Destroy();
+		uint64_t Reserve();
+		uint64_t GetCompletedValue();
+		bool IsCompleted(uint64_t value);
+		// blocks the cpu until the gpu signaled value, used before a resource of a previous submission is reused
+		void WaitUntil(uint64_t value);
+		SemaphoreWait WaitFor(uint64_t value, VkPipelineStageFlags stage);
+	public:
+		VkSemaphore semaphore = VK_NULL_HANDLE;
+		uint64_t last_reserved = 0;
+	private:
+		VkDevice logical_device = VK_NULL_HANDLE;
+		uint64_t last_completed = 0; // cached, so checks of completed values don't call into the driver
+	};
+}
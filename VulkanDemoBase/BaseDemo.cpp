@@ -4,8 +4,25 @@
 #include "VulkanValidationLayers.h"
 #include "VulkanLogicalDevice.h"
 #include "VulkanHelper.h"
+#include "VulkanCpuProfiler.h"
 #include <array>
 #include <chrono>
+#include <algorithm>
+#include <filesystem>
+
+namespace {
+	const uint32_t HANDOFF_SPINS_BEFORE_SLEEP = 64;
+
+	// between attempts at the frame packet ring: spin a little, then sleep so that a thread waiting on a slower one leaves its core
+	void HandoffBackoff(uint32_t& spins) {
+		if (++spins < HANDOFF_SPINS_BEFORE_SLEEP) {
+			std::this_thread::yield();
+		}
+		else {
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+	}
+}
 
 
 void BaseDemo::InitWindow() {
@@ -19,8 +36,10 @@ void BaseDemo::InitWindow() {
 	glfwSetFramebufferSizeCallback(window, BaseDemo::FramebufferResizeCallback);
 }
 void BaseDemo::Run() {
+	vk::VulkanCpuProfiler::SetThreadName("main");
 	InitWindow();
 	InitVulkan();
+	frame_statistics.Create(FRAME_BUDGET_MS, FRAME_STATISTICS_WINDOW);
 	MainLoop();
 	Cleanup();
 }
@@ -28,7 +47,10 @@ void BaseDemo::Run() {
 
 void BaseDemo::MainLoop() {
 	while (!glfwWindowShouldClose(window)) {
-		glfwPollEvents();
+		{
+			CPU_PROFILE_ZONE("glfwPollEvents");
+			glfwPollEvents();
+		}
 		Render();
 	}
 }
@@ -43,27 +65,55 @@ void BaseDemo::InitVulkan() {
 	PickPhysicalDeviceAndCreateLogicalDevice();
 	CreateGraphicAndPresentCommandPool();
 	CreateSyncObjects();
+	job_system.Start();
+	CreateDescriptorAllocators();
+	CreateShaderLibrary();
+	CreatePipelineRegistry();
 	CreatePermanentResources();
 	//non-permanent resources
 	CreateSwapChain();
 	CreateDepthStencil();
 	CreateRenderpass();
 	CreateFramebuffers();
-	SetupImagesInflightFences();
+	SetupImagesInflight();
 	CreateNonPermanentResources();
+	StartShaderHotReload();
+	StartSimulation();
 }
 
 void BaseDemo::Cleanup() {
+	StopSimulation();
+	shader_hot_reload.Stop();
+	job_system.Stop();
 	vkDeviceWaitIdle(logical_device);
 	//cleanup vulkan
 	// non-permanent resources
 	CleanupSwapChain();
 	// permanent resources
 	CleanupPermanentResources();
+	if (ShowFPS()) {
+		std::cout << "descriptor caches: " << descriptor_layout_cache.GetLayoutCount() << " layouts, " << descriptor_layout_cache.GetHitCount() << " layout hits, "
+			<< descriptor_set_cache.GetMissCount() << " sets written, " << descriptor_set_cache.GetHitCount() << " set hits\n";
+		std::cout << "shader library: " << shader_library.GetFileCount() << " files read, " << shader_library.GetModuleCount() << " modules, "
+			<< shader_library.GetHitCount() << " hits, " << shader_library.GetArchivedFileCount() << " files from the archive\n";
+		std::cout << "pipeline registry: " << pipeline_registry.GetPipelineCount() << " pipelines left, " << pipeline_registry.GetHitCount() << " hits\n";
+		if (PipelineSimulation()) {
+			std::cout << "frame pipeline: " << simulated_frame_count << " frames simulated, " << render_stalls << " frames waited for the simulation, "
+				<< simulation_stalls << " simulations waited for rendering\n";
+		}
+	}
+	pipeline_usage_log.Save(PIPELINE_USAGE_LOG_PATH);
+	pipeline_registry.Destroy();
+	shader_library.Destroy();
+	descriptor_set_cache.Destroy();
+	descriptor_layout_cache.Destroy();
+	descriptor_allocator.Destroy();
 	for (uint32_t i = 0; i < MAX_FRAMES_INFLIGHT; i++) {
 		vkDestroySemaphore(logical_device, image_available_semaphores[i], nullptr);
 		vkDestroySemaphore(logical_device, render_finished_semaphores[i], nullptr);
-		vkDestroyFence(logical_device, cmdbuffers_inflight[i], nullptr);
+	}
+	for (vk::VulkanQueue& queue : queues) {
+		queue.timeline.Destroy();
 	}
 	vkDestroyCommandPool(logical_device, command_pool, nullptr);
 	vkDestroyDevice(logical_device, nullptr);
@@ -75,6 +125,11 @@ void BaseDemo::Cleanup() {
 	//cleanup window
 	glfwDestroyWindow(window);
 	glfwTerminate();
+	frame_statistics.WriteJson("frame_stats.json");
+#if VK_CPU_PROFILER_ENABLED
+	vk::VulkanCpuProfiler::WriteChromeTrace("cpu_trace.json");
+	std::cout << "CPU profiler zone overhead: " << vk::VulkanCpuProfiler::MeasureZoneOverhead(100000) << " ns\n";
+#endif
 }
 
 void BaseDemo::CreateVulkanInstance() {
@@ -88,7 +143,7 @@ void BaseDemo::CreateVulkanInstance() {
 	app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 	app_info.pEngineName = "Manhs";
 	app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-	app_info.apiVersion = VK_API_VERSION_1_0;
+	app_info.apiVersion = VK_API_VERSION_1_2;
 
 	VkInstanceCreateInfo create_info = {};
 	create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -138,6 +193,20 @@ std::vector<const char*> BaseDemo::GetDeviceExtensions() {
 	return { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
 }
 
+bool BaseDemo::IsDeviceSuitable(VkPhysicalDevice physical_device) {
+	return true;
+}
+
+VkPhysicalDeviceFeatures BaseDemo::GetDeviceFeatures() {
+	return {};
+}
+
+VkPhysicalDeviceVulkan12Features BaseDemo::GetVulkan12Features() {
+	VkPhysicalDeviceVulkan12Features features = {};
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	return features;
+}
+
 void BaseDemo::CreateSurface() {
 	if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS) {
 		throw std::runtime_error("fail to create window surface");
@@ -158,17 +227,23 @@ void BaseDemo::PickPhysicalDeviceAndCreateLogicalDevice() {
 	std::vector<uint32_t> queue_family_indices;
 	std::vector<vk::QueueCreationRequirement> queue_family_reqs = GetQueueFamilyRequirements();
 	std::vector<const char*> device_extensions = GetDeviceExtensions();
-	physical_device = vk::PickPhysicalDevice(instance, surface, queue_family_reqs, device_extensions, queue_family_indices);
+	physical_device = vk::PickPhysicalDevice(instance, surface, queue_family_reqs, device_extensions, queue_family_indices,
+		[this](VkPhysicalDevice device) { return IsDeviceSuitable(device); });
 	if (physical_device == VK_NULL_HANDLE) {
 		throw std::runtime_error("cannot find appropriate physical device");
 	}
 	// create logical devices
 	std::vector<const char*> validation_layers = GetValidationLayers();
-	vk::CreateLogicalDevice(queue_family_reqs, queue_family_indices, device_extensions, VALIDATION_LAYER_ENABLED, validation_layers, physical_device, logical_device);
+	VkPhysicalDeviceFeatures device_features = GetDeviceFeatures();
+	VkPhysicalDeviceVulkan12Features vulkan12_features = GetVulkan12Features();
+	vulkan12_features.timelineSemaphore = VK_TRUE;
+	vk::CreateLogicalDevice(queue_family_reqs, queue_family_indices, device_extensions, device_features, &vulkan12_features, VALIDATION_LAYER_ENABLED, 
+		validation_layers, physical_device, logical_device);
 	// get queues
 	for (uint32_t i = 0; i < queue_family_indices.size(); i++) {
 		for (uint32_t count = 0; count < queue_family_reqs[i].num_queue; count++) {
 			vk::VulkanQueue queue = vk::VulkanQueue::GetQueue(logical_device, queue_family_indices[i], count, queue_family_reqs[i].types);
+			queue.timeline.Create(logical_device);
 			queues.push_back(queue);
 		}
 	}
@@ -184,25 +259,252 @@ void BaseDemo::CreateSwapChain() {
 void BaseDemo::CreateSyncObjects() {
 	image_available_semaphores.resize(MAX_FRAMES_INFLIGHT);
 	render_finished_semaphores.resize(MAX_FRAMES_INFLIGHT);
-	cmdbuffers_inflight.resize(MAX_FRAMES_INFLIGHT);
+	frames_inflight.resize(MAX_FRAMES_INFLIGHT, 0);
 	for (uint32_t i = 0; i < MAX_FRAMES_INFLIGHT; i++) {
 		vk::init::CreateSemaphore(logical_device, &image_available_semaphores[i]);
 		vk::init::CreateSemaphore(logical_device, &render_finished_semaphores[i]);
-		vk::init::CreateFence(logical_device, VK_FENCE_CREATE_SIGNALED_BIT, &cmdbuffers_inflight[i]);
+	}
+}
+
+void BaseDemo::CreateDescriptorAllocators() {
+	descriptor_allocator.Create(logical_device);
+	descriptor_set_cache.Create(logical_device, &descriptor_allocator);
+	descriptor_layout_cache.Create(logical_device, &descriptor_allocator);
+}
+
+void BaseDemo::CreateShaderLibrary() {
+	shader_library.Create(logical_device);
+	// built by tools/build_shaders.py, without it the modules are read from the loose .spv files
+	if (std::filesystem::exists(SHADER_ARCHIVE_PATH)) {
+		shader_library.OpenArchive(SHADER_ARCHIVE_PATH);
+	}
+}
+
+void BaseDemo::CreatePipelineRegistry() {
+	pipeline_registry.Create(logical_device, PIPELINE_CACHE_PATH);
+	pipeline_usage_log.Load(PIPELINE_USAGE_LOG_PATH);
+}
+
+void BaseDemo::StartShaderHotReload() {
+	if (!SHADER_HOT_RELOAD_ENABLED || shader_reload_groups.empty()) {
+		return;
+	}
+	try {
+		shader_hot_reload.Start({ "shaders" });
+	}
+	catch (const std::runtime_error& error) {
+		std::cout << "shader hot reload is disabled: " << error.what() << "\n"; // i.e. the demo doesn't run from its own directory
+	}
+}
+
+void BaseDemo::RegisterShaderReload(const std::vector<std::string>& modules, std::function<void()> cleanup_pipelines, std::function<void()> create_pipelines) {
+	shader_reload_groups.push_back({ modules, std::move(cleanup_pipelines), std::move(create_pipelines) });
+}
+
+void BaseDemo::OnShadersReloaded() {}
+
+void BaseDemo::RunFrameJobs(uint32_t image_index) {
+	CPU_PROFILE_FUNCTION();
+	vk::JobCounter scene_updated;
+	UpdateSceneJobs(scene_updated);
+	job_system.Wait(scene_updated);
+	vk::JobCounter culled;
+	CullJobs(culled);
+	job_system.Wait(culled);
+	vk::JobCounter packed;
+	PackUniformJobs(image_index, packed);
+	job_system.Wait(packed);
+	vk::JobCounter recorded;
+	RecordJobs(image_index, recorded);
+	job_system.Wait(recorded);
+}
+
+bool BaseDemo::PipelineSimulation() {
+	return false;
+}
+
+std::unique_ptr<FramePacket> BaseDemo::Simulate(uint64_t frame_index, double time) {
+	return nullptr;
+}
+
+const FramePacket* BaseDemo::GetFramePacket() {
+	return current_frame_packet.get();
+}
+
+void BaseDemo::StartSimulation() {
+	simulation_start_time = std::chrono::steady_clock::now();
+	simulated_frame_count = 0;
+	if (!PipelineSimulation()) {
+		return;
+	}
+	simulation_running = true;
+	simulation_thread = std::thread(&BaseDemo::SimulationLoop, this);
+}
+
+void BaseDemo::StopSimulation() {
+	if (!simulation_thread.joinable()) {
+		return;
+	}
+	simulation_running = false;
+	simulation_thread.join();
+	frame_packets.Clear();
+}
+
+// simulated_frame_count is only written here while the thread runs, and read by the main thread once it is joined
+void BaseDemo::SimulationLoop() {
+	vk::VulkanCpuProfiler::SetThreadName("simulation");
+	while (simulation_running) {
+		// wait for a free slot before simulating rather than after, so a packet is never older than the frame rendering when it is made
+		uint32_t spins = 0;
+		while (!frame_packets.CanPush()) {
+			if (!simulation_running) {
+				return;
+			}
+			HandoffBackoff(spins);
+		}
+		if (spins > 0) {
+			simulation_stalls++;
+		}
+		std::unique_ptr<const FramePacket> packet;
+		try {
+			packet = SimulateNextFrame();
+		}
+		catch (...) {
+			simulation_exception = std::current_exception();
+			simulation_failed.store(true, std::memory_order_release);
+			return;
+		}
+		frame_packets.TryPush(std::move(packet)); // can't fail, only this thread fills the slot
+	}
+}
+
+void BaseDemo::TakeFramePacket() {
+	if (retry_frame_packet) {
+		retry_frame_packet = false;
+		return;
+	}
+	if (!simulation_thread.joinable()) {
+		current_frame_packet = SimulateNextFrame();
+		return;
+	}
+	CPU_PROFILE_FUNCTION();
+	uint32_t spins = 0;
+	while (!frame_packets.TryPop(current_frame_packet)) {
+		if (simulation_failed.load(std::memory_order_acquire)) {
+			std::rethrow_exception(simulation_exception);
+		}
+		HandoffBackoff(spins);
+	}
+	if (spins > 0) {
+		render_stalls++;
+	}
+}
+
+// on the simulation thread, or on the main thread without one
+std::unique_ptr<const FramePacket> BaseDemo::SimulateNextFrame() {
+	CPU_PROFILE_ZONE("Simulate");
+	double time = GetSimulationTime();
+	std::unique_ptr<FramePacket> packet = Simulate(simulated_frame_count, time);
+	if (packet) {
+		packet->frame_index = simulated_frame_count;
+		packet->time = time;
+	}
+	simulated_frame_count++;
+	return packet;
+}
+
+double BaseDemo::GetSimulationTime() {
+	return std::chrono::duration<double, std::chrono::seconds::period>(std::chrono::steady_clock::now() - simulation_start_time).count();
+}
+
+void BaseDemo::UpdateSceneJobs(vk::JobCounter& counter) {}
+
+void BaseDemo::CullJobs(vk::JobCounter& counter) {}
+
+void BaseDemo::PackUniformJobs(uint32_t image_index, vk::JobCounter& counter) {}
+
+void BaseDemo::RecordJobs(uint32_t image_index, vk::JobCounter& counter) {}
+
+// between two frames, so command buffers are re-recorded before the next Draw submits them
+void BaseDemo::ApplyShaderReloads() {
+	if (!shader_hot_reload.IsRunning()) {
+		return;
+	}
+	std::vector<std::string> compiled_modules = shader_hot_reload.TakeCompiledModules();
+	if (compiled_modules.empty()) {
+		return;
+	}
+	CPU_PROFILE_FUNCTION();
+	vkDeviceWaitIdle(logical_device); // the pipelines replaced may still be used by frames in flight
+	std::vector<std::string> reloaded_modules;
+	for (const std::string& module : compiled_modules) {
+		try {
+			shader_library.Reload(module.c_str());
+			reloaded_modules.push_back(module);
+		}
+		catch (const std::runtime_error& error) {
+			std::cout << "shader hot reload: " << module << " is not loaded, " << error.what() << "\n";
+		}
+	}
+	std::vector<ShaderReloadGroup*> rebuilt_groups;
+	for (ShaderReloadGroup& group : shader_reload_groups) {
+		auto uses_module = [&](const std::string& module) {
+			return std::find(group.modules.begin(), group.modules.end(), module) != group.modules.end();
+		};
+		if (std::any_of(reloaded_modules.begin(), reloaded_modules.end(), uses_module)) {
+			rebuilt_groups.push_back(&group);
+		}
+	}
+	// every pipeline of a replaced module is released before any is created, the new module may have the old one's handle
+	for (ShaderReloadGroup* group : rebuilt_groups) {
+		group->cleanup_pipelines();
+	}
+	for (ShaderReloadGroup* group : rebuilt_groups) {
+		group->create_pipelines();
+	}
+	if (!rebuilt_groups.empty()) {
+		OnShadersReloaded();
+		std::cout << "shader hot reload: pipelines rebuilt\n";
 	}
 }
 
 void BaseDemo::Render() {
-	Draw();
+	CPU_PROFILE_FUNCTION();
+	ApplyShaderReloads();
+	frame_statistics.BeginFrame(); // a frame is measured from one Render to the next, so it includes event polling and present
+	TakeFramePacket();
+	{
+		CPU_PROFILE_ZONE("Draw");
+		Draw();
+	}
 	fps_count += 1;
-	static auto start_time = std::chrono::high_resolution_clock::now();
-	if (ShowFPS()) {
-		auto current_time = std::chrono::high_resolution_clock::now();
-		float elapsed = std::chrono::duration<float, std::chrono::seconds::period>(current_time - start_time).count();
-		std::cout << "FPS: " << (fps_count / elapsed) << "\n";
+	if (ShowFPS() && fps_count % FRAME_STATISTICS_REPORT_INTERVAL == 0) {
+		std::cout << "frame statistics: " << frame_statistics.ToJson() << "\n";
 	}
 }
 
+void BaseDemo::WaitUntil(vk::VulkanTimelineSemaphore& timeline, uint64_t value) {
+	CPU_PROFILE_FUNCTION();
+	auto start_time = std::chrono::steady_clock::now();
+	timeline.WaitUntil(value);
+	frame_statistics.AddGpuWait(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start_time).count());
+}
+
+void BaseDemo::WaitForFrameSlot() {
+	WaitUntil(queues[0].timeline, frames_inflight[current_frame]);
+}
+
+VkResult BaseDemo::AcquireNextImage(uint32_t* image_index) {
+	CPU_PROFILE_FUNCTION();
+	auto start_time = std::chrono::steady_clock::now();
+	VkResult result = vkAcquireNextImageKHR(logical_device, vulkan_swap_chain.swap_chain, UINT64_MAX,
+		image_available_semaphores[current_frame], VK_NULL_HANDLE, image_index);
+	frame_statistics.AddAcquireWait(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start_time).count());
+	// Draw returns without rendering when the swapchain is out of date, the next frame renders the same packet
+	retry_frame_packet = result == VK_ERROR_OUT_OF_DATE_KHR;
+	return result;
+}
+
 void BaseDemo::CreateGraphicAndPresentCommandPool() {
 	VkCommandPoolCreateInfo create_info = {};
 	create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
@@ -210,6 +512,7 @@ void BaseDemo::CreateGraphicAndPresentCommandPool() {
 		throw std::runtime_error("the first queue in vector must be both graphic and present");
 	}
 	create_info.queueFamilyIndex = queues[0].family_index; 
+	create_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT; // lets demos re-record single command buffers every frame
 	if (vkCreateCommandPool(logical_device, &create_info, nullptr, &command_pool) != VK_SUCCESS) {
 		throw std::runtime_error("fail to create graphic/present command queue");
 	}
@@ -304,6 +607,7 @@ void BaseDemo::CreateFramebuffers() {
 }
 
 void BaseDemo::RecreateSwapChain() {
+	CPU_PROFILE_FUNCTION();
 	// handle minimization
 	int width = 0, height = 0;
 	glfwGetFramebufferSize(window, &width, &height);
@@ -319,12 +623,14 @@ void BaseDemo::RecreateSwapChain() {
 	CreateDepthStencil();
 	CreateRenderpass();
 	CreateFramebuffers();
-	SetupImagesInflightFences();
+	SetupImagesInflight();
 	CreateNonPermanentResources();
 }
 
 void BaseDemo::CleanupSwapChain() {
 	CleanupNonPermanentResources();
+	descriptor_set_cache.Clear();
+	descriptor_allocator.Reset();
 	images_inflight.clear();// clear everything away, when swapchain is recreated
 	for (VkFramebuffer framebuffer : swapchain_framebuffers) {
 		vkDestroyFramebuffer(logical_device, framebuffer, nullptr);
@@ -334,8 +640,8 @@ void BaseDemo::CleanupSwapChain() {
 	vulkan_swap_chain.Destroy();
 }
 
-void BaseDemo::SetupImagesInflightFences() {
-	images_inflight.resize(vulkan_swap_chain.image_count, VK_NULL_HANDLE);
+void BaseDemo::SetupImagesInflight() {
+	images_inflight.resize(vulkan_swap_chain.image_count, 0);
 }
 
 // static methods
@@ -4,9 +4,33 @@
 #include "GLFW/glfw3.h"
 #include "VulkanPhysicalDevice.h"
 #include <vector>
+#include <string>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <exception>
 #include "VulkanSwapChain.h"
 #include "VulkanQueue.h"
 #include "VulkanCompositeImage.h"
+#include "VulkanFrameStatistics.h"
+#include "VulkanDescriptorAllocator.h"
+#include "VulkanDescriptorCache.h"
+#include "VulkanShaderLibrary.h"
+#include "VulkanShaderHotReload.h"
+#include "VulkanPipelineRegistry.h"
+#include "VulkanPipelinePermutations.h"
+#include "VulkanJobSystem.h"
+#include "VulkanSpscRing.h"
+
+// scene state of one frame made by BaseDemo::Simulate, i.e. transforms, lights and camera. Demos derive their own packet from it.
+// Never changed once handed to rendering
+struct FramePacket {
+	uint64_t frame_index = 0;
+	double time = 0.0; // seconds since the simulation started
+	virtual ~FramePacket() = default;
+};
 
 class BaseDemo {
 public:
@@ -18,7 +42,7 @@ protected:
 	virtual uint32_t GetWindowInitWidth() = 0;
 	virtual uint32_t GetWindowInitHeight() = 0;
 	virtual std::vector<vk::QueueCreationRequirement> GetQueueFamilyRequirements() = 0;
-	virtual bool ShowFPS() = 0;
+	virtual bool ShowFPS() = 0; // print the frame statistics every FRAME_STATISTICS_REPORT_INTERVAL frames
 	virtual void Draw() = 0;
 	virtual void CreatePermanentResources() = 0; // for resources not recreated when window is resized, such as vertex buffer
 	virtual void CleanupPermanentResources() = 0;
@@ -26,10 +50,38 @@ protected:
 	virtual void CleanupNonPermanentResources() = 0;
 	// methods can be overriden
 	virtual std::vector<const char*> GetDeviceExtensions();
+	// devices it rejects aren't picked, for features GetDeviceFeatures or GetVulkan12Features always request
+	virtual bool IsDeviceSuitable(VkPhysicalDevice physical_device);
+	virtual VkPhysicalDeviceFeatures GetDeviceFeatures(); // called after physical_device is picked, so supported features can be checked
+	virtual VkPhysicalDeviceVulkan12Features GetVulkan12Features(); // same, timelineSemaphore is always enabled on top of it
 	virtual std::vector<const char*> GetValidationLayers();
 	virtual std::vector<const char*> GetRequiredInstanceExtensions();
 
 	void RecreateSwapChain();// to be called when window resizes
+	// timeline wait and image acquire that also account the time blocked to the frame statistics
+	void WaitUntil(vk::VulkanTimelineSemaphore& timeline, uint64_t value);
+	// waits for the previous submission of current_frame
+	void WaitForFrameSlot();
+	VkResult AcquireNextImage(uint32_t* image_index);
+	// when one of modules is compiled again by the shader hot reload, cleanup_pipelines then create_pipelines run at the next frame boundary,
+	// create_pipelines getting the new modules from shader_library. Groups are registered once, with the permanent resources
+	void RegisterShaderReload(const std::vector<std::string>& modules, std::function<void()> cleanup_pipelines, std::function<void()> create_pipelines);
+	virtual void OnShadersReloaded(); // after pipelines were rebuilt, to record again the command buffers using them
+	// the CPU work of a frame as four stages of jobs on job_system: scene update, culling, uniform packing, then command recording. Each
+	// hook runs the jobs of its stage with counter, and RunFrameJobs starts a stage once the jobs of the one before are done. Hooks do
+	// nothing by default, a demo overrides the stages it has work for and calls RunFrameJobs from Draw
+	void RunFrameJobs(uint32_t image_index);
+	virtual void UpdateSceneJobs(vk::JobCounter& counter);
+	virtual void CullJobs(vk::JobCounter& counter);
+	virtual void PackUniformJobs(uint32_t image_index, vk::JobCounter& counter);
+	virtual void RecordJobs(uint32_t image_index, vk::JobCounter& counter);
+	// the packet of each frame is made by Simulate and read in Draw with GetFramePacket. When PipelineSimulation returns true, Simulate
+	// runs on a simulation thread while the main thread renders the frame before, packets are handed over through a lock free ring. It must
+	// then not touch Vulkan objects or anything Draw writes. Otherwise it runs on the main thread right before Draw. By default there is
+	// no packet
+	virtual bool PipelineSimulation();
+	virtual std::unique_ptr<FramePacket> Simulate(uint64_t frame_index, double time);
+	const FramePacket* GetFramePacket(); // nullptr without packets
 
 private:
 	void InitWindow();
@@ -37,6 +89,13 @@ private:
 	void MainLoop();
 	void Cleanup();
 	void Render();
+	void ApplyShaderReloads();
+	void StartSimulation();
+	void StopSimulation();
+	void SimulationLoop();
+	void TakeFramePacket(); // waits for the simulation thread when it is behind, keeps the packet of a frame that failed to acquire an image
+	std::unique_ptr<const FramePacket> SimulateNextFrame();
+	double GetSimulationTime();
 	
 	void CleanupSwapChain();
 
@@ -47,14 +106,24 @@ private:
 	void PickPhysicalDeviceAndCreateLogicalDevice();
 	void CreateGraphicAndPresentCommandPool();
 	void CreateSyncObjects();
+	void CreateDescriptorAllocators();
+	void CreateShaderLibrary();
+	void StartShaderHotReload();
+	void CreatePipelineRegistry();
 	void CreateSwapChain();
 	void CreateDepthStencil();
 	void CreateRenderpass();
 	void CreateFramebuffers();
-	void SetupImagesInflightFences();
+	void SetupImagesInflight();
 	// static methods
 	static void FramebufferResizeCallback(GLFWwindow* window, int width, int height);
 
+	struct ShaderReloadGroup {
+		std::vector<std::string> modules;
+		std::function<void()> cleanup_pipelines;
+		std::function<void()> create_pipelines;
+	};
+
 public:
 	GLFWwindow* window;
 	bool framebuffer_resized;
@@ -67,21 +136,54 @@ public:
 	vk::VulkanSwapChain vulkan_swap_chain;
 	std::vector<VkSemaphore> image_available_semaphores;
 	std::vector<VkSemaphore> render_finished_semaphores;
-	std::vector<VkFence> cmdbuffers_inflight;
+	std::vector<uint64_t> frames_inflight; // value of queues[0].timeline signaled by the last submission of each frame slot, 0 if none
 	VkCommandPool command_pool;
 	std::vector<VkCommandBuffer> draw_cmd_buffers;
 	vk::VulkanCompositeImage depth_stencil;
 	VkRenderPass renderpass;
 	std::vector<VkFramebuffer> swapchain_framebuffers;
-	std::vector<VkFence> images_inflight;
+	std::vector<uint64_t> images_inflight; // same for the last submission rendering to each swapchain image
+	vk::VulkanDescriptorAllocator descriptor_allocator; // for the sets of non-permanent resources, reset when the swapchain is recreated
+	vk::VulkanDescriptorSetCache descriptor_set_cache; // sets from descriptor_allocator, cleared with it
+	vk::VulkanDescriptorLayoutCache descriptor_layout_cache; // layouts live until the device is destroyed
+	vk::ShaderLibrary shader_library; // modules live until the device is destroyed
+	vk::ShaderHotReload shader_hot_reload; // compiles the sources of shaders/ while the demo runs
+	vk::PipelineRegistry pipeline_registry; // pipelines are released by the demos before their layouts and render passes are destroyed
+	vk::JobSystem job_system; // a worker per hardware thread, started before the permanent resources
+	vk::PipelineUsageLog pipeline_usage_log; // permutations used by the previous run, warmed when the demos create their permutation sets
 	uint32_t current_frame;
 	uint32_t fps_count = 0;
+	vk::VulkanFrameStatistics frame_statistics;
 #ifdef NDEBUG
 	const static bool VALIDATION_LAYER_ENABLED = false;
+	const static bool SHADER_HOT_RELOAD_ENABLED = false;
 #else
 	const static bool VALIDATION_LAYER_ENABLED = true;
+	const static bool SHADER_HOT_RELOAD_ENABLED = true;
 #endif
 	const uint32_t MAX_FRAMES_INFLIGHT = 5;
+	const float FRAME_BUDGET_MS = 1000.0f / 60.0f;
+	const uint32_t FRAME_STATISTICS_WINDOW = 1000;
+	const uint32_t FRAME_STATISTICS_REPORT_INTERVAL = 1000;
+	const char* const SHADER_ARCHIVE_PATH = "shaders/shaders.spva";
+	const char* const PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+	const char* const PIPELINE_USAGE_LOG_PATH = "pipeline_usage.log";
+	// packets simulated ahead of the one Draw renders. The simulation thread waits for a free slot before simulating, so with 1 it works on
+	// frame N + 1 while frame N renders, then waits for frame N + 1 to be taken
+	const static uint32_t FRAME_PACKET_QUEUE_CAPACITY = 1;
+private:
+	std::vector<ShaderReloadGroup> shader_reload_groups;
+	vk::SpscRing<std::unique_ptr<const FramePacket>, FRAME_PACKET_QUEUE_CAPACITY> frame_packets;
+	std::unique_ptr<const FramePacket> current_frame_packet; // the packet Draw renders
+	bool retry_frame_packet = false; // the last Draw didn't render current_frame_packet, the next one takes it again
+	std::thread simulation_thread;
+	std::atomic<bool> simulation_running{ false };
+	std::atomic<bool> simulation_failed{ false };
+	std::exception_ptr simulation_exception; // written before simulation_failed is set
+	std::chrono::steady_clock::time_point simulation_start_time;
+	uint64_t simulated_frame_count = 0;
+	std::atomic<uint64_t> simulation_stalls{ 0 }; // frames whose simulation waited for rendering to free a slot
+	uint64_t render_stalls = 0; // frames that waited for their packet
 };
 
 
@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+"""Offline shader build of the demos.
+
+Compiles every GLSL stage source of a demo's shaders/ directory to SPIR-V with glslangValidator, optimizes it with the spirv-opt
+performance passes (-O), expands the variants listed in the directory's shaders.json, then packs all modules into shaders/shaders.spva,
+which vk::ShaderLibrary maps at startup instead of opening one file per shader. The loose .spv files are written too, for the
+shader hot reload and runs without the archive.
+
+shaders.json lists variants baked offline, each one a module of its own named <stage module>_<name>.spv:
+    {"variants": [{"source": "shadow_map.frag", "name": "optimized_pcf", "specialization": {"0": 1}, "defines": ["FOO=1"]}]}
+specialization gives constant_id: value defaults that are frozen into the module, so spirv-opt folds the branches they select.
+
+Modules are only compiled again when their source, an include of the directory or the manifest is newer than the .spv.
+Run it from the repository root, or as a pre-build step:
+    python tools/build_shaders.py [Bloom/shaders ShadowMap/shaders ...]
+"""
+import argparse
+import json
+import os
+import struct
+import subprocess
+import sys
+
+STAGE_EXTENSIONS = (".vert", ".frag", ".comp", ".geom", ".tesc", ".tese")
+INCLUDE_EXTENSION = ".glsl"
+MANIFEST_NAME = "shaders.json"
+ARCHIVE_NAME = "shaders.spva"
+ARCHIVE_VERSION = 1  # vk::ShaderArchive::VERSION
+CODE_ALIGNMENT = 16
+DEFAULT_DIRECTORIES = ["Bloom/shaders", "ShadowMap/shaders", "Triangle/shaders"]
+GLSLANG_FLAGS = ["-V", "--target-env", "vulkan1.2"]
+
+
+def hash_bytes(data):
+    """64 bit FNV-1a, same as vk::util::HashBytes."""
+    value = 14695981039346656037
+    for byte in data:
+        value ^= byte
+        value = (value * 1099511628211) & 0xFFFFFFFFFFFFFFFF
+    return value
+
+
+def module_name(source, variant=None):
+    stem, extension = os.path.splitext(source)
+    name = stem + "_" + extension[1:]
+    if variant:
+        name += "_" + variant
+    return name + ".spv"
+
+
+def is_outdated(output, inputs):
+    if not os.path.exists(output):
+        return True
+    output_time = os.path.getmtime(output)
+    return any(os.path.getmtime(path) > output_time for path in inputs)
+
+
+def run(command):
+    result = subprocess.run(command)
+    if result.returncode != 0:
+        raise RuntimeError("fail to run " + " ".join(command))
+
+
+def build_module(args, directory, source, output, defines=(), specialization=None):
+    """Same flags as vk::ShaderHotReload::DEFAULT_COMPILER_COMMAND and DEFAULT_OPTIMIZER_COMMAND, keep them in sync."""
+    source_path = os.path.join(directory, source)
+    output_path = os.path.join(directory, output)
+    run([args.glslang] + GLSLANG_FLAGS + ["-D" + define for define in defines] + [source_path, "-o", output_path])
+    passes = []
+    if specialization:
+        values = " ".join("{}:{}".format(constant_id, str(value).lower()) for constant_id, value in sorted(specialization.items()))
+        passes += ["--set-spec-const-default-value=" + values, "--freeze-spec-const"]
+    if not args.no_optimize:
+        passes.append("-O")
+    if passes:
+        run([args.spirv_opt] + passes + [output_path, "-o", output_path])
+
+
+def build_directory(args, directory):
+    manifest_path = os.path.join(directory, MANIFEST_NAME)
+    manifest = {"variants": []}
+    if os.path.exists(manifest_path):
+        with open(manifest_path) as manifest_file:
+            manifest = json.load(manifest_file)
+    files = sorted(os.listdir(directory))
+    sources = [name for name in files if name.endswith(STAGE_EXTENSIONS)]
+    common_inputs = [os.path.join(directory, name) for name in files if name.endswith(INCLUDE_EXTENSION)]
+    if os.path.exists(manifest_path):
+        common_inputs.append(manifest_path)
+
+    modules = []
+    for source in sources:
+        modules.append((module_name(source), source, (), None))
+    for variant in manifest.get("variants", []):
+        if variant["source"] not in sources:
+            raise RuntimeError("{}: variant {} of missing source {}".format(manifest_path, variant["name"], variant["source"]))
+        modules.append((module_name(variant["source"], variant["name"]), variant["source"], variant.get("defines", ()),
+                        variant.get("specialization")))
+
+    compiled = 0
+    for output, source, defines, specialization in modules:
+        inputs = [os.path.join(directory, source)] + common_inputs
+        if args.force or is_outdated(os.path.join(directory, output), inputs):
+            build_module(args, directory, source, output, defines, specialization)
+            compiled += 1
+
+    archive_path = os.path.join(directory, ARCHIVE_NAME)
+    module_paths = [os.path.join(directory, output) for output, _, _, _ in modules]
+    if compiled > 0 or args.force or is_outdated(archive_path, module_paths):
+        # the demos load modules relative to their own directory
+        write_archive(archive_path, [("shaders/" + output, path) for (output, _, _, _), path in zip(modules, module_paths)])
+    print("{}: {} modules, {} compiled".format(directory, len(modules), compiled))
+
+
+def write_archive(archive_path, modules):
+    """Header, entries sorted by name hash, names, then the code of every module 16 bytes aligned. Layout of vk::ShaderArchive."""
+    header_size = 16
+    entry_size = 32
+    items = []
+    for name, path in modules:
+        with open(path, "rb") as module_file:
+            code = module_file.read()
+        if len(code) == 0 or len(code) % 4 != 0:
+            raise RuntimeError(path + " is not SPIR-V")
+        encoded_name = name.encode("utf-8")
+        items.append((hash_bytes(encoded_name), encoded_name, code))
+    items.sort(key=lambda item: item[0])
+
+    names_offset = header_size + entry_size * len(items)
+    names = b"".join(item[1] for item in items)
+    offset = names_offset + len(names)
+    entries = b""
+    code_blob = b""
+    name_offset = names_offset
+    for name_hash, name, code in items:
+        padding = (-offset) % CODE_ALIGNMENT
+        code_blob += b"\0" * padding
+        offset += padding
+        entries += struct.pack("<QQIIII", name_hash, hash_bytes(code), name_offset, len(name), offset, len(code))
+        code_blob += code
+        offset += len(code)
+        name_offset += len(name)
+
+    with open(archive_path + ".tmp", "wb") as archive_file:
+        archive_file.write(struct.pack("<4sIII", b"SPVA", ARCHIVE_VERSION, len(items), 0))
+        archive_file.write(entries)
+        archive_file.write(names)
+        archive_file.write(code_blob)
+    os.replace(archive_path + ".tmp", archive_path)  # a running demo keeps its mapping of the previous archive
+
+
+def main():
+    parser = argparse.ArgumentParser(description="compile, optimize and pack the demo shaders")
+    parser.add_argument("directories", nargs="*", default=DEFAULT_DIRECTORIES)
+    parser.add_argument("--glslang", default="glslangValidator")
+    parser.add_argument("--spirv-opt", default="spirv-opt")
+    parser.add_argument("--no-optimize", action="store_true", help="skip the spirv-opt performance passes")
+    parser.add_argument("--force", action="store_true", help="compile every module even if it is up to date")
+    args = parser.parse_args()
+    try:
+        for directory in args.directories:
+            build_directory(args, directory)
+    except (RuntimeError, OSError) as error:
+        print("build_shaders: " + str(error), file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())